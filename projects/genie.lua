@@ -114,6 +114,11 @@ newoption {
 	description = "Build unit tests."
 }
 
+newoption {
+	trigger = "with-benchmarks",
+	description = "Build benchmarks."
+}
+
 newoption {
 	trigger = "with-app",
 	description = "Do build app."
@@ -868,6 +873,45 @@ if build_app then
 		defaultConfigurations()
 end
 
+function benchmarkProject(name)
+	project(name)
+		kind "ConsoleApp"
+		debugdir "../data"
+
+		files { "../src/bench/" .. name .. ".cpp" }
+		includedirs { "../src" }
+		links { "engine" }
+
+		configuration { "linux-*" }
+			links { "dl", "rt" }
+		configuration {}
+
+		useLua()
+		defaultConfigurations()
+end
+
+if _OPTIONS["with-benchmarks"] then
+	benchmarkProject "simd_bench"
+	benchmarkProject "fiber_bench"
+	benchmarkProject "job_bench"
+	benchmarkProject "pack_bench"
+end
+
+project "packer"
+	kind "ConsoleApp"
+	debugdir "../data"
+
+	files { "../src/packer/packer.cpp" }
+	includedirs { "../src" }
+	links { "engine" }
+
+	configuration { "linux-*" }
+		links { "dl", "rt" }
+	configuration {}
+
+	useLua()
+	defaultConfigurations()
+
 for _, plugin in ipairs(base_plugins) do
 	linkPlugin(plugin)
 end
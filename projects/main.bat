@@ -460,12 +460,10 @@ exit /B 0
 :create_bundle
 	echo Creating bundle...
 	genie.exe --embed-resources --static-plugins vs2019
-	cd ..\data
-	tar -cvf data.tar .
-	move data.tar ../src/studio
-	cd ..\projects\
+	%msbuild_cmd% tmp/vs2019/LumixEngine.sln /t:packer /p:Configuration=RelWithDebInfo
+	tmp\vs2019\bin\RelWithDebInfo\packer.exe ..\data ..\src\studio\data.pack
 	%msbuild_cmd% tmp/vs2019/LumixEngine.sln /p:Configuration=RelWithDebInfo
-	del ..\src\studio\data.tar
+	del ..\src\studio\data.pack
 	pause
 exit /B 0
 
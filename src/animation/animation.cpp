@@ -30,7 +30,6 @@ Animation::Animation(const Path& path, ResourceManager& resource_manager, IAlloc
 	, m_allocator(allocator)
 	, m_frame_count(0)
 	, m_fps(30)
-	, m_mem(allocator)
 	, m_bones(allocator)
 	, m_root_motion_bone_idx(-1)
 {
@@ -222,10 +221,21 @@ void Animation::getRelativePose(float time, Pose& pose, Model& model, BoneMask*
 }
 
 
+bool Animation::loadView(const ContentView& content)
+{
+	m_content = content;
+	if (!load(content.size(), content.data())) {
+		m_content.reset();
+		return false;
+	}
+	return true;
+}
+
+
+// mem is kept alive by m_content
 bool Animation::load(u64 mem_size, const u8* mem)
 {
 	m_bones.clear();
-	m_mem.clear();
 	Header header;
 	InputMemoryStream file(mem, mem_size);
 	file.read(&header, sizeof(header));
@@ -255,10 +265,8 @@ bool Animation::load(u64 mem_size, const u8* mem)
 	m_bones.resize(bone_count);
 	if (bone_count == 0) return true;
 
-	int size = int(file.size() - file.getPosition());
-	m_mem.resize(size);
-	file.read(&m_mem[0], size);
-	InputMemoryStream blob(&m_mem[0], size);
+	const u64 size = file.size() - file.getPosition();
+	InputMemoryStream blob((const u8*)file.getData() + file.getPosition(), size);
 	for (int i = 0; i < m_bones.size(); ++i)
 	{
 		m_bones[i].name = blob.read<u32>();
@@ -280,7 +288,7 @@ bool Animation::load(u64 mem_size, const u8* mem)
 void Animation::unload()
 {
 	m_bones.clear();
-	m_mem.clear();
+	m_content.reset();
 	m_frame_count = 0;
 }
 
@@ -53,6 +53,7 @@ class Animation final : public Resource
 	private:
 		void unload() override;
 		bool load(u64 size, const u8* mem) override;
+		bool loadView(const ContentView& content) override;
 
 	private:
 		IAllocator& m_allocator;
@@ -68,7 +69,8 @@ class Animation final : public Resource
 			const Quat* rot;
 		};
 		Array<Bone> m_bones;
-		Array<u8> m_mem;
+		// bones point into the file
+		ContentView m_content;
 		int m_fps;
 		int m_root_motion_bone_idx;
 };
@@ -6,6 +6,7 @@
 #include "engine/engine.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
+#include "engine/tag_allocator.h"
 #include "engine/universe/universe.h"
 
 
@@ -100,7 +101,7 @@ struct AnimationSystemImpl final : public IPlugin
 	void destroyScene(IScene* scene) override;
 	const char* getName() const override { return "animation"; }
 
-	IAllocator& m_allocator;
+	TagAllocator m_allocator;
 	Engine& m_engine;
 	AnimResourceManager<Animation> m_animation_manager;
 	AnimResourceManager<PropertyAnimation> m_property_animation_manager;
@@ -109,7 +110,7 @@ struct AnimationSystemImpl final : public IPlugin
 
 
 AnimationSystemImpl::AnimationSystemImpl(Engine& engine)
-	: m_allocator(engine.getAllocator())
+	: m_allocator(engine.getAllocator(), "Animation")
 	, m_engine(engine)
 	, m_animation_manager(m_allocator)
 	, m_property_animation_manager(m_allocator)
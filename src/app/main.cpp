@@ -349,6 +349,7 @@ public:
 
 	void onIdle() override
 	{
+		Profiler::frame();
 		float frame_time = m_frame_timer->tick();
 		m_engine->update(*m_universe);
 		m_pipeline->render();
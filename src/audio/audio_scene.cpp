@@ -752,6 +752,14 @@ struct AudioSceneImpl final : public AudioScene
 	Universe& getUniverse() override { return m_universe; }
 	IPlugin& getPlugin() const override { return m_system; }
 
+	void getUpdateDependencies(UpdateDependencies& deps) const override
+	{
+		deps.exclusive = false;
+		deps.reads_transforms = true;
+		// animation events
+		deps.reads[0] = "animation";
+	}
+
 	AssociativeArray<EntityRef, AmbientSound> m_ambient_sounds;
 	AssociativeArray<EntityRef, EchoZone> m_echo_zones;
 	AssociativeArray<EntityRef, ChorusZone> m_chorus_zones;
@@ -33,6 +33,7 @@ bool Clip::load(u64 size, const u8* mem)
 	copyMemory(&m_data[0], output, res * m_channels * sizeof(m_data[0]));
 	free(output);
 
+	m_size = m_data.byte_size();
 	return true;
 }
 
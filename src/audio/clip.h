@@ -23,6 +23,9 @@ public:
 
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
+	// vorbis decoding touches only the clip, so all of it runs on a job worker
+	bool isDecodeSupported() const override { return true; }
+	bool decode(const ContentView& content) override { return load(content.size(), content.data()); }
 	int getChannels() const { return m_channels; }
 	int getSampleRate() const { return m_sample_rate; }
 	int getSize() const { return m_data.size() * sizeof(m_data[0]); }
@@ -0,0 +1,99 @@
+#include "engine/lumix.h"
+#include "engine/fibers.h"
+#include "engine/os.h"
+#include <stdio.h>
+#ifdef __linux__
+	#include <ucontext.h>
+	#include <stdlib.h>
+#endif
+
+
+using namespace Lumix;
+
+
+enum { SWITCHES_COUNT = 4 * 1024 * 1024 };
+
+
+static Fiber::Handle g_main_fiber;
+static Fiber::Handle g_worker_fiber;
+
+
+#ifdef _WIN32
+	static void __stdcall pingPong(void*)
+#else
+	static void pingPong(void*)
+#endif
+{
+	for (;;) {
+		Fiber::switchTo(&g_worker_fiber, g_main_fiber);
+	}
+}
+
+
+static void report(const char* name, float seconds)
+{
+	// every iteration is two switches, there and back
+	const double switches = 2.0 * SWITCHES_COUNT;
+	printf("%-12s %8.2f M switches/s, %6.1f ns/switch\n", name, switches / seconds / 1e6, seconds * 1e9 / switches);
+}
+
+
+#ifdef __linux__
+	static ucontext_t g_main_context;
+	static ucontext_t g_worker_context;
+
+
+	static void ucontextPingPong()
+	{
+		for (;;) {
+			swapcontext(&g_worker_context, &g_main_context);
+		}
+	}
+
+
+	// the implementation used before the asm switch, for comparison
+	static void benchUContext()
+	{
+		getcontext(&g_worker_context);
+		g_worker_context.uc_stack.ss_sp = malloc(64 * 1024);
+		g_worker_context.uc_stack.ss_size = 64 * 1024;
+		g_worker_context.uc_link = nullptr;
+		makecontext(&g_worker_context, ucontextPingPong, 0);
+
+		OS::Timer timer;
+		for (int i = 0; i < SWITCHES_COUNT; ++i) {
+			swapcontext(&g_main_context, &g_worker_context);
+		}
+		report("ucontext", timer.getTimeSinceStart());
+		free(g_worker_context.uc_stack.ss_sp);
+	}
+#endif
+
+
+#ifdef _WIN32
+	static void __stdcall benchMain(void*)
+#else
+	static void benchMain(void*)
+#endif
+{
+	g_worker_fiber = Fiber::create(64 * 1024, pingPong, nullptr);
+
+	OS::Timer timer;
+	for (int i = 0; i < SWITCHES_COUNT; ++i) {
+		Fiber::switchTo(&g_main_fiber, g_worker_fiber);
+	}
+	report("Fiber", timer.getTimeSinceStart());
+
+	Fiber::destroy(g_worker_fiber);
+
+	#ifdef __linux__
+		benchUContext();
+	#endif
+}
+
+
+int main(int argc, char* argv[])
+{
+	Fiber::initThread(benchMain, &g_main_fiber);
+	return 0;
+}
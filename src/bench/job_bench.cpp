@@ -0,0 +1,260 @@
+#include "engine/lumix.h"
+#include "engine/allocator.h"
+#include "engine/job_system.h"
+#include "engine/math.h"
+#include "engine/mt/atomic.h"
+#include "engine/mt/thread.h"
+#include "engine/os.h"
+#include "engine/string.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+using namespace Lumix;
+
+
+enum {
+	LATENCY_ITERATIONS = 20000,
+	THROUGHPUT_JOBS = 1024 * 1024,
+	THROUGHPUT_BATCH = 4096,
+	FOREACH_COUNT = 4 * 1024 * 1024,
+	FOREACH_ITERATIONS = 10,
+	PINNED_JOBS_PER_PRODUCER = 32 * 1024,
+	MAX_RESULTS = 256
+};
+
+
+struct Result
+{
+	char name[64];
+	int workers;
+	double value;
+	const char* unit;
+};
+
+
+static Result g_results[MAX_RESULTS];
+static int g_results_count = 0;
+
+
+static void addResult(const char* name, int workers, double value, const char* unit)
+{
+	if (g_results_count == MAX_RESULTS) return;
+
+	Result& r = g_results[g_results_count];
+	++g_results_count;
+	copyString(r.name, name);
+	r.workers = workers;
+	r.value = value;
+	r.unit = unit;
+	// progress goes to stderr, so stdout stays valid json
+	fprintf(stderr, "%-32s %3d workers %14.2f %s\n", name, workers, value, unit);
+}
+
+
+static double toSeconds(u64 ticks)
+{
+	return ticks / double(OS::Timer::getFrequency());
+}
+
+
+static void emptyJob(void*) {}
+
+
+static void benchRunWaitLatency(int workers)
+{
+	// warm up, so fibers and signals are already allocated
+	for (int i = 0; i < 100; ++i) {
+		JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+		JobSystem::run(nullptr, emptyJob, &signal);
+		JobSystem::wait(signal);
+	}
+
+	const u64 start = OS::Timer::getRawTimestamp();
+	for (int i = 0; i < LATENCY_ITERATIONS; ++i) {
+		JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+		JobSystem::run(nullptr, emptyJob, &signal);
+		JobSystem::wait(signal);
+	}
+	const double t = toSeconds(OS::Timer::getRawTimestamp() - start);
+	addResult("run_wait_latency", workers, t * 1e9 / LATENCY_ITERATIONS, "ns");
+}
+
+
+// same round trip, but the waiting side is a job, so wait suspends its fiber on the precondition signal
+static void benchFiberWaitLatency(int workers)
+{
+	static double result;
+	JobSystem::SignalHandle done = JobSystem::INVALID_HANDLE;
+	JobSystem::run(nullptr, [](void*){
+		const u64 start = OS::Timer::getRawTimestamp();
+		for (int i = 0; i < LATENCY_ITERATIONS; ++i) {
+			JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+			JobSystem::run(nullptr, emptyJob, &signal);
+			JobSystem::wait(signal);
+		}
+		result = toSeconds(OS::Timer::getRawTimestamp() - start);
+	}, &done);
+	JobSystem::wait(done);
+	addResult("fiber_wait_latency", workers, result * 1e9 / LATENCY_ITERATIONS, "ns");
+}
+
+
+static void benchEmptyJobThroughput(int workers)
+{
+	// pushed from the main thread, which does not own a deque
+	u64 start = OS::Timer::getRawTimestamp();
+	for (int i = 0; i < THROUGHPUT_JOBS; i += THROUGHPUT_BATCH) {
+		JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+		for (int j = 0; j < THROUGHPUT_BATCH; ++j) {
+			JobSystem::run(nullptr, emptyJob, &signal);
+		}
+		JobSystem::wait(signal);
+	}
+	double t = toSeconds(OS::Timer::getRawTimestamp() - start);
+	addResult("empty_jobs_external", workers, THROUGHPUT_JOBS / t / 1e6, "Mjobs/s");
+
+	// pushed from a worker, so the jobs go to its deque and get stolen
+	static double result;
+	JobSystem::SignalHandle done = JobSystem::INVALID_HANDLE;
+	JobSystem::run(nullptr, [](void*){
+		const u64 start = OS::Timer::getRawTimestamp();
+		for (int i = 0; i < THROUGHPUT_JOBS; i += THROUGHPUT_BATCH) {
+			JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+			for (int j = 0; j < THROUGHPUT_BATCH; ++j) {
+				JobSystem::run(nullptr, emptyJob, &signal);
+			}
+			JobSystem::wait(signal);
+		}
+		result = toSeconds(OS::Timer::getRawTimestamp() - start);
+	}, &done);
+	JobSystem::wait(done);
+	addResult("empty_jobs_worker", workers, THROUGHPUT_JOBS / result / 1e6, "Mjobs/s");
+}
+
+
+static void benchForEach(int workers, float* data)
+{
+	auto f = [data](u32 idx){
+		data[idx] = sqrtf(data[idx] * 0.5f + 1.f);
+	};
+
+	JobSystem::forEach(FOREACH_COUNT, f);
+
+	const u64 start = OS::Timer::getRawTimestamp();
+	for (int i = 0; i < FOREACH_ITERATIONS; ++i) {
+		JobSystem::forEach(FOREACH_COUNT, f);
+	}
+	const double t = toSeconds(OS::Timer::getRawTimestamp() - start);
+	addResult("for_each", workers, t * 1e3 / FOREACH_ITERATIONS, "ms");
+}
+
+
+struct PinnedProducer
+{
+	u8 worker_index;
+};
+
+
+// every worker produces jobs pinned to `worker_index`, either all to the first worker or each to its own one
+static void benchPinned(int workers, const char* name, bool spread)
+{
+	static PinnedProducer producers[256];
+	const int producers_count = minimum(workers, lengthOf(producers));
+	for (int i = 0; i < producers_count; ++i) {
+		producers[i].worker_index = spread ? u8(i) : 0;
+	}
+
+	const u64 start = OS::Timer::getRawTimestamp();
+	JobSystem::SignalHandle done = JobSystem::INVALID_HANDLE;
+	for (int i = 0; i < producers_count; ++i) {
+		JobSystem::run(&producers[i], [](void* data){
+			const PinnedProducer* producer = (PinnedProducer*)data;
+			JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+			for (int j = 0; j < PINNED_JOBS_PER_PRODUCER; ++j) {
+				JobSystem::runEx(nullptr, emptyJob, &signal, JobSystem::INVALID_HANDLE, producer->worker_index);
+			}
+			JobSystem::wait(signal);
+		}, &done);
+	}
+	JobSystem::wait(done);
+	const double t = toSeconds(OS::Timer::getRawTimestamp() - start);
+	addResult(name, workers, producers_count * PINNED_JOBS_PER_PRODUCER / t / 1e6, "Mjobs/s");
+}
+
+
+static void writeJSON(FILE* fp, int max_workers)
+{
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"benchmark\": \"job_bench\",\n");
+	fprintf(fp, "\t\"max_workers\": %d,\n", max_workers);
+	fprintf(fp, "\t\"results\": [\n");
+	for (int i = 0; i < g_results_count; ++i) {
+		const Result& r = g_results[i];
+		fprintf(fp, "\t\t{ \"name\": \"%s\", \"workers\": %d, \"value\": %.4f, \"unit\": \"%s\" }%s\n"
+			, r.name
+			, r.workers
+			, r.value
+			, r.unit
+			, i + 1 < g_results_count ? "," : "");
+	}
+	fprintf(fp, "\t]\n");
+	fprintf(fp, "}\n");
+}
+
+
+// job_bench [-o output.json] [-workers N]
+int main(int argc, char* argv[])
+{
+	const char* output_path = nullptr;
+	int max_workers = (int)MT::getCPUsCount();
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			++i;
+			output_path = argv[i];
+		}
+		else if (strcmp(argv[i], "-workers") == 0 && i + 1 < argc) {
+			++i;
+			max_workers = atoi(argv[i]);
+		}
+	}
+	max_workers = clamp(max_workers, 1, 64);
+
+	DefaultAllocator allocator;
+	float* data = (float*)allocator.allocate(sizeof(float) * FOREACH_COUNT);
+	for (int i = 0; i < FOREACH_COUNT; ++i) {
+		data[i] = float(i & 0xff);
+	}
+
+	// forEach scales over 1, 2, 4, ... workers, the rest runs only with all of them
+	for (int workers = 1;; workers = minimum(workers * 2, max_workers)) {
+		if (!JobSystem::init(u8(workers), allocator)) {
+			fprintf(stderr, "Failed to initialize the job system with %d workers\n", workers);
+			return -1;
+		}
+		benchForEach(workers, data);
+		const bool is_last = workers == max_workers;
+		if (is_last) {
+			benchRunWaitLatency(workers);
+			benchFiberWaitLatency(workers);
+			benchEmptyJobThroughput(workers);
+			benchPinned(workers, "pinned_single_worker", false);
+			benchPinned(workers, "pinned_own_worker", true);
+		}
+		JobSystem::shutdown();
+		if (is_last) break;
+	}
+
+	allocator.deallocate(data);
+
+	FILE* fp = output_path ? fopen(output_path, "wb") : stdout;
+	if (!fp) {
+		fprintf(stderr, "Could not open %s\n", output_path);
+		return -1;
+	}
+	writeJSON(fp, max_workers);
+	if (fp != stdout) fclose(fp);
+	return 0;
+}
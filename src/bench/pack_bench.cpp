@@ -0,0 +1,360 @@
+#include "engine/lumix.h"
+#include "engine/allocator.h"
+#include "engine/array.h"
+#include "engine/crc32.h"
+#include "engine/hash_map.h"
+#include "engine/os.h"
+#include "engine/pack.h"
+#include "engine/path_utils.h"
+#include "engine/stream.h"
+#include "engine/string.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+using namespace Lumix;
+
+
+enum {
+	ITERATIONS = 10,
+	MAX_RESULTS = 64
+};
+
+
+struct Result
+{
+	char name[64];
+	double value;
+	const char* unit;
+};
+
+
+struct TarHeader {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char padding[12];
+};
+
+
+struct SourceFile
+{
+	StaticString<MAX_PATH_LENGTH> path;
+	u32 hash;
+	u64 offset;
+	u64 size;
+};
+
+
+static Result g_results[MAX_RESULTS];
+static int g_results_count = 0;
+
+
+static void addResult(const char* name, double value, const char* unit)
+{
+	if (g_results_count == MAX_RESULTS) return;
+
+	Result& r = g_results[g_results_count];
+	++g_results_count;
+	copyString(r.name, name);
+	r.value = value;
+	r.unit = unit;
+	// progress goes to stderr, so stdout stays valid json
+	fprintf(stderr, "%-32s %14.3f %s\n", name, value, unit);
+}
+
+
+static double toMs(u64 ticks)
+{
+	return ticks * 1000.0 / OS::Timer::getFrequency();
+}
+
+
+static u32 getPathHash(const char* path)
+{
+	char normalized[MAX_PATH_LENGTH];
+	PathUtils::normalize(path, Span(normalized));
+	return crc32(normalized);
+}
+
+
+// path is relative to root, empty for root itself
+static void gatherFiles(IAllocator& allocator, const char* root, const char* path, Array<SourceFile>& files, OutputMemoryStream& data)
+{
+	const StaticString<MAX_PATH_LENGTH> full_dir(root, "/", path);
+	OS::FileIterator* iter = OS::createFileIterator(full_dir, allocator);
+	OS::FileInfo info;
+	while (OS::getNextFile(iter, &info)) {
+		if (equalStrings(info.filename, ".") || equalStrings(info.filename, "..")) continue;
+
+		StaticString<MAX_PATH_LENGTH> child;
+		if (path[0]) child << path << "/";
+		child << info.filename;
+		if (info.is_directory) {
+			gatherFiles(allocator, root, child, files, data);
+			continue;
+		}
+
+		// tar headers without the prefix field have room only for short names
+		if (stringLength(child) >= (int)sizeof(TarHeader::name)) continue;
+
+		const StaticString<MAX_PATH_LENGTH> full_path(root, "/", child);
+		OS::InputFile file;
+		if (!file.open(full_path)) continue;
+
+		SourceFile& f = files.emplace();
+		f.path = child;
+		f.hash = getPathHash(child);
+		f.offset = data.getPos();
+		f.size = file.size();
+		if (f.size > 0) file.read(data.skip((int)f.size), f.size);
+		file.close();
+	}
+	OS::destroyFileIterator(iter);
+}
+
+
+static void writeTar(const Array<SourceFile>& files, const OutputMemoryStream& data, OutputMemoryStream& tar)
+{
+	static const u8 zeros[512] = {};
+	for (const SourceFile& f : files) {
+		TarHeader header;
+		memset(&header, 0, sizeof(header));
+		copyString(header.name, f.path);
+		snprintf(header.size, sizeof(header.size), "%011llo", (unsigned long long)f.size);
+		header.typeflag = '0';
+		tar.write(&header, sizeof(header));
+		tar.write((const u8*)data.getData() + f.offset, f.size);
+		tar.write(zeros, (512 - f.size % 512) % 512);
+	}
+	tar.write(zeros, sizeof(zeros));
+	tar.write(zeros, sizeof(zeros));
+}
+
+
+// same as the tar bundle used to be loaded
+static void indexTar(const u8* tar, u64 size, HashMap<u32, const u8*>& map)
+{
+	InputMemoryStream str(tar, size);
+	TarHeader header;
+	while (str.getPosition() < str.size()) {
+		const u8* ptr = (const u8*)str.getData() + str.getPosition();
+		str.read(&header, sizeof(header));
+		u32 file_size;
+		fromCStringOctal(Span(header.size, sizeof(header.size)), Ref(file_size));
+		if (header.name[0] && header.typeflag == 0 || header.typeflag == '0') {
+			map.insert(getPathHash(header.name), ptr);
+		}
+
+		str.setPosition(str.getPosition() + (512 - str.getPosition() % 512) % 512);
+		str.setPosition(str.getPosition() + file_size + (512 - file_size % 512) % 512);
+	}
+}
+
+
+static bool readFile(const char* path, Array<u8>& content)
+{
+	OS::InputFile file;
+	if (!file.open(path)) return false;
+	content.resize((int)file.size());
+	const bool res = file.read(content.begin(), content.byte_size());
+	file.close();
+	return res;
+}
+
+
+static bool writeFile(const char* path, const OutputMemoryStream& data)
+{
+	OS::OutputFile file;
+	if (!file.open(path)) return false;
+	const bool res = file.write(data.getData(), data.getPos());
+	file.close();
+	return res;
+}
+
+
+// open the archive and get the content of all files, like the file system does with the bundle
+static void benchTar(IAllocator& allocator, const Array<SourceFile>& files, const char* path, u64 expected_checksum)
+{
+	u64 best_read = 0xffffFFFFffffFFFF;
+	u64 best_index = 0xffffFFFFffffFFFF;
+	u64 best_extract = 0xffffFFFFffffFFFF;
+	Array<u8> archive(allocator);
+	Array<u8> content(allocator);
+	for (int i = 0; i < ITERATIONS; ++i) {
+		const u64 start = OS::Timer::getRawTimestamp();
+		if (!readFile(path, archive)) return;
+		const u64 read_end = OS::Timer::getRawTimestamp();
+
+		HashMap<u32, const u8*> map(allocator);
+		indexTar(archive.begin(), archive.byte_size(), map);
+		const u64 index_end = OS::Timer::getRawTimestamp();
+
+		u64 checksum = 0;
+		for (const SourceFile& f : files) {
+			auto iter = map.find(f.hash);
+			const TarHeader* header = (const TarHeader*)iter.value();
+			u32 size;
+			fromCStringOctal(Span(header->size), Ref(size));
+			content.resize(size);
+			if (size > 0) memcpy(content.begin(), iter.value() + 512, size);
+			checksum += size > 0 ? content[size - 1] : 0;
+		}
+		const u64 extract_end = OS::Timer::getRawTimestamp();
+		if (checksum != expected_checksum) fprintf(stderr, "tar content mismatch\n");
+
+		best_read = minimum(best_read, read_end - start);
+		best_index = minimum(best_index, index_end - read_end);
+		best_extract = minimum(best_extract, extract_end - index_end);
+	}
+	addResult("tar_read_archive", toMs(best_read), "ms");
+	addResult("tar_index", toMs(best_index), "ms");
+	addResult("tar_extract_all", toMs(best_extract), "ms");
+	addResult("tar_total", toMs(best_read + best_index + best_extract), "ms");
+}
+
+
+static void benchPack(IAllocator& allocator, const Array<SourceFile>& files, const char* path, u64 expected_checksum)
+{
+	u64 best_read = 0xffffFFFFffffFFFF;
+	u64 best_index = 0xffffFFFFffffFFFF;
+	u64 best_extract = 0xffffFFFFffffFFFF;
+	Array<u8> archive(allocator);
+	Array<u8> content(allocator);
+	for (int i = 0; i < ITERATIONS; ++i) {
+		const u64 start = OS::Timer::getRawTimestamp();
+		if (!readFile(path, archive)) return;
+		const u64 read_end = OS::Timer::getRawTimestamp();
+
+		PackFile pack(allocator);
+		if (!pack.open(archive.begin(), archive.byte_size())) {
+			fprintf(stderr, "Could not open pack\n");
+			return;
+		}
+		const u64 index_end = OS::Timer::getRawTimestamp();
+
+		// stored files are used in place, the same as the file system does
+		u64 checksum = 0;
+		for (const SourceFile& f : files) {
+			const PackEntry* entry = pack.find(f.hash);
+			if (entry->size == 0) continue;
+			const u8* stored = pack.getStoredData(*entry);
+			if (stored) {
+				checksum += stored[entry->size - 1];
+				continue;
+			}
+			content.resize((int)entry->size);
+			pack.read(*entry, 0, entry->size, content.begin());
+			checksum += content[(int)entry->size - 1];
+		}
+		const u64 extract_end = OS::Timer::getRawTimestamp();
+		if (checksum != expected_checksum) fprintf(stderr, "pack content mismatch\n");
+
+		best_read = minimum(best_read, read_end - start);
+		best_index = minimum(best_index, index_end - read_end);
+		best_extract = minimum(best_extract, extract_end - index_end);
+	}
+	addResult("pack_read_archive", toMs(best_read), "ms");
+	addResult("pack_index", toMs(best_index), "ms");
+	addResult("pack_extract_all", toMs(best_extract), "ms");
+	addResult("pack_total", toMs(best_read + best_index + best_extract), "ms");
+}
+
+
+static void writeJSON(FILE* fp, int files_count)
+{
+	fprintf(fp, "{\n");
+	fprintf(fp, "\t\"benchmark\": \"pack_bench\",\n");
+	fprintf(fp, "\t\"files\": %d,\n", files_count);
+	fprintf(fp, "\t\"results\": [\n");
+	for (int i = 0; i < g_results_count; ++i) {
+		const Result& r = g_results[i];
+		fprintf(fp, "\t\t{ \"name\": \"%s\", \"value\": %.4f, \"unit\": \"%s\" }%s\n"
+			, r.name
+			, r.value
+			, r.unit
+			, i + 1 < g_results_count ? "," : "");
+	}
+	fprintf(fp, "\t]\n");
+	fprintf(fp, "}\n");
+}
+
+
+// compares loading of all files in a directory bundled as tar and as pack
+// reads of the archives are from the OS cache after the first iteration, so the difference in size
+// shows better in sizes than in read times
+// pack_bench [-o output.json] [-dir data_dir]
+int main(int argc, char* argv[])
+{
+	const char* output_path = nullptr;
+	const char* dir = ".";
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			++i;
+			output_path = argv[i];
+		}
+		else if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc) {
+			++i;
+			dir = argv[i];
+		}
+	}
+
+	DefaultAllocator allocator;
+	Array<SourceFile> files(allocator);
+	OutputMemoryStream data(allocator);
+	gatherFiles(allocator, dir, "", files, data);
+
+	OutputMemoryStream tar(allocator);
+	writeTar(files, data, tar);
+
+	PackWriter writer(allocator);
+	u64 checksum = 0;
+	for (const SourceFile& f : files) {
+		const u8* content = (const u8*)data.getData() + f.offset;
+		if (!writer.add(f.path, content, f.size)) {
+			fprintf(stderr, "%s has the same hash as another file\n", f.path.data);
+			return -1;
+		}
+		checksum += f.size > 0 ? content[f.size - 1] : 0;
+	}
+	OutputMemoryStream pack(allocator);
+	writer.write(pack);
+
+	const char* tar_path = "pack_bench.tar";
+	const char* pack_path = "pack_bench.pack";
+	if (!writeFile(tar_path, tar) || !writeFile(pack_path, pack)) {
+		fprintf(stderr, "Could not write archives\n");
+		return -1;
+	}
+
+	addResult("tar_size", tar.getPos() / (1024.0 * 1024.0), "MB");
+	addResult("pack_size", pack.getPos() / (1024.0 * 1024.0), "MB");
+	benchTar(allocator, files, tar_path, checksum);
+	benchPack(allocator, files, pack_path, checksum);
+
+	OS::deleteFile(tar_path);
+	OS::deleteFile(pack_path);
+
+	FILE* fp = output_path ? fopen(output_path, "wb") : stdout;
+	if (!fp) {
+		fprintf(stderr, "Could not open %s\n", output_path);
+		return -1;
+	}
+	writeJSON(fp, files.size());
+	if (fp != stdout) fclose(fp);
+	return 0;
+}
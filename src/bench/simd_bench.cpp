@@ -0,0 +1,195 @@
+#include "engine/lumix.h"
+#include "engine/os.h"
+#include "engine/simd.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+using namespace Lumix;
+
+
+enum { 
+	SPHERES_COUNT = 64 * 1024,
+	STREAM_LENGTH = 64 * 1024,
+	ITERATIONS = 200
+};
+
+
+struct alignas(32) Planes
+{
+	float xs[8];
+	float ys[8];
+	float zs[8];
+	float ds[8];
+};
+
+
+struct alignas(32) BenchData
+{
+	float sx[SPHERES_COUNT];
+	float sy[SPHERES_COUNT];
+	float sz[SPHERES_COUNT];
+	float sr[SPHERES_COUNT];
+	float a[STREAM_LENGTH];
+	float b[STREAM_LENGTH];
+	float result[STREAM_LENGTH];
+};
+
+
+static float randFloat(float from, float to)
+{
+	return from + (to - from) * (rand() / (float)RAND_MAX);
+}
+
+
+static int cullScalar(const Planes& planes, const BenchData& data, float bias)
+{
+	int visible = 0;
+	for (int i = 0; i < SPHERES_COUNT; ++i) {
+		bool inside = true;
+		for (int j = 0; j < 8; ++j) {
+			const float d = planes.xs[j] * data.sx[i] + planes.ys[j] * data.sy[i] + planes.zs[j] * data.sz[i] + planes.ds[j];
+			if (d + data.sr[i] + bias < 0) {
+				inside = false;
+				break;
+			}
+		}
+		visible += inside ? 1 : 0;
+	}
+	return visible;
+}
+
+
+static int cullF4(const Planes& planes, const BenchData& data, float bias)
+{
+	const float4 px = f4Load(planes.xs);
+	const float4 py = f4Load(planes.ys);
+	const float4 pz = f4Load(planes.zs);
+	const float4 pd = f4Load(planes.ds);
+	const float4 px2 = f4Load(&planes.xs[4]);
+	const float4 py2 = f4Load(&planes.ys[4]);
+	const float4 pz2 = f4Load(&planes.zs[4]);
+	const float4 pd2 = f4Load(&planes.ds[4]);
+	int visible = 0;
+	for (int i = 0; i < SPHERES_COUNT; ++i) {
+		const float4 cx = f4Splat(data.sx[i]);
+		const float4 cy = f4Splat(data.sy[i]);
+		const float4 cz = f4Splat(data.sz[i]);
+		const float4 r = f4Splat(-data.sr[i] - bias);
+
+		float4 t = f4Add(f4Add(f4Mul(cx, px), f4Mul(cy, py)), f4Add(f4Mul(cz, pz), pd));
+		if (f4MoveMask(f4Sub(t, r))) continue;
+		t = f4Add(f4Add(f4Mul(cx, px2), f4Mul(cy, py2)), f4Add(f4Mul(cz, pz2), pd2));
+		if (f4MoveMask(f4Sub(t, r))) continue;
+		++visible;
+	}
+	return visible;
+}
+
+
+LUMIX_AVX2_TARGET static int cullF8(const Planes& planes, const BenchData& data, float bias)
+{
+	const float8 px = f8Load(planes.xs);
+	const float8 py = f8Load(planes.ys);
+	const float8 pz = f8Load(planes.zs);
+	const float8 pd = f8Load(planes.ds);
+	int visible = 0;
+	for (int i = 0; i < SPHERES_COUNT; ++i) {
+		const float8 cx = f8Splat(data.sx[i]);
+		const float8 cy = f8Splat(data.sy[i]);
+		const float8 cz = f8Splat(data.sz[i]);
+		const float8 r = f8Splat(-data.sr[i] - bias);
+
+		const float8 t = f8Add(f8Add(f8Mul(cx, px), f8Mul(cy, py)), f8Add(f8Mul(cz, pz), pd));
+		if (f8MoveMask(f8Sub(t, r))) continue;
+		++visible;
+	}
+	return visible;
+}
+
+
+static void streamScalar(BenchData& data)
+{
+	for (int i = 0; i < STREAM_LENGTH; ++i) {
+		data.result[i] = data.a[i] * data.b[i] + data.result[i];
+	}
+}
+
+
+static void streamF4(BenchData& data)
+{
+	for (int i = 0; i < STREAM_LENGTH; i += 4) {
+		const float4 t = f4Mul(f4Load(&data.a[i]), f4Load(&data.b[i]));
+		f4Store(&data.result[i], f4Add(t, f4Load(&data.result[i])));
+	}
+}
+
+
+LUMIX_AVX2_TARGET static void streamF8(BenchData& data)
+{
+	for (int i = 0; i < STREAM_LENGTH; i += 8) {
+		const float8 t = f8Mul(f8Load(&data.a[i]), f8Load(&data.b[i]));
+		f8Store(&data.result[i], f8Add(t, f8Load(&data.result[i])));
+	}
+}
+
+
+template <typename F>
+static void measure(const char* name, F f)
+{
+	OS::Timer timer;
+	int checksum = 0;
+	for (int i = 0; i < ITERATIONS; ++i) {
+		checksum += f(i * 0.001f);
+	}
+	const float t = timer.getTimeSinceStart();
+	printf("%-16s %10.3f ms/iteration (checksum %d)\n", name, t * 1000 / ITERATIONS, checksum);
+}
+
+
+int main(int argc, char* argv[])
+{
+	static Planes planes;
+	static BenchData data;
+
+	srand(0);
+	for (int i = 0; i < 8; ++i) {
+		const float x = randFloat(-1, 1);
+		const float y = randFloat(-1, 1);
+		const float z = randFloat(-1, 1);
+		const float len = sqrtf(x * x + y * y + z * z);
+		planes.xs[i] = x / len;
+		planes.ys[i] = y / len;
+		planes.zs[i] = z / len;
+		planes.ds[i] = randFloat(0, 50);
+	}
+	for (int i = 0; i < SPHERES_COUNT; ++i) {
+		data.sx[i] = randFloat(-100, 100);
+		data.sy[i] = randFloat(-100, 100);
+		data.sz[i] = randFloat(-100, 100);
+		data.sr[i] = randFloat(0.1f, 5);
+	}
+	for (int i = 0; i < STREAM_LENGTH; ++i) {
+		data.a[i] = randFloat(-1, 1);
+		data.b[i] = randFloat(-1, 1);
+		data.result[i] = 0;
+	}
+
+	#ifdef LUMIX_SSE
+		printf("float4: SSE\n");
+	#else
+		printf("float4: scalar emulation\n");
+	#endif
+	printf("float8: %s\n", f8IsSupported() ? "AVX2" : "not supported");
+
+	measure("cull scalar", [&](float bias){ return cullScalar(planes, data, bias); });
+	measure("cull float4", [&](float bias){ return cullF4(planes, data, bias); });
+	if (f8IsSupported()) measure("cull float8", [&](float bias){ return cullF8(planes, data, bias); });
+
+	measure("stream scalar", [&](float){ streamScalar(data); return 0; });
+	measure("stream float4", [&](float){ streamF4(data); return 0; });
+	if (f8IsSupported()) measure("stream float8", [&](float){ streamF8(data); return 0; });
+
+	return 0;
+}
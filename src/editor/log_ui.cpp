@@ -19,17 +19,19 @@ LogUI::LogUI(IAllocator& allocator)
 	, m_are_notifications_hovered(false)
 	, m_move_notifications_to_front(false)
 {
-	getLogCallback().bind<LogUI, &LogUI::onLog>(this);
-
 	for (int i = 0; i < (int)LogLevel::COUNT; ++i)
 	{
 		m_new_message_count[i] = 0;
 	}
+
+	LogCallbackLock lock;
+	getLogCallback().bind<LogUI, &LogUI::onLog>(this);
 }
 
 
 LogUI::~LogUI()
 {
+	LogCallbackLock lock;
 	getLogCallback().unbind<LogUI, &LogUI::onLog>(this);
 }
 
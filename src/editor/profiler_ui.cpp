@@ -9,8 +9,10 @@
 #include "engine/profiler.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
+#include "engine/scene_scheduler.h"
 #include "engine/debug.h"
 #include "engine/engine.h"
+#include "engine/tag_allocator.h"
 #include "imgui/imgui.h"
 #include "utils.h"
 #include <inttypes.h>
@@ -83,7 +85,13 @@ static const char* getContexSwitchReasonString(i8 reason)
 		"WrRundown"		   ,
 		"MaximumWaitReason",
 	};
-	if (reason >= lengthOf(reasons)) return "Unknown";
+	switch (reason) {
+		case Profiler::CONTEXT_SWITCH_WAIT: return "Wait";
+		case Profiler::CONTEXT_SWITCH_PREEMPTED: return "Preempted";
+		case Profiler::CONTEXT_SWITCH_MIGRATION: return "Migration";
+		default: break;
+	}
+	if (reason < 0 || reason >= lengthOf(reasons)) return "Unknown";
 	return reasons[reason];
 }
 
@@ -126,6 +134,8 @@ struct ProfilerUIImpl final : public ProfilerUI
 		if (ImGui::Begin("Profiler", &m_is_open))
 		{
 			onGUICPUProfiler();
+			onGUICounters();
+			onGUISceneUpdates();
 			onGUIMemoryProfiler();
 			onGUIResources();
 		}
@@ -173,7 +183,10 @@ struct ProfilerUIImpl final : public ProfilerUI
 
 
 	void onGUICPUProfiler();
+	void onGUICounters();
+	void onGUISceneUpdates();
 	void onGUIMemoryProfiler();
+	void onGUIAllocatorTags();
 	void onGUIResources();
 	void onFrame();
 	void addToTree(Debug::Allocator::AllocationInfo* info);
@@ -429,8 +442,111 @@ void ProfilerUIImpl::onGUIMemoryProfiler()
 		showAllocationTree(child, SIZE);
 	}
 	ImGui::Columns(1);
+
+	onGUIAllocatorTags();
+
+	if (!ImGui::TreeNode("Size classes")) return;
+
+	ImGui::Columns(4, "sizeclassesc");
+	ImGui::Text("Block size");
+	ImGui::NextColumn();
+	ImGui::Text("Committed");
+	ImGui::NextColumn();
+	ImGui::Text("Allocations");
+	ImGui::NextColumn();
+	ImGui::Text("Live");
+	ImGui::NextColumn();
+	for (u32 i = 0, c = DefaultAllocator::getSizeClassesCount(); i < c; ++i)
+	{
+		const DefaultAllocator::SizeClassStats stats = DefaultAllocator::getSizeClassStats(i);
+		if (stats.allocations == 0) continue;
+
+		if (stats.block_size == 0) ImGui::Text("> 32KB");
+		else ImGui::Text("%u", stats.block_size);
+		ImGui::NextColumn();
+		ImGui::Text("%.3fMB", (stats.committed_bytes / 1024) / 1024.0f);
+		ImGui::NextColumn();
+		ImGui::Text("%llu", (unsigned long long)stats.allocations);
+		ImGui::NextColumn();
+		ImGui::Text("%lld", (long long)(stats.allocations - stats.deallocations));
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+	ImGui::TreePop();
+}
+
+void ProfilerUIImpl::onGUIAllocatorTags()
+{
+	if (!ImGui::TreeNode("Tags")) return;
+
+	TagAllocator::Stats stats[TagAllocator::MAX_TAGS];
+	const u32 count = minimum(TagAllocator::getStats(Span(stats)), (u32)TagAllocator::MAX_TAGS);
+
+	bool track_stacks = TagAllocator::isStackTrackingEnabled();
+	if (ImGui::Checkbox("Record callstacks", &track_stacks)) TagAllocator::enableStackTracking(track_stacks);
+
+	ImGui::Columns(4, "tagsc");
+	ImGui::Text("Tag");
+	ImGui::NextColumn();
+	ImGui::Text("Live");
+	ImGui::NextColumn();
+	ImGui::Text("Peak");
+	ImGui::NextColumn();
+	ImGui::Text("Allocations per frame");
+	ImGui::NextColumn();
+	for (u32 i = 0; i < count; ++i)
+	{
+		const TagAllocator::Stats& tag = stats[i];
+		int depth = 0;
+		for (i32 p = tag.parent; p >= 0; p = stats[p].parent) ++depth;
+
+		ImGui::Indent(depth * 10.f + 1);
+		const bool open = ImGui::TreeNode(&stats[i], "%s", tag.name);
+		ImGui::Unindent(depth * 10.f + 1);
+		ImGui::NextColumn();
+		ImGui::Text("%.3fMB", (tag.live_bytes / 1024) / 1024.0f);
+		ImGui::NextColumn();
+		ImGui::Text("%.3fMB", (tag.peak_bytes / 1024) / 1024.0f);
+		ImGui::NextColumn();
+		ImGui::Text("%u", tag.frame_allocations);
+		ImGui::NextColumn();
+		if (!open) continue;
+
+		// the biggest callstacks, recorded only while enabled
+		TagAllocator::StackStats stacks[16];
+		const u32 stacks_count = TagAllocator::getStackStats(tag.id, Span(stacks));
+		for (u32 j = 0; j < stacks_count; ++j)
+		{
+			Debug::StackNode* nodes[64];
+			const int path_len = Debug::StackTree::getPath(stacks[j].stack, Span(nodes));
+			char fn_name[100];
+			int line;
+			// the leaf is inside the tag allocator, its caller is more interesting
+			const int caller = minimum(1, path_len - 1);
+			if (path_len == 0 || !Debug::StackTree::getFunction(nodes[caller], Span(fn_name), Ref(line))) copyString(fn_name, "N/A");
+			if (ImGui::TreeNode(stacks[j].stack, "%s", fn_name))
+			{
+				for (int k = 1; k < path_len; ++k)
+				{
+					if (!Debug::StackTree::getFunction(nodes[k], Span(fn_name), Ref(line))) copyString(fn_name, "N/A");
+					ImGui::Text("%s (%d)", fn_name, line);
+				}
+				ImGui::TreePop();
+			}
+			ImGui::NextColumn();
+			ImGui::Text("%.3fMB", (stacks[j].bytes / 1024) / 1024.0f);
+			ImGui::NextColumn();
+			ImGui::Text("%u blocks", stacks[j].count);
+			ImGui::NextColumn();
+			ImGui::NextColumn();
+		}
+		ImGui::TreePop();
+	}
+	ImGui::Columns(1);
+	ImGui::TreePop();
 }
 
+
 template <typename T>
 static void read(Profiler::ThreadState& ctx, u32 p, T& value)
 {
@@ -545,6 +661,25 @@ void ProfilerUIImpl::onGUICPUProfiler()
 			}
 			ImGui::EndMenu();
 		}
+		if (Profiler::isCapturing()) {
+			if (ImGui::MenuItem("Stop capture")) Profiler::stopCapture();
+		}
+		else if (ImGui::MenuItem("Start capture...")) {
+			char path[MAX_PATH_LENGTH];
+			if (OS::getSaveFilename(Span(path), "Profiler capture\0*.lpc\0", "lpc") && !Profiler::startCapture(path)) {
+				logError("Editor") << "Failed to start profiler capture " << path;
+			}
+		}
+		if (ImGui::MenuItem("Export capture to JSON...")) {
+			char capture_path[MAX_PATH_LENGTH];
+			char json_path[MAX_PATH_LENGTH];
+			if (OS::getOpenFilename(Span(capture_path), "Profiler capture\0*.lpc\0", nullptr)
+				&& OS::getSaveFilename(Span(json_path), "JSON\0*.json\0", "json")
+				&& !Profiler::exportChromeTrace(capture_path, json_path))
+			{
+				logError("Editor") << "Failed to export " << capture_path << " to " << json_path;
+			}
+		}
 		if (Profiler::contextSwitchesEnabled())
 		{
 			ImGui::Checkbox("Show context switches", &m_show_context_switches);
@@ -689,6 +824,11 @@ void ProfilerUIImpl::onGUICPUProfiler()
 					if (open_blocks[level].job_info.precondition != JobSystem::INVALID_HANDLE) {
 						ImGui::Text("Precondition signal: %d", open_blocks[level].job_info.precondition);
 					}
+					switch ((JobSystem::Priority)open_blocks[level].job_info.priority) {
+						case JobSystem::Priority::HIGH: ImGui::Text("Priority: high"); break;
+						case JobSystem::Priority::BACKGROUND: ImGui::Text("Priority: background"); break;
+						default: break;
+					}
 					for (int i = 0; i < properties_count; ++i) {
 						if (properties[i].level != level) continue;
 
@@ -772,6 +912,7 @@ void ProfilerUIImpl::onGUICPUProfiler()
 				open_blocks[level].color = 0xffDDddDD;
 				open_blocks[level].job_info.signal_on_finish = JobSystem::INVALID_HANDLE;
 				open_blocks[level].job_info.precondition = JobSystem::INVALID_HANDLE;
+				open_blocks[level].job_info.priority = (u8)JobSystem::Priority::NORMAL;
 				break;
 			case Profiler::EventType::END_BLOCK:
 				if (level >= 0) {
@@ -870,12 +1011,25 @@ void ProfilerUIImpl::onGUICPUProfiler()
 			ImGui::Text("  from: %s (%d)", getThreadName(r.old_thread_id), r.old_thread_id);
 			ImGui::Text("  to: %s (%d)", getThreadName(r.new_thread_id), r.new_thread_id);
 			ImGui::Text("  reason: %s", getContexSwitchReasonString(r.reason));
+			ImGui::Text("  cpu: %d", r.cpu);
 			ImGui::EndTooltip();
 		}
 		tr.last_context_switch.time = r.timestamp;
 		tr.last_context_switch.is_enter = is_enter;
 	};
 
+	auto draw_migration = [&](float x, const Profiler::ContextSwitchRecord& r, const ThreadRecord& tr) {
+		const float y = tr.y + 10;
+		dl->AddTriangleFilled(ImVec2(x - 4, y - 6), ImVec2(x + 4, y - 6), ImVec2(x, y), 0xff00ffff);
+		if (ImGui::IsMouseHoveringRect(ImVec2(x - 4, y - 6), ImVec2(x + 4, y))) {
+			ImGui::BeginTooltip();
+			ImGui::Text("Migration:");
+			ImGui::Text("  thread: %s (%d)", getThreadName(r.new_thread_id), r.new_thread_id);
+			ImGui::Text("  to cpu: %d", r.cpu);
+			ImGui::EndTooltip();
+		}
+	};
+
 	{
 		Profiler::ThreadState ctx(global, -1);
 		renderArrow(ImVec2(a.x, y), m_gpu_open ? ImGuiDir_Down : ImGuiDir_Right, 1, dl);
@@ -947,6 +1101,7 @@ void ProfilerUIImpl::onGUICPUProfiler()
 					}
 					break;
 				case Profiler::EventType::GPU_FRAME:
+				case Profiler::EventType::COUNTER:
 					break;
 				case Profiler::EventType::FRAME:
 					if (header.time >= view_start && header.time <= view_end && m_show_frames) {
@@ -963,6 +1118,10 @@ void ProfilerUIImpl::onGUICPUProfiler()
 						auto old_iter = threads_records.find(r.old_thread_id);
 						const float x = get_view_x(header.time);
 
+						if (r.reason == Profiler::CONTEXT_SWITCH_MIGRATION) {
+							if (new_iter.isValid()) draw_migration(x, r, new_iter.value());
+							break;
+						}
 						if (new_iter.isValid()) draw_cswitch(x, r, new_iter.value(), true);
 						if (old_iter.isValid()) draw_cswitch(x, r, old_iter.value(), false);
 					}
@@ -989,6 +1148,122 @@ void ProfilerUIImpl::onGUICPUProfiler()
 }
 
 
+void ProfilerUIImpl::onGUICounters()
+{
+	if (!ImGui::CollapsingHeader("Counters")) return;
+
+	Profiler::GlobalState global;
+	const int counters_count = global.countersCount();
+	if (counters_count == 0) {
+		ImGui::Text("No counters");
+		return;
+	}
+
+	struct CounterValues {
+		float last;
+		float max;
+		bool any;
+	};
+	Array<CounterValues> values(m_allocator);
+	values.resize(counters_count);
+	for (CounterValues& v : values) {
+		v.any = false;
+	}
+
+	{
+		Profiler::ThreadState ctx(global, -1);
+		u32 p = ctx.begin;
+		const u32 end = ctx.end;
+		while (p != end) {
+			Profiler::EventHeader header;
+			read(ctx, p, header);
+			if (header.type == Profiler::EventType::COUNTER) {
+				Profiler::CounterRecord r;
+				read(ctx, p + sizeof(Profiler::EventHeader), r);
+				if (r.counter < (u32)counters_count) {
+					CounterValues& v = values[r.counter];
+					v.max = v.any ? maximum(v.max, r.value) : r.value;
+					v.last = r.value;
+					v.any = true;
+				}
+			}
+			p += header.size;
+		}
+	}
+
+	ImGui::Columns(3, "counters");
+	ImGui::Text("Counter");
+	ImGui::NextColumn();
+	ImGui::Text("Last");
+	ImGui::NextColumn();
+	ImGui::Text("Max");
+	ImGui::NextColumn();
+	ImGui::Separator();
+	for (int i = 0; i < counters_count; ++i) {
+		ImGui::Text("%s", global.getCounterName(i));
+		ImGui::NextColumn();
+		if (values[i].any) {
+			ImGui::Text("%.0f", values[i].last);
+			ImGui::NextColumn();
+			ImGui::Text("%.0f", values[i].max);
+		}
+		else {
+			ImGui::Text("-");
+			ImGui::NextColumn();
+			ImGui::Text("-");
+		}
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+}
+
+
+void ProfilerUIImpl::onGUISceneUpdates()
+{
+	if (!ImGui::CollapsingHeader("Scene updates")) return;
+
+	const SceneScheduler& scheduler = m_engine.getSceneScheduler();
+	const Array<SceneScheduler::Stats>& stats = scheduler.getStats();
+	if (stats.empty()) {
+		ImGui::Text("No scenes");
+		return;
+	}
+
+	const float wall_ms = scheduler.getWallMs();
+	ImGui::Text("Wall: %.3f ms", wall_ms);
+	ImGui::Text("Serial: %.3f ms", scheduler.getSerialMs());
+	ImGui::Text("Critical path: %.3f ms", scheduler.getCriticalPathMs());
+
+	// timeline, critical path is red, exclusive scenes run on the main thread and are gray
+	ImGui::InvisibleButton("scene_updates", ImVec2(-1, stats.size() * 20.f));
+	ImDrawList* dl = ImGui::GetWindowDrawList();
+	const ImVec2 a = ImGui::GetItemRectMin();
+	const ImVec2 b = ImGui::GetItemRectMax();
+	const float scale = wall_ms > 0 ? (b.x - a.x) / wall_ms : 0;
+	for (int i = 0; i < stats.size(); ++i) {
+		const SceneScheduler::Stats& s = stats[i];
+		const float x_start = a.x + s.start_ms * scale;
+		const float x_end = maximum(x_start + 1, a.x + (s.start_ms + s.duration_ms) * scale);
+		const float y = a.y + i * 20.f;
+		const ImVec2 ra(x_start, y);
+		const ImVec2 rb(x_end, y + 19);
+		const u32 color = s.critical ? 0xff4040ff : s.exclusive ? 0xffaaaaaa : 0xff40ff40;
+		dl->AddRectFilled(ra, rb, color);
+		dl->AddRect(ra, rb, ImGui::GetColorU32(ImGuiCol_Border));
+		dl->AddText(ImVec2(x_start + 2, y), 0xff000000, s.name);
+		if (ImGui::IsMouseHoveringRect(ra, rb)) {
+			ImGui::BeginTooltip();
+			ImGui::Text("%s (%s)", s.name, s.late_update ? "late update" : "update");
+			ImGui::Text("Start: %.3f ms", s.start_ms);
+			ImGui::Text("Duration: %.3f ms", s.duration_ms);
+			if (s.exclusive) ImGui::Text("Exclusive");
+			if (s.critical) ImGui::Text("On critical path");
+			ImGui::EndTooltip();
+		}
+	}
+}
+
+
 ProfilerUI* ProfilerUI::create(Engine& engine)
 {
 	auto& allocator = static_cast<Debug::Allocator&>(engine.getAllocator());
@@ -292,6 +292,8 @@ public:
 		checkDataDirCommandLine(data_dir, lengthOf(data_dir));
 		m_engine = Engine::create(data_dir[0] ? data_dir : (saved_data_dir[0] ? saved_data_dir : current_dir)
 			, m_allocator);
+		// compiled assets are overwritten in place, which fails while they are mapped
+		m_engine->getFileSystem().setMinMappedSize(0);
 		createLua();
 
 		m_editor = WorldEditor::create(current_dir, *m_engine, m_allocator);
@@ -759,6 +761,8 @@ public:
 		}
 		m_asset_browser->update();
 		m_log_ui->update(time_delta);
+		// plugins can move entities after the engine update, views render in guiEndFrame
+		m_editor->getUniverse()->updateTransforms();
 
 		guiEndFrame();
 		m_mouse_move.set(0, 0);
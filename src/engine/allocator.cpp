@@ -1,81 +1,527 @@
 #include "engine/allocator.h"
+#include "engine/math.h"
 #include "engine/mt/atomic.h"
-#include <stdlib.h>
-#ifndef _WIN32
-	#include <string.h>
-	#include <malloc.h>
-#endif
+#include "engine/mt/thread.h"
+#include "engine/os.h"
+#include <string.h>
 
 
 namespace Lumix
 {
 
 
-	void* DefaultAllocator::allocate(size_t n)
-	{
-		return malloc(n);
+// 8, 16, 32, 48, ... 128 and then four classes per power of two up to 1MB
+static const u32 SIZE_CLASSES_COUNT = 61;
+static const u32 MAX_SMALL_SIZE = 1024 * 1024;
+// bigger blocks are moved between threads one by one and committed only when they are carved from their span
+static const u32 MAX_BATCHED_SIZE = 64 * 1024;
+static const u32 MAX_SMALL_ALIGN = 4096;
+// small blocks live in one big reservation, so a pointer tells by its address which kind of block it is
+static const u32 REGION_PAGE_SIZE = 64 * 1024;
+static const u64 REGION_SIZE = 8ULL * 1024 * 1024 * 1024;
+static const u32 REGION_PAGES_COUNT = u32(REGION_SIZE / REGION_PAGE_SIZE);
+// threads move blocks between their caches and the shared lists in batches of about this many bytes
+static const u32 BATCH_BYTES = 16 * 1024;
+static const u32 MAX_BATCH = 64;
+
+
+struct alignas(64) CentralBin
+{
+	volatile i32 lock;
+	void* free_list;
+	u8* span_pos;
+	u8* span_end;
+	u64 committed_bytes;
+	u64 allocations;
+	u64 deallocations;
+};
+
+
+// header of a big block, placed at the beginning of the block's reservation
+struct alignas(64) LargeBlockHeader
+{
+	size_t reserved;
+	size_t committed;
+	size_t size;
+	u8 padding[32];
+	// the slot right in front of the block always points to the header, it is this one if the block is not overaligned
+	LargeBlockHeader* self;
+};
+
+
+// zero initialized, so it is usable from static constructors of other translation units
+struct Heap
+{
+	volatile i32 init_lock;
+	volatile i32 initialized;
+	volatile i32 region_lock;
+	u32 mem_page_size;
+	u8* region;
+	u8* region_top;
+	CentralBin bins[SIZE_CLASSES_COUNT];
+	volatile i64 large_committed;
+	volatile i64 large_allocations;
+	volatile i64 large_deallocations;
+	// size class + 1 of every region page, 0 if the page is not used yet
+	u8 page_classes[REGION_PAGES_COUNT];
+};
+
+
+struct ThreadBin
+{
+	void* head;
+	u32 count;
+	u64 allocations;
+	u64 deallocations;
+};
+
+
+struct ThreadCache
+{
+	~ThreadCache();
+
+	ThreadBin bins[SIZE_CLASSES_COUNT];
+	// static destructors can still allocate after the thread's cache is gone
+	bool destroyed;
+};
+
+
+static Heap g_heap;
+static thread_local ThreadCache g_thread_cache;
+
+
+static_assert(sizeof(LargeBlockHeader) == 64, "LargeBlockHeader::self must be right in front of the block");
+
+
+static void lock(volatile i32* value)
+{
+	for (u32 i = 0; !MT::compareAndExchange(value, 1, 0); ++i) {
+		if (i > 64) MT::yield();
 	}
+}
 
 
-	void DefaultAllocator::deallocate(void* p)
-	{
-		free(p);
+static void unlock(volatile i32* value)
+{
+	MT::memoryBarrier();
+	*value = 0;
+}
+
+
+static void atomicAdd64(volatile i64* value, i64 delta)
+{
+	for (;;) {
+		const i64 v = *value;
+		if (MT::compareAndExchange64(value, v + delta, v)) return;
 	}
+}
 
 
-	void* DefaultAllocator::reallocate(void* ptr, size_t size)
-	{
-		return realloc(ptr, size);
+static LUMIX_FORCE_INLINE void* getNext(void* block)
+{
+	void* next;
+	memcpy(&next, block, sizeof(next));
+	return next;
+}
+
+
+static LUMIX_FORCE_INLINE void setNext(void* block, void* next)
+{
+	memcpy(block, &next, sizeof(next));
+}
+
+
+static LUMIX_FORCE_INLINE size_t alignSize(size_t size, size_t align)
+{
+	return (size + align - 1) & ~(align - 1);
+}
+
+
+static LUMIX_FORCE_INLINE u32 getSizeClassSize(u32 cls)
+{
+	if (cls < 9) return cls == 0 ? 8 : cls * 16;
+	const u32 group = (cls - 9) >> 2;
+	return (128 << group) + (((cls - 9) & 3) + 1) * (32 << group);
+}
+
+
+static LUMIX_FORCE_INLINE u32 getSizeClass(size_t size)
+{
+	if (size <= 8) return 0;
+	if (size <= 128) return u32(size + 15) >> 4;
+	const u32 k = log2(u32(size - 1));
+	return 9 + (k - 7) * 4 + (u32(size - 1) >> (k - 2)) - 4;
+}
+
+
+// spans are REGION_PAGE_SIZE aligned, so a class works for an alignment its size is a multiple of
+static LUMIX_FORCE_INLINE u32 getAlignedSizeClass(size_t size, size_t align)
+{
+	u32 cls = getSizeClass(size);
+	while (getSizeClassSize(cls) & (align - 1)) ++cls;
+	return cls;
+}
+
+
+static LUMIX_FORCE_INLINE u32 getSpanSize(u32 cls)
+{
+	const u32 size = getSizeClassSize(cls);
+	if (size <= 8192) return REGION_PAGE_SIZE;
+	if (size <= MAX_BATCHED_SIZE) return 4 * REGION_PAGE_SIZE;
+	return 4 * size;
+}
+
+
+static LUMIX_FORCE_INLINE u32 getBatchSize(u32 cls)
+{
+	const u32 size = getSizeClassSize(cls);
+	if (size > MAX_BATCHED_SIZE) return 1;
+	return clamp(BATCH_BYTES / size, 2U, (u32)MAX_BATCH);
+}
+
+
+static LUMIX_FORCE_INLINE bool isSmall(const void* ptr)
+{
+	return g_heap.region && ptr >= g_heap.region && ptr < g_heap.region + REGION_SIZE;
+}
+
+
+static LUMIX_FORCE_INLINE u32 getBlockSizeClass(const void* ptr)
+{
+	return g_heap.page_classes[((const u8*)ptr - g_heap.region) / REGION_PAGE_SIZE] - 1;
+}
+
+
+static LUMIX_FORCE_INLINE LargeBlockHeader* getLargeHeader(void* ptr)
+{
+	return ((LargeBlockHeader**)ptr)[-1];
+}
+
+
+static void initHeap()
+{
+	lock(&g_heap.init_lock);
+	if (!g_heap.initialized) {
+		g_heap.mem_page_size = OS::getMemPageSize();
+		// if the region can not be reserved, everything goes through the big block path
+		u8* mem = (u8*)OS::memReserve(REGION_SIZE + REGION_PAGE_SIZE);
+		if (mem) {
+			g_heap.region = (u8*)alignSize((uintptr)mem, REGION_PAGE_SIZE);
+			g_heap.region_top = g_heap.region;
+		}
+		MT::memoryBarrier();
+		g_heap.initialized = 1;
 	}
+	unlock(&g_heap.init_lock);
+}
 
-#ifdef _WIN32
-	void* DefaultAllocator::allocate_aligned(size_t size, size_t align)
-	{
-		return _aligned_malloc(size, align);
+
+static LUMIX_FORCE_INLINE void checkHeap()
+{
+	if (!g_heap.initialized) initHeap();
+}
+
+
+// called with central's lock held
+static void flushStats(CentralBin& central, ThreadBin& bin)
+{
+	central.allocations += bin.allocations;
+	central.deallocations += bin.deallocations;
+	bin.allocations = 0;
+	bin.deallocations = 0;
+}
+
+
+// called with central's lock held
+static bool allocateSpan(u32 cls, CentralBin& central)
+{
+	const u32 span_size = getSpanSize(cls);
+	lock(&g_heap.region_lock);
+	u8* span = g_heap.region_top;
+	const bool fits = span && span + span_size <= g_heap.region + REGION_SIZE;
+	if (fits) {
+		g_heap.region_top += span_size;
+		const u32 page = u32((span - g_heap.region) / REGION_PAGE_SIZE);
+		for (u32 i = 0; i < span_size / REGION_PAGE_SIZE; ++i) {
+			g_heap.page_classes[page + i] = u8(cls + 1);
+		}
 	}
+	unlock(&g_heap.region_lock);
+	if (!fits) return false;
 
+	if (getSizeClassSize(cls) <= MAX_BATCHED_SIZE) {
+		OS::memCommit(span, span_size);
+		central.committed_bytes += span_size;
+	}
+	central.span_pos = span;
+	central.span_end = span + span_size;
+	return true;
+}
 
-	void DefaultAllocator::deallocate_aligned(void* ptr)
-	{
-		_aligned_free(ptr);
+
+// bin is empty, returns the first block and puts the rest of a batch to bin
+static void* refill(u32 cls, ThreadBin& bin)
+{
+	CentralBin& central = g_heap.bins[cls];
+	const u32 size = getSizeClassSize(cls);
+	const u32 batch = getBatchSize(cls);
+	void* head = nullptr;
+	u32 count = 0;
+
+	lock(&central.lock);
+	flushStats(central, bin);
+	while (count < batch) {
+		void* block = central.free_list;
+		if (block) {
+			central.free_list = getNext(block);
+		}
+		else {
+			if (uintptr(central.span_end - central.span_pos) < size && !allocateSpan(cls, central)) break;
+			block = central.span_pos;
+			central.span_pos += size;
+			if (size > MAX_BATCHED_SIZE) {
+				OS::memCommit(block, size);
+				central.committed_bytes += size;
+			}
+		}
+		setNext(block, head);
+		head = block;
+		++count;
 	}
+	unlock(&central.lock);
 
+	if (!head) return nullptr;
+	bin.head = getNext(head);
+	bin.count = count - 1;
+	return head;
+}
 
-	void* DefaultAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
-	{
-		return _aligned_realloc(ptr, size, align);
+
+// gives `count` blocks from the top of bin back to the shared list
+static void flush(u32 cls, ThreadBin& bin, u32 count)
+{
+	CentralBin& central = g_heap.bins[cls];
+	void* first = bin.head;
+	void* last = first;
+	if (count > 0) {
+		for (u32 i = 1; i < count; ++i) last = getNext(last);
+		bin.head = getNext(last);
+		bin.count -= count;
 	}
-#else
-	void* DefaultAllocator::allocate_aligned(size_t size, size_t align)
-	{
-		return aligned_alloc(align, size);
+
+	lock(&central.lock);
+	if (count > 0) {
+		setNext(last, central.free_list);
+		central.free_list = first;
 	}
+	flushStats(central, bin);
+	unlock(&central.lock);
+}
 
 
-	void DefaultAllocator::deallocate_aligned(void* ptr)
-	{
-		free(ptr);
+ThreadCache::~ThreadCache()
+{
+	for (u32 cls = 0; cls < SIZE_CLASSES_COUNT; ++cls) {
+		ThreadBin& bin = bins[cls];
+		if (bin.count > 0 || bin.allocations > 0 || bin.deallocations > 0) flush(cls, bin, bin.count);
 	}
+	destroyed = true;
+}
 
 
-	void* DefaultAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
-	{
-		// POSIX and glibc do not provide a way to realloc with alignment preservation
-		if (size == 0) {
-			free(ptr);
-			return nullptr;
-		}
-		void* newptr = aligned_alloc(align, size);
-		if (newptr == nullptr) {
-			return nullptr;
+static void* allocateSmall(u32 cls)
+{
+	ThreadCache& cache = g_thread_cache;
+	if (cache.destroyed) {
+		ThreadBin tmp = {};
+		tmp.allocations = 1;
+		void* ptr = refill(cls, tmp);
+		flush(cls, tmp, tmp.count);
+		return ptr;
+	}
+
+	ThreadBin& bin = cache.bins[cls];
+	void* ptr = bin.head;
+	if (ptr) {
+		bin.head = getNext(ptr);
+		--bin.count;
+	}
+	else {
+		ptr = refill(cls, bin);
+		if (!ptr) return nullptr;
+	}
+	++bin.allocations;
+	return ptr;
+}
+
+
+static void deallocateSmall(void* ptr)
+{
+	const u32 cls = getBlockSizeClass(ptr);
+	ThreadCache& cache = g_thread_cache;
+	if (cache.destroyed) {
+		ThreadBin tmp = {};
+		tmp.head = ptr;
+		tmp.count = 1;
+		tmp.deallocations = 1;
+		flush(cls, tmp, 1);
+		return;
+	}
+
+	ThreadBin& bin = cache.bins[cls];
+	setNext(ptr, bin.head);
+	bin.head = ptr;
+	++bin.count;
+	++bin.deallocations;
+	// keep one batch, so alternating allocations and deallocations do not hit the shared list
+	const u32 batch = getBatchSize(cls);
+	if (bin.count > 2 * batch) flush(cls, bin, batch);
+}
+
+
+// the reservation is twice the size, so the block can grow in place
+static void* allocateLarge(size_t size, size_t align)
+{
+	align = maximum(align, sizeof(LargeBlockHeader));
+	const size_t reserved = alignSize(2 * size + align + sizeof(LargeBlockHeader), REGION_PAGE_SIZE);
+	u8* mem = (u8*)OS::memReserve(reserved);
+	if (!mem) return nullptr;
+
+	u8* ptr = (u8*)alignSize((uintptr)mem + sizeof(LargeBlockHeader), align);
+	const size_t committed = alignSize(ptr - mem + size, g_heap.mem_page_size);
+	OS::memCommit(mem, committed);
+
+	LargeBlockHeader* header = (LargeBlockHeader*)mem;
+	header->reserved = reserved;
+	header->committed = committed;
+	header->size = size;
+	((LargeBlockHeader**)ptr)[-1] = header;
+
+	atomicAdd64(&g_heap.large_committed, committed);
+	atomicAdd64(&g_heap.large_allocations, 1);
+	return ptr;
+}
+
+
+static void deallocateLarge(void* ptr)
+{
+	LargeBlockHeader* header = getLargeHeader(ptr);
+	atomicAdd64(&g_heap.large_committed, -(i64)header->committed);
+	atomicAdd64(&g_heap.large_deallocations, 1);
+	OS::memRelease(header);
+}
+
+
+u32 DefaultAllocator::getSizeClassesCount()
+{
+	return SIZE_CLASSES_COUNT + 1;
+}
+
+
+DefaultAllocator::SizeClassStats DefaultAllocator::getSizeClassStats(u32 idx)
+{
+	SizeClassStats stats = {};
+	if (idx == SIZE_CLASSES_COUNT) {
+		stats.committed_bytes = g_heap.large_committed;
+		stats.allocations = g_heap.large_allocations;
+		stats.deallocations = g_heap.large_deallocations;
+		return stats;
+	}
+
+	ASSERT(idx < SIZE_CLASSES_COUNT);
+	CentralBin& central = g_heap.bins[idx];
+	lock(&central.lock);
+	stats.block_size = getSizeClassSize(idx);
+	stats.committed_bytes = central.committed_bytes;
+	stats.allocations = central.allocations;
+	stats.deallocations = central.deallocations;
+	unlock(&central.lock);
+	return stats;
+}
+
+
+void* DefaultAllocator::allocate(size_t n)
+{
+	// the same alignment malloc guarantees
+	return allocate_aligned(n, 16);
+}
+
+
+void DefaultAllocator::deallocate(void* p)
+{
+	deallocate_aligned(p);
+}
+
+
+void* DefaultAllocator::reallocate(void* ptr, size_t size)
+{
+	return reallocate_aligned(ptr, size, 16);
+}
+
+
+void* DefaultAllocator::allocate_aligned(size_t size, size_t align)
+{
+	ASSERT(isPowOfTwo(align));
+	checkHeap();
+	if (size <= MAX_SMALL_SIZE && align <= MAX_SMALL_ALIGN) {
+		void* ptr = allocateSmall(getAlignedSizeClass(size, align));
+		if (ptr) return ptr;
+	}
+	return allocateLarge(size, align);
+}
+
+
+void DefaultAllocator::deallocate_aligned(void* ptr)
+{
+	if (!ptr) return;
+	if (isSmall(ptr)) {
+		deallocateSmall(ptr);
+	}
+	else {
+		deallocateLarge(ptr);
+	}
+}
+
+
+void* DefaultAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
+{
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0) {
+		deallocate_aligned(ptr);
+		return nullptr;
+	}
+
+	const bool is_aligned = ((uintptr)ptr & (align - 1)) == 0;
+	size_t old_size;
+	if (isSmall(ptr)) {
+		old_size = getSizeClassSize(getBlockSizeClass(ptr));
+		// shrinking keeps the block unless it would waste more than half of it
+		if (is_aligned && size <= old_size && (size > old_size / 2 || old_size <= 16)) return ptr;
+	}
+	else {
+		LargeBlockHeader* header = getLargeHeader(ptr);
+		old_size = header->size;
+		const size_t end = (u8*)ptr - (u8*)header + size;
+		if (is_aligned && size > MAX_SMALL_SIZE && end <= header->reserved) {
+			if (end > header->committed) {
+				const size_t committed = minimum(alignSize(end, g_heap.mem_page_size), header->reserved);
+				OS::memCommit((u8*)header + header->committed, committed - header->committed);
+				atomicAdd64(&g_heap.large_committed, committed - header->committed);
+				header->committed = committed;
+			}
+			header->size = size;
+			return ptr;
 		}
-		memcpy(newptr, ptr, malloc_usable_size(ptr));
-		free(ptr);
-		return newptr;
 	}
-#endif
 
-	
+	void* new_ptr = allocate_aligned(size, align);
+	if (!new_ptr) return nullptr;
+	memcpy(new_ptr, ptr, minimum(old_size, size));
+	deallocate_aligned(ptr);
+	return new_ptr;
+}
+
+
 BaseProxyAllocator::BaseProxyAllocator(IAllocator& source)
 	: m_source(source)
 {
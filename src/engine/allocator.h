@@ -54,9 +54,26 @@ struct LUMIX_ENGINE_API IAllocator
 };
 
 
+// blocks up to 1MB come from size class slabs cached per thread, bigger blocks get their own
+// virtual memory reservation, so they can grow in place
+// all instances share the same heap, memory can be freed by any of them
 class LUMIX_ENGINE_API DefaultAllocator final : public IAllocator
 {
 public:
+	struct SizeClassStats
+	{
+		// 0 for blocks bigger than the biggest size class
+		u32 block_size;
+		u64 committed_bytes;
+		// threads report their allocations in batches, so the counts can lag a bit behind
+		u64 allocations;
+		u64 deallocations;
+	};
+
+	// the last one is for big blocks
+	static u32 getSizeClassesCount();
+	static SizeClassStats getSizeClassStats(u32 idx);
+
 	void* allocate(size_t n) override;
 	void deallocate(void* p) override;
 	void* reallocate(void* ptr, size_t size) override;
@@ -1,7 +1,9 @@
 #include "engine/engine.h"
+#include "engine/command_line_parser.h"
 #include "engine/crc32.h"
 #include "engine/debug.h"
 #include "engine/file_system.h"
+#include "engine/frame_allocator.h"
 #include "engine/input_system.h"
 #include "engine/iplugin.h"
 #include "engine/job_system.h"
@@ -16,7 +18,9 @@
 #include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
+#include "engine/scene_scheduler.h"
 #include "engine/stream.h"
+#include "engine/tag_allocator.h"
 #include "engine/universe/component.h"
 #include "engine/universe/universe.h"
 #include <imgui/imgui.h>
@@ -423,7 +427,13 @@ static void logToFile(LogLevel level, const char*, const char* message)
 	}
 	g_log_file.write(message, stringLength(message));
 	g_log_file.write("\n", 1);
-	g_log_file.flush();
+}
+
+
+// the log writer calls this once per batch of messages
+static void flushLogFile()
+{
+	if (g_is_log_file_open) g_log_file.flush();
 }
 
 
@@ -456,8 +466,10 @@ public:
 
 	EngineImpl(const char* working_dir, IAllocator& allocator)
 		: m_allocator(allocator)
+		, m_frame_allocator(m_allocator)
 		, m_prefab_resource_manager(m_allocator)
 		, m_resource_manager(m_allocator)
+		, m_scene_scheduler(m_allocator)
 		, m_lua_resources(m_allocator)
 		, m_last_lua_resource_idx(-1)
 		, m_fps(0)
@@ -475,17 +487,82 @@ public:
 		Profiler::setThreadName("Worker");
 		installUnhandledExceptionHandler();
 
-		getLogCallback().bind<logToFile>();
-		getLogCallback().bind<showLogInVS>();
+		{
+			LogCallbackLock lock;
+			getLogCallback().bind<logToFile>();
+			getLogCallback().bind<showLogInVS>();
+			getLogFlushCallback().bind<flushLogFile>();
+		}
+
+		u32 fs_workers = 0;
+		u32 resource_budget_mb = 0;
+		i32 resource_keep_warm_seconds = -1;
+		char cmd_line[2048];
+		OS::getCommandLine(Span(cmd_line));
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			if (parser.currentEquals("-large_pages")) {
+				if (!m_page_allocator.enableLargePages()) {
+					logWarning("Core") << "Large pages are not available.";
+				}
+			}
+			else if (parser.currentEquals("-profiler_capture")) {
+				if (!parser.next()) break;
+				char path[MAX_PATH_LENGTH];
+				parser.getCurrent(path, lengthOf(path));
+				if (!Profiler::startCapture(path)) {
+					logError("Core") << "Failed to start profiler capture " << path;
+				}
+			}
+			else if (parser.currentEquals("-profiler_stats")) {
+				Profiler::enableBlockStats(10);
+				Profiler::dumpBlockStats(10, nullptr);
+			}
+			else if (parser.currentEquals("-profiler_stats_file")) {
+				if (!parser.next()) break;
+				char path[MAX_PATH_LENGTH];
+				parser.getCurrent(path, lengthOf(path));
+				Profiler::enableBlockStats(10);
+				Profiler::dumpBlockStats(10, path);
+			}
+			else if (parser.currentEquals("-alloc_stacks")) {
+				TagAllocator::enableStackTracking(true);
+			}
+			else if (parser.currentEquals("-deferred_transforms")) {
+				m_deferred_transforms = true;
+			}
+			else if (parser.currentEquals("-fs_workers")) {
+				if (!parser.next()) break;
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				fromCString(Span(tmp, stringLength(tmp)), Ref(fs_workers));
+			}
+			else if (parser.currentEquals("-resource_budget")) {
+				if (!parser.next()) break;
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				fromCString(Span(tmp, stringLength(tmp)), Ref(resource_budget_mb));
+			}
+			else if (parser.currentEquals("-resource_keep_warm")) {
+				if (!parser.next()) break;
+				char tmp[32];
+				parser.getCurrent(tmp, lengthOf(tmp));
+				fromCString(Span(tmp, stringLength(tmp)), Ref(resource_keep_warm_seconds));
+			}
+		}
+		m_pages_counter = Profiler::createCounter("Pages in use");
+		m_peak_pages_counter = Profiler::createCounter("Pages peak");
 
 		m_platform_data = {};
 		m_state = luaL_newstate();
 		luaL_openlibs(m_state);
 		registerLuaAPI();
 
-		m_file_system = FileSystem::create(working_dir, m_allocator);
+		m_file_system = FileSystem::create(working_dir, m_allocator, fs_workers);
 
 		m_resource_manager.init(*m_file_system);
+		m_resource_manager.setBudget(u64(resource_budget_mb) * 1024 * 1024);
+		if (resource_keep_warm_seconds >= 0) m_resource_manager.setKeepWarmTime((float)resource_keep_warm_seconds);
 		m_prefab_resource_manager.create(PrefabResource::TYPE, m_resource_manager);
 
 		m_fps_frame = 0;
@@ -862,6 +939,8 @@ public:
 	static void LUA_pause(Engine* engine, bool pause) { engine->pause(pause); }
 	static void LUA_nextFrame(Engine* engine) { engine->nextFrame(); }
 	static void LUA_setTimeMultiplier(Engine* engine, float multiplier) { engine->setTimeMultiplier(multiplier); }
+	static void LUA_setResourceBudget(Engine* engine, int megabytes) { engine->getResourceManager().setBudget(u64(maximum(megabytes, 0)) * 1024 * 1024); }
+	static void LUA_setResourceKeepWarmTime(Engine* engine, float seconds) { engine->getResourceManager().setKeepWarmTime(seconds); }
 	static Vec4 LUA_multMatrixVec(const Matrix& m, const Vec4& v) { return m * v; }
 	static Quat LUA_multQuat(const Quat& a, const Quat& b) { return a * b; }
 
@@ -1019,6 +1098,8 @@ public:
 		REGISTER_FUNCTION(setEntityLocalRotation);
 		REGISTER_FUNCTION(setEntityPosition);
 		REGISTER_FUNCTION(setEntityRotation);
+		REGISTER_FUNCTION(setResourceBudget);
+		REGISTER_FUNCTION(setResourceKeepWarmTime);
 		REGISTER_FUNCTION(setTimeMultiplier);
 		REGISTER_FUNCTION(startGame);
 		REGISTER_FUNCTION(unloadResource);
@@ -1201,6 +1282,11 @@ public:
 			res->getResourceManager().unload(*res);
 		}
 
+		// plugins destroy their managers in any order, warm resources can reference resources of any manager
+		m_resource_manager.unloadKeptWarm();
+		// resources released by plugins are unloaded right away
+		m_resource_manager.setBudget(0);
+
 		Reflection::shutdown();
 		PluginManager::destroy(m_plugin_manager);
 		if (m_input_system) InputSystem::destroy(*m_input_system);
@@ -1209,7 +1295,13 @@ public:
 		m_prefab_resource_manager.destroy();
 		lua_close(m_state);
 
-		g_log_file.close();
+		Profiler::stopCapture();
+		flushLog();
+		{
+			LogCallbackLock lock;
+			g_log_file.close();
+			g_is_log_file_open = false;
+		}
 		PathManager::destroy(*m_path_manager);
 	}
 
@@ -1229,11 +1321,14 @@ public:
 
 	IAllocator& getAllocator() override { return m_allocator; }
 	PageAllocator& getPageAllocator() override { return m_page_allocator; }
+	FrameAllocator& getFrameAllocator() override { return m_frame_allocator; }
+	const SceneScheduler& getSceneScheduler() const override { return m_scene_scheduler; }
 
 
 	Universe& createUniverse(bool set_lua_globals) override
 	{
-		Universe* universe = LUMIX_NEW(m_allocator, Universe)(m_allocator);
+		Universe* universe = LUMIX_NEW(m_allocator, Universe)(m_allocator, m_frame_allocator);
+		universe->setDeferredTransforms(m_deferred_transforms);
 		const Array<IPlugin*>& plugins = m_plugin_manager->getPlugins();
 		for (auto* plugin : plugins)
 		{
@@ -1334,6 +1429,8 @@ public:
 	void update(Universe& context) override
 	{
 		PROFILE_FUNCTION();
+		m_frame_allocator.reset();
+		TagAllocator::frame();
 		++m_fps_frame;
 		if (m_fps_timer.getTimeSinceTick() > 1.0f)
 		{
@@ -1348,23 +1445,15 @@ public:
 		}
 		m_time += dt;
 		m_last_time_delta = dt;
-		{
-			PROFILE_BLOCK("update scenes");
-			for (auto* scene : context.getScenes())
-			{
-				scene->update(dt, m_paused);
-			}
-		}
-		{
-			PROFILE_BLOCK("late update scenes");
-			for (auto* scene : context.getScenes())
-			{
-				scene->lateUpdate(dt, m_paused);
-			}
-		}
+		m_scene_scheduler.update(context, dt, m_paused);
+		context.updateTransforms();
 		m_plugin_manager->update(dt, m_paused);
 		m_input_system->update(dt);
 		getFileSystem().updateAsyncTransactions();
+		m_resource_manager.update();
+
+		Profiler::pushCounter(m_pages_counter, (float)m_page_allocator.getAllocatedCount());
+		Profiler::pushCounter(m_peak_pages_counter, (float)m_page_allocator.getPeakCount());
 
 		if (m_next_frame)
 		{
@@ -1584,10 +1673,14 @@ public:
 private:
 	IAllocator& m_allocator;
 	PageAllocator m_page_allocator;
+	FrameAllocator m_frame_allocator;
+	u32 m_pages_counter;
+	u32 m_peak_pages_counter;
 
 	FileSystem* m_file_system;
 
 	ResourceManagerHub m_resource_manager;
+	SceneScheduler m_scene_scheduler;
 	
 	PluginManager* m_plugin_manager;
 	PrefabResourceManager m_prefab_resource_manager;
@@ -1602,6 +1695,7 @@ private:
 	bool m_is_game_running;
 	bool m_paused;
 	bool m_next_frame;
+	bool m_deferred_transforms = false;
 	PlatformData m_platform_data;
 	PathManager* m_path_manager;
 	lua_State* m_state;
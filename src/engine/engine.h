@@ -16,11 +16,13 @@ struct IAllocator;
 class InputMemoryStream;
 class InputSystem;
 class OutputMemoryStream;
+class FrameAllocator;
 class PageAllocator;
 class Path;
 struct PathManager;
 class PluginManager;
 class ResourceManagerHub;
+class SceneScheduler;
 class Universe;
 template <typename T> class Array;
 
@@ -50,6 +52,8 @@ public:
 	virtual ResourceManagerHub& getResourceManager() = 0;
 	virtual IAllocator& getAllocator() = 0;
 	virtual PageAllocator& getPageAllocator() = 0;
+	virtual FrameAllocator& getFrameAllocator() = 0;
+	virtual const SceneScheduler& getSceneScheduler() const = 0;
 
 	virtual void startGame(Universe& context) = 0;
 	virtual void stopGame(Universe& context) = 0;
@@ -1,9 +1,7 @@
 #pragma once
 
 
-#ifdef __linux__
-	#include <ucontext.h>
-#endif
+#include "engine/lumix.h"
 
 
 namespace Lumix
@@ -21,19 +19,19 @@ namespace Fiber
 	typedef void* Handle;
 	typedef void(__stdcall *FiberProc)(void*);
 #else 
-	typedef ucontext_t Handle;
+	typedef void* Handle;
 	typedef void (*FiberProc)(void*);
 #endif
 constexpr void* INVALID_FIBER = nullptr;
 
 
-void initThread(FiberProc proc, Handle* handle);
-Handle create(int stack_size, FiberProc proc, void* parameter);
-void destroy(Handle fiber);
-void switchTo(Handle* from, Handle fiber);
+LUMIX_ENGINE_API void initThread(FiberProc proc, Handle* handle);
+LUMIX_ENGINE_API Handle create(int stack_size, FiberProc proc, void* parameter);
+LUMIX_ENGINE_API void destroy(Handle fiber);
+LUMIX_ENGINE_API void switchTo(Handle* from, Handle fiber);
 
 
 } // namespace Fiber
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
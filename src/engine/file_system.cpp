@@ -6,10 +6,14 @@
 #include "engine/delegate_list.h"
 #include "engine/flag_set.h"
 #include "engine/hash_map.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
+#include "engine/mt/atomic.h"
 #include "engine/mt/sync.h"
 #include "engine/mt/task.h"
+#include "engine/mt/thread.h"
 #include "engine/os.h"
+#include "engine/pack.h"
 #include "engine/path.h"
 #include "engine/path_utils.h"
 #include "engine/profiler.h"
@@ -24,26 +28,115 @@ namespace Lumix
 {
 
 
-struct TarHeader {
-	char name[100];
-	char mode[8];
-	char uid[8];
-	char gid[8];
-	char size[12];
-	char mtime[12];
-	char chksum[8];
-	char typeflag;
-	char linkname[100];
-	char magic[6];
-	char version[2];
-	char uname[32];
-	char gname[32];
-	char devmajor[8];
-	char devminor[8];
-	char prefix[155];   
+struct ContentView::Block
+{
+	enum class Type : u32 {
+		HEAP,
+		MAPPED
+	};
+
+	IAllocator* allocator;
+	const void* mapped;
+	u64 mapped_size;
+	i32 volatile ref_count;
+	Type type;
 };
 
 
+ContentView::ContentView(Block* block, const u8* data, u64 size)
+	: m_block(block)
+	, m_data(data)
+	, m_size(size)
+{}
+
+
+ContentView::ContentView(const ContentView& rhs)
+	: m_block(rhs.m_block)
+	, m_data(rhs.m_data)
+	, m_size(rhs.m_size)
+{
+	if (m_block) MT::atomicIncrement(&m_block->ref_count);
+}
+
+
+ContentView::ContentView(ContentView&& rhs)
+	: m_block(rhs.m_block)
+	, m_data(rhs.m_data)
+	, m_size(rhs.m_size)
+{
+	rhs.m_block = nullptr;
+	rhs.m_data = nullptr;
+	rhs.m_size = 0;
+}
+
+
+ContentView::~ContentView() { reset(); }
+
+
+void ContentView::operator =(const ContentView& rhs)
+{
+	if (rhs.m_block) MT::atomicIncrement(&rhs.m_block->ref_count);
+	reset();
+	m_block = rhs.m_block;
+	m_data = rhs.m_data;
+	m_size = rhs.m_size;
+}
+
+
+void ContentView::operator =(ContentView&& rhs)
+{
+	if (this == &rhs) return;
+	reset();
+	m_block = rhs.m_block;
+	m_data = rhs.m_data;
+	m_size = rhs.m_size;
+	rhs.m_block = nullptr;
+	rhs.m_data = nullptr;
+	rhs.m_size = 0;
+}
+
+
+void ContentView::reset()
+{
+	if (m_block && MT::atomicDecrement(&m_block->ref_count) == 0) {
+		if (m_block->type == Block::Type::MAPPED) OS::unmapFile(m_block->mapped, m_block->mapped_size);
+		m_block->allocator->deallocate_aligned(m_block);
+	}
+	m_block = nullptr;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+
+// block and data in one allocation, data is right after the block
+static ContentView allocateContent(IAllocator& allocator, u64 size)
+{
+	ContentView::Block* block = (ContentView::Block*)allocator.allocate_aligned(sizeof(ContentView::Block) + size, 16);
+	block->allocator = &allocator;
+	block->mapped = nullptr;
+	block->mapped_size = 0;
+	block->ref_count = 1;
+	block->type = ContentView::Block::Type::HEAP;
+	return ContentView(block, (const u8*)(block + 1), size);
+}
+
+
+static ContentView mapContent(IAllocator& allocator, const char* path)
+{
+	u64 size;
+	const void* mem = OS::mapFile(path, Ref(size));
+	if (!mem) return ContentView();
+
+	ContentView::Block* block = LUMIX_NEW(allocator, ContentView::Block);
+	block->allocator = &allocator;
+	block->mapped = mem;
+	block->mapped_size = size;
+	block->ref_count = 1;
+	block->type = ContentView::Block::Type::MAPPED;
+	return ContentView(block, (const u8*)mem, size);
+}
+
+
 struct AsyncItem
 {
 	enum class Flags : u32 {
@@ -51,22 +144,65 @@ struct AsyncItem
 		CANCELED = 1 << 1,
 	};
 
-	AsyncItem(IAllocator& allocator) : data(allocator) {}
-	
 	bool isFailed() const { return flags.isSet(Flags::FAILED); }
 	bool isCanceled() const { return flags.isSet(Flags::CANCELED); }
 
+	// only one of callback and view_callback is bound, decode_callback only together with view_callback
 	FileSystem::ContentCallback callback;
-	Array<u8> data;
+	FileSystem::ContentViewCallback view_callback;
+	FileSystem::DecodeCallback decode_callback;
+	ContentView data;
 	StaticString<MAX_PATH_LENGTH> path;
 	u32 id = 0;
 	FlagSet<Flags, u32> flags;
 };
 
 
+// fifo, popped items are compacted away in batches, so finishing a request does not shift the whole array
+struct AsyncQueue
+{
+	explicit AsyncQueue(IAllocator& allocator) : allocator(allocator), items(allocator) {}
+
+	bool empty() const { return head == (u32)items.size(); }
+
+	void pop(AsyncItem& item)
+	{
+		ASSERT(!empty());
+		item = static_cast<AsyncItem&&>(items[head]);
+		++head;
+		if (head == (u32)items.size()) {
+			items.clear();
+			head = 0;
+		}
+		else if (head >= 64 && head * 2 >= (u32)items.size()) {
+			Array<AsyncItem> tmp(allocator);
+			tmp.reserve(items.size() - head);
+			for (u32 i = head, c = items.size(); i < c; ++i) {
+				tmp.emplace(static_cast<AsyncItem&&>(items[i]));
+			}
+			items.swap(tmp);
+			head = 0;
+		}
+	}
+
+	IAllocator& allocator;
+	Array<AsyncItem> items;
+	u32 head = 0;
+};
+
+
 struct FileSystemImpl;
 
 
+// read request whose decode callback is called on a job worker
+struct DecodeJob
+{
+	FileSystemImpl* fs;
+	AsyncItem item;
+	JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
+};
+
+
 class FSTask final : public MT::Task
 {
 public:
@@ -80,44 +216,67 @@ public:
 	~FSTask() = default;
 
 
-	void stop();
+	void stop() { m_finish = true; }
 	int task() override;
 
+	// request being read, guarded by FileSystemImpl::m_mutex
+	u32 m_current_id = 0;
+	bool m_current_canceled = false;
+
 private:
 	FileSystemImpl& m_fs;
-	bool m_finish = false;
+	volatile bool m_finish = false;
 };
 
 
 struct FileSystemImpl final : public FileSystem
 {
-	explicit FileSystemImpl(const char* base_path, IAllocator& allocator)
+	explicit FileSystemImpl(const char* base_path, IAllocator& allocator, u32 workers_count)
 		: m_allocator(allocator)
-		, m_queue(allocator)	
+		, m_tasks(allocator)
+		, m_queues{AsyncQueue(allocator), AsyncQueue(allocator), AsyncQueue(allocator)}
 		, m_finished(allocator)	
+		, m_dispatched(allocator)
+		, m_decoding(allocator)
 		, m_last_id(0)
-		, m_semaphore(0, 0xffFF)
-		, m_bundled(allocator)
-		, m_bundled_map(allocator)
+		, m_semaphore(0, 0x7fffFFFF)
+		, m_bundle(allocator)
 	{
 		setBasePath(base_path);
 		loadBundled();
-		m_task = LUMIX_NEW(m_allocator, FSTask)(*this, m_allocator);
-		m_task->create("Filesystem", true);
+		if (workers_count == 0) workers_count = clamp(MT::getCPUsCount() / 2, 1u, 4u);
+		for (u32 i = 0; i < workers_count; ++i) {
+			FSTask* task = LUMIX_NEW(m_allocator, FSTask)(*this, m_allocator);
+			task->create("Filesystem", true);
+			m_tasks.push(task);
+		}
 	}
 
 
 	~FileSystemImpl()
 	{
-		m_task->stop();
-		m_task->destroy();
-		LUMIX_DELETE(m_allocator, m_task);
+		for (FSTask* task : m_tasks) task->stop();
+		for (FSTask* task : m_tasks) m_semaphore.signal();
+		for (FSTask* task : m_tasks) {
+			task->destroy();
+			LUMIX_DELETE(m_allocator, task);
+		}
+		// decode jobs access this
+		for (;;) {
+			JobSystem::SignalHandle signal;
+			{
+				MT::CriticalSectionLock lock(m_mutex);
+				if (m_decoding.empty()) break;
+				signal = m_decoding.back()->signal;
+			}
+			JobSystem::wait(signal);
+		}
 	}
 
 
 	void loadBundled() {
 		#ifdef _WIN32
-			HRSRC hrsrc = FindResource(GetModuleHandle(NULL), MAKEINTRESOURCE(102), "TAR");
+			HRSRC hrsrc = FindResource(GetModuleHandle(NULL), MAKEINTRESOURCE(102), "PACK");
 			if (!hrsrc) return;
 			HGLOBAL hglobal = LoadResource(GetModuleHandle(NULL), hrsrc);
 			if (!hglobal) return;
@@ -130,25 +289,9 @@ struct FileSystemImpl final : public FileSystem
 			GetModuleFileName(NULL, exe_path, MAX_PATH_LENGTH);
 
 			m_bundled_last_modified = OS::getLastModified(exe_path);
-			m_bundled.resize((int)size);
-			memcpy(m_bundled.begin(), res_mem, m_bundled.byte_size());
-			InputMemoryStream str(m_bundled.begin(), m_bundled.byte_size());
-
-			UnlockResource(res_mem);
-
-			TarHeader header;
-			while (str.getPosition() < str.size()) {
-				const u8* ptr = (const u8*)str.getData() + str.getPosition();
-				str.read(&header, sizeof(header));
-				u32 size;
-				fromCStringOctal(Span(header.size, sizeof(header.size)), Ref(size)); 
-				if (header.name[0] && header.typeflag == 0 || header.typeflag == '0') {
-					Path path(header.name);
-					m_bundled_map.insert(path.getHash(), ptr);
-				}
-
-				str.setPosition(str.getPosition() + (512 - str.getPosition() % 512) % 512);
-				str.setPosition(str.getPosition() + size + (512 - size % 512) % 512);
+			// resources are mapped with the module and stay valid until it is unloaded, so the pack is not copied
+			if (!m_bundle.open(res_mem, size)) {
+				logError("Engine") << "Bundled data are corrupted or in an unsupported format";
 			}
 		#endif
 	}
@@ -157,7 +300,13 @@ struct FileSystemImpl final : public FileSystem
 	bool hasWork() override
 	{
 		MT::CriticalSectionLock lock(m_mutex);
-		return !m_queue.empty();
+		for (const AsyncQueue& queue : m_queues) {
+			if (!queue.empty()) return true;
+		}
+		for (const FSTask* task : m_tasks) {
+			if (task->m_current_id != 0) return true;
+		}
+		return !m_decoding.empty();
 	}
 
 
@@ -173,21 +322,58 @@ struct FileSystemImpl final : public FileSystem
 		}
 	}
 
+	void setMinMappedSize(u64 size) override { m_min_mapped_size = size; }
+
+
+	// views of stored bundled files point directly to the bundle, compressed files are decompressed to the heap
+	bool getBundledContent(u32 path_hash, Ref<ContentView> content) const
+	{
+		const PackEntry* entry = m_bundle.find(path_hash);
+		if (!entry) return false;
+
+		const u8* stored = m_bundle.getStoredData(*entry);
+		if (stored) {
+			content = ContentView(nullptr, stored, entry->size);
+			return true;
+		}
+
+		content = allocateContent(m_allocator, entry->size);
+		return m_bundle.read(*entry, 0, entry->size, (u8*)content->data());
+	}
+
+
+	bool readContent(const char* path, Ref<ContentView> content)
+	{
+		OS::InputFile file;
+		const StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path);
+		if (!file.open(full_path)) return getBundledContent(crc32(path), content);
+
+		const u64 size = file.size();
+		if (m_min_mapped_size > 0 && size >= m_min_mapped_size) {
+			file.close();
+			content = mapContent(m_allocator, full_path);
+			if (content->data()) return true;
+			// fallback to read
+			if (!file.open(full_path)) return false;
+		}
+
+		content = allocateContent(m_allocator, size);
+		const bool success = file.read((u8*)content->data(), size);
+		file.close();
+		return success;
+	}
+
+
 	bool getContentSync(const Path& path, Ref<Array<u8>> content) override {
 		OS::InputFile file;
 		StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path.c_str());
 
 		if (!file.open(full_path)) {
-			auto iter = m_bundled_map.find(path.getHash());
-			if (iter.isValid()) {
-				const TarHeader* header = (const TarHeader*)iter.value();
-				u32 size;
-				fromCStringOctal(Span(header->size), Ref(size));
-				content->resize(size);
-				copyMemory(content->begin(), iter.value() + 512, content->byte_size());
-				return true;
-			}
-			return false;
+			const PackEntry* entry = m_bundle.find(path.getHash());
+			if (!entry) return false;
+
+			content->resize((int)entry->size);
+			return m_bundle.read(*entry, 0, entry->size, content->begin());
 		}
 
 		content->resize((int)file.size());
@@ -199,32 +385,125 @@ struct FileSystemImpl final : public FileSystem
 		return true;
 	}
 
-	AsyncHandle getContent(const Path& file, const ContentCallback& callback) override
+	// called with m_mutex locked
+	AsyncItem& pushRequest(const Path& file, Priority priority)
 	{
-		if (!file.isValid()) return AsyncHandle::invalid();
-
-		MT::CriticalSectionLock lock(m_mutex);
-		AsyncItem& item = m_queue.emplace(m_allocator);
+		AsyncItem& item = m_queues[(int)priority].items.emplace();
 		++m_last_id;
 		if (m_last_id == 0) ++m_last_id;
 		item.id = m_last_id;
 		item.path = file.c_str();
-		item.callback = callback;
 		m_semaphore.signal();
+		return item;
+	}
+
+
+	AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority) override
+	{
+		if (!file.isValid()) return AsyncHandle::invalid();
+
+		MT::CriticalSectionLock lock(m_mutex);
+		AsyncItem& item = pushRequest(file, priority);
+		item.callback = callback;
 		return AsyncHandle(item.id);
 	}
 
 
+	AsyncHandle getContentView(const Path& file, const ContentViewCallback& callback, Priority priority) override
+	{
+		if (!file.isValid()) return AsyncHandle::invalid();
+
+		MT::CriticalSectionLock lock(m_mutex);
+		AsyncItem& item = pushRequest(file, priority);
+		item.view_callback = callback;
+		return AsyncHandle(item.id);
+	}
+
+
+	AsyncHandle getContentDecoded(const Path& file, const DecodeCallback& decode, const ContentViewCallback& callback, Priority priority) override
+	{
+		if (!file.isValid()) return AsyncHandle::invalid();
+
+		MT::CriticalSectionLock lock(m_mutex);
+		AsyncItem& item = pushRequest(file, priority);
+		item.decode_callback = decode;
+		item.view_callback = callback;
+		return AsyncHandle(item.id);
+	}
+
+
+	// called with m_mutex locked, so the signal is set before cancel can see the job
+	void startDecode(AsyncItem&& item)
+	{
+		DecodeJob* job = LUMIX_NEW(m_allocator, DecodeJob);
+		job->fs = this;
+		job->item = static_cast<AsyncItem&&>(item);
+		m_decoding.push(job);
+		JobSystem::run(job, &FileSystemImpl::decodeJob, &job->signal);
+	}
+
+
+	static void decodeJob(void* data)
+	{
+		DecodeJob* job = (DecodeJob*)data;
+		FileSystemImpl& fs = *job->fs;
+		fs.m_mutex.enter();
+		const bool canceled = job->item.isCanceled();
+		fs.m_mutex.exit();
+
+		if (!canceled) job->item.decode_callback.invoke(job->item.data);
+
+		{
+			MT::CriticalSectionLock lock(fs.m_mutex);
+			fs.m_decoding.swapAndPopItem(job);
+			if (!job->item.isCanceled()) fs.m_finished.emplace(static_cast<AsyncItem&&>(job->item));
+		}
+		// content of canceled items is released outside of the lock
+		LUMIX_DELETE(fs.m_allocator, job);
+	}
+
+
 	void cancel(AsyncHandle async) override
+	{
+		JobSystem::SignalHandle decoding = JobSystem::INVALID_HANDLE;
+		markCanceled(async, Ref(decoding));
+		// the caller can destroy what decode uses right after cancel returns
+		if (JobSystem::isValid(decoding)) JobSystem::wait(decoding);
+	}
+
+
+	void markCanceled(AsyncHandle async, Ref<JobSystem::SignalHandle> decoding)
 	{
 		MT::CriticalSectionLock lock(m_mutex);
-		for (AsyncItem& item : m_queue) {
+		for (AsyncQueue& queue : m_queues) {
+			for (u32 i = queue.head, c = queue.items.size(); i < c; ++i) {
+				if (queue.items[i].id == async.value) {
+					queue.items[i].flags.set(AsyncItem::Flags::CANCELED);
+					return;
+				}
+			}
+		}
+		for (FSTask* task : m_tasks) {
+			if (task->m_current_id == async.value) {
+				task->m_current_canceled = true;
+				return;
+			}
+		}
+		for (DecodeJob* job : m_decoding) {
+			if (job->item.id == async.value) {
+				job->item.flags.set(AsyncItem::Flags::CANCELED);
+				decoding = job->signal;
+				return;
+			}
+		}
+		for (AsyncItem& item : m_finished) {
 			if (item.id == async.value) {
 				item.flags.set(AsyncItem::Flags::CANCELED);
 				return;
 			}
 		}
-		for (AsyncItem& item : m_finished) {
+		// callbacks can cancel requests dispatched in the same update
+		for (AsyncItem& item : m_dispatched) {
 			if (item.id == async.value) {
 				item.flags.set(AsyncItem::Flags::CANCELED);
 				return;
@@ -233,6 +512,19 @@ struct FileSystemImpl final : public FileSystem
 	}
 
 
+	// highest priority first
+	bool popRequest(AsyncItem& item)
+	{
+		for (AsyncQueue& queue : m_queues) {
+			if (!queue.empty()) {
+				queue.pop(item);
+				return true;
+			}
+		}
+		return false;
+	}
+
+
 	bool open(const char* path, Ref<OS::InputFile> file) override
 	{
 		StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path);
@@ -268,16 +560,13 @@ struct FileSystemImpl final : public FileSystem
 		StaticString<MAX_PATH_LENGTH> full_path_to(m_base_path, to);
 		if (OS::copyFile(full_path_from, full_path_to)) return true;
 
-		auto iter = m_bundled_map.find(crc32(from));
-		if(!iter.isValid()) return false;
+		ContentView content;
+		if (!getBundledContent(crc32(from), Ref(content))) return false;
 
 		OS::OutputFile file;
 		if(!file.open(full_path_to)) return false;
 
-		u32 size;
-		TarHeader* header = (TarHeader*)iter.value();
-		fromCStringOctal(Span(header->size), Ref(size));
-		const bool res = file.write(iter.value() + 512, size);
+		const bool res = file.write(content.data(), content.size());
 		file.close();
 		return res;
 	}
@@ -287,7 +576,7 @@ struct FileSystemImpl final : public FileSystem
 	{
 		StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path);
 		if (!OS::fileExists(full_path)) {
-			return (m_bundled_map.find(crc32(path)).isValid());
+			return m_bundle.find(crc32(path)) != nullptr;
 		}
 		return true;
 	}
@@ -297,7 +586,7 @@ struct FileSystemImpl final : public FileSystem
 	{
 		StaticString<MAX_PATH_LENGTH> full_path(m_base_path, path);
 		const u64 res = OS::getLastModified(full_path);
-		if (!res && m_bundled_map.find(crc32(path)).isValid()) {
+		if (!res && m_bundle.find(crc32(path))) {
 			return m_bundled_last_modified;
 		}
 		return res;
@@ -315,34 +604,49 @@ struct FileSystemImpl final : public FileSystem
 	{
 		PROFILE_FUNCTION();
 
-		for(;;) {
-			m_mutex.enter();
-			if (m_finished.empty()) {
-				m_mutex.exit();
-				break;
-			}
-
-			AsyncItem item = static_cast<AsyncItem&&>(m_finished[0]);
-			m_finished.erase(0);
+		{
+			MT::CriticalSectionLock lock(m_mutex);
+			// nonempty m_dispatched means we are called from a callback
+			if (m_finished.empty() || !m_dispatched.empty()) return;
+			m_dispatched.swap(m_finished);
+		}
 
+		for (int i = 0; i < m_dispatched.size(); ++i) {
+			m_mutex.enter();
+			const bool canceled = m_dispatched[i].isCanceled();
 			m_mutex.exit();
 
-			if(!item.isCanceled()) {
-				item.callback.invoke(item.data.size(), item.data.begin(), !item.isFailed());
+			AsyncItem& item = m_dispatched[i];
+			if (canceled) continue;
+			if (item.view_callback.isValid()) {
+				item.view_callback.invoke(item.data, !item.isFailed());
+			}
+			else {
+				item.callback.invoke(item.data.size(), item.data.data(), !item.isFailed());
 			}
 		}
+
+		// releases views nobody kept, outside of the lock since that can free their memory
+		Array<AsyncItem> dispatched(m_allocator);
+		m_mutex.enter();
+		dispatched.swap(m_dispatched);
+		m_mutex.exit();
+		dispatched.clear();
 	}
 
 	IAllocator& m_allocator;
-	FSTask* m_task;
+	Array<FSTask*> m_tasks;
 	StaticString<MAX_PATH_LENGTH> m_base_path;
-	Array<AsyncItem> m_queue;
+	AsyncQueue m_queues[(int)Priority::COUNT];
 	Array<AsyncItem> m_finished;
-	Array<u8> m_bundled;
-	HashMap<u32, const u8*> m_bundled_map;
+	// finished items whose callbacks are being called
+	Array<AsyncItem> m_dispatched;
+	Array<DecodeJob*> m_decoding;
+	PackFile m_bundle;
 	u64 m_bundled_last_modified;
 	MT::CriticalSection m_mutex;
 	MT::Semaphore m_semaphore;
+	u64 m_min_mapped_size = 64 * 1024;
 
 	u32 m_last_id;
 };
@@ -350,76 +654,48 @@ struct FileSystemImpl final : public FileSystem
 
 int FSTask::task()
 {
+	AsyncItem item;
 	while (!m_finish) {
 		m_fs.m_semaphore.wait();
 		if (m_finish) break;
 
-		StaticString<MAX_PATH_LENGTH> path;
 		{
 			MT::CriticalSectionLock lock(m_fs.m_mutex);
-			ASSERT(!m_fs.m_queue.empty());
-			path = m_fs.m_queue[0].path;
-			if (m_fs.m_queue[0].isCanceled()) {
-				m_fs.m_queue.erase(0);
-				continue;
-			}
+			if (!m_fs.popRequest(item)) continue;
+			if (item.isCanceled()) continue;
+			m_current_id = item.id;
+			m_current_canceled = false;
 		}
 
-		bool success = true;
-		
-		Array<u8> data(m_fs.m_allocator);
-
-		OS::InputFile file;
-		StaticString<MAX_PATH_LENGTH> full_path(m_fs.m_base_path, path);
-		
-		if (file.open(full_path)) {
-			data.resize((int)file.size());
-			if (!file.read(data.begin(), data.byte_size())) {
-				success = false;
-			}
-			file.close();
-		}
-		else {
-			auto iter = m_fs.m_bundled_map.find(crc32(path));
-			if (iter.isValid()) {
-				const TarHeader* header = (const TarHeader*)iter.value();
-				u32 size;
-				fromCStringOctal(Span(header->size), Ref(size));
-				data.resize(size);
-				copyMemory(data.begin(), iter.value() + 512, data.byte_size());
-				success = true;
-			}
-			else {
-				success = false;
-			}
-		}
+		PROFILE_BLOCK("read file");
+		const bool success = m_fs.readContent(item.path, Ref(item.data));
 
 		{
 			MT::CriticalSectionLock lock(m_fs.m_mutex);
-			if (!m_fs.m_queue[0].isCanceled()) {
-				m_fs.m_finished.emplace(static_cast<AsyncItem&&>(m_fs.m_queue[0]));
-				m_fs.m_finished.back().data = static_cast<Array<u8>&&>(data);
-				if(!success) {
-					m_fs.m_finished.back().flags.set(AsyncItem::Flags::FAILED);
+			if (!m_current_canceled) {
+				if (!success) {
+					item.flags.set(AsyncItem::Flags::FAILED);
+					m_fs.m_finished.emplace(static_cast<AsyncItem&&>(item));
+				}
+				else if (item.decode_callback.isValid()) {
+					m_fs.startDecode(static_cast<AsyncItem&&>(item));
+				}
+				else {
+					m_fs.m_finished.emplace(static_cast<AsyncItem&&>(item));
 				}
-				m_fs.m_queue.erase(0);
 			}
+			m_current_id = 0;
 		}
+		// canceled while reading, unmapping is not done under the lock
+		item.data.reset();
 	}
 	return 0;
 }
 
 
-void FSTask::stop()
-{
-	m_finish = true;
-	m_fs.m_semaphore.signal();
-}
-
-
-FileSystem* FileSystem::create(const char* base_path, IAllocator& allocator)
+FileSystem* FileSystem::create(const char* base_path, IAllocator& allocator, u32 workers_count)
 {
-	return LUMIX_NEW(allocator, FileSystemImpl)(base_path, allocator);
+	return LUMIX_NEW(allocator, FileSystemImpl)(base_path, allocator, workers_count);
 }
 
 void FileSystem::destroy(FileSystem* fs)
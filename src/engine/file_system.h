@@ -16,10 +16,50 @@ namespace OS
 	class OutputFile;
 }
 
+// read-only content of a file, copies share the memory, which is released with the last copy
+// resources can keep a copy instead of copying the data
+// the memory is either a heap copy, a memory mapped file or a stored entry of the bundle, which is never released
+class LUMIX_ENGINE_API ContentView
+{
+public:
+	struct Block;
+
+	ContentView() {}
+	ContentView(Block* block, const u8* data, u64 size);
+	ContentView(const ContentView& rhs);
+	ContentView(ContentView&& rhs);
+	~ContentView();
+
+	void operator =(const ContentView& rhs);
+	void operator =(ContentView&& rhs);
+
+	const u8* data() const { return m_data; }
+	u64 size() const { return m_size; }
+	void reset();
+
+private:
+	Block* m_block = nullptr;
+	const u8* m_data = nullptr;
+	u64 m_size = 0;
+};
+
+
 class LUMIX_ENGINE_API FileSystem
 {
 public:
 	using ContentCallback = Delegate<void(u64, const u8*, bool)>;
+	using ContentViewCallback = Delegate<void(const ContentView&, bool)>;
+	using DecodeCallback = Delegate<void(const ContentView&)>;
+
+	// requests with higher priority are read first, requests with the same priority in order
+	enum class Priority : u8
+	{
+		HIGH, // needed right now, e.g. visible
+		NORMAL,
+		BACKGROUND, // prefetch
+
+		COUNT
+	};
 
 	struct LUMIX_ENGINE_API AsyncHandle {
 		static AsyncHandle invalid() { return AsyncHandle(0xffFFffFF); }
@@ -28,7 +68,8 @@ public:
 		bool isValid() const { return value != 0xffFFffFF; }
 	};
 
-	static FileSystem* create(const char* base_path, IAllocator& allocator);
+	// workers_count == 0 picks a count based on the number of cpus
+	static FileSystem* create(const char* base_path, IAllocator& allocator, u32 workers_count = 0);
 	static void destroy(FileSystem* fs);
 
 	virtual ~FileSystem() {}
@@ -43,12 +84,22 @@ public:
 	virtual bool open(const char* path, Ref<OS::OutputFile> file) = 0;
 
 	virtual void setBasePath(const char* path) = 0;
+	// files at least this big are memory mapped instead of read, 0 disables mapping
+	// mapped files can not be overwritten while there is a view of them
+	virtual void setMinMappedSize(u64 size) = 0;
 	virtual const char* getBasePath() const = 0;
 	virtual void updateAsyncTransactions() = 0;
 	virtual bool hasWork() = 0;
 
 	virtual bool getContentSync(const Path& file, Ref<Array<u8>> content) =  0;
-	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback) = 0;
+	// callback is called from updateAsyncTransactions on the thread calling it, in the order in which reads finish
+	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority = Priority::NORMAL) = 0;
+	// same as getContent, but the callback can keep a copy of the view
+	virtual AsyncHandle getContentView(const Path& file, const ContentViewCallback& callback, Priority priority = Priority::NORMAL) = 0;
+	// decode is called on a job worker once the file is read successfully, callback afterwards the same as in getContentView
+	// the request is not finished, i.e. hasWork returns true, until decode returns
+	// canceling a request waits until its decode returns, so decode can not outlive its owner
+	virtual AsyncHandle getContentDecoded(const Path& file, const DecodeCallback& decode, const ContentViewCallback& callback, Priority priority = Priority::NORMAL) = 0;
 	virtual void cancel(AsyncHandle handle) = 0;
 };
 
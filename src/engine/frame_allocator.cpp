@@ -0,0 +1,201 @@
+#include "frame_allocator.h"
+#include "engine/log.h"
+#include "engine/math.h"
+#include "engine/mt/atomic.h"
+#include "engine/os.h"
+#include <string.h>
+
+
+namespace Lumix
+{
+
+
+// size of the block is stored right in front of it, so reallocate knows how much to copy
+struct FrameAllocationHeader
+{
+	u32 size;
+	u32 padding;
+};
+
+
+struct FrameThreadChunk
+{
+	const FrameAllocator* allocator = nullptr;
+	i32 generation = 0;
+	u8* pos = nullptr;
+	u8* end = nullptr;
+	// the last allocation can grow in place
+	u8* last = nullptr;
+};
+
+
+static thread_local FrameThreadChunk g_thread_chunk;
+
+
+static LUMIX_FORCE_INLINE u8* alignPtr(u8* ptr, size_t align)
+{
+	return (u8*)(((uintptr)ptr + align - 1) & ~uintptr(align - 1));
+}
+
+
+FrameAllocator::FrameAllocator(IAllocator& fallback)
+	: m_fallback(fallback)
+{
+	for (Buffer& buffer : m_buffers) {
+		buffer.mem = (u8*)OS::memReserve(BUFFER_SIZE);
+		LUMIX_FATAL(buffer.mem);
+	}
+}
+
+
+FrameAllocator::~FrameAllocator()
+{
+	for (Buffer& buffer : m_buffers) {
+		OS::memRelease(buffer.mem);
+	}
+}
+
+
+void FrameAllocator::reset()
+{
+	// the buffer is reused two frames after it was filled, nobody can use it anymore
+	Buffer& buffer = m_buffers[(m_generation + 1) & 1];
+	buffer.top = 0;
+	MT::memoryBarrier();
+	// every thread's chunk belongs to the previous generation now
+	MT::atomicIncrement(&m_generation);
+}
+
+
+bool FrameAllocator::owns(const void* ptr) const
+{
+	for (const Buffer& buffer : m_buffers) {
+		if (ptr >= buffer.mem && ptr < buffer.mem + BUFFER_SIZE) return true;
+	}
+	return false;
+}
+
+
+// atomicAdd does not return the same value on all platforms, so the top is moved with a cas
+u8* FrameAllocator::bump(Buffer& buffer, u32 size)
+{
+	i32 top;
+	for (;;) {
+		top = buffer.top;
+		if ((u64)top + size > BUFFER_SIZE) return nullptr;
+		if (MT::compareAndExchange(&buffer.top, top + size, top)) break;
+	}
+
+	const u32 end = top + size;
+	if (end > buffer.committed) {
+		MT::CriticalSectionLock lock(m_commit_mutex);
+		if (end > buffer.committed) {
+			const u32 committed = minimum((end + COMMIT_GRANULARITY - 1) & ~(COMMIT_GRANULARITY - 1), (u32)BUFFER_SIZE);
+			OS::memCommit(buffer.mem + buffer.committed, committed - buffer.committed);
+			buffer.committed = committed;
+		}
+	}
+	return buffer.mem + top;
+}
+
+
+void* FrameAllocator::allocate_aligned(size_t size, size_t align)
+{
+	align = maximum(align, alignof(FrameAllocationHeader));
+	const size_t needed = size + align + sizeof(FrameAllocationHeader);
+	const i32 generation = m_generation;
+	Buffer& buffer = m_buffers[generation & 1];
+
+	FrameThreadChunk& chunk = g_thread_chunk;
+	if (chunk.allocator != this || chunk.generation != generation) {
+		chunk = {};
+		chunk.allocator = this;
+		chunk.generation = generation;
+	}
+
+	u8* ptr = chunk.pos ? alignPtr(chunk.pos + sizeof(FrameAllocationHeader), align) : nullptr;
+	if (!ptr || ptr + size > chunk.end) {
+		u8* mem = nullptr;
+		if (needed <= CHUNK_SIZE / 4) {
+			mem = bump(buffer, CHUNK_SIZE);
+			if (mem) {
+				chunk.pos = mem;
+				chunk.end = mem + CHUNK_SIZE;
+				ptr = alignPtr(chunk.pos + sizeof(FrameAllocationHeader), align);
+			}
+		}
+		else if (needed <= BUFFER_SIZE) {
+			// big blocks get their own space, so the rest of the current chunk is not wasted
+			mem = bump(buffer, (u32)needed);
+			if (mem) {
+				ptr = alignPtr(mem + sizeof(FrameAllocationHeader), align);
+				((FrameAllocationHeader*)ptr)[-1].size = (u32)size;
+				return ptr;
+			}
+		}
+
+		if (!mem) {
+			if (!m_overflow_reported) {
+				m_overflow_reported = true;
+				logWarning("Engine") << "Frame allocator is out of memory, using the fallback allocator.";
+			}
+			return m_fallback.allocate_aligned(size, align);
+		}
+	}
+
+	((FrameAllocationHeader*)ptr)[-1].size = (u32)size;
+	chunk.pos = ptr + size;
+	chunk.last = ptr;
+	return ptr;
+}
+
+
+void FrameAllocator::deallocate_aligned(void* ptr)
+{
+	if (ptr && !owns(ptr)) m_fallback.deallocate_aligned(ptr);
+}
+
+
+void* FrameAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
+{
+	if (!ptr) return allocate_aligned(size, align);
+	if (!owns(ptr)) return m_fallback.reallocate_aligned(ptr, size, align);
+	if (size == 0) return nullptr;
+
+	FrameAllocationHeader& header = ((FrameAllocationHeader*)ptr)[-1];
+	FrameThreadChunk& chunk = g_thread_chunk;
+	if (chunk.allocator == this
+		&& chunk.generation == m_generation
+		&& chunk.last == ptr
+		&& (u8*)ptr + size <= chunk.end)
+	{
+		header.size = (u32)size;
+		chunk.pos = (u8*)ptr + size;
+		return ptr;
+	}
+
+	void* new_ptr = allocate_aligned(size, align);
+	memcpy(new_ptr, ptr, minimum((size_t)header.size, size));
+	return new_ptr;
+}
+
+
+void* FrameAllocator::allocate(size_t size)
+{
+	return allocate_aligned(size, alignof(FrameAllocationHeader));
+}
+
+
+void FrameAllocator::deallocate(void* ptr)
+{
+	deallocate_aligned(ptr);
+}
+
+
+void* FrameAllocator::reallocate(void* ptr, size_t size)
+{
+	return reallocate_aligned(ptr, size, alignof(FrameAllocationHeader));
+}
+
+
+} // namespace Lumix
@@ -0,0 +1,57 @@
+#pragma once
+
+
+#include "engine/allocator.h"
+#include "engine/mt/sync.h"
+
+
+namespace Lumix
+{
+
+
+// linear allocator for transient data, memory stays valid until the end of the next frame
+// deallocate does nothing, everything allocated in one frame is released at once two resets later
+// each thread bumps its own chunk, so allocations do not lock
+class LUMIX_ENGINE_API FrameAllocator final : public IAllocator
+{
+public:
+	// fallback is used when a frame runs out of reserved memory
+	explicit FrameAllocator(IAllocator& fallback);
+	~FrameAllocator();
+
+	// called once per frame, releases memory allocated two frames ago
+	void reset();
+
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t size) override;
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+
+private:
+	enum : u32 {
+		BUFFER_SIZE = 256 * 1024 * 1024,
+		CHUNK_SIZE = 64 * 1024,
+		COMMIT_GRANULARITY = 1024 * 1024
+	};
+
+	struct Buffer
+	{
+		u8* mem = nullptr;
+		volatile i32 top = 0;
+		volatile u32 committed = 0;
+	};
+
+	u8* bump(Buffer& buffer, u32 size);
+	bool owns(const void* ptr) const;
+
+	IAllocator& m_fallback;
+	Buffer m_buffers[2];
+	MT::CriticalSection m_commit_mutex;
+	volatile i32 m_generation = 0;
+	bool m_overflow_reported = false;
+};
+
+
+} // namespace Lumix
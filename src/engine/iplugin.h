@@ -17,6 +17,22 @@ namespace Lumix
 
 	struct LUMIX_ENGINE_API IScene
 	{
+		// what update and lateUpdate touch, scenes which do not conflict are updated concurrently on workers
+		struct UpdateDependencies
+		{
+			enum { MAX_SCENES = 8 };
+
+			// updated on the main thread and never concurrently with other scenes
+			bool exclusive = true;
+			bool reads_transforms = false;
+			// transform listeners run inside the writer's update, so writers conflict with all scenes touching transforms
+			bool writes_transforms = false;
+			// other scenes by plugin name, a scene always writes its own data
+			// writing "lua_script" runs script callbacks, which conflicts with all scenes
+			const char* reads[MAX_SCENES] = {};
+			const char* writes[MAX_SCENES] = {};
+		};
+
 		virtual ~IScene() {}
 
 		virtual void serialize(OutputMemoryStream& serializer) = 0;
@@ -26,6 +42,7 @@ namespace Lumix
 		virtual IPlugin& getPlugin() const = 0;
 		virtual void update(float time_delta, bool paused) = 0;
 		virtual void lateUpdate(float time_delta, bool paused) {}
+		virtual void getUpdateDependencies(UpdateDependencies& deps) const {}
 		virtual Universe& getUniverse() = 0;
 		virtual void startGame() {}
 		virtual void stopGame() {}
@@ -25,6 +25,16 @@ enum {
 };
 
 
+enum {
+	SIGNALS_PER_SEGMENT = 1024,
+	MAX_SIGNAL_SEGMENTS = (HANDLE_ID_MASK + 1) / SIGNALS_PER_SEGMENT,
+	INVALID_FREE_SIGNAL = 0xffFFffFF,
+	FIBER_STACK_SIZE = 64 * 1024,
+	// free fibers above this count lose their stacks when a worker goes idle
+	IDLE_FIBERS_KEEP = 64
+};
+
+
 struct Job
 {
 	void (*task)(void*) = nullptr;
@@ -32,6 +42,7 @@ struct Job
 	SignalHandle dec_on_finish;
 	SignalHandle precondition;
 	u8 worker_index;
+	Priority priority = Priority::NORMAL;
 };
 
 
@@ -40,12 +51,84 @@ struct Signal {
 	u32 generation;
 	Job next_job;
 	SignalHandle sibling;
+	u32 next_free;
+};
+
+
+// signals live in fixed segments, so pointers to them stay valid while the pool grows
+struct SignalSegment {
+	Signal signals[SIGNALS_PER_SEGMENT];
+	u32 free_head = INVALID_FREE_SIGNAL;
+	u32 used = 0;
 };
 
 
 struct WorkerTask;
 
 
+// Chase-Lev work stealing deque, only the owner can push and pop, anyone can steal
+struct WorkStealingQueue
+{
+	enum { CAPACITY = 4096, MASK = CAPACITY - 1 };
+
+	bool push(const Job& job)
+	{
+		const i64 b = m_bottom;
+		const i64 t = m_top;
+		if (b - t >= CAPACITY) return false;
+
+		m_jobs[b & MASK] = job;
+		MT::memoryBarrier();
+		m_bottom = b + 1;
+		return true;
+	}
+
+
+	bool pop(Job* job)
+	{
+		const i64 b = m_bottom - 1;
+		m_bottom = b;
+		MT::memoryBarrier();
+		const i64 t = m_top;
+		if (t > b) {
+			m_bottom = b + 1;
+			return false;
+		}
+
+		*job = m_jobs[b & MASK];
+		if (t != b) return true;
+
+		// last job, race with thieves
+		const bool won = MT::compareAndExchange64(&m_top, t + 1, t);
+		m_bottom = b + 1;
+		return won;
+	}
+
+
+	bool steal(Job* job)
+	{
+		const i64 t = m_top;
+		MT::memoryBarrier();
+		const i64 b = m_bottom;
+		if (t >= b) return false;
+
+		// the slot can not be overwritten before top moves, so a torn copy is always rejected by the cas
+		const Job tmp = m_jobs[t & MASK];
+		if (!MT::compareAndExchange64(&m_top, t + 1, t)) return false;
+		*job = tmp;
+		return true;
+	}
+
+
+	bool isEmpty() const { return m_bottom <= m_top; }
+
+
+	alignas(64) volatile i64 m_top = 0;
+	alignas(64) volatile i64 m_bottom = 0;
+	alignas(64) Job m_jobs[CAPACITY];
+};
+
+
 struct FiberDecl
 {
 	int idx;
@@ -58,6 +141,7 @@ struct FiberDecl
 #else
 	static void manage(void* data);
 #endif
+static FiberDecl* popFreeFiber();
 
 struct System
 {
@@ -65,39 +149,57 @@ struct System
 		: m_allocator(allocator)
 		, m_workers(allocator)
 		, m_job_queue(allocator)
+		, m_high_priority_job_queue(allocator)
+		, m_background_job_queue(allocator)
 		, m_ready_fibers(allocator)
-		, m_signals_pool(allocator)
-		, m_work_signal(true)
+		, m_background_ready_fibers(allocator)
 		, m_event_outside_job(true)
-		, m_free_queue(allocator)
+		, m_fibers(allocator)
 		, m_free_fibers(allocator)
 		, m_backup_workers(allocator)
+		, m_parked_workers(allocator)
 	{
-		m_signals_pool.resize(4096);
-		m_free_queue.resize(4096);
 		m_event_outside_job.trigger();
-		m_work_signal.reset();
-		for(int i = 0; i < 4096; ++i) {
-			m_free_queue[i] = i;
-			m_signals_pool[i].sibling = JobSystem::INVALID_HANDLE;
-			m_signals_pool[i].generation = 0;
-		}
+		for (u32& gen : m_released_generations) gen = 0;
+		for (SignalSegment*& segment : m_signal_segments) segment = nullptr;
 	}
 
 
 	MT::CriticalSection m_sync;
 	MT::CriticalSection m_job_queue_sync;
+	MT::CriticalSection m_parked_sync;
 	MT::Event m_event_outside_job;
-	MT::Event m_work_signal;
 	Array<WorkerTask*> m_workers;
 	Array<WorkerTask*> m_backup_workers;
+	Array<WorkerTask*> m_parked_workers;
+	volatile i32 m_parked_count = 0;
+	// jobs pushed from threads which do not own a deque
 	Array<Job> m_job_queue;
-	Array<Signal> m_signals_pool;
-	FiberDecl m_fiber_pool[512];
+	Array<Job> m_high_priority_job_queue;
+	// background jobs are never in deques, so the limit can be checked in one place
+	Array<Job> m_background_job_queue;
+	volatile i32 m_background_running = 0;
+	i32 m_background_limit = 1;
+	// both pools are guarded by m_sync
+	SignalSegment* m_signal_segments[MAX_SIGNAL_SEGMENTS];
+	// generation a released segment continues from, so old handles never match a new signal
+	u32 m_released_generations[MAX_SIGNAL_SEGMENTS];
+	int m_signal_segments_count = 0;
+	u32 m_signals_used = 0;
+	u32 m_signals_high_water = 0;
+	Array<FiberDecl*> m_fibers;
 	Array<FiberDecl*> m_free_fibers;
+	u32 m_fiber_stacks_count = 0;
+	u32 m_fibers_high_water = 0;
+	bool m_counters_dirty = false;
+	u32 m_signals_counter;
+	u32 m_signals_high_water_counter;
+	u32 m_fibers_counter;
+	u32 m_fibers_high_water_counter;
 	Array<FiberDecl*> m_ready_fibers;
+	// resumed background jobs, those take a background slot again before they continue
+	Array<FiberDecl*> m_background_ready_fibers;
 	IAllocator& m_allocator;
-	Array<u32> m_free_queue;
 };
 
 
@@ -122,6 +224,7 @@ struct WorkerTask : MT::Task
 		, m_ready_fibers(system.m_allocator)
 		, m_enabled(true)
 		, m_work_signal(true)
+		, m_random_seed(worker_index * 2654435761u + 1)
 	{
 		m_enabled.reset();
 		m_work_signal.reset();
@@ -144,23 +247,32 @@ struct WorkerTask : MT::Task
 	#endif
 	{
 		g_system->m_sync.enter();
-		FiberDecl* fiber = g_system->m_free_fibers.back();
-		g_system->m_free_fibers.pop();
-		if (fiber->fiber == Fiber::INVALID_FIBER) {
-			fiber->fiber = Fiber::create(64 * 1024, manage, fiber);
-		}
+		FiberDecl* fiber = popFreeFiber();
 		getWorker()->m_current_fiber = fiber;
 		Fiber::switchTo(&getWorker()->m_primary_fiber, fiber->fiber);
 	}
 
 
+	u32 nextRandom()
+	{
+		m_random_seed ^= m_random_seed << 13;
+		m_random_seed ^= m_random_seed >> 17;
+		m_random_seed ^= m_random_seed << 5;
+		return m_random_seed;
+	}
+
+
+	WorkStealingQueue m_deques[2]; // Priority::HIGH and Priority::NORMAL
 	bool m_finished = false;
 	FiberDecl* m_current_fiber = nullptr;
 	Fiber::Handle m_primary_fiber;
 	System& m_system;
+	// jobs pinned to this worker and fibers resumed on it, guarded by m_queue_sync
+	MT::CriticalSection m_queue_sync;
 	Array<Job> m_job_queue;
 	Array<FiberDecl*> m_ready_fibers;
 	u8 m_worker_index;
+	u32 m_random_seed;
 	bool m_is_enabled = false;
 	bool m_is_backup = false;
 	MT::Event m_enabled;
@@ -168,54 +280,274 @@ struct WorkerTask : MT::Task
 };
 
 
-static LUMIX_FORCE_INLINE SignalHandle allocateSignal()
+static void pushPoolCounters()
+{
+	Profiler::pushCounter(g_system->m_signals_counter, (float)g_system->m_signals_used);
+	Profiler::pushCounter(g_system->m_signals_high_water_counter, (float)g_system->m_signals_high_water);
+	const u32 fibers_used = g_system->m_fibers.size() - g_system->m_free_fibers.size();
+	Profiler::pushCounter(g_system->m_fibers_counter, (float)fibers_used);
+	Profiler::pushCounter(g_system->m_fibers_high_water_counter, (float)g_system->m_fibers_high_water);
+}
+
+
+static LUMIX_FORCE_INLINE Signal* getSignal(SignalHandle handle)
 {
-	LUMIX_FATAL(!g_system->m_free_queue.empty());
+	const u32 id = handle & HANDLE_ID_MASK;
+	SignalSegment* segment = g_system->m_signal_segments[id / SIGNALS_PER_SEGMENT];
+	return segment ? &segment->signals[id % SIGNALS_PER_SEGMENT] : nullptr;
+}
+
+
+static SignalSegment* allocateSignalSegment()
+{
+	const int idx = g_system->m_signal_segments_count;
+	LUMIX_FATAL(idx < MAX_SIGNAL_SEGMENTS);
+
+	SignalSegment* segment = LUMIX_NEW(g_system->m_allocator, SignalSegment);
+	const u32 generation = g_system->m_released_generations[idx];
+	for (u32 i = 0; i < SIGNALS_PER_SEGMENT; ++i) {
+		Signal& signal = segment->signals[i];
+		signal.value = 0;
+		signal.generation = generation;
+		signal.sibling = JobSystem::INVALID_HANDLE;
+		signal.next_job.task = nullptr;
+		signal.next_free = i + 1 < SIGNALS_PER_SEGMENT ? i + 1 : INVALID_FREE_SIGNAL;
+	}
+	segment->free_head = 0;
+	g_system->m_signal_segments[idx] = segment;
+	++g_system->m_signal_segments_count;
+	return segment;
+}
+
 
-	const u32 handle = g_system->m_free_queue.back();
-	Signal& w = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
+// lower segments are preferred, so the top one can drain and be released when the system is idle
+static LUMIX_FORCE_INLINE SignalHandle allocateSignal()
+{
+	int segment_idx = 0;
+	while (segment_idx < g_system->m_signal_segments_count
+		&& g_system->m_signal_segments[segment_idx]->free_head == INVALID_FREE_SIGNAL)
+	{
+		++segment_idx;
+	}
+	SignalSegment* segment = segment_idx < g_system->m_signal_segments_count
+		? g_system->m_signal_segments[segment_idx]
+		: allocateSignalSegment();
+
+	const u32 idx = segment->free_head;
+	Signal& w = segment->signals[idx];
+	segment->free_head = w.next_free;
+	++segment->used;
 	w.value = 1;
 	w.sibling = JobSystem::INVALID_HANDLE;
 	w.next_job.task = nullptr;
-	g_system->m_free_queue.pop();
 
-	return handle & HANDLE_ID_MASK | w.generation;
+	++g_system->m_signals_used;
+	if (g_system->m_signals_used > g_system->m_signals_high_water) {
+		g_system->m_signals_high_water = g_system->m_signals_used;
+		g_system->m_counters_dirty = true;
+	}
+
+	return (segment_idx * SIGNALS_PER_SEGMENT + idx) | w.generation;
+}
+
+
+static void freeSignal(u32 id, Signal& signal)
+{
+	signal.generation = (((signal.generation >> 16) + 1) & 0xffFF) << 16;
+	signal.next_job.task = nullptr;
+	SignalSegment* segment = g_system->m_signal_segments[id / SIGNALS_PER_SEGMENT];
+	signal.next_free = segment->free_head;
+	segment->free_head = id % SIGNALS_PER_SEGMENT;
+	--segment->used;
+	--g_system->m_signals_used;
+}
+
+
+static FiberDecl* popFreeFiber()
+{
+	if (g_system->m_free_fibers.empty()) {
+		FiberDecl* decl = LUMIX_NEW(g_system->m_allocator, FiberDecl);
+		decl->idx = g_system->m_fibers.size();
+		g_system->m_fibers.push(decl);
+		g_system->m_free_fibers.push(decl);
+	}
+
+	FiberDecl* fiber = g_system->m_free_fibers.back();
+	g_system->m_free_fibers.pop();
+	if (fiber->fiber == Fiber::INVALID_FIBER) {
+		fiber->fiber = Fiber::create(FIBER_STACK_SIZE, manage, fiber);
+		if (fiber->fiber == Fiber::INVALID_FIBER) {
+			logError("Engine") << "Failed to create a fiber, " << g_system->m_fiber_stacks_count << " fiber stacks exist.";
+		}
+		// the caller is about to switch to it, there is nothing to fall back to
+		LUMIX_FATAL(fiber->fiber != Fiber::INVALID_FIBER);
+		++g_system->m_fiber_stacks_count;
+	}
+
+	const u32 used = g_system->m_fibers.size() - g_system->m_free_fibers.size();
+	if (used > g_system->m_fibers_high_water) {
+		g_system->m_fibers_high_water = used;
+		g_system->m_counters_dirty = true;
+	}
+	return fiber;
+}
+
+
+// called without m_sync first, so it looks only at plain counters, never at the segments
+static bool needsTrim()
+{
+	if (g_system->m_counters_dirty) return true;
+
+	const u32 fibers_used = g_system->m_fibers.size() - g_system->m_free_fibers.size();
+	if (g_system->m_fiber_stacks_count - fibers_used > IDLE_FIBERS_KEEP) return true;
+
+	const int segments_count = g_system->m_signal_segments_count;
+	return segments_count > 1 && g_system->m_signals_used < u32(segments_count - 1) * SIGNALS_PER_SEGMENT / 2;
+}
+
+
+// called by workers before they park, gives back what a burst of jobs made the pools grow to
+static void trimPools()
+{
+	if (!needsTrim()) return;
+
+	MT::CriticalSectionLock lock(g_system->m_sync);
+	if (!needsTrim()) return;
+
+	// the most recently freed fibers are at the back, their stacks are the likeliest to be in cache
+	Array<FiberDecl*>& free_fibers = g_system->m_free_fibers;
+	const u32 used = g_system->m_fibers.size() - free_fibers.size();
+	for (int i = free_fibers.size() - IDLE_FIBERS_KEEP - 1; i >= 0; --i) {
+		if (g_system->m_fiber_stacks_count - used <= IDLE_FIBERS_KEEP) break;
+		FiberDecl* fiber = free_fibers[i];
+		if (fiber->fiber == Fiber::INVALID_FIBER) continue;
+		Fiber::destroy(fiber->fiber);
+		fiber->fiber = Fiber::INVALID_FIBER;
+		--g_system->m_fiber_stacks_count;
+	}
+
+	// the first segment is never released, a half empty segment below the top avoids grow / release ping-pong
+	for (int top = g_system->m_signal_segments_count - 1; top > 0; --top) {
+		SignalSegment* segment = g_system->m_signal_segments[top];
+		if (segment->used != 0) break;
+		if (g_system->m_signal_segments[top - 1]->used > SIGNALS_PER_SEGMENT / 2) break;
+
+		u32 generation = 0;
+		for (const Signal& signal : segment->signals) {
+			generation = maximum(generation, signal.generation);
+		}
+		g_system->m_released_generations[top] = generation;
+		LUMIX_DELETE(g_system->m_allocator, segment);
+		g_system->m_signal_segments[top] = nullptr;
+		--g_system->m_signal_segments_count;
+	}
+
+	pushPoolCounters();
+	g_system->m_counters_dirty = false;
+}
+
+
+// wakes at most one parked worker, there is no broadcast
+static void wakeOne()
+{
+	MT::memoryBarrier();
+	if (g_system->m_parked_count == 0) return;
+
+	WorkerTask* worker;
+	{
+		MT::CriticalSectionLock lock(g_system->m_parked_sync);
+		if (g_system->m_parked_workers.empty()) return;
+		worker = g_system->m_parked_workers.back();
+		g_system->m_parked_workers.pop();
+		g_system->m_parked_count = g_system->m_parked_workers.size();
+	}
+	worker->m_work_signal.trigger();
+}
+
+
+static Array<Job>& getGlobalQueue(Priority priority)
+{
+	switch (priority) {
+		case Priority::HIGH: return g_system->m_high_priority_job_queue;
+		case Priority::BACKGROUND: return g_system->m_background_job_queue;
+		default: return g_system->m_job_queue;
+	}
 }
 
 
 static void pushJob(const Job& job)
 {
 	if (job.worker_index != ANY_WORKER) {
+		// pinned jobs can not move anywhere else, so they ignore the background limit
 		WorkerTask* worker = g_system->m_workers[job.worker_index % g_system->m_workers.size()];
-		worker->m_job_queue.push(job);
+		{
+			MT::CriticalSectionLock lock(worker->m_queue_sync);
+			worker->m_job_queue.push(job);
+		}
 		worker->m_work_signal.trigger();
 		return;
 	}
-	g_system->m_job_queue.push(job);
-	g_system->m_work_signal.trigger();
+
+	WorkerTask* worker = getWorker();
+	if (job.priority == Priority::BACKGROUND 
+		|| !worker 
+		|| worker->m_is_backup 
+		|| !worker->m_deques[(int)job.priority].push(job))
+	{
+		MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
+		getGlobalQueue(job.priority).push(job);
+	}
+	wakeOne();
 }
 
 
-void trigger(SignalHandle handle)
+static bool isBackground(const Job& job)
+{
+	return job.priority == Priority::BACKGROUND && job.worker_index == ANY_WORKER;
+}
+
+
+static void pushReadyFiber(FiberDecl* fiber)
 {
-	LUMIX_FATAL((handle & HANDLE_ID_MASK) < 4096);
+	if (fiber->current_job.worker_index != ANY_WORKER) {
+		WorkerTask* worker = g_system->m_workers[fiber->current_job.worker_index % g_system->m_workers.size()];
+		{
+			MT::CriticalSectionLock lock(worker->m_queue_sync);
+			worker->m_ready_fibers.push(fiber);
+		}
+		worker->m_work_signal.trigger();
+		return;
+	}
+
+	{
+		MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
+		if (isBackground(fiber->current_job)) {
+			g_system->m_background_ready_fibers.push(fiber);
+		}
+		else {
+			g_system->m_ready_fibers.push(fiber);
+		}
+	}
+	wakeOne();
+}
+
 
+void trigger(SignalHandle handle)
+{
 	MT::CriticalSectionLock lock(g_system->m_sync);
 	
-	Signal& counter = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
-	--counter.value;
-	if (counter.value > 0) return;
+	Signal* counter = getSignal(handle);
+	LUMIX_FATAL(counter);
+	--counter->value;
+	if (counter->value > 0) return;
 
 	SignalHandle iter = handle;
 	while (isValid(iter)) {
-		Signal& signal = g_system->m_signals_pool[iter & HANDLE_ID_MASK];
+		Signal& signal = *getSignal(iter);
 		if(signal.next_job.task) {
-			MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
 			pushJob(signal.next_job);
 		}
-		signal.generation = (((signal.generation >> 16) + 1) & 0xffFF) << 16;
-		g_system->m_free_queue.push(iter & HANDLE_ID_MASK | signal.generation);
-		signal.next_job.task = nullptr;
+		freeSignal(iter & HANDLE_ID_MASK, signal);
 		iter = signal.sibling;
 	}
 }
@@ -229,8 +561,9 @@ static LUMIX_FORCE_INLINE bool isSignalZero(SignalHandle handle, bool lock)
 	const u32 id = handle & HANDLE_ID_MASK;
 	
 	if (lock) g_system->m_sync.enter();
-	Signal& counter = g_system->m_signals_pool[id];
-	bool is_zero = counter.generation != gen || counter.value == 0;
+	// the segment of an old handle could have been released, its signal is zero then
+	Signal* counter = getSignal(id);
+	bool is_zero = !counter || counter->generation != gen || counter->value == 0;
 	if (lock) g_system->m_sync.exit();
 	return is_zero;
 }
@@ -241,19 +574,21 @@ static LUMIX_FORCE_INLINE void runInternal(void* data
 	, SignalHandle precondition
 	, bool lock
 	, SignalHandle* on_finish
-	, u8 worker_index)
+	, u8 worker_index
+	, Priority priority)
 {
 	Job j;
 	j.data = data;
 	j.task = task;
 	j.worker_index = worker_index;
 	j.precondition = precondition;
+	j.priority = priority;
 
 	if (lock) g_system->m_sync.enter();
 	j.dec_on_finish = [&]() -> SignalHandle {
 		if (!on_finish) return INVALID_HANDLE;
 		if (isValid(*on_finish) && !isSignalZero(*on_finish, false)) {
-			++g_system->m_signals_pool[*on_finish & HANDLE_ID_MASK].value;
+			++getSignal(*on_finish)->value;
 			return *on_finish;
 		}
 		return allocateSignal();
@@ -261,14 +596,13 @@ static LUMIX_FORCE_INLINE void runInternal(void* data
 	if (on_finish) *on_finish = j.dec_on_finish;
 
 	if (!isValid(precondition) || isSignalZero(precondition, false)) {
-		MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
 		pushJob(j);
 	}
 	else {
-		Signal& counter = g_system->m_signals_pool[precondition & HANDLE_ID_MASK];
+		Signal& counter = *getSignal(precondition);
 		if(counter.next_job.task) {
 			const SignalHandle ch = allocateSignal();
-			Signal& c = g_system->m_signals_pool[ch & HANDLE_ID_MASK];
+			Signal& c = *getSignal(ch);
 			c.next_job = j;
 			c.sibling = counter.sibling;
 			counter.sibling = ch;
@@ -301,10 +635,10 @@ void enableBackupWorker(bool enable)
 
 	ASSERT(enable);
 	WorkerTask* task = LUMIX_NEW(g_system->m_allocator, WorkerTask)(*g_system, 0xff);
+	task->m_is_backup = true;
 	if (task->create("Backup worker", false)) {
 		g_system->m_backup_workers.push(task);
 		task->m_is_enabled = true;
-		task->m_is_backup = true;
 		task->m_enabled.trigger();
 	}
 	else {
@@ -321,7 +655,7 @@ void incSignal(SignalHandle* signal)
 	MT::CriticalSectionLock lock(g_system->m_sync);
 	
 	if (isValid(*signal) && !isSignalZero(*signal, false)) {
-		++g_system->m_signals_pool[*signal & HANDLE_ID_MASK].value;
+		++getSignal(*signal)->value;
 	}
 	else {
 		*signal = allocateSignal();
@@ -337,13 +671,176 @@ void decSignal(SignalHandle signal)
 
 void run(void* data, void(*task)(void*), SignalHandle* on_finished)
 {
-	runInternal(data, task, INVALID_HANDLE, true, on_finished, ANY_WORKER);
+	runInternal(data, task, INVALID_HANDLE, true, on_finished, ANY_WORKER, Priority::NORMAL);
+}
+
+
+void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHandle precondition, u8 worker_index, Priority priority)
+{
+	runInternal(data, task, precondition, true, on_finished, worker_index, priority);
+}
+
+
+void setBackgroundWorkersLimit(u32 limit)
+{
+	g_system->m_background_limit = maximum(1, (i32)limit);
+	wakeOne();
+}
+
+
+u32 getBackgroundWorkersLimit()
+{
+	return g_system->m_background_limit;
+}
+
+
+static bool steal(WorkerTask* worker, Priority priority, Job* job)
+{
+	const int count = g_system->m_workers.size();
+	if (count == 0) return false;
+	const int offset = worker->nextRandom() % count;
+	for (int i = 0; i < count; ++i) {
+		WorkerTask* victim = g_system->m_workers[(i + offset) % count];
+		if (victim == worker) continue;
+		if (victim->m_deques[(int)priority].steal(job)) return true;
+	}
+	return false;
+}
+
+
+static bool popGlobal(Array<Job>& queue, Job* job)
+{
+	if (queue.empty()) return false;
+
+	MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
+	if (queue.empty()) return false;
+	*job = queue.back();
+	queue.pop();
+	if (!queue.empty()) wakeOne();
+	return true;
+}
+
+
+static bool isBackgroundSlotFree()
+{
+	return g_system->m_background_running < g_system->m_background_limit;
+}
+
+
+static bool acquireBackgroundSlot()
+{
+	for (;;) {
+		const i32 running = g_system->m_background_running;
+		if (running >= g_system->m_background_limit) return false;
+		if (MT::compareAndExchange(&g_system->m_background_running, running + 1, running)) return true;
+	}
+}
+
+
+static bool getWork(WorkerTask* worker, Job* job, FiberDecl** fiber)
+{
+	if (!worker->m_ready_fibers.empty() || !worker->m_job_queue.empty()) {
+		MT::CriticalSectionLock lock(worker->m_queue_sync);
+		if (!worker->m_ready_fibers.empty()) {
+			*fiber = worker->m_ready_fibers.back();
+			worker->m_ready_fibers.pop();
+			return true;
+		}
+		if (!worker->m_job_queue.empty()) {
+			*job = worker->m_job_queue.back();
+			worker->m_job_queue.pop();
+			return true;
+		}
+	}
+
+	if (!g_system->m_ready_fibers.empty()) {
+		MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
+		if (!g_system->m_ready_fibers.empty()) {
+			*fiber = g_system->m_ready_fibers.back();
+			g_system->m_ready_fibers.pop();
+			if (!g_system->m_ready_fibers.empty()) wakeOne();
+			return true;
+		}
+	}
+
+	for (int i = (int)Priority::HIGH; i <= (int)Priority::NORMAL; ++i) {
+		const Priority priority = (Priority)i;
+		WorkStealingQueue& deque = worker->m_deques[(int)priority];
+		if (deque.pop(job)) {
+			if (!deque.isEmpty()) wakeOne();
+			return true;
+		}
+
+		if (popGlobal(getGlobalQueue(priority), job)) return true;
+
+		if (steal(worker, priority, job)) {
+			wakeOne();
+			return true;
+		}
+	}
+
+	const bool has_background_work = !g_system->m_background_ready_fibers.empty() || !g_system->m_background_job_queue.empty();
+	if (has_background_work && acquireBackgroundSlot()) {
+		// jobs already started are finished first
+		if (!g_system->m_background_ready_fibers.empty()) {
+			MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
+			if (!g_system->m_background_ready_fibers.empty()) {
+				*fiber = g_system->m_background_ready_fibers.back();
+				g_system->m_background_ready_fibers.pop();
+				return true;
+			}
+		}
+		if (popGlobal(g_system->m_background_job_queue, job)) return true;
+		MT::atomicDecrement(&g_system->m_background_running);
+	}
+	return false;
+}
+
+
+static bool hasWork(WorkerTask* worker)
+{
+	{
+		MT::CriticalSectionLock lock(worker->m_queue_sync);
+		if (!worker->m_ready_fibers.empty() || !worker->m_job_queue.empty()) return true;
+	}
+	{
+		MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
+		if (!g_system->m_ready_fibers.empty()) return true;
+		if (!g_system->m_job_queue.empty()) return true;
+		if (!g_system->m_high_priority_job_queue.empty()) return true;
+		const bool has_background_work = !g_system->m_background_ready_fibers.empty() || !g_system->m_background_job_queue.empty();
+		if (has_background_work && isBackgroundSlotFree()) return true;
+	}
+	for (WorkerTask* w : g_system->m_workers) {
+		if (!w->m_deques[0].isEmpty() || !w->m_deques[1].isEmpty()) return true;
+	}
+	return false;
 }
 
 
-void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHandle precondition, u8 worker_index)
+// the worker registers as parked before the final check for work, and pushers check for parked workers
+// after they publish a job, so one of them always sees the other
+static void park(WorkerTask* worker)
 {
-	runInternal(data, task, precondition, true, on_finished, worker_index);
+	trimPools();
+
+	{
+		MT::CriticalSectionLock lock(g_system->m_parked_sync);
+		g_system->m_parked_workers.push(worker);
+		g_system->m_parked_count = g_system->m_parked_workers.size();
+	}
+	MT::memoryBarrier();
+
+	if (!hasWork(worker) && !worker->m_finished) {
+		PROFILE_BLOCK("idle");
+		Profiler::blockColor(0xff, 0, 0xff);
+		worker->m_work_signal.wait();
+	}
+	worker->m_work_signal.reset();
+
+	MT::CriticalSectionLock lock(g_system->m_parked_sync);
+	g_system->m_parked_workers.eraseItem(worker);
+	g_system->m_parked_count = g_system->m_parked_workers.size();
 }
 
 
@@ -371,30 +868,7 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 
 		FiberDecl* fiber = nullptr;
 		Job job;
-		{
-			MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
-
-			if (!worker->m_ready_fibers.empty()) {
-				fiber = worker->m_ready_fibers.back();
-				worker->m_ready_fibers.pop();
-				if (worker->m_ready_fibers.empty()) worker->m_work_signal.reset();
-			}
-			else if (!worker->m_job_queue.empty()) {
-				job = worker->m_job_queue.back();
-				worker->m_job_queue.pop();
-				if (worker->m_job_queue.empty()) worker->m_work_signal.reset();
-			}
-			else if (!g_system->m_ready_fibers.empty()) {
-				fiber = g_system->m_ready_fibers.back();
-				g_system->m_ready_fibers.pop();
-				if (g_system->m_ready_fibers.empty()) g_system->m_work_signal.reset();
-			}
-			else if(!g_system->m_job_queue.empty()) {
-				job = g_system->m_job_queue.back();
-				g_system->m_job_queue.pop();
-				if (g_system->m_job_queue.empty()) g_system->m_work_signal.reset();
-			}
-		}
+		getWork(worker, &job, &fiber);
 
 		if (fiber) {
 			Profiler::endBlock();
@@ -416,12 +890,15 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 		if (job.task) {
 			Profiler::endBlock();
 			Profiler::beginBlock("job");
-			if (isValid(job.dec_on_finish) || isValid(job.precondition)) {
-				Profiler::pushJobInfo(job.dec_on_finish, job.precondition);
+			if (isValid(job.dec_on_finish) || isValid(job.precondition) || job.priority != Priority::NORMAL) {
+				Profiler::pushJobInfo(job.dec_on_finish, job.precondition, (u8)job.priority);
 			}
 			this_fiber->current_job = job;
 			job.task(job.data);
             this_fiber->current_job.task = nullptr;
+			if (isBackground(job)) {
+				MT::atomicDecrement(&g_system->m_background_running);
+			}
 			if (isValid(job.dec_on_finish)) {
 				trigger(job.dec_on_finish);
 			}
@@ -432,9 +909,7 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 		}
 		else 
 		{
-			PROFILE_BLOCK("idle");
-			Profiler::blockColor(0xff, 0, 0xff);
-			MT::Event::waitMultiple(g_system->m_work_signal, worker->m_work_signal, 1);
+			park(worker);
 		}
 	}
 	Profiler::endBlock();
@@ -446,23 +921,24 @@ bool init(u8 workers_count, IAllocator& allocator)
 {
 	ASSERT(!g_system);
 
-	g_system = LUMIX_NEW(allocator, System)(allocator);
-	g_system->m_work_signal.reset();
-
-	g_system->m_free_fibers.reserve(lengthOf(g_system->m_fiber_pool));
-	for (FiberDecl& fiber : g_system->m_fiber_pool) {
-		g_system->m_free_fibers.push(&fiber);
-	}
+	// counters can not be destroyed, so they are shared by all inits
+	static const u32 signals_counter = Profiler::createCounter("Job signals");
+	static const u32 signals_high_water_counter = Profiler::createCounter("Job signals high-water");
+	static const u32 fibers_counter = Profiler::createCounter("Job fibers");
+	static const u32 fibers_high_water_counter = Profiler::createCounter("Job fibers high-water");
 
-	const int fiber_num = lengthOf(g_system->m_fiber_pool);
-	for(int i = 0; i < fiber_num; ++i) { 
-		FiberDecl& decl = g_system->m_fiber_pool[i];
-		decl.idx = i;
-	}
+	g_system = LUMIX_NEW(allocator, System)(allocator);
+	g_system->m_signals_counter = signals_counter;
+	g_system->m_signals_high_water_counter = signals_high_water_counter;
+	g_system->m_fibers_counter = fibers_counter;
+	g_system->m_fibers_high_water_counter = fibers_high_water_counter;
+	allocateSignalSegment();
 
 	int count = maximum(1, int(workers_count));
+	g_system->m_workers.reserve(count);
+	g_system->m_parked_workers.reserve(count + 8);
 	for (int i = 0; i < count; ++i) {
-		WorkerTask* task = LUMIX_NEW(allocator, WorkerTask)(*g_system, i < 64 ? u64(1) << i : 0);
+		WorkerTask* task = LUMIX_NEW(allocator, WorkerTask)(*g_system, i);
 		if (task->create("Worker", false)) {
 			task->m_is_enabled = true;
 			task->m_enabled.trigger();
@@ -475,6 +951,8 @@ bool init(u8 workers_count, IAllocator& allocator)
 		}
 	}
 
+	g_system->m_background_limit = maximum(1, g_system->m_workers.size() / 2);
+
 	return !g_system->m_workers.empty();
 }
 
@@ -502,25 +980,30 @@ void shutdown()
 		wt->m_enabled.trigger();
 	}
 
-	for (MT::Task* task : g_system->m_backup_workers)
+	for (WorkerTask* task : g_system->m_backup_workers)
 	{
-		while (!task->isFinished()) g_system->m_work_signal.trigger();
+		while (!task->isFinished()) task->m_work_signal.trigger();
 		task->destroy();
 		LUMIX_DELETE(allocator, task);
 	}
 
-	for (MT::Task* task : g_system->m_workers)
+	for (WorkerTask* task : g_system->m_workers)
 	{
-		while (!task->isFinished()) g_system->m_work_signal.trigger();
+		while (!task->isFinished()) task->m_work_signal.trigger();
 		task->destroy();
 		LUMIX_DELETE(allocator, task);
 	}
 
-	for (FiberDecl& fiber : g_system->m_fiber_pool)
+	for (FiberDecl* fiber : g_system->m_fibers)
 	{
-		if(fiber.fiber != Fiber::INVALID_FIBER) {
-			Fiber::destroy(fiber.fiber);
+		if(fiber->fiber != Fiber::INVALID_FIBER) {
+			Fiber::destroy(fiber->fiber);
 		}
+		LUMIX_DELETE(allocator, fiber);
+	}
+
+	for (int i = 0; i < g_system->m_signal_segments_count; ++i) {
+		LUMIX_DELETE(allocator, g_system->m_signal_segments[i]);
 	}
 
 	LUMIX_DELETE(allocator, g_system);
@@ -541,25 +1024,15 @@ void wait(SignalHandle handle)
 		FiberDecl* this_fiber = getWorker()->m_current_fiber;
 
 		runInternal(this_fiber, [](void* data){
-			MT::CriticalSectionLock lock(g_system->m_job_queue_sync);
-			FiberDecl* fiber = (FiberDecl*)data;
-			if (fiber->current_job.worker_index == ANY_WORKER) {
-				g_system->m_ready_fibers.push(fiber);
-				g_system->m_work_signal.trigger();
-			}
-			else {
-				WorkerTask* worker = g_system->m_workers[fiber->current_job.worker_index % g_system->m_workers.size()];
-				worker->m_ready_fibers.push(fiber);
-				worker->m_work_signal.trigger();
-			}
-		}, handle, false, nullptr, 0);
+			pushReadyFiber((FiberDecl*)data);
+		}, handle, false, nullptr, 0, Priority::HIGH);
+
+		// a suspended background job does not occupy a worker, it could deadlock on its own children otherwise
+		// it is resumed through m_background_ready_fibers, which takes the slot again
+		if (isBackground(this_fiber->current_job)) MT::atomicDecrement(&g_system->m_background_running);
 		
 		const Profiler::FiberSwitchData& switch_data = Profiler::beginFiberWait(handle);
-		FiberDecl* new_fiber = g_system->m_free_fibers.back();
-		g_system->m_free_fibers.pop();
-		if (new_fiber->fiber == Fiber::INVALID_FIBER) {
-			new_fiber->fiber = Fiber::create(64 * 1024, manage, new_fiber);
-		}
+		FiberDecl* new_fiber = popFreeFiber();
 		getWorker()->m_current_fiber = new_fiber;
 		Fiber::switchTo(&this_fiber->fiber, new_fiber->fiber);
 		getWorker()->m_current_fiber = this_fiber;
@@ -582,7 +1055,7 @@ void wait(SignalHandle handle)
 
 		runInternal(nullptr, [](void* data) {
 			g_system->m_event_outside_job.trigger();
-		}, handle, false, nullptr, 0);
+		}, handle, false, nullptr, 0, Priority::HIGH);
 
 		g_system->m_sync.exit();
 
@@ -2,6 +2,8 @@
 
 
 #include "lumix.h"
+#include "engine/mt/atomic.h"
+#include "engine/mt/sync.h"
 
 
 namespace Lumix
@@ -19,57 +21,277 @@ using SignalHandle = u32;
 constexpr u8 ANY_WORKER = 0xff;
 constexpr u32 INVALID_HANDLE = 0xffFFffFF;
 
+enum class Priority : u8
+{
+	HIGH, // frame critical, e.g. culling and command building
+	NORMAL,
+	BACKGROUND, // long running, e.g. texture compression, runs on at most getBackgroundWorkersLimit() workers at once
+
+	COUNT
+};
+
 LUMIX_ENGINE_API bool init(u8 workers_count, IAllocator& allocator);
 LUMIX_ENGINE_API void shutdown();
 LUMIX_ENGINE_API int getWorkersCount();
 
 LUMIX_ENGINE_API void enableBackupWorker(bool enable);
+LUMIX_ENGINE_API void setBackgroundWorkersLimit(u32 limit);
+LUMIX_ENGINE_API u32 getBackgroundWorkersLimit();
 
 LUMIX_ENGINE_API void incSignal(SignalHandle* signal);
 LUMIX_ENGINE_API void decSignal(SignalHandle signal);
 
 LUMIX_ENGINE_API void run(void* data, void(*task)(void*), SignalHandle* on_finish);
-LUMIX_ENGINE_API void runEx(void* data, void (*task)(void*), SignalHandle* on_finish, SignalHandle precondition, u8 worker_index);
+LUMIX_ENGINE_API void runEx(void* data, void (*task)(void*), SignalHandle* on_finish, SignalHandle precondition, u8 worker_index, Priority priority = Priority::NORMAL);
 LUMIX_ENGINE_API void wait(SignalHandle waitable);
 LUMIX_ENGINE_API inline bool isValid(SignalHandle waitable) { return waitable != INVALID_HANDLE; }
 
 
 template <typename F>
-void runOnWorkers(F& f)
+void runOnWorkers(F& f, Priority priority = Priority::NORMAL)
 {
 	SignalHandle signal = JobSystem::INVALID_HANDLE;
 	for(int i = 0, c = getWorkersCount(); i < c; ++i) {
-		JobSystem::run(&f, [](void* data){
+		JobSystem::runEx(&f, [](void* data){
 			(*(F*)data)();
-		}, &signal);
+		}, &signal, JobSystem::INVALID_HANDLE, ANY_WORKER, priority);
 	}
 	wait(signal);
 }
 
 
+struct Range
+{
+	u32 begin;
+	u32 end;
+};
+
+
+// parallel algorithms spawn at most getWorkersCount() * PARALLEL_JOBS_PER_WORKER jobs
+enum { 
+	PARALLEL_JOBS_PER_WORKER = 4,
+	MAX_PREFIX_SUM_BLOCKS = 256
+};
+
+
+inline u32 getParallelJobsCount(u32 count, u32 grain)
+{
+	const u32 max_jobs = u32(getWorkersCount()) * PARALLEL_JOBS_PER_WORKER;
+	const u32 chunks = (count + grain - 1) / grain;
+	return chunks < max_jobs ? chunks : max_jobs;
+}
+
+
+// guided self-scheduling, takes 1 / (2 * jobs_count) of what is left but at least grain items,
+// so the first ranges are big and they get smaller as the work runs out
+// offset is 64bit, so positions above 2^31 do not turn negative
+inline bool takeRange(volatile i64* offset, u32 end, u32 grain, u32 jobs_count, Range* range)
+{
+	for (;;) {
+		const i64 current = *offset;
+		if (current >= end) return false;
+		const u32 from = (u32)current;
+		const u32 remaining = end - from;
+		u32 size = remaining / (2 * jobs_count);
+		if (size < grain) size = grain;
+		if (size > remaining) size = remaining;
+
+		if (MT::compareAndExchange64(offset, i64(from) + size, current)) {
+			range->begin = from;
+			range->end = from + size;
+			return true;
+		}
+	}
+}
+
+
+// calls f(Range) on disjoint subranges of [begin, end), each at least grain items long except the last one
 template <typename F>
-void forEach(u32 count, F& f)
+void parallelFor(u32 begin, u32 end, u32 grain, F& f)
+{
+	if (end <= begin) return;
+	if (grain == 0) grain = 1;
+
+	const u32 jobs_count = getParallelJobsCount(end - begin, grain);
+	if (jobs_count <= 1) {
+		f(Range{begin, end});
+		return;
+	}
+
+	struct Data {
+		F* f;
+		volatile i64 offset;
+		u32 end;
+		u32 grain;
+		u32 jobs_count;
+	} data;
+	data.f = &f;
+	data.offset = begin;
+	data.end = end;
+	data.grain = grain;
+	data.jobs_count = jobs_count;
+
+	SignalHandle signal = JobSystem::INVALID_HANDLE;
+	for (u32 i = 0; i < jobs_count; ++i) {
+		JobSystem::run(&data, [](void* ptr){
+			Data& data = *(Data*)ptr;
+			Range range;
+			while (takeRange(&data.offset, data.end, data.grain, data.jobs_count, &range)) {
+				(*data.f)(range);
+			}
+		}, &signal);
+	}
+	wait(signal);
+}
+
+
+// f(Range) returns the result for the range, op(T, T) combines two results
+// op must be associative and commutative, partial results of jobs are combined in unspecified order
+template <typename T, typename F, typename Op>
+T parallelReduce(u32 begin, u32 end, u32 grain, const T& identity, F& f, Op& op)
 {
+	if (end <= begin) return identity;
+	if (grain == 0) grain = 1;
+
+	const u32 jobs_count = getParallelJobsCount(end - begin, grain);
+	if (jobs_count <= 1) return op(identity, f(Range{begin, end}));
+
 	struct Data {
 		F* f;
-		volatile i32 offset = 0;
+		Op* op;
+		const T* identity;
+		T result;
+		MT::CriticalSection result_mutex;
+		volatile i64 offset;
+		u32 end;
+		u32 grain;
+		u32 jobs_count;
+	} data;
+	data.f = &f;
+	data.op = &op;
+	data.identity = &identity;
+	data.result = identity;
+	data.offset = begin;
+	data.end = end;
+	data.grain = grain;
+	data.jobs_count = jobs_count;
+
+	SignalHandle signal = JobSystem::INVALID_HANDLE;
+	for (u32 i = 0; i < jobs_count; ++i) {
+		JobSystem::run(&data, [](void* ptr){
+			Data& data = *(Data*)ptr;
+			T partial = *data.identity;
+			bool any = false;
+			Range range;
+			while (takeRange(&data.offset, data.end, data.grain, data.jobs_count, &range)) {
+				partial = (*data.op)(partial, (*data.f)(range));
+				any = true;
+			}
+			if (!any) return;
+
+			MT::CriticalSectionLock lock(data.result_mutex);
+			data.result = (*data.op)(data.result, partial);
+		}, &signal);
+	}
+	wait(signal);
+	return data.result;
+}
+
+
+// inclusive prefix sum, out[i] = in[0] + ... + in[i], in and out can be the same array
+// T needs operator + and T(0) must be the identity
+template <typename T>
+void parallelPrefixSum(const T* in, T* out, u32 count, u32 grain)
+{
+	if (count == 0) return;
+	if (grain == 0) grain = 1;
+
+	u32 blocks_count = getParallelJobsCount(count, grain);
+	if (blocks_count > MAX_PREFIX_SUM_BLOCKS) blocks_count = MAX_PREFIX_SUM_BLOCKS;
+	if (blocks_count <= 1) {
+		T sum = in[0];
+		out[0] = sum;
+		for (u32 i = 1; i < count; ++i) {
+			sum = sum + in[i];
+			out[i] = sum;
+		}
+		return;
+	}
+
+	// blocks are static so the second pass can find the offset of each block
+	struct Data {
+		const T* in;
+		T* out;
 		u32 count;
+		u32 blocks_count;
+		volatile i32 block_idx;
+		T block_sums[MAX_PREFIX_SUM_BLOCKS];
+
+		Range getBlock(u32 idx) const {
+			const u64 from = u64(count) * idx / blocks_count;
+			const u64 to = u64(count) * (idx + 1) / blocks_count;
+			return { u32(from), u32(to) };
+		}
 	} data;
+	data.in = in;
+	data.out = out;
 	data.count = count;
-	data.f = &f;
-	
+	data.blocks_count = blocks_count;
+
+	// pass 1: scan each block independently
+	data.block_idx = 0;
 	SignalHandle signal = JobSystem::INVALID_HANDLE;
-	for(u32 i = 0; i < count; ++i) {
+	for (u32 i = 0; i < blocks_count; ++i) {
 		JobSystem::run(&data, [](void* ptr){
 			Data& data = *(Data*)ptr;
-			for(;;) {
-				const u32 idx = MT::atomicIncrement(&data.offset) - 1;
-				if(idx >= data.count) break;
-				(*data.f)(idx);
+			const u32 idx = MT::atomicIncrement(&data.block_idx) - 1;
+			const Range block = data.getBlock(idx);
+			T sum = data.in[block.begin];
+			data.out[block.begin] = sum;
+			for (u32 i = block.begin + 1; i < block.end; ++i) {
+				sum = sum + data.in[i];
+				data.out[i] = sum;
 			}
+			data.block_sums[idx] = sum;
 		}, &signal);
 	}
 	wait(signal);
+
+	// exclusive scan of block sums, there are only a few of them
+	T offset = T(0);
+	for (u32 i = 0; i < blocks_count; ++i) {
+		const T tmp = data.block_sums[i];
+		data.block_sums[i] = offset;
+		offset = offset + tmp;
+	}
+
+	// pass 2: add offset of preceding blocks, the first block is already done
+	data.block_idx = 1;
+	signal = JobSystem::INVALID_HANDLE;
+	for (u32 i = 1; i < blocks_count; ++i) {
+		JobSystem::run(&data, [](void* ptr){
+			Data& data = *(Data*)ptr;
+			const u32 idx = MT::atomicIncrement(&data.block_idx) - 1;
+			const Range block = data.getBlock(idx);
+			const T offset = data.block_sums[idx];
+			for (u32 i = block.begin; i < block.end; ++i) {
+				data.out[i] = offset + data.out[i];
+			}
+		}, &signal);
+	}
+	wait(signal);
+}
+
+
+template <typename F>
+void forEach(u32 count, F& f)
+{
+	auto range_f = [&f](const Range& range){
+		for (u32 i = range.begin; i < range.end; ++i) {
+			f(i);
+		}
+	};
+	parallelFor(0, count, 1, range_f);
 }
 
 
@@ -1,7 +1,106 @@
 #include "engine/fibers.h"
+#include "engine/allocator.h"
 #include "engine/lumix.h"
-#include <ucontext.h>
+#include "engine/profiler.h"
+#include <sys/mman.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+
+// Saves callee-saved registers on the current stack, stores the stack pointer to *from_sp
+// and restores everything from to_sp. Unlike swapcontext there is no signal mask syscall.
+extern "C" void lumix_switch_context(void** from_sp, void* to_sp);
+// First "return" of a new fiber lands here, proc and parameter are in callee-saved registers.
+extern "C" void lumix_fiber_entry();
+
+
+#if defined __x86_64__
+	asm(
+		".text\n"
+		".globl lumix_switch_context\n"
+		".hidden lumix_switch_context\n"
+		".type lumix_switch_context,@function\n"
+		"lumix_switch_context:\n"
+		"	pushq %rbp\n"
+		"	pushq %rbx\n"
+		"	pushq %r12\n"
+		"	pushq %r13\n"
+		"	pushq %r14\n"
+		"	pushq %r15\n"
+		"	subq $8, %rsp\n"
+		"	stmxcsr (%rsp)\n"
+		"	fnstcw 4(%rsp)\n"
+		"	movq %rsp, (%rdi)\n"
+		"	movq %rsi, %rsp\n"
+		"	ldmxcsr (%rsp)\n"
+		"	fldcw 4(%rsp)\n"
+		"	addq $8, %rsp\n"
+		"	popq %r15\n"
+		"	popq %r14\n"
+		"	popq %r13\n"
+		"	popq %r12\n"
+		"	popq %rbx\n"
+		"	popq %rbp\n"
+		"	ret\n"
+		".size lumix_switch_context,.-lumix_switch_context\n"
+
+		".globl lumix_fiber_entry\n"
+		".hidden lumix_fiber_entry\n"
+		".type lumix_fiber_entry,@function\n"
+		"lumix_fiber_entry:\n"
+		"	movq %r13, %rdi\n"
+		"	callq *%r12\n"
+		"	ud2\n"
+		".size lumix_fiber_entry,.-lumix_fiber_entry\n"
+	);
+#elif defined __aarch64__
+	asm(
+		".text\n"
+		".globl lumix_switch_context\n"
+		".hidden lumix_switch_context\n"
+		".type lumix_switch_context,%function\n"
+		"lumix_switch_context:\n"
+		"	sub sp, sp, #160\n"
+		"	stp x19, x20, [sp, #0]\n"
+		"	stp x21, x22, [sp, #16]\n"
+		"	stp x23, x24, [sp, #32]\n"
+		"	stp x25, x26, [sp, #48]\n"
+		"	stp x27, x28, [sp, #64]\n"
+		"	stp x29, x30, [sp, #80]\n"
+		"	stp d8, d9, [sp, #96]\n"
+		"	stp d10, d11, [sp, #112]\n"
+		"	stp d12, d13, [sp, #128]\n"
+		"	stp d14, d15, [sp, #144]\n"
+		"	mov x9, sp\n"
+		"	str x9, [x0]\n"
+		"	mov sp, x1\n"
+		"	ldp x19, x20, [sp, #0]\n"
+		"	ldp x21, x22, [sp, #16]\n"
+		"	ldp x23, x24, [sp, #32]\n"
+		"	ldp x25, x26, [sp, #48]\n"
+		"	ldp x27, x28, [sp, #64]\n"
+		"	ldp x29, x30, [sp, #80]\n"
+		"	ldp d8, d9, [sp, #96]\n"
+		"	ldp d10, d11, [sp, #112]\n"
+		"	ldp d12, d13, [sp, #128]\n"
+		"	ldp d14, d15, [sp, #144]\n"
+		"	add sp, sp, #160\n"
+		"	ret\n"
+		".size lumix_switch_context,.-lumix_switch_context\n"
+
+		".globl lumix_fiber_entry\n"
+		".hidden lumix_fiber_entry\n"
+		".type lumix_fiber_entry,%function\n"
+		"lumix_fiber_entry:\n"
+		"	mov x0, x20\n"
+		"	blr x19\n"
+		"	brk #0\n"
+		".size lumix_fiber_entry,.-lumix_fiber_entry\n"
+	);
+#else
+	#error Platform not supported
+#endif
+
 
 namespace Lumix
 {
@@ -11,50 +110,100 @@ namespace Fiber
 {
 
 
-thread_local Handle g_finisher;
+struct Context
+{
+	void* sp = nullptr;
+	u8* stack = nullptr;
+	size_t stack_size = 0;
+};
 
 
-void initThread(FiberProc proc, Handle* out)
+static thread_local Context g_thread_context;
+static thread_local Context* g_current = nullptr;
+
+
+static size_t getPageSize()
 {
-	*out = create(64*1024, proc, nullptr);
-	getcontext(&g_finisher);
-	out->uc_link = &g_finisher;
-	switchTo(&g_finisher, *out);
+	static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	return page_size;
 }
 
 
-Handle create(int stack_size, FiberProc proc, void* parameter)
+void initThread(FiberProc proc, Handle* out)
 {
-	ucontext_t fib;
-	getcontext(&fib);
-    fib.uc_stack.ss_sp = (::malloc)(stack_size);
-    fib.uc_stack.ss_size = stack_size;
-    fib.uc_link = 0;
-    makecontext(&fib, (void(*)())proc, 1, parameter); 
-	return fib;
+	// the thread's own stack, sp is filled on the first switch
+	g_current = &g_thread_context;
+	*out = &g_thread_context;
+	proc(nullptr);
+	g_current = nullptr;
 }
 
 
-void destroy(Handle fiber)
+Handle create(int stack_size, FiberProc proc, void* parameter)
 {
-	ASSERT(false);
+	const size_t page_size = getPageSize();
+	const size_t size = ((size_t)stack_size + page_size - 1) & ~(page_size - 1);
+	
+	// the lowest page is a guard page, stack overflow crashes instead of corrupting the neighbour
+	void* mem = mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (mem == MAP_FAILED) return INVALID_FIBER;
+	if (mprotect(mem, page_size, PROT_NONE) != 0) {
+		munmap(mem, size + page_size);
+		return INVALID_FIBER;
+	}
+
+	// context lives at the top of its own stack
+	u8* top = (u8*)mem + size + page_size - ((sizeof(Context) + 15) & ~15);
+	Context* ctx = new (NewPlaceholder(), top) Context;
+	ctx->stack = (u8*)mem;
+	ctx->stack_size = size + page_size;
+
+	#if defined __x86_64__
+		// mxcsr | fpu cw, r15, r14, r13, r12, rbx, rbp, return address, 16B padding
+		u64* frame = (u64*)(top - 80);
+		frame[0] = 0x1F80 | ((u64)0x037F << 32);
+		frame[1] = 0; // r15
+		frame[2] = 0; // r14
+		frame[3] = (u64)parameter; // r13
+		frame[4] = (u64)proc; // r12
+		frame[5] = 0; // rbx
+		frame[6] = 0; // rbp
+		frame[7] = (u64)&lumix_fiber_entry;
+		frame[8] = 0;
+		frame[9] = 0;
+	#elif defined __aarch64__
+		// x19 - x30, d8 - d15
+		u64* frame = (u64*)(top - 160);
+		for (int i = 0; i < 20; ++i) frame[i] = 0;
+		frame[0] = (u64)proc; // x19
+		frame[1] = (u64)parameter; // x20
+		frame[11] = (u64)&lumix_fiber_entry; // x30
+	#endif
+	ctx->sp = frame;
+	return ctx;
 }
 
 
-void switchTo(Handle* prev, Handle fiber)
+void destroy(Handle fiber)
 {
-	swapcontext(prev, &fiber); 
+	Context* ctx = (Context*)fiber;
+	ASSERT(ctx != g_current);
+	munmap(ctx->stack, ctx->stack_size);
 }
 
 
-void* getParameter()
+void switchTo(Handle* from, Handle fiber)
 {
-	ASSERT(false);
-	return nullptr;
+	// `from` is ignored, same as on windows, the current fiber is tracked per thread
+	Profiler::beforeFiberSwitch();
+	Context* prev = g_current;
+	Context* next = (Context*)fiber;
+	g_current = next;
+	lumix_switch_context(&prev->sp, next->sp);
 }
 
 
 } // namespace Fibers
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
@@ -1,8 +1,13 @@
 #include "engine/delegate_list.h"
 #include "engine/log.h"
+#include "engine/mt/atomic.h"
+#include "engine/mt/sync.h"
+#include "engine/mt/task.h"
+#include "engine/os.h"
 #include "engine/path.h"
 #include "engine/string.h"
 #include <stdlib.h>
+#include <string.h>
 
 
 namespace Lumix
@@ -12,6 +17,7 @@ void fatal(bool cond, const char* msg)
 {
 	if (!cond) {
 		logError("FATAL") << msg << " is false.";
+		flushLog();
 		abort();
 	}
 }
@@ -19,6 +25,237 @@ void fatal(bool cond, const char* msg)
 
 static DefaultAllocator g_allocator;
 static LogCallback g_callback(g_allocator);
+static DelegateList<void ()> g_flush_callback(g_allocator);
+
+
+enum {
+	// records over this are dropped until the writer catches up
+	MAX_QUEUED_BYTES = 4 * 1024 * 1024,
+	// identical messages in this window are reported only once with a repeat count
+	REPEAT_WINDOW_MS = 1000
+};
+
+
+// system and message strings follow the record
+struct LogRecord
+{
+	LogRecord* next;
+	LogLevel level;
+	u32 size;
+	u32 message_offset;
+
+	const char* system() const { return (const char*)(this + 1); }
+	const char* message() const { return (const char*)this + message_offset; }
+};
+
+
+// producers push records to a lock-free stack, the writer takes the whole stack at once,
+// callbacks are invoked only by the writer, or by whoever flushes the log
+struct LogWriter final : MT::Task
+{
+	LogWriter()
+		: MT::Task(g_allocator)
+		, wakeup(false)
+	{}
+
+	~LogWriter()
+	{
+		if (state == RUNNING) {
+			finished = true;
+			wakeup.trigger();
+			destroy();
+		}
+		// the rest is written synchronously
+		state = STOPPED;
+		drain();
+		if (last) reportRepeats();
+	}
+
+	int task() override
+	{
+		while (!finished) {
+			wakeup.waitTimeout(REPEAT_WINDOW_MS);
+			drain();
+		}
+		return 0;
+	}
+
+	void push(LogLevel level, const char* system, const char* message)
+	{
+		const u32 system_len = stringLength(system) + 1;
+		const u32 message_len = stringLength(message) + 1;
+		const u32 size = sizeof(LogRecord) + system_len + message_len;
+		for (;;) {
+			const i32 queued = queued_bytes;
+			if (queued + size > MAX_QUEUED_BYTES) {
+				MT::atomicIncrement(&dropped[(int)level]);
+				return;
+			}
+			if (MT::compareAndExchange(&queued_bytes, queued + size, queued)) break;
+		}
+
+		LogRecord* record = (LogRecord*)g_allocator.allocate(size);
+		record->level = level;
+		record->size = size;
+		record->message_offset = sizeof(LogRecord) + system_len;
+		memcpy(record + 1, system, system_len);
+		memcpy((u8*)record + record->message_offset, message, message_len);
+
+		for (;;) {
+			const i64 head = queue;
+			record->next = (LogRecord*)(uintptr)head;
+			if (MT::compareAndExchange64(&queue, (i64)(uintptr)record, head)) {
+				// the writer is woken up once per batch
+				if (!head) wakeup.trigger();
+				return;
+			}
+		}
+	}
+
+	void dispatch(LogLevel level, const char* system, const char* message)
+	{
+		MT::CriticalSectionLock lock(callback_mutex);
+		g_callback.invoke(level, system, message);
+	}
+
+	void reportRepeats()
+	{
+		if (repeats == 0) return;
+
+		StaticString<64> tmp("Last message repeated ", repeats, " times");
+		dispatch(last->level, last->system(), tmp);
+		repeats = 0;
+	}
+
+	void release(LogRecord* record)
+	{
+		MT::atomicSubtract(&queued_bytes, record->size);
+		g_allocator.deallocate(record);
+	}
+
+	void drain()
+	{
+		MT::CriticalSectionLock lock(drain_mutex);
+		LogRecord* stack;
+		for (;;) {
+			const i64 head = queue;
+			if (MT::compareAndExchange64(&queue, 0, head)) {
+				stack = (LogRecord*)(uintptr)head;
+				break;
+			}
+		}
+
+		// the stack is in reverse order
+		LogRecord* batch = nullptr;
+		while (stack) {
+			LogRecord* next = stack->next;
+			stack->next = batch;
+			batch = stack;
+			stack = next;
+		}
+
+		const u64 now = OS::Timer::getRawTimestamp();
+		const u64 repeat_window = OS::Timer::getFrequency() * REPEAT_WINDOW_MS / 1000;
+		if (last && now - last_time > repeat_window) {
+			reportRepeats();
+			release(last);
+			last = nullptr;
+		}
+
+		const bool any = batch != nullptr;
+		while (batch) {
+			LogRecord* record = batch;
+			batch = batch->next;
+			if (last
+				&& record->level == last->level
+				&& equalStrings(record->system(), last->system())
+				&& equalStrings(record->message(), last->message()))
+			{
+				++repeats;
+				release(record);
+				continue;
+			}
+
+			reportRepeats();
+			dispatch(record->level, record->system(), record->message());
+			if (last) release(last);
+			last = record;
+			last_time = now;
+		}
+
+		for (int i = 0; i < (int)LogLevel::COUNT; ++i) {
+			if (dropped[i] == 0) continue;
+			const i32 count = dropped[i];
+			MT::atomicSubtract(&dropped[i], count);
+			StaticString<64> tmp("Log queue is full, ", count, " messages dropped");
+			dispatch((LogLevel)i, "Log", tmp);
+		}
+
+		if (any) {
+			MT::CriticalSectionLock lock(callback_mutex);
+			g_flush_callback.invoke();
+		}
+	}
+
+	enum State : i32 {
+		NOT_STARTED,
+		STARTING,
+		RUNNING,
+		STOPPED
+	};
+
+	volatile i64 queue = 0;
+	volatile i32 queued_bytes = 0;
+	volatile i32 dropped[(int)LogLevel::COUNT] = {};
+	volatile i32 state = NOT_STARTED;
+	volatile bool finished = false;
+	MT::Event wakeup;
+	MT::CriticalSection drain_mutex;
+	MT::CriticalSection callback_mutex;
+	// kept to detect repeated messages
+	LogRecord* last = nullptr;
+	u64 last_time = 0;
+	u32 repeats = 0;
+};
+
+
+static LogWriter g_writer;
+
+
+static void pushLog(LogLevel level, const char* system, const char* message)
+{
+	// the writer thread is started by the first message
+	if (g_writer.state == LogWriter::NOT_STARTED && MT::compareAndExchange(&g_writer.state, LogWriter::STARTING, LogWriter::NOT_STARTED)) {
+		const bool started = g_writer.create("Log writer", true);
+		g_writer.state = started ? LogWriter::RUNNING : LogWriter::STOPPED;
+	}
+
+	if (g_writer.state == LogWriter::STOPPED) {
+		// no writer thread, e.g. during static destruction
+		g_writer.push(level, system, message);
+		g_writer.drain();
+		return;
+	}
+	g_writer.push(level, system, message);
+}
+
+
+void flushLog()
+{
+	g_writer.drain();
+}
+
+
+LogCallbackLock::LogCallbackLock()
+{
+	g_writer.callback_mutex.enter();
+}
+
+
+LogCallbackLock::~LogCallbackLock()
+{
+	g_writer.callback_mutex.exit();
+}
 
 
 struct Log {
@@ -35,6 +272,7 @@ thread_local Log g_log_warning(LogLevel::WARNING);
 thread_local Log g_log_error(LogLevel::ERROR);
 
 LogCallback& getLogCallback() { return g_callback; }
+DelegateList<void ()>& getLogFlushCallback() { return g_flush_callback; }
 LogProxy logInfo(const char* system) { return LogProxy(&g_log_info, system); }
 LogProxy logWarning(const char* system) { return LogProxy(&g_log_warning, system); }
 LogProxy logError(const char* system) { return LogProxy(&g_log_error, system); }
@@ -48,7 +286,7 @@ LogProxy::LogProxy(Log* log, const char* system)
 
 LogProxy::~LogProxy()
 {
-	g_callback.invoke(log->level, system, log->message.c_str());
+	pushLog(log->level, system, log->message.c_str());
 	log->message = "";
 }
 
@@ -25,6 +25,7 @@ enum class LogLevel {
 	COUNT
 };
 
+// callbacks are called from the log writer thread
 using LogCallback = DelegateList<void (LogLevel, const char*, const char*)>;
 
 
@@ -55,6 +56,18 @@ LUMIX_ENGINE_API LogProxy logInfo(const char* system);
 LUMIX_ENGINE_API LogProxy logWarning(const char* system);
 LUMIX_ENGINE_API LogProxy logError(const char* system);
 LUMIX_ENGINE_API LogCallback& getLogCallback();
+// called after each batch of messages, e.g. to flush files
+LUMIX_ENGINE_API DelegateList<void ()>& getLogFlushCallback();
+// blocks until all queued messages are passed to callbacks
+LUMIX_ENGINE_API void flushLog();
+
+
+// callbacks must be bound and unbound only while this is alive
+struct LUMIX_ENGINE_API LogCallbackLock
+{
+	LogCallbackLock();
+	~LogCallbackLock();
+};
 
 
 } // namespace Lumix
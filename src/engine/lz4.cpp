@@ -0,0 +1,217 @@
+#include "engine/lz4.h"
+#include <string.h>
+
+
+namespace Lumix
+{
+namespace LZ4
+{
+
+
+enum {
+	MIN_MATCH = 4,
+	// the last match must start at least 12 bytes before the end of the block
+	MF_LIMIT = 12,
+	// the last 5 bytes are always literals
+	LAST_LITERALS = 5,
+	MAX_OFFSET = 0xffFF,
+	HASH_BITS = 12
+};
+
+
+static const u32 EMPTY_SLOT = 0xffFFffFF;
+
+
+static LUMIX_FORCE_INLINE u32 read32(const u8* ptr)
+{
+	u32 res;
+	memcpy(&res, ptr, sizeof(res));
+	return res;
+}
+
+
+static LUMIX_FORCE_INLINE u32 hash(u32 sequence)
+{
+	return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+
+// length which does not fit in the 4 bits of the token is continued in bytes, 255 means another byte follows
+static u8* writeLength(u8* op, u32 length)
+{
+	while (length >= 255) {
+		*op = 255;
+		++op;
+		length -= 255;
+	}
+	*op = u8(length);
+	return op + 1;
+}
+
+
+static const u8* readLength(const u8* ip, const u8* ip_end, Ref<u32> length)
+{
+	u8 b;
+	do {
+		if (ip == ip_end) return nullptr;
+		b = *ip;
+		++ip;
+		length = length + b;
+	} while (b == 255);
+	return ip;
+}
+
+
+// match_length == 0 for the last sequence, which has only literals
+static u8* writeSequence(u8* op, const u8* op_end, const u8* literals, u32 literals_count, u32 offset, u32 match_length)
+{
+	u64 needed = 1 + literals_count + literals_count / 255 + 1;
+	if (match_length > 0) needed += 2 + (match_length - MIN_MATCH) / 255 + 1;
+	if (u64(op_end - op) < needed) return nullptr;
+
+	u8* token = op;
+	++op;
+	u8 token_value;
+	if (literals_count >= 15) {
+		token_value = 15 << 4;
+		op = writeLength(op, literals_count - 15);
+	}
+	else {
+		token_value = u8(literals_count << 4);
+	}
+	memcpy(op, literals, literals_count);
+	op += literals_count;
+
+	if (match_length > 0) {
+		op[0] = u8(offset);
+		op[1] = u8(offset >> 8);
+		op += 2;
+		const u32 length = match_length - MIN_MATCH;
+		if (length >= 15) {
+			token_value |= 15;
+			op = writeLength(op, length - 15);
+		}
+		else {
+			token_value |= u8(length);
+		}
+	}
+	*token = token_value;
+	return op;
+}
+
+
+u32 getMaxCompressedSize(u32 size)
+{
+	return size + size / 255 + 16;
+}
+
+
+// greedy, single hash table without chains, ratio is traded for speed
+u32 compress(const u8* src, u32 src_size, u8* dst, u32 dst_capacity)
+{
+	u8* op = dst;
+	const u8* const op_end = dst + dst_capacity;
+	const u8* anchor = src;
+
+	if (src_size > MF_LIMIT) {
+		u32 table[1 << HASH_BITS];
+		for (u32& slot : table) slot = EMPTY_SLOT;
+
+		const u8* ip = src;
+		const u8* const match_limit = src + src_size - MF_LIMIT;
+		const u8* const match_end_limit = src + src_size - LAST_LITERALS;
+		// incompressible data is skipped faster
+		u32 misses = 0;
+		while (ip < match_limit) {
+			const u32 sequence = read32(ip);
+			u32& slot = table[hash(sequence)];
+			const u32 ref_pos = slot;
+			const u32 pos = u32(ip - src);
+			slot = pos;
+			if (ref_pos == EMPTY_SLOT || pos - ref_pos > MAX_OFFSET || read32(src + ref_pos) != sequence) {
+				ip += 1 + (misses >> 6);
+				++misses;
+				continue;
+			}
+			misses = 0;
+
+			const u8* ref = src + ref_pos;
+			const u8* match_end = ip + MIN_MATCH;
+			const u8* ref_end = ref + MIN_MATCH;
+			while (match_end < match_end_limit && *match_end == *ref_end) {
+				++match_end;
+				++ref_end;
+			}
+			while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+				--ip;
+				--ref;
+			}
+
+			op = writeSequence(op, op_end, anchor, u32(ip - anchor), u32(ip - ref), u32(match_end - ip));
+			if (!op) return 0;
+
+			ip = match_end;
+			anchor = ip;
+			table[hash(read32(ip - 2))] = u32(ip - 2 - src);
+		}
+	}
+
+	op = writeSequence(op, op_end, anchor, u32(src + src_size - anchor), 0, 0);
+	if (!op) return 0;
+	return u32(op - dst);
+}
+
+
+bool decompress(const u8* src, u32 src_size, u8* dst, u32 dst_size)
+{
+	const u8* ip = src;
+	const u8* const ip_end = src + src_size;
+	u8* op = dst;
+	u8* const op_end = dst + dst_size;
+
+	for (;;) {
+		if (ip == ip_end) return false;
+		const u32 token = *ip;
+		++ip;
+
+		u32 literals_count = token >> 4;
+		if (literals_count == 15) {
+			ip = readLength(ip, ip_end, Ref(literals_count));
+			if (!ip) return false;
+		}
+		if (literals_count > u32(ip_end - ip) || literals_count > u32(op_end - op)) return false;
+		memcpy(op, ip, literals_count);
+		ip += literals_count;
+		op += literals_count;
+
+		// the last sequence has no match
+		if (ip == ip_end) return op == op_end;
+
+		if (ip_end - ip < 2) return false;
+		const u32 offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > u32(op - dst)) return false;
+
+		u32 match_length = token & 15;
+		if (match_length == 15) {
+			ip = readLength(ip, ip_end, Ref(match_length));
+			if (!ip) return false;
+		}
+		match_length += MIN_MATCH;
+		if (match_length > u32(op_end - op)) return false;
+
+		const u8* match = op - offset;
+		if (offset >= match_length) {
+			memcpy(op, match, match_length);
+		}
+		else {
+			// overlapping, repeats the last offset bytes
+			for (u32 i = 0; i < match_length; ++i) op[i] = match[i];
+		}
+		op += match_length;
+	}
+}
+
+
+} // namespace LZ4
+} // namespace Lumix
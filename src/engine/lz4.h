@@ -0,0 +1,25 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+// LZ4 block format, without the frame format
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+namespace LZ4
+{
+
+
+LUMIX_ENGINE_API u32 getMaxCompressedSize(u32 size);
+// returns size of the compressed data, 0 if it does not fit in dst
+LUMIX_ENGINE_API u32 compress(const u8* src, u32 src_size, u8* dst, u32 dst_capacity);
+// fails if src is corrupted or does not decompress to exactly dst_size bytes
+LUMIX_ENGINE_API bool decompress(const u8* src, u32 src_size, u8* dst, u32 dst_size);
+
+
+} // namespace LZ4
+} // namespace Lumix
@@ -148,9 +148,13 @@ struct WindowState {
 };
 
 LUMIX_ENGINE_API void* memReserve(size_t size);
+// large pages can not be committed later, the memory is reserved and committed at once, returns null if not available
+LUMIX_ENGINE_API void* memReserveLargePages(size_t size);
 LUMIX_ENGINE_API void memCommit(void* ptr, size_t size);
 LUMIX_ENGINE_API void memRelease(void* ptr);
 LUMIX_ENGINE_API u32 getMemPageSize();
+// 0 if large pages are not supported
+LUMIX_ENGINE_API u32 getMemLargePageSize();
 
 LUMIX_ENGINE_API FileIterator* createFileIterator(const char* path, IAllocator& allocator);
 LUMIX_ENGINE_API void destroyFileIterator(FileIterator* iterator);
@@ -170,6 +174,9 @@ LUMIX_ENGINE_API size_t getFileSize(const char* path);
 LUMIX_ENGINE_API bool fileExists(const char* path);
 LUMIX_ENGINE_API bool dirExists(const char* path);
 LUMIX_ENGINE_API u64 getLastModified(const char* file);
+// read-only view of the whole file, null on failure or if the file is empty
+LUMIX_ENGINE_API const void* mapFile(const char* path, Ref<u64> size);
+LUMIX_ENGINE_API void unmapFile(const void* mem, u64 size);
 LUMIX_ENGINE_API bool makePath(const char* path);
 
 LUMIX_ENGINE_API void clipCursor(WindowHandle win, int x, int y, int w, int h);
@@ -0,0 +1,259 @@
+#include "engine/pack.h"
+#include "engine/crc32.h"
+#include "engine/lz4.h"
+#include "engine/path_utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+namespace Lumix
+{
+
+
+static u64 alignUp(u64 value, u64 alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+
+PackFile::PackFile(IAllocator& allocator)
+	: m_allocator(allocator)
+{}
+
+
+bool PackFile::open(const void* mem, u64 size)
+{
+	close();
+	if (size < sizeof(PackHeader)) return false;
+
+	const PackHeader* header = (const PackHeader*)mem;
+	if (header->magic != PackHeader::MAGIC) return false;
+	if (header->version > (u32)PackHeader::Version::LATEST) return false;
+	if (header->block_size == 0) return false;
+
+	const u64 index_size = u64(header->entries_count) * sizeof(PackEntry) + u64(header->blocks_count) * sizeof(PackBlock);
+	if (sizeof(PackHeader) + index_size > header->data_offset || header->data_offset > size) return false;
+
+	const u8* index = (const u8*)mem + sizeof(PackHeader);
+	if (crc32(index, (int)index_size) != header->index_crc) return false;
+
+	const PackEntry* entries = (const PackEntry*)index;
+	const PackBlock* blocks = (const PackBlock*)(entries + header->entries_count);
+	for (u32 i = 0; i < header->blocks_count; ++i) {
+		const PackBlock& block = blocks[i];
+		if (block.compressed_size > header->block_size) return false;
+		if (block.offset < header->data_offset || block.offset + block.compressed_size > size) return false;
+	}
+	for (u32 i = 0; i < header->entries_count; ++i) {
+		const PackEntry& entry = entries[i];
+		if (i > 0 && entries[i - 1].hash >= entry.hash) return false;
+		const u64 blocks_count = (entry.size + header->block_size - 1) / header->block_size;
+		if (entry.first_block + blocks_count > header->blocks_count) return false;
+	}
+
+	m_mem = (const u8*)mem;
+	m_size = size;
+	m_header = header;
+	m_entries = entries;
+	m_blocks = blocks;
+	return true;
+}
+
+
+void PackFile::close()
+{
+	m_mem = nullptr;
+	m_size = 0;
+	m_header = nullptr;
+	m_entries = nullptr;
+	m_blocks = nullptr;
+}
+
+
+const PackEntry* PackFile::find(u32 path_hash) const
+{
+	if (!m_header) return nullptr;
+
+	u32 begin = 0;
+	u32 end = m_header->entries_count;
+	while (begin < end) {
+		const u32 mid = begin + (end - begin) / 2;
+		if (m_entries[mid].hash < path_hash) {
+			begin = mid + 1;
+		}
+		else {
+			end = mid;
+		}
+	}
+	if (begin < m_header->entries_count && m_entries[begin].hash == path_hash) return &m_entries[begin];
+	return nullptr;
+}
+
+
+u32 PackFile::getBlocksCount(const PackEntry& entry) const
+{
+	return u32((entry.size + m_header->block_size - 1) / m_header->block_size);
+}
+
+
+const u8* PackFile::getStoredData(const PackEntry& entry) const
+{
+	const u32 block_size = m_header->block_size;
+	const PackBlock* blocks = m_blocks + entry.first_block;
+	const u32 blocks_count = getBlocksCount(entry);
+	if (blocks_count == 0) return m_mem + m_header->data_offset;
+
+	for (u32 i = 0; i < blocks_count; ++i) {
+		const u64 raw_size = minimum(u64(block_size), entry.size - u64(i) * block_size);
+		if (blocks[i].compressed_size != raw_size) return nullptr;
+		if (blocks[i].offset != blocks[0].offset + u64(i) * block_size) return nullptr;
+	}
+	return m_mem + blocks[0].offset;
+}
+
+
+bool PackFile::read(const PackEntry& entry, u64 offset, u64 size, u8* out) const
+{
+	if (offset > entry.size || size > entry.size - offset) return false;
+
+	const u32 block_size = m_header->block_size;
+	// only for blocks which are not read whole
+	Array<u8> partial(m_allocator);
+	const u64 end = offset + size;
+	u64 pos = offset;
+	while (pos < end) {
+		const u32 block_idx = u32(pos / block_size);
+		const PackBlock& block = m_blocks[entry.first_block + block_idx];
+		const u64 block_start = u64(block_idx) * block_size;
+		const u32 raw_size = u32(minimum(u64(block_size), entry.size - block_start));
+		const u32 offset_in_block = u32(pos - block_start);
+		const u32 count = u32(minimum(u64(raw_size - offset_in_block), end - pos));
+		const u8* src = m_mem + block.offset;
+
+		if (block.compressed_size == raw_size) {
+			memcpy(out, src + offset_in_block, count);
+		}
+		else if (count == raw_size) {
+			if (!LZ4::decompress(src, block.compressed_size, out, raw_size)) return false;
+		}
+		else {
+			partial.resize(raw_size);
+			if (!LZ4::decompress(src, block.compressed_size, partial.begin(), raw_size)) return false;
+			memcpy(out, partial.begin() + offset_in_block, count);
+		}
+		out += count;
+		pos += count;
+	}
+	return true;
+}
+
+
+bool PackFile::verify() const
+{
+	if (!m_header) return false;
+
+	for (u32 i = 0; i < m_header->blocks_count; ++i) {
+		const PackBlock& block = m_blocks[i];
+		if (crc32(m_mem + block.offset, (int)block.compressed_size) != block.crc) return false;
+	}
+	return true;
+}
+
+
+PackWriter::PackWriter(IAllocator& allocator, u32 block_size)
+	: m_allocator(allocator)
+	, m_block_size(block_size)
+	, m_entries(allocator)
+	, m_blocks(allocator)
+	, m_hashes(allocator)
+	, m_data(allocator)
+	, m_compressed(allocator)
+{
+	m_compressed.resize(LZ4::getMaxCompressedSize(block_size));
+}
+
+
+bool PackWriter::add(const char* path, const void* data, u64 size)
+{
+	char normalized[MAX_PATH_LENGTH];
+	PathUtils::normalize(path, Span(normalized));
+	const u32 hash = crc32(normalized);
+	if (m_hashes.find(hash).isValid()) return false;
+	m_hashes.insert(hash, m_entries.size());
+
+	// so stored entries are aligned when used in place
+	static const u8 zeros[PackHeader::ENTRY_ALIGNMENT] = {};
+	const u64 aligned = alignUp(m_data.getPos(), PackHeader::ENTRY_ALIGNMENT);
+	m_data.write(zeros, aligned - m_data.getPos());
+
+	PackEntry& entry = m_entries.emplace();
+	entry.hash = hash;
+	entry.first_block = m_blocks.size();
+	entry.size = size;
+	m_uncompressed_size += size;
+
+	const u8* src = (const u8*)data;
+	for (u64 pos = 0; pos < size; pos += m_block_size) {
+		const u32 raw_size = u32(minimum(u64(m_block_size), size - pos));
+		const u32 compressed_size = LZ4::compress(src + pos, raw_size, m_compressed.begin(), m_compressed.size());
+
+		PackBlock& block = m_blocks.emplace();
+		block.offset = m_data.getPos();
+		if (compressed_size > 0 && compressed_size < raw_size) {
+			block.compressed_size = compressed_size;
+			m_data.write(m_compressed.begin(), compressed_size);
+		}
+		else {
+			block.compressed_size = raw_size;
+			m_data.write(src + pos, raw_size);
+		}
+		block.crc = crc32((const u8*)m_data.getData() + block.offset, (int)block.compressed_size);
+	}
+	return true;
+}
+
+
+bool PackWriter::write(IOutputStream& stream)
+{
+	Array<PackEntry> entries(m_allocator);
+	entries.resize(m_entries.size());
+	if (!m_entries.empty()) memcpy(entries.begin(), m_entries.begin(), m_entries.byte_size());
+	qsort(entries.begin(), entries.size(), sizeof(entries[0]), [](const void* a, const void* b) -> int {
+		const u32 a_hash = ((const PackEntry*)a)->hash;
+		const u32 b_hash = ((const PackEntry*)b)->hash;
+		return a_hash < b_hash ? -1 : (a_hash > b_hash ? 1 : 0);
+	});
+
+	PackHeader header;
+	header.magic = PackHeader::MAGIC;
+	header.version = (u32)PackHeader::Version::LATEST;
+	header.entries_count = entries.size();
+	header.blocks_count = m_blocks.size();
+	header.block_size = m_block_size;
+	header.data_offset = alignUp(sizeof(header) + entries.byte_size() + m_blocks.byte_size(), PackHeader::DATA_ALIGNMENT);
+
+	Array<PackBlock> blocks(m_allocator);
+	blocks.reserve(m_blocks.size());
+	for (const PackBlock& block : m_blocks) {
+		PackBlock& b = blocks.emplace(block);
+		b.offset += header.data_offset;
+	}
+
+	header.index_crc = crc32(entries.begin(), (int)entries.byte_size());
+	header.index_crc = continueCrc32(header.index_crc, blocks.begin(), (int)blocks.byte_size());
+
+	const u64 padding = header.data_offset - sizeof(header) - entries.byte_size() - blocks.byte_size();
+	Array<u8> zeros(m_allocator);
+	zeros.resize((int)padding);
+	if (padding > 0) memset(zeros.begin(), 0, zeros.byte_size());
+
+	bool success = stream.write(&header, sizeof(header));
+	success = success && stream.write(entries.begin(), entries.byte_size());
+	success = success && stream.write(blocks.begin(), blocks.byte_size());
+	success = success && stream.write(zeros.begin(), zeros.byte_size());
+	success = success && stream.write(m_data.getData(), m_data.getPos());
+	return success;
+}
+
+
+} // namespace Lumix
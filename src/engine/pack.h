@@ -0,0 +1,120 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/hash_map.h"
+#include "engine/stream.h"
+
+
+namespace Lumix
+{
+
+
+// read-only archive of files, the bundle embedded in the executable is a pack
+// layout: header, entries sorted by path hash, blocks, data starting at DATA_ALIGNMENT
+// entries are split into blocks, each compressed on its own, so any part of an entry can be read
+// without decompressing the whole entry
+// blocks which do not compress are stored, an entry with only stored blocks can be used in place
+struct PackHeader
+{
+	static const u32 MAGIC = 0x4b50414c; // 'LAPK'
+	static const u32 DATA_ALIGNMENT = 4096;
+	static const u32 ENTRY_ALIGNMENT = 16;
+	static const u32 DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+	enum class Version : u32 {
+		FIRST,
+
+		LATEST
+	};
+
+	u32 magic;
+	u32 version;
+	u32 entries_count;
+	u32 blocks_count;
+	u32 block_size;
+	// crc32 of entries and blocks
+	u32 index_crc;
+	u64 data_offset;
+};
+
+
+struct PackEntry
+{
+	// same as Path::getHash
+	u32 hash;
+	u32 first_block;
+	u64 size;
+};
+
+
+struct PackBlock
+{
+	// from the beginning of the pack
+	u64 offset;
+	// equal to the uncompressed size if the block is stored
+	u32 compressed_size;
+	// crc32 of the block as it is in the pack
+	u32 crc;
+};
+
+
+class LUMIX_ENGINE_API PackFile
+{
+public:
+	explicit PackFile(IAllocator& allocator);
+
+	// mem is not copied and must stay valid while the pack is open, checks the header and the index
+	bool open(const void* mem, u64 size);
+	void close();
+	bool isOpen() const { return m_header != nullptr; }
+
+	const PackEntry* find(u32 path_hash) const;
+	u32 getEntriesCount() const { return m_header ? m_header->entries_count : 0; }
+	const PackEntry& getEntry(u32 idx) const { return m_entries[idx]; }
+	// data of the entry if all its blocks are stored, null if it must be decompressed
+	const u8* getStoredData(const PackEntry& entry) const;
+	// decompresses only blocks overlapping [offset, offset + size)
+	bool read(const PackEntry& entry, u64 offset, u64 size, u8* out) const;
+	// checks crc of all blocks, too slow to be done on every read
+	bool verify() const;
+
+private:
+	u32 getBlocksCount(const PackEntry& entry) const;
+
+	IAllocator& m_allocator;
+	const u8* m_mem = nullptr;
+	u64 m_size = 0;
+	const PackHeader* m_header = nullptr;
+	const PackEntry* m_entries = nullptr;
+	const PackBlock* m_blocks = nullptr;
+};
+
+
+class LUMIX_ENGINE_API PackWriter
+{
+public:
+	explicit PackWriter(IAllocator& allocator, u32 block_size = PackHeader::DEFAULT_BLOCK_SIZE);
+
+	// data are compressed right away, fails if a file with the same path hash was already added
+	bool add(const char* path, const void* data, u64 size);
+	bool write(IOutputStream& stream);
+
+	u32 getEntriesCount() const { return m_entries.size(); }
+	u64 getUncompressedSize() const { return m_uncompressed_size; }
+	u64 getDataSize() const { return m_data.getPos(); }
+
+private:
+	IAllocator& m_allocator;
+	u32 m_block_size;
+	Array<PackEntry> m_entries;
+	// offsets are relative to m_data
+	Array<PackBlock> m_blocks;
+	HashMap<u32, u32> m_hashes;
+	OutputMemoryStream m_data;
+	Array<u8> m_compressed;
+	u64 m_uncompressed_size = 0;
+};
+
+
+} // namespace Lumix
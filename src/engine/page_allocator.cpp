@@ -1,6 +1,8 @@
 #include "page_allocator.h"
+#include "engine/log.h"
+#include "engine/os.h"
 #include "mt/atomic.h"
-#include "engine/win/simple_win.h"
+#include "mt/thread.h"
 #include <string.h>
 
 
@@ -8,50 +10,296 @@ namespace Lumix
 {
 
 
+// page pointers are PAGE_SIZE aligned and fit in 48 bits, the remaining bits are used as an ABA tag
+static const u32 PAGE_SHIFT = 14;
+static const u32 TAG_SHIFT = 48 - PAGE_SHIFT;
+static_assert(PageAllocator::PAGE_SIZE == 1 << PAGE_SHIFT, "PAGE_SHIFT does not match PAGE_SIZE");
+
+
+static LUMIX_FORCE_INLINE i64 packPage(void* page, u64 tag)
+{
+	return i64(((uintptr)page >> PAGE_SHIFT) | (tag << TAG_SHIFT));
+}
+
+
+static LUMIX_FORCE_INLINE void* unpackPage(i64 value)
+{
+	return (void*)uintptr(((u64)value & ((1ULL << TAG_SHIFT) - 1)) << PAGE_SHIFT);
+}
+
+
+static LUMIX_FORCE_INLINE u64 unpackTag(i64 value)
+{
+	return (u64)value >> TAG_SHIFT;
+}
+
+
+static LUMIX_FORCE_INLINE void* getNext(void* page)
+{
+	void* next;
+	memcpy(&next, page, sizeof(next));
+	return next;
+}
+
+
+static LUMIX_FORCE_INLINE void setNext(void* page, void* next)
+{
+	memcpy(page, &next, sizeof(next));
+}
+
+
+static void lock(volatile i32* value)
+{
+	for (u32 i = 0; !MT::compareAndExchange(value, 1, 0); ++i) {
+		if (i > 64) MT::yield();
+	}
+}
+
+
+static void unlock(volatile i32* value)
+{
+	MT::memoryBarrier();
+	*value = 0;
+}
+
+
+// live allocators, threads exiting after an allocator was destroyed must not touch its magazines
+static struct
+{
+	enum { MAX_ALLOCATORS = 16 };
+
+	volatile i32 lock = 0;
+	volatile i32 last_id = 0;
+	PageAllocator* allocators[MAX_ALLOCATORS] = {};
+} g_allocators;
+
+
+struct ThreadMagazines
+{
+	enum { MAX_BINDINGS = 4 };
+
+	~ThreadMagazines()
+	{
+		lock(&g_allocators.lock);
+		for (u32 i = 0; i < count; ++i) {
+			Binding& b = bindings[i];
+			for (PageAllocator* allocator : g_allocators.allocators) {
+				if (allocator == b.allocator && allocator->id == b.allocator_id) {
+					allocator->releaseMagazine(*b.magazine);
+					break;
+				}
+			}
+		}
+		unlock(&g_allocators.lock);
+		count = 0;
+		destroyed = true;
+	}
+
+	struct Binding
+	{
+		const PageAllocator* allocator;
+		u32 allocator_id;
+		PageAllocator::Magazine* magazine;
+	};
+
+	Binding bindings[MAX_BINDINGS];
+	u32 count;
+	// static destructors can still allocate after the thread's magazines are gone
+	bool destroyed;
+};
+
+
+static thread_local ThreadMagazines g_thread_magazines;
+
+
+PageAllocator::PageAllocator()
+{
+	id = (u32)MT::atomicIncrement(&g_allocators.last_id);
+	lock(&g_allocators.lock);
+	int i = 0;
+	while (i < g_allocators.MAX_ALLOCATORS && g_allocators.allocators[i]) ++i;
+	LUMIX_FATAL(i < g_allocators.MAX_ALLOCATORS);
+	g_allocators.allocators[i] = this;
+	unlock(&g_allocators.lock);
+}
+
+
 PageAllocator::~PageAllocator()
 {
-	void* p = free_pages;
-	while (p) {
-		void* tmp = p;
-		memcpy(&p, p, sizeof(p));
-		VirtualFree(tmp, 0, MEM_RELEASE);
+	lock(&g_allocators.lock);
+	for (PageAllocator*& allocator : g_allocators.allocators) {
+		if (allocator == this) allocator = nullptr;
+	}
+	unlock(&g_allocators.lock);
+
+	for (int i = 0; i < chunks_count; ++i) {
+		OS::memRelease(chunks[i]);
+	}
+}
+
+
+bool PageAllocator::enableLargePages()
+{
+	ASSERT(chunks_count == 0);
+	const u32 large_page_size = OS::getMemLargePageSize();
+	large_pages = large_page_size != 0 && CHUNK_SIZE % large_page_size == 0;
+	return large_pages;
+}
+
+
+PageAllocator::Magazine* PageAllocator::getMagazine()
+{
+	ThreadMagazines& tm = g_thread_magazines;
+	for (u32 i = 0; i < tm.count; ++i) {
+		ThreadMagazines::Binding& b = tm.bindings[i];
+		if (b.allocator != this) continue;
+		if (b.allocator_id == id) return b.magazine;
+		// a destroyed allocator had the same address
+		tm.bindings[i] = tm.bindings[tm.count - 1];
+		--tm.count;
+		break;
+	}
+	if (tm.destroyed || tm.count == ThreadMagazines::MAX_BINDINGS) return nullptr;
+
+	for (Magazine& magazine : magazines) {
+		if (magazine.used || !MT::compareAndExchange(&magazine.used, 1, 0)) continue;
+
+		ThreadMagazines::Binding& b = tm.bindings[tm.count];
+		b.allocator = this;
+		b.allocator_id = id;
+		b.magazine = &magazine;
+		++tm.count;
+		return &magazine;
+	}
+	// more threads than magazines, the rest uses the free stack directly
+	return nullptr;
+}
+
+
+void PageAllocator::releaseMagazine(Magazine& magazine)
+{
+	if (magazine.count > 0) {
+		for (u32 i = 0; i + 1 < magazine.count; ++i) {
+			setNext(magazine.pages[i], magazine.pages[i + 1]);
+		}
+		pushFree(magazine.pages[0], magazine.pages[magazine.count - 1]);
+		magazine.count = 0;
 	}
+	MT::memoryBarrier();
+	magazine.used = 0;
 }
 
 
-void PageAllocator::lock()
+void* PageAllocator::popFree()
 {
-	mutex.enter();
+	for (;;) {
+		const i64 top = free_pages;
+		void* page = unpackPage(top);
+		if (!page) return nullptr;
+		// page can be popped and reused by another thread meanwhile, the tag makes the cas fail then
+		void* next = getNext(page);
+		if (MT::compareAndExchange64(&free_pages, packPage(next, unpackTag(top) + 1), top)) return page;
+	}
 }
 
 
-void PageAllocator::unlock()
+void PageAllocator::pushFree(void* first, void* last)
 {
-	mutex.exit();
+	for (;;) {
+		const i64 top = free_pages;
+		setNext(last, unpackPage(top));
+		if (MT::compareAndExchange64(&free_pages, packPage(first, unpackTag(top) + 1), top)) return;
+	}
 }
 
 
-void* PageAllocator::allocate(bool lock)
+void* PageAllocator::grow()
 {
-	if (lock) mutex.enter();
-	if (free_pages) {
-		void* tmp = free_pages;
-		memcpy(&free_pages, free_pages, sizeof(free_pages));
-		if (lock) mutex.exit();
-		return tmp;
+	MT::CriticalSectionLock lock(chunks_mutex);
+	// someone else could have grown the pool while we waited for the lock
+	void* page = popFree();
+	if (page) return page;
+
+	LUMIX_FATAL(chunks_count < MAX_CHUNKS);
+	void* chunk = nullptr;
+	if (large_pages) {
+		chunk = OS::memReserveLargePages(CHUNK_SIZE);
+		if (!chunk) {
+			logWarning("Engine") << "Failed to allocate large pages, falling back to normal pages.";
+			large_pages = false;
+		}
 	}
-	if (lock) mutex.exit();
-	return VirtualAlloc(nullptr, PAGE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (!chunk) {
+		chunk = OS::memReserve(CHUNK_SIZE);
+		LUMIX_FATAL(chunk);
+		OS::memCommit(chunk, CHUNK_SIZE);
+	}
+	chunks[chunks_count] = chunk;
+	++chunks_count;
+
+	u8* first = (u8*)(((uintptr)chunk + PAGE_SIZE - 1) & ~uintptr(PAGE_SIZE - 1));
+	const u32 count = u32(((u8*)chunk + CHUNK_SIZE - first) / PAGE_SIZE);
+	for (u32 i = 1; i + 1 < count; ++i) {
+		setNext(first + i * PAGE_SIZE, first + (i + 1) * PAGE_SIZE);
+	}
+	// the first page is returned, the rest goes to the free stack in one go
+	pushFree(first + PAGE_SIZE, first + (count - 1) * PAGE_SIZE);
+	return first;
 }
 
 
-void PageAllocator::deallocate(void* mem, bool lock)
+void* PageAllocator::allocate()
 {
-	if (lock) mutex.enter();
-	memcpy(mem, &free_pages, sizeof(free_pages));
-	free_pages = mem;
-	if (lock) mutex.exit();
+	Magazine* magazine = getMagazine();
+	void* page;
+	if (magazine && magazine->count > 0) {
+		--magazine->count;
+		page = magazine->pages[magazine->count];
+	}
+	else {
+		page = popFree();
+		if (!page) page = grow();
+		if (magazine) {
+			while (magazine->count < MAGAZINE_SIZE / 2) {
+				void* tmp = popFree();
+				if (!tmp) break;
+				magazine->pages[magazine->count] = tmp;
+				++magazine->count;
+			}
+		}
+	}
+
+	const i32 count = MT::atomicIncrement(&allocated_count);
+	for (;;) {
+		const i32 peak = peak_count;
+		if (count <= peak || MT::compareAndExchange(&peak_count, count, peak)) break;
+	}
+	return page;
+}
+
+
+void PageAllocator::deallocate(void* mem)
+{
+	MT::atomicDecrement(&allocated_count);
+
+	Magazine* magazine = getMagazine();
+	if (!magazine) {
+		pushFree(mem, mem);
+		return;
+	}
+
+	if (magazine->count == MAGAZINE_SIZE) {
+		// give back the older half, so other threads can use it
+		for (u32 i = 0; i < MAGAZINE_SIZE / 2 - 1; ++i) {
+			setNext(magazine->pages[i], magazine->pages[i + 1]);
+		}
+		pushFree(magazine->pages[0], magazine->pages[MAGAZINE_SIZE / 2 - 1]);
+		memmove(magazine->pages, magazine->pages + MAGAZINE_SIZE / 2, sizeof(magazine->pages[0]) * MAGAZINE_SIZE / 2);
+		magazine->count = MAGAZINE_SIZE / 2;
+	}
+	magazine->pages[magazine->count] = mem;
+	++magazine->count;
 }
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
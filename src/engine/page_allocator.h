@@ -1,6 +1,7 @@
 #pragma once
 
 
+#include "allocator.h"
 #include "mt/atomic.h"
 #include "mt/sync.h"
 
@@ -9,22 +10,60 @@ namespace Lumix
 {
 
 
+// allocate and deallocate do not lock, pages are cached per thread and shared through a lock-free stack
 class LUMIX_ENGINE_API PageAllocator final
 {
 public:
 	enum { PAGE_SIZE = 16384 };
 
+	PageAllocator();
 	~PageAllocator();
-		
-	void* allocate(bool lock);
-	void deallocate(void* mem, bool lock);
 
-	void lock();
-	void unlock();
-		
+	// has to be called before the first allocation, returns false if large pages are not available
+	bool enableLargePages();
+
+	void* allocate();
+	void deallocate(void* mem);
+
+	u32 getAllocatedCount() const { return allocated_count; }
+	u32 getPeakCount() const { return peak_count; }
+
 private:
-	void* free_pages = nullptr;
-	MT::CriticalSection mutex;
+	enum {
+		// pages are reserved from the OS in chunks, so they can be backed by 2MB large pages
+		CHUNK_SIZE = 2 * 1024 * 1024,
+		MAX_CHUNKS = 1024,
+		MAGAZINE_SIZE = 32,
+		MAX_MAGAZINES = 64
+	};
+
+	// a thread owns a magazine until it exits, then its pages return to the free stack
+	struct alignas(64) Magazine
+	{
+		void* pages[MAGAZINE_SIZE];
+		u32 count = 0;
+		volatile i32 used = 0;
+	};
+
+	friend struct ThreadMagazines;
+
+	void* popFree();
+	void pushFree(void* first, void* last);
+	void* grow();
+	Magazine* getMagazine();
+	void releaseMagazine(Magazine& magazine);
+
+	// page pointer and ABA tag packed together
+	alignas(64) volatile i64 free_pages = 0;
+	alignas(64) volatile i32 allocated_count = 0;
+	volatile i32 peak_count = 0;
+	Magazine magazines[MAX_MAGAZINES];
+	// threads remember their magazine by the allocator and this id, the address can be reused
+	u32 id;
+	MT::CriticalSection chunks_mutex;
+	void* chunks[MAX_CHUNKS] = {};
+	int chunks_count = 0;
+	bool large_pages = false;
 };
 
 
@@ -62,7 +101,7 @@ struct PagedList
 		while(i) {
 			T* tmp = i;
 			i = i->header.next;
-			allocator.deallocate(tmp, true);
+			allocator.deallocate(tmp);
 		}
 	}
 
@@ -74,31 +113,25 @@ struct PagedList
 	T* detach()
 	{
 		T* tmp = begin;
-		begin = end = nullptr;
+		begin = nullptr;
 		return tmp;
 	}
 
 
+	// can be called from multiple threads, pages are prepended, so their order is not preserved
 	T* push()
 	{
-		allocator.lock();
-		void* mem = allocator.allocate(false);
+		void* mem = allocator.allocate();
 		T* page = new (NewPlaceholder(), mem) T;
-		if(!begin) {
-			begin = end = page;
-		}
-		else {
-			end->header.next = page;
-			page->header.next = nullptr;
-			end = page;
+		for (;;) {
+			T* head = (T*)begin;
+			page->header.next = head;
+			if (MT::compareAndExchange64((volatile i64*)&begin, (i64)page, (i64)head)) return page;
 		}
-		allocator.unlock();
-		return page;
 	}
 
 
-	T* begin = nullptr;
-	T* end = nullptr;
+	T* volatile begin = nullptr;
 	PageAllocator& allocator;
 };
 
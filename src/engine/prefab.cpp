@@ -25,6 +25,7 @@ bool PrefabResource::load(u64 size, const u8* mem)
 {
 	data.resize((int)size);
 	copyMemory(data.begin(), mem, size);
+	m_size = size;
 	return true;
 }
 
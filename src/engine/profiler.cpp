@@ -2,18 +2,28 @@
 #include "engine/fibers.h"
 #include "engine/hash_map.h"
 #include "engine/allocator.h"
+#include "engine/log.h"
 #include "engine/mt/atomic.h"
 #include "engine/mt/sync.h"
 #include "engine/mt/task.h"
 #include "engine/mt/thread.h"
 #include "engine/os.h"
 #include "profiler.h"
+#include <stdlib.h>
 #include <string.h>
 
-#define INITGUID
-#include <Windows.h>
-#include <evntcons.h>
-#include <evntrace.h>
+#ifdef _WIN32
+	#define INITGUID
+	#include <Windows.h>
+	#include <evntcons.h>
+	#include <evntrace.h>
+#else
+	#include <linux/perf_event.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <time.h>
+	#include <unistd.h>
+#endif
 #include <thread>
 #include <assert.h>
 
@@ -25,28 +35,77 @@ namespace Profiler
 {
 
 
+enum {
+	BUFFER_SIZE = 1024 * 512,
+	CAPTURE_PERIOD_MS = 10,
+	// four buckets per power of two nanoseconds, up to ~34s
+	STATS_BUCKETS = 36 * 4,
+	// the window is split to slices, the oldest one is dropped as the window moves
+	STATS_SLICES = 10
+};
+
+
+struct OpenBlock
+{
+	const char* name;
+	u64 time;
+	// began before the stats could see it, its duration is unknown
+	bool is_partial;
+};
+
+
+// blocks open when a fiber started to wait, they continue in the blocks reopened after the wait
+struct FiberWaitBlocks
+{
+	i32 id;
+	u32 count = 0;
+	// begin times, 0 if unknown, as many as FiberSwitchData::blocks
+	u64 times[16];
+};
+
+
+// a ring with a single producer, readers copy it without blocking the producer
 struct ThreadContext
 {
 	ThreadContext(IAllocator& allocator) 
 		: buffer(allocator)
+		, snapshot(allocator)
+		, stats_stack(allocator)
 		, open_blocks(allocator)
 	{
-		buffer.resize(1024 * 512);
+		buffer.resize(BUFFER_SIZE);
 		open_blocks.reserve(64);
 	}
 
 	Array<const char*> open_blocks;
 	Array<u8> buffer;
-	u32 begin = 0;
-	u32 end = 0;
+	volatile u32 begin = 0;
+	volatile u32 end = 0;
+	// readers' copy of the ring, only new events are copied to it
+	Array<u8> snapshot;
+	u32 snapshot_begin = 0;
+	u32 snapshot_end = 0;
+	// position of the capture in the ring
+	u32 capture_pos = 0;
+	StaticString<64> captured_name;
+	// position of the block statistics in the ring and blocks they did not see end yet
+	u32 stats_pos = 0;
+	Array<OpenBlock> stats_stack;
+	FiberWaitBlocks stats_resumed;
+	u32 stats_reopened = 0;
 	u32 rows = 0;
 	bool open = false;
+	// protects name and flags, producers of the global context serialize on it too
 	MT::CriticalSection mutex;
 	StaticString<64> name;
 	bool show_in_profiler = false;
 	u32 thread_id;
 };
 
+
+#ifdef _WIN32
+
+
 #define SWITCH_CONTEXT_OPCODE 36
 
 #pragma pack(1)
@@ -86,24 +145,172 @@ struct TraceTask : MT::Task {
 };
 
 
+#else
+
+
+// context switches of each of our threads are read from its own perf_event_open ring,
+// migrations are detected when a thread is switched in on a different cpu
+struct TraceTask : MT::Task {
+	enum {
+		RING_PAGES = 8,
+		PERIOD_MS = 10
+	};
+
+	struct ThreadEvents
+	{
+		int fd;
+		u8* ring;
+		u32 thread_id;
+		u32 cpu;
+	};
+
+	TraceTask(IAllocator& allocator);
+
+	int task() override;
+	bool addThread(u32 thread_id);
+	void removeThread(u32 thread_id);
+	void drain(ThreadEvents& thread);
+	void shutdown();
+	void calibrateClock();
+	u64 toTimestamp(u64 monotonic_ns) const;
+
+	MT::CriticalSection mutex;
+	Array<ThreadEvents> threads;
+	u32 page_size;
+	volatile bool finished = false;
+	// perf records are timed by CLOCK_MONOTONIC, this maps it to OS::Timer's timestamps
+	u64 clock_base_ns;
+	u64 clock_base_ticks;
+	double ticks_per_ns;
+};
+
+
+// closes the thread's perf ring when the thread exits, the kernel can give its id to a new thread
+struct ThreadEventsGuard
+{
+	~ThreadEventsGuard();
+
+	u32 thread_id;
+};
+
+
+static thread_local ThreadEventsGuard g_thread_events;
+
+
+#endif
+
+
+// drains the rings to a capture file, see CaptureHeader
+struct CaptureTask : MT::Task {
+	CaptureTask(IAllocator& allocator);
+
+	int task() override;
+	void drain();
+	void drain(ThreadContext& ctx, i32 thread_idx);
+	void writeString(const char* str);
+	void writeChunkHeader(CaptureChunkType type, u32 size);
+
+	OS::OutputFile file;
+	MT::Event wakeup;
+	volatile bool finished = false;
+	HashMap<const char*, bool> strings;
+	Array<u8> events;
+	// chunks are collected here and written to the file once per drain
+	OutputMemoryStream blob;
+	u32 counters_count = 0;
+};
+
+
+struct BlockStatsSlice
+{
+	u32 histogram[STATS_BUCKETS];
+	u32 calls;
+	u64 total;
+	u64 min;
+	u64 max;
+};
+
+
+struct BlockStatsEntry
+{
+	const char* name;
+	BlockStatsSlice slices[STATS_SLICES];
+};
+
+
+// new events of a thread in BlockStatsState::events
+struct BlockStatsStream
+{
+	ThreadContext* ctx;
+	u32 pos;
+	u32 end;
+};
+
+
+struct BlockStatsState
+{
+	BlockStatsState(IAllocator& allocator)
+		: allocator(allocator)
+		, entries(allocator)
+		, entries_map(allocator)
+		, events(allocator)
+		, streams(allocator)
+		, fiber_waits(allocator)
+	{}
+
+	~BlockStatsState()
+	{
+		for (BlockStatsEntry* entry : entries) LUMIX_DELETE(allocator, entry);
+	}
+
+	IAllocator& allocator;
+	MT::CriticalSection mutex;
+	Array<BlockStatsEntry*> entries;
+	HashMap<const char*, int> entries_map;
+	Array<u8> events;
+	Array<BlockStatsStream> streams;
+	// fibers which started to wait and were not seen to resume yet
+	Array<FiberWaitBlocks> fiber_waits;
+	u32 frames[STATS_SLICES] = {};
+	u32 slice = 0;
+	u64 slice_start;
+	u64 slice_duration;
+	double ns_per_tick;
+	u64 dump_period = 0;
+	u64 last_dump;
+	OS::OutputFile dump_file;
+	bool dump_to_file = false;
+};
+
+
 static struct Instance
 {
 	Instance()
 		: contexts(allocator)
+		, counters(allocator)
 		, trace_task(allocator)
 		, global_context(allocator)
 	{
+		global_context.thread_id = 0;
 		startTrace();
 	}
 
 
 	~Instance()
 	{
-		CloseTrace(trace_task.open_handle);
-		trace_task.destroy();
+		stopCapture();
+		enableBlockStats(0);
+		#ifdef _WIN32
+			CloseTrace(trace_task.open_handle);
+			trace_task.destroy();
+		#else
+			trace_task.shutdown();
+		#endif
 	}
 
 
+#ifdef _WIN32
+
 	static void startTrace()
 	{
 		static TRACEHANDLE trace_handle;
@@ -139,13 +346,33 @@ static struct Instance
 		g_instance.trace_task.open_handle = OpenTrace(&trace);
 		g_instance.trace_task.create("Profiler trace", true);
 	}
+#else
+	void startTrace()
+	{
+		// threads are added as they register, the calling thread checks whether perf events are available
+		const u32 thread_id = (u32)syscall(SYS_gettid);
+		context_switches_enabled = trace_task.addThread(thread_id);
+		if (context_switches_enabled) {
+			g_thread_events.thread_id = thread_id;
+			trace_task.create("Profiler trace", true);
+		}
+	}
+#endif
 
 
 	ThreadContext* getThreadContext()
 	{
 		thread_local ThreadContext* ctx = [&](){
 			ThreadContext* new_ctx = LUMIX_NEW(allocator, ThreadContext)(allocator);
-			new_ctx->thread_id = MT::getCurrentThreadID();
+			#ifdef _WIN32
+				new_ctx->thread_id = MT::getCurrentThreadID();
+			#else
+				// context switch records use kernel thread ids, pthread_t does not match them
+				new_ctx->thread_id = (u32)syscall(SYS_gettid);
+				if (context_switches_enabled && trace_task.addThread(new_ctx->thread_id)) {
+					g_thread_events.thread_id = new_ctx->thread_id;
+				}
+			#endif
 			MT::CriticalSectionLock lock(mutex);
 			contexts.push(new_ctx);
 			return new_ctx;
@@ -157,6 +384,7 @@ static struct Instance
 
 	DefaultAllocator allocator;
 	Array<ThreadContext*> contexts;
+	Array<const char*> counters;
 	MT::CriticalSection mutex;
 	OS::Timer timer;
 	bool paused = false;
@@ -166,120 +394,133 @@ static struct Instance
 	u64 last_frame_time = 0;
 	volatile i32 fiber_wait_id = 0;
 	TraceTask trace_task;
+	CaptureTask* capture_task = nullptr;
+	BlockStatsState* block_stats = nullptr;
 	ThreadContext global_context;
 } g_instance;
 
 
-template <typename T>
-void write(ThreadContext& ctx, u64 timestamp, EventType type, const T& value)
+static LUMIX_FORCE_INLINE u16 readEventSize(const u8* buf, u32 buf_size, u32 pos)
 {
-	if (g_instance.paused && timestamp > g_instance.paused_time) return;
-
-	#pragma pack(1)
-		struct {
-			EventHeader header;
-			T value;
-		} v;
-	#pragma pack()
-	v.header.type = type;
-	v.header.size = sizeof(v);
-	v.header.time = timestamp;
-	v.value = value;
-
-	MT::CriticalSectionLock lock(ctx.mutex);
-	u8* buf = ctx.buffer.begin();
-	const int buf_size = ctx.buffer.size();
+	// the size is the first member of EventHeader and can be split by the end of the ring
+	return u16(buf[pos % buf_size] | (buf[(pos + 1) % buf_size] << 8));
+}
 
-	while (sizeof(v) + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
-	}
 
-	const u32 lend = ctx.end % buf_size;
-	if (buf_size - lend >= sizeof(v)) {
-		memcpy(buf + lend, &v, sizeof(v));
+static void copyToRing(u8* buf, u32 buf_size, u32 pos, const void* data, u32 size)
+{
+	const u32 l = pos % buf_size;
+	if (buf_size - l >= size) {
+		memcpy(buf + l, data, size);
 	}
 	else {
-		memcpy(buf + lend, &v, buf_size - lend);
-		memcpy(buf, ((u8*)&v) + buf_size - lend, sizeof(v) - (buf_size - lend));
+		memcpy(buf + l, data, buf_size - l);
+		memcpy(buf, (const u8*)data + buf_size - l, size - (buf_size - l));
 	}
+}
 
-	ctx.end += sizeof(v);
-};
 
-template <typename T>
-void write(ThreadContext& ctx, EventType type, const T& value)
+static void writeEvent(ThreadContext& ctx, u64 timestamp, EventType type, const void* data, u32 size)
 {
-	if (g_instance.paused) return;
+	EventHeader header;
+	header.type = type;
+	ASSERT(sizeof(header) + size <= 0xffff);
+	header.size = u16(sizeof(header) + size);
+	header.time = timestamp;
 
-#pragma pack(1)
-	struct {
-		EventHeader header;
-		T value;
-	} v;
-#pragma pack()
-	v.header.type = type;
-	v.header.size = sizeof(v);
-	v.header.time = OS::Timer::getRawTimestamp();
-	v.value = value;
+	// the global context has many producers, thread contexts only their own thread
+	const bool shared = &ctx == &g_instance.global_context;
+	if (shared) ctx.mutex.enter();
 
-	MT::CriticalSectionLock lock(ctx.mutex);
 	u8* buf = ctx.buffer.begin();
-	const int buf_size = ctx.buffer.size();
-
-	while (sizeof(v) + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
+	const u32 buf_size = ctx.buffer.size();
+	const u32 end = ctx.end;
+	if (header.size + end - ctx.begin > buf_size) {
+		// drop more than needed, so readers are synchronized with only once in a while
+		u32 begin = ctx.begin;
+		while (header.size + buf_size / 16 + end - begin > buf_size) {
+			begin += readEventSize(buf, buf_size, begin);
+		}
+		ctx.begin = begin;
+		// readers must see the new begin before the old events are overwritten
+		MT::memoryBarrier();
 	}
 
-	const u32 lend = ctx.end % buf_size;
-	if (buf_size - lend >= sizeof(v)) {
-		memcpy(buf + lend, &v, sizeof(v));
-	}
-	else {
-		memcpy(buf + lend, &v, buf_size - lend);
-		memcpy(buf, ((u8*)&v) + buf_size - lend, sizeof(v) - (buf_size - lend));
-	}
+	copyToRing(buf, buf_size, end, &header, sizeof(header));
+	copyToRing(buf, buf_size, end + sizeof(header), data, size);
+	MT::memoryBarrier();
+	ctx.end = end + header.size;
+
+	if (shared) ctx.mutex.exit();
+}
+
+
+template <typename T>
+void write(ThreadContext& ctx, u64 timestamp, EventType type, const T& value)
+{
+	if (g_instance.paused && timestamp > g_instance.paused_time) return;
+	writeEvent(ctx, timestamp, type, &value, sizeof(value));
+};
 
-	ctx.end += sizeof(v);
+template <typename T>
+void write(ThreadContext& ctx, EventType type, const T& value)
+{
+	if (g_instance.paused) return;
+	writeEvent(ctx, OS::Timer::getRawTimestamp(), type, &value, sizeof(value));
 };
 
 
 void write(ThreadContext& ctx, EventType type, const u8* data, int size)
 {
 	if (g_instance.paused) return;
+	writeEvent(ctx, OS::Timer::getRawTimestamp(), type, data, size);
+};
 
-	EventHeader header;
-	header.type = type;
-	ASSERT(sizeof(header) + size <= 0xffff);
-	header.size = u16(sizeof(header) + size);
-	header.time = OS::Timer::getRawTimestamp();
 
-	MT::CriticalSectionLock lock(ctx.mutex);
-	u8* buf = ctx.buffer.begin();
+// copies [from, end) of the ring to `dst` and returns the producer's begin after the copy,
+// events in front of it could have been overwritten while they were copied
+static u32 copyFromRing(ThreadContext& ctx, u32 from, u32 end, u8* dst, u32 dst_size, bool linear)
+{
+	const u8* buf = ctx.buffer.begin();
 	const u32 buf_size = ctx.buffer.size();
-
-	while (header.size + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
+	u32 pos = from;
+	while (pos != end) {
+		const u32 l = pos % buf_size;
+		const u32 size = minimum(end - pos, buf_size - l);
+		u8* out = linear ? dst + (pos - from) : dst + pos % dst_size;
+		memcpy(out, buf + l, size);
+		pos += size;
 	}
+	MT::memoryBarrier();
+	return ctx.begin;
+}
 
-	auto cpy = [&](const u8* ptr, u32 size) {
-		const u32 lend = ctx.end % buf_size;
-		if (buf_size - lend >= size) {
-			memcpy(buf + lend, ptr, size);
-		}
-		else {
-			memcpy(buf + lend, ptr, buf_size - lend);
-			memcpy(buf, ((u8*)ptr) + buf_size - lend, size - (buf_size - lend));
-		}
 
-		ctx.end += size;
-	};
+// positions wrap around, so they are compared by their distance
+static LUMIX_FORCE_INLINE bool isBefore(u32 a, u32 b)
+{
+	return i32(a - b) < 0;
+}
 
-	cpy((u8*)&header, sizeof(header));
-	cpy(data, size);
-};
+
+static void refreshSnapshot(ThreadContext& ctx)
+{
+	if (ctx.snapshot.empty()) ctx.snapshot.resize(ctx.buffer.size());
+
+	const u32 end = ctx.end;
+	MT::memoryBarrier();
+	const u32 begin = ctx.begin;
+	// events copied by previous refreshes are still in the snapshot
+	const bool continues = !isBefore(ctx.snapshot_end, begin) && !isBefore(end, ctx.snapshot_end);
+	const u32 from = continues ? ctx.snapshot_end : begin;
+	const u32 new_begin = copyFromRing(ctx, from, end, ctx.snapshot.begin(), ctx.snapshot.size(), false);
+
+	ctx.snapshot_begin = isBefore(end, new_begin) ? end : new_begin;
+	ctx.snapshot_end = end;
+}
+
+
+#ifdef _WIN32
 
 
 TraceTask::TraceTask(IAllocator& allocator)
@@ -303,10 +544,977 @@ void TraceTask::callback(PEVENT_RECORD event) {
 	rec.new_thread_id = cs->NewThreadId;
 	rec.old_thread_id = cs->OldThreadId;
 	rec.reason = cs->OldThreadWaitReason;
+	rec.cpu = event->BufferContext.ProcessorNumber;
 	write(g_instance.global_context, rec.timestamp, Profiler::EventType::CONTEXT_SWITCH, rec);
 };
 
 
+#else
+
+
+TraceTask::TraceTask(IAllocator& allocator)
+	: MT::Task(allocator)
+	, threads(allocator)
+{
+	page_size = (u32)sysconf(_SC_PAGESIZE);
+	ticks_per_ns = OS::Timer::getFrequency() / 1e9;
+	calibrateClock();
+}
+
+
+static u64 getMonotonicTime()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return u64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+// called periodically, so the two clocks do not drift apart
+void TraceTask::calibrateClock()
+{
+	const u64 before = getMonotonicTime();
+	const u64 ticks = OS::Timer::getRawTimestamp();
+	const u64 after = getMonotonicTime();
+	clock_base_ns = before + (after - before) / 2;
+	clock_base_ticks = ticks;
+}
+
+
+u64 TraceTask::toTimestamp(u64 monotonic_ns) const
+{
+	const i64 delta = i64(monotonic_ns - clock_base_ns);
+	return clock_base_ticks + i64(delta * ticks_per_ns);
+}
+
+
+ThreadEventsGuard::~ThreadEventsGuard()
+{
+	if (thread_id != 0) g_instance.trace_task.removeThread(thread_id);
+}
+
+
+bool TraceTask::addThread(u32 thread_id)
+{
+	{
+		MT::CriticalSectionLock lock(mutex);
+		for (const ThreadEvents& thread : threads) {
+			if (thread.thread_id == thread_id) return true;
+		}
+	}
+
+	perf_event_attr attr = {};
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = PERF_COUNT_SW_DUMMY;
+	attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CPU;
+	attr.sample_id_all = 1;
+	attr.context_switch = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.use_clockid = 1;
+	attr.clockid = CLOCK_MONOTONIC;
+
+	const int fd = (int)syscall(SYS_perf_event_open, &attr, thread_id, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (fd < 0) return false;
+
+	void* ring = mmap(nullptr, (RING_PAGES + 1) * page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ring == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+
+	ThreadEvents thread;
+	thread.fd = fd;
+	thread.ring = (u8*)ring;
+	thread.thread_id = thread_id;
+	thread.cpu = 0xffFFffFF;
+	MT::CriticalSectionLock lock(mutex);
+	threads.push(thread);
+	return true;
+}
+
+
+void TraceTask::removeThread(u32 thread_id)
+{
+	MT::CriticalSectionLock lock(mutex);
+	for (int i = 0, c = threads.size(); i < c; ++i) {
+		ThreadEvents& thread = threads[i];
+		if (thread.thread_id != thread_id) continue;
+
+		drain(thread);
+		munmap(thread.ring, (RING_PAGES + 1) * page_size);
+		close(thread.fd);
+		threads.swapAndPop(i);
+		return;
+	}
+}
+
+
+void TraceTask::drain(ThreadEvents& thread)
+{
+	perf_event_mmap_page* header = (perf_event_mmap_page*)thread.ring;
+	const u8* data = thread.ring + page_size;
+	const u64 data_size = RING_PAGES * page_size;
+	const u64 head = header->data_head;
+	// records must not be read before data_head
+	MT::memoryBarrier();
+
+	u64 tail = header->data_tail;
+	while (tail < head) {
+		// a record can be split by the end of the ring
+		u8 record[256];
+		perf_event_header record_header;
+		for (u32 i = 0; i < sizeof(record_header); ++i) {
+			((u8*)&record_header)[i] = data[(tail + i) % data_size];
+		}
+		if (record_header.size == 0 || record_header.size > sizeof(record)) break;
+		for (u32 i = 0; i < record_header.size; ++i) {
+			record[i] = data[(tail + i) % data_size];
+		}
+		tail += record_header.size;
+
+		if (record_header.type != PERF_RECORD_SWITCH) continue;
+
+		// sample_id follows the header, its members are given by sample_type
+		struct {
+			u32 pid;
+			u32 tid;
+			u64 time;
+			u32 cpu;
+			u32 reserved;
+		} sample_id;
+		memcpy(&sample_id, record + sizeof(record_header), sizeof(sample_id));
+
+		ContextSwitchRecord rec;
+		rec.timestamp = toTimestamp(sample_id.time);
+		rec.cpu = u8(sample_id.cpu);
+		if (record_header.misc & PERF_RECORD_MISC_SWITCH_OUT) {
+			rec.old_thread_id = thread.thread_id;
+			rec.new_thread_id = 0;
+			rec.reason = (record_header.misc & PERF_RECORD_MISC_SWITCH_OUT_PREEMPT) ? CONTEXT_SWITCH_PREEMPTED : CONTEXT_SWITCH_WAIT;
+			write(g_instance.global_context, rec.timestamp, EventType::CONTEXT_SWITCH, rec);
+			continue;
+		}
+
+		rec.old_thread_id = 0;
+		rec.new_thread_id = thread.thread_id;
+		rec.reason = CONTEXT_SWITCH_WAIT;
+		write(g_instance.global_context, rec.timestamp, EventType::CONTEXT_SWITCH, rec);
+		if (thread.cpu != sample_id.cpu && thread.cpu != 0xffFFffFF) {
+			rec.old_thread_id = thread.thread_id;
+			rec.reason = CONTEXT_SWITCH_MIGRATION;
+			write(g_instance.global_context, rec.timestamp, EventType::CONTEXT_SWITCH, rec);
+		}
+		thread.cpu = sample_id.cpu;
+	}
+
+	MT::memoryBarrier();
+	header->data_tail = head;
+}
+
+
+int TraceTask::task()
+{
+	while (!finished) {
+		MT::sleep(PERIOD_MS);
+		MT::CriticalSectionLock lock(mutex);
+		calibrateClock();
+		for (ThreadEvents& thread : threads) {
+			drain(thread);
+		}
+	}
+	return 0;
+}
+
+
+void TraceTask::shutdown()
+{
+	if (g_instance.context_switches_enabled) {
+		finished = true;
+		destroy();
+	}
+	for (ThreadEvents& thread : threads) {
+		munmap(thread.ring, (RING_PAGES + 1) * page_size);
+		close(thread.fd);
+	}
+	threads.clear();
+}
+
+
+#endif
+
+
+CaptureTask::CaptureTask(IAllocator& allocator)
+	: MT::Task(allocator)
+	, wakeup(false)
+	, strings(allocator)
+	, events(allocator)
+	, blob(allocator)
+{}
+
+
+int CaptureTask::task()
+{
+	while (!finished) {
+		wakeup.waitTimeout(CAPTURE_PERIOD_MS);
+		drain();
+	}
+	return 0;
+}
+
+
+void CaptureTask::writeChunkHeader(CaptureChunkType type, u32 size)
+{
+	CaptureChunkHeader header;
+	header.type = type;
+	header.size = size;
+	blob.write(header);
+}
+
+
+void CaptureTask::writeString(const char* str)
+{
+	if (strings.find(str).isValid()) return;
+	strings.insert(str, true);
+
+	const u32 len = stringLength(str) + 1;
+	writeChunkHeader(CaptureChunkType::STRING, sizeof(u64) + len);
+	blob.write((u64)(uintptr)str);
+	blob.write(str, len);
+}
+
+
+void CaptureTask::drain(ThreadContext& ctx, i32 thread_idx)
+{
+	{
+		MT::CriticalSectionLock lock(ctx.mutex);
+		if (!equalStrings(ctx.name, ctx.captured_name)) {
+			ctx.captured_name = ctx.name;
+			CaptureThread thread = {};
+			thread.thread_idx = thread_idx;
+			thread.thread_id = ctx.thread_id;
+			copyString(thread.name, ctx.name);
+			writeChunkHeader(CaptureChunkType::THREAD, sizeof(thread));
+			blob.write(thread);
+		}
+	}
+
+	const u32 end = ctx.end;
+	MT::memoryBarrier();
+	const u32 begin = ctx.begin;
+	u32 from = ctx.capture_pos;
+	if (isBefore(from, begin)) from = begin;
+	u32 valid = from;
+	if (from != end) {
+		events.resize(end - from);
+		const u32 new_begin = copyFromRing(ctx, from, end, events.begin(), 0, true);
+		if (isBefore(from, new_begin)) valid = isBefore(end, new_begin) ? end : new_begin;
+	}
+
+	if (valid != ctx.capture_pos) {
+		CaptureLost lost;
+		lost.thread_idx = thread_idx;
+		lost.size = valid - ctx.capture_pos;
+		writeChunkHeader(CaptureChunkType::LOST, sizeof(lost));
+		blob.write(lost);
+	}
+	ctx.capture_pos = end;
+	if (valid == end) return;
+
+	// pointers in events mean nothing in the file, so the strings they point to are written first
+	const u8* data = events.begin() + (valid - from);
+	const u32 size = end - valid;
+	for (u32 pos = 0; pos < size;) {
+		EventHeader header;
+		memcpy(&header, data + pos, sizeof(header));
+		const u8* value = data + pos + sizeof(header);
+		switch (header.type) {
+			case EventType::BEGIN_BLOCK: {
+				const char* name;
+				memcpy(&name, value, sizeof(name));
+				writeString(name);
+				break;
+			}
+			case EventType::INT: {
+				IntRecord r;
+				memcpy(&r, value, sizeof(r));
+				writeString(r.key);
+				break;
+			}
+			default: break;
+		}
+		pos += header.size;
+	}
+
+	writeChunkHeader(CaptureChunkType::EVENTS, sizeof(thread_idx) + size);
+	blob.write(thread_idx);
+	blob.write(data, size);
+}
+
+
+void CaptureTask::drain()
+{
+	Array<ThreadContext*> contexts(getAllocator());
+	{
+		MT::CriticalSectionLock lock(g_instance.mutex);
+		for (ThreadContext* ctx : g_instance.contexts) contexts.push(ctx);
+		for (; counters_count < (u32)g_instance.counters.size(); ++counters_count) {
+			const char* name = g_instance.counters[counters_count];
+			const u32 len = stringLength(name) + 1;
+			writeChunkHeader(CaptureChunkType::COUNTER, sizeof(counters_count) + len);
+			blob.write(counters_count);
+			blob.write(name, len);
+		}
+	}
+
+	for (int i = 0; i < contexts.size(); ++i) {
+		drain(*contexts[i], i);
+	}
+	// global events are last, so threads they refer to are already in the file
+	drain(g_instance.global_context, -1);
+
+	if (blob.getPos() > 0) {
+		file.write(blob.getData(), blob.getPos());
+		file.flush();
+		blob.clear();
+	}
+}
+
+
+bool startCapture(const char* path)
+{
+	if (g_instance.capture_task) return false;
+
+	CaptureTask* task = LUMIX_NEW(g_instance.allocator, CaptureTask)(g_instance.allocator);
+	if (!task->file.open(path)) {
+		LUMIX_DELETE(g_instance.allocator, task);
+		return false;
+	}
+
+	CaptureHeader header;
+	header.magic = CaptureHeader::MAGIC;
+	header.version = CaptureHeader::VERSION;
+	header.frequency = frequency();
+	task->file.write(&header, sizeof(header));
+
+	{
+		MT::CriticalSectionLock lock(g_instance.mutex);
+		auto reset = [](ThreadContext& ctx) {
+			MT::CriticalSectionLock ctx_lock(ctx.mutex);
+			ctx.capture_pos = ctx.begin;
+			ctx.captured_name = "";
+		};
+		reset(g_instance.global_context);
+		for (ThreadContext* ctx : g_instance.contexts) reset(*ctx);
+	}
+
+	if (!task->create("Profiler capture", true)) {
+		task->file.close();
+		LUMIX_DELETE(g_instance.allocator, task);
+		return false;
+	}
+	g_instance.capture_task = task;
+	return true;
+}
+
+
+void stopCapture()
+{
+	CaptureTask* task = g_instance.capture_task;
+	if (!task) return;
+
+	task->finished = true;
+	task->wakeup.trigger();
+	task->destroy();
+	task->file.close();
+	LUMIX_DELETE(g_instance.allocator, task);
+	g_instance.capture_task = nullptr;
+}
+
+
+bool isCapturing()
+{
+	return g_instance.capture_task != nullptr;
+}
+
+
+static void writeJSONString(OutputMemoryStream& blob, const char* str)
+{
+	static const char hex[] = "0123456789abcdef";
+	blob << "\"";
+	for (const char* c = str; *c; ++c) {
+		if (*c == '"' || *c == '\\') {
+			blob << "\\";
+			blob.write(*c);
+		}
+		else if ((u8)*c < 0x20) {
+			const char tmp[] = { '\\', 'u', '0', '0', hex[(u8)*c >> 4], hex[*c & 0xf] };
+			blob.write(tmp, sizeof(tmp));
+		}
+		else {
+			blob.write(*c);
+		}
+	}
+	blob << "\"";
+}
+
+
+static void beginJSONEvent(OutputMemoryStream& blob, bool& first, const char* phase, u64 time, u64 frequency, u32 tid)
+{
+	// microseconds with a fraction, doubles would print too many digits
+	const double us = time / double(frequency) * 1e6;
+	const u64 whole = u64(us);
+	const u32 ns = u32((us - whole) * 1000);
+
+	blob << (first ? "" : ",\n") << "{\"ph\": \"" << phase << "\", \"pid\": 0, \"tid\": " << tid << ", \"ts\": " << whole << ".";
+	if (ns < 100) blob << "0";
+	if (ns < 10) blob << "0";
+	blob << ns;
+	first = false;
+}
+
+
+bool exportChromeTrace(const char* capture_path, const char* json_path)
+{
+	IAllocator& allocator = g_instance.allocator;
+	OS::InputFile in;
+	if (!in.open(capture_path)) return false;
+
+	CaptureHeader header;
+	if (!in.read(&header, sizeof(header)) || header.magic != CaptureHeader::MAGIC || header.version != CaptureHeader::VERSION) {
+		in.close();
+		return false;
+	}
+
+	OS::OutputFile out;
+	if (!out.open(json_path)) {
+		in.close();
+		return false;
+	}
+
+	HashMap<u64, u32> strings(allocator);
+	HashMap<i32, u32> thread_ids(allocator);
+	HashMap<u32, bool> own_threads(allocator);
+	Array<char> string_data(allocator);
+	Array<u32> counters(allocator);
+	Array<u8> chunk(allocator);
+	OutputMemoryStream blob(allocator);
+	bool first = true;
+
+	auto getString = [&](u64 ptr) -> const char* {
+		auto iter = strings.find(ptr);
+		return iter.isValid() ? &string_data[iter.value()] : "N/A";
+	};
+	auto addString = [&](const char* str) {
+		const u32 offset = string_data.size();
+		const int len = stringLength(str) + 1;
+		string_data.resize(offset + len);
+		memcpy(&string_data[offset], str, len);
+		return offset;
+	};
+
+	blob << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+	CaptureChunkHeader chunk_header;
+	while (in.read(&chunk_header, sizeof(chunk_header))) {
+		chunk.resize(chunk_header.size);
+		if (chunk_header.size > 0 && !in.read(chunk.begin(), chunk_header.size)) break;
+		const u8* data = chunk.begin();
+
+		switch (chunk_header.type) {
+			case CaptureChunkType::THREAD: {
+				CaptureThread thread;
+				memcpy(&thread, data, sizeof(thread));
+				thread.name[lengthOf(thread.name) - 1] = '\0';
+				if (thread.thread_idx < 0) break;
+				thread_ids.insert(thread.thread_idx, thread.thread_id);
+				own_threads.insert(thread.thread_id, true);
+				blob << (first ? "" : ",\n") << "{\"ph\": \"M\", \"pid\": 0, \"tid\": " << thread.thread_id << ", \"name\": \"thread_name\", \"args\": {\"name\": ";
+				writeJSONString(blob, thread.name);
+				blob << "}}";
+				first = false;
+				break;
+			}
+			case CaptureChunkType::STRING: {
+				u64 ptr;
+				memcpy(&ptr, data, sizeof(ptr));
+				chunk.back() = 0;
+				strings.insert(ptr, addString((const char*)data + sizeof(ptr)));
+				break;
+			}
+			case CaptureChunkType::COUNTER: {
+				u32 idx;
+				memcpy(&idx, data, sizeof(idx));
+				chunk.back() = 0;
+				while ((u32)counters.size() <= idx) counters.push(0);
+				counters[idx] = addString((const char*)data + sizeof(idx));
+				break;
+			}
+			case CaptureChunkType::EVENTS: {
+				i32 thread_idx;
+				memcpy(&thread_idx, data, sizeof(thread_idx));
+				auto tid_iter = thread_ids.find(thread_idx);
+				const u32 tid = tid_iter.isValid() ? tid_iter.value() : 0;
+				for (u32 pos = sizeof(thread_idx); pos + sizeof(EventHeader) <= chunk_header.size;) {
+					EventHeader event;
+					memcpy(&event, data + pos, sizeof(event));
+					if (event.size < sizeof(event)) break;
+					const u8* value = data + pos + sizeof(event);
+					switch (event.type) {
+						case EventType::BEGIN_BLOCK: {
+							u64 name;
+							memcpy(&name, value, sizeof(name));
+							beginJSONEvent(blob, first, "B", event.time, header.frequency, tid);
+							blob << ", \"name\": ";
+							writeJSONString(blob, getString(name));
+							blob << "}";
+							break;
+						}
+						case EventType::END_BLOCK:
+							beginJSONEvent(blob, first, "E", event.time, header.frequency, tid);
+							blob << "}";
+							break;
+						case EventType::FRAME:
+							beginJSONEvent(blob, first, "i", event.time, header.frequency, tid);
+							blob << ", \"name\": \"Frame\", \"s\": \"g\"}";
+							break;
+						case EventType::INT: {
+							IntRecord r;
+							memcpy(&r, value, sizeof(r));
+							beginJSONEvent(blob, first, "i", event.time, header.frequency, tid);
+							blob << ", \"s\": \"t\", \"name\": ";
+							writeJSONString(blob, getString((u64)(uintptr)r.key));
+							blob << ", \"args\": {\"value\": " << (i32)r.value << "}}";
+							break;
+						}
+						case EventType::STRING: {
+							chunk[pos + event.size - 1] = 0;
+							beginJSONEvent(blob, first, "i", event.time, header.frequency, tid);
+							blob << ", \"s\": \"t\", \"name\": ";
+							writeJSONString(blob, (const char*)value);
+							blob << "}";
+							break;
+						}
+						case EventType::COUNTER: {
+							CounterRecord r;
+							memcpy(&r, value, sizeof(r));
+							if (r.counter >= (u32)counters.size()) break;
+							beginJSONEvent(blob, first, "C", event.time, header.frequency, tid);
+							blob << ", \"name\": ";
+							writeJSONString(blob, &string_data[counters[r.counter]]);
+							blob << ", \"args\": {\"value\": " << r.value << "}}";
+							break;
+						}
+						case EventType::CONTEXT_SWITCH: {
+							// only switches of our own threads are interesting
+							ContextSwitchRecord r;
+							memcpy(&r, value, sizeof(r));
+							if (r.reason == CONTEXT_SWITCH_MIGRATION) {
+								if (own_threads.find(r.new_thread_id).isValid()) {
+									beginJSONEvent(blob, first, "i", r.timestamp, header.frequency, r.new_thread_id);
+									blob << ", \"s\": \"t\", \"name\": \"Migrated\", \"args\": {\"cpu\": " << (u32)r.cpu << "}}";
+								}
+								break;
+							}
+							if (own_threads.find(r.old_thread_id).isValid()) {
+								beginJSONEvent(blob, first, "i", r.timestamp, header.frequency, r.old_thread_id);
+								blob << ", \"s\": \"t\", \"name\": \"Switched out\", \"args\": {\"reason\": " << (i32)r.reason << "}}";
+							}
+							if (own_threads.find(r.new_thread_id).isValid()) {
+								beginJSONEvent(blob, first, "i", r.timestamp, header.frequency, r.new_thread_id);
+								blob << ", \"s\": \"t\", \"name\": \"Switched in\"}";
+							}
+							break;
+						}
+						default: break;
+					}
+					pos += event.size;
+				}
+				break;
+			}
+			case CaptureChunkType::LOST: break;
+		}
+
+		if (blob.getPos() > 1024 * 1024) {
+			out.write(blob.getData(), blob.getPos());
+			blob.clear();
+		}
+	}
+	blob << "\n]}\n";
+	out.write(blob.getData(), blob.getPos());
+
+	const bool is_error = out.isError();
+	out.close();
+	in.close();
+	return !is_error;
+}
+
+
+static u32 getStatsBucket(u64 ns)
+{
+	if (ns < 4) return u32(ns);
+	u32 k = 0;
+	while ((ns >> k) >= 2) ++k;
+	const u32 idx = k * 4 + u32((ns >> (k - 2)) & 3);
+	return minimum(idx, (u32)STATS_BUCKETS - 1);
+}
+
+
+// middle of the bucket's range
+static u64 getStatsBucketValue(u32 idx)
+{
+	const u32 k = idx >> 2;
+	if (k < 2) return idx;
+	const u64 lower = u64(4 + (idx & 3)) << (k - 2);
+	return lower + (u64(1) << (k - 2)) / 2;
+}
+
+
+static void recordBlock(BlockStatsState& state, const char* name, u64 ticks)
+{
+	int idx;
+	auto iter = state.entries_map.find(name);
+	if (iter.isValid()) {
+		idx = iter.value();
+	}
+	else {
+		// the same name can have more addresses, e.g. when it is used in more modules
+		idx = -1;
+		for (int i = 0; i < state.entries.size(); ++i) {
+			if (equalStrings(state.entries[i]->name, name)) {
+				idx = i;
+				break;
+			}
+		}
+		if (idx < 0) {
+			BlockStatsEntry* entry = LUMIX_NEW(state.allocator, BlockStatsEntry);
+			memset(entry, 0, sizeof(*entry));
+			entry->name = name;
+			state.entries.push(entry);
+			idx = state.entries.size() - 1;
+		}
+		state.entries_map.insert(name, idx);
+	}
+
+	BlockStatsSlice& slice = state.entries[idx]->slices[state.slice];
+	const u64 ns = u64(ticks * state.ns_per_tick);
+	++slice.histogram[getStatsBucket(ns)];
+	if (slice.calls == 0 || ns < slice.min) slice.min = ns;
+	if (ns > slice.max) slice.max = ns;
+	slice.total += ns;
+	++slice.calls;
+}
+
+
+// copies new events in the thread's ring to the end of state.events
+static void copyBlockEvents(BlockStatsState& state, ThreadContext& ctx)
+{
+	const u32 end = ctx.end;
+	MT::memoryBarrier();
+	const u32 begin = ctx.begin;
+	u32 from = ctx.stats_pos;
+	if (isBefore(from, begin)) {
+		// some events were overwritten, open blocks can not be matched anymore
+		from = begin;
+		ctx.stats_stack.clear();
+		ctx.stats_resumed.count = 0;
+	}
+	if (from == end) return;
+
+	const u32 offset = state.events.size();
+	state.events.resize(offset + (end - from));
+	const u32 new_begin = copyFromRing(ctx, from, end, state.events.begin() + offset, 0, true);
+	u32 valid = from;
+	if (isBefore(from, new_begin)) {
+		valid = isBefore(end, new_begin) ? end : new_begin;
+		ctx.stats_stack.clear();
+		ctx.stats_resumed.count = 0;
+	}
+	ctx.stats_pos = end;
+
+	BlockStatsStream& stream = state.streams.emplace();
+	stream.ctx = &ctx;
+	stream.pos = offset + (valid - from);
+	stream.end = state.events.size();
+}
+
+
+static void processBlockEvent(BlockStatsState& state, ThreadContext& ctx, const EventHeader& header, const u8* data)
+{
+	switch (header.type) {
+		case EventType::BEGIN_BLOCK: {
+			OpenBlock& block = ctx.stats_stack.emplace();
+			memcpy(&block.name, data, sizeof(block.name));
+			block.time = header.time;
+			block.is_partial = false;
+			if (ctx.stats_reopened < ctx.stats_resumed.count) {
+				// a block reopened after a fiber wait is the same call as the one closed before the wait
+				const u32 i = ctx.stats_reopened;
+				block.time = i < lengthOf(ctx.stats_resumed.times) ? ctx.stats_resumed.times[i] : 0;
+				block.is_partial = block.time == 0;
+				++ctx.stats_reopened;
+			}
+			break;
+		}
+		case EventType::END_BLOCK:
+			if (!ctx.stats_stack.empty()) {
+				const OpenBlock block = ctx.stats_stack.back();
+				ctx.stats_stack.pop();
+				if (!block.is_partial) recordBlock(state, block.name, header.time - block.time);
+			}
+			break;
+		case EventType::BEGIN_FIBER_WAIT: {
+			FiberWaitRecord r;
+			memcpy(&r, data, sizeof(r));
+			if (state.fiber_waits.size() >= 1024) {
+				// the fiber resumed in events which were overwritten
+				state.fiber_waits.erase(0);
+			}
+			FiberWaitBlocks& blocks = state.fiber_waits.emplace();
+			blocks.id = r.id;
+			blocks.count = r.blocks_count;
+			const int first = ctx.stats_stack.size() - (int)r.blocks_count;
+			for (u32 i = 0; i < lengthOf(blocks.times); ++i) {
+				const int idx = first + (int)i;
+				const OpenBlock* block = idx >= 0 && idx < ctx.stats_stack.size() ? &ctx.stats_stack[idx] : nullptr;
+				blocks.times[i] = block && !block->is_partial ? block->time : 0;
+			}
+			// the fiber switch closes the blocks, these ends are not matched
+			ctx.stats_stack.clear();
+			break;
+		}
+		case EventType::END_FIBER_WAIT: {
+			FiberWaitRecord r;
+			memcpy(&r, data, sizeof(r));
+			ctx.stats_reopened = 0;
+			ctx.stats_resumed.id = r.id;
+			ctx.stats_resumed.count = r.blocks_count;
+			memset(ctx.stats_resumed.times, 0, sizeof(ctx.stats_resumed.times));
+			for (int i = 0, c = state.fiber_waits.size(); i < c; ++i) {
+				if (state.fiber_waits[i].id == r.id) {
+					memcpy(ctx.stats_resumed.times, state.fiber_waits[i].times, sizeof(ctx.stats_resumed.times));
+					state.fiber_waits.swapAndPop(i);
+					break;
+				}
+			}
+			break;
+		}
+		default: break;
+	}
+}
+
+
+// matches new begin and end events of all threads, a fiber can resume on another thread than the one it waited on,
+// so the events are processed in the order of their time
+static void updateBlockStats(BlockStatsState& state)
+{
+	state.events.clear();
+	state.streams.clear();
+	for (ThreadContext* ctx : g_instance.contexts) {
+		copyBlockEvents(state, *ctx);
+	}
+
+	const u8* data = state.events.begin();
+	for (;;) {
+		BlockStatsStream* next = nullptr;
+		EventHeader next_header;
+		for (BlockStatsStream& stream : state.streams) {
+			if (stream.pos == stream.end) continue;
+			EventHeader header;
+			memcpy(&header, data + stream.pos, sizeof(header));
+			if (!next || header.time < next_header.time) {
+				next = &stream;
+				next_header = header;
+			}
+		}
+		if (!next) break;
+
+		processBlockEvent(state, *next->ctx, next_header, data + next->pos + sizeof(next_header));
+		next->pos += next_header.size;
+	}
+}
+
+
+static void computeBlockStats(const BlockStatsState& state, const BlockStatsEntry& entry, BlockStats& stats)
+{
+	u32 histogram[STATS_BUCKETS] = {};
+	u64 total = 0;
+	u64 min = 0;
+	u64 max = 0;
+	u32 calls = 0;
+	u32 frames = 0;
+	for (u32 i = 0; i < STATS_SLICES; ++i) {
+		const BlockStatsSlice& slice = entry.slices[i];
+		frames += state.frames[i];
+		if (slice.calls == 0) continue;
+
+		for (u32 j = 0; j < STATS_BUCKETS; ++j) histogram[j] += slice.histogram[j];
+		if (calls == 0 || slice.min < min) min = slice.min;
+		max = maximum(max, slice.max);
+		total += slice.total;
+		calls += slice.calls;
+	}
+
+	auto percentile = [&](float p) {
+		const u32 target = u32(calls * p);
+		u32 count = 0;
+		for (u32 j = 0; j < STATS_BUCKETS; ++j) {
+			count += histogram[j];
+			if (count > target) return clamp(getStatsBucketValue(j), min, max);
+		}
+		return max;
+	};
+
+	stats.name = entry.name;
+	stats.calls = calls;
+	stats.calls_per_frame = frames > 0 ? calls / float(frames) : 0;
+	stats.min = min / 1e6f;
+	stats.max = max / 1e6f;
+	stats.avg = calls > 0 ? float(total / double(calls) / 1e6) : 0;
+	stats.p50 = calls > 0 ? percentile(0.5f) / 1e6f : 0;
+	stats.p99 = calls > 0 ? percentile(0.99f) / 1e6f : 0;
+}
+
+
+static void dumpBlockStats(BlockStatsState& state, u64 now)
+{
+	Array<BlockStats> stats(state.allocator);
+	stats.resize(state.entries.size());
+	for (int i = 0; i < stats.size(); ++i) {
+		computeBlockStats(state, *state.entries[i], stats[i]);
+	}
+	// the most expensive blocks first
+	qsort(stats.begin(), stats.size(), sizeof(stats[0]), [](const void* a, const void* b) -> int {
+		const BlockStats* lhs = (const BlockStats*)a;
+		const BlockStats* rhs = (const BlockStats*)b;
+		const float l = lhs->avg * lhs->calls;
+		const float r = rhs->avg * rhs->calls;
+		return l < r ? 1 : (l > r ? -1 : 0);
+	});
+
+	const float time = float((now - g_instance.timer.first_tick) / double(frequency()));
+	for (const BlockStats& s : stats) {
+		if (s.calls == 0) continue;
+		if (state.dump_to_file) {
+			state.dump_file << time << ",\"" << s.name << "\"," << s.calls << "," << s.calls_per_frame << "," 
+				<< s.min << "," << s.avg << "," << s.p50 << "," << s.p99 << "," << s.max << "\n";
+		}
+		else {
+			logInfo("Profiler") << s.name << ": " << s.calls << " calls, " << s.calls_per_frame << " per frame, min "
+				<< s.min << " ms, avg " << s.avg << " ms, p50 " << s.p50 << " ms, p99 " << s.p99 << " ms, max " << s.max << " ms";
+		}
+	}
+	if (state.dump_to_file) state.dump_file.flush();
+}
+
+
+static void updateBlockStats(BlockStatsState& state, u64 now)
+{
+	MT::CriticalSectionLock lock(state.mutex);
+
+	if (now - state.slice_start > state.slice_duration * STATS_SLICES) {
+		// nothing was updated for the whole window
+		state.slice_start = now - state.slice_duration;
+	}
+	while (now - state.slice_start >= state.slice_duration) {
+		state.slice = (state.slice + 1) % STATS_SLICES;
+		state.slice_start += state.slice_duration;
+		state.frames[state.slice] = 0;
+		for (BlockStatsEntry* entry : state.entries) {
+			memset(&entry->slices[state.slice], 0, sizeof(entry->slices[state.slice]));
+		}
+	}
+	++state.frames[state.slice];
+
+	{
+		MT::CriticalSectionLock contexts_lock(g_instance.mutex);
+		updateBlockStats(state);
+	}
+
+	if (state.dump_period > 0 && now - state.last_dump >= state.dump_period) {
+		state.last_dump = now;
+		dumpBlockStats(state, now);
+	}
+}
+
+
+void enableBlockStats(float window_seconds)
+{
+	if (g_instance.block_stats) {
+		if (g_instance.block_stats->dump_to_file) g_instance.block_stats->dump_file.close();
+		LUMIX_DELETE(g_instance.allocator, g_instance.block_stats);
+		g_instance.block_stats = nullptr;
+	}
+	if (window_seconds <= 0) return;
+
+	BlockStatsState* state = LUMIX_NEW(g_instance.allocator, BlockStatsState)(g_instance.allocator);
+	const u64 now = OS::Timer::getRawTimestamp();
+	state->ns_per_tick = 1e9 / frequency();
+	state->slice_duration = maximum(u64(window_seconds / STATS_SLICES * frequency()), (u64)1);
+	state->slice_start = now;
+	state->last_dump = now;
+
+	// only events recorded from now on are counted
+	MT::CriticalSectionLock lock(g_instance.mutex);
+	for (ThreadContext* ctx : g_instance.contexts) {
+		ctx->stats_pos = ctx->end;
+		ctx->stats_stack.clear();
+		ctx->stats_resumed.count = 0;
+	}
+	g_instance.block_stats = state;
+}
+
+
+bool getBlockStats(const char* name, BlockStats& stats)
+{
+	BlockStatsState* state = g_instance.block_stats;
+	if (!state) return false;
+
+	MT::CriticalSectionLock lock(state->mutex);
+	for (BlockStatsEntry* entry : state->entries) {
+		if (equalStrings(entry->name, name)) {
+			computeBlockStats(*state, *entry, stats);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+u32 getAllBlockStats(Span<BlockStats> stats)
+{
+	BlockStatsState* state = g_instance.block_stats;
+	if (!state) return 0;
+
+	MT::CriticalSectionLock lock(state->mutex);
+	const u32 count = minimum(stats.length(), (u32)state->entries.size());
+	for (u32 i = 0; i < count; ++i) {
+		computeBlockStats(*state, *state->entries[i], stats[i]);
+	}
+	return state->entries.size();
+}
+
+
+void dumpBlockStats(float period_seconds, const char* path)
+{
+	BlockStatsState* state = g_instance.block_stats;
+	if (!state) return;
+
+	MT::CriticalSectionLock lock(state->mutex);
+	if (state->dump_to_file) state->dump_file.close();
+	state->dump_to_file = false;
+	state->dump_period = period_seconds > 0 ? u64(period_seconds * frequency()) : 0;
+	if (state->dump_period == 0 || !path) return;
+
+	state->dump_to_file = state->dump_file.open(path);
+	if (!state->dump_to_file) {
+		logError("Profiler") << "Failed to open " << path << ", block statistics are written to the log.";
+		return;
+	}
+	state->dump_file << "time,name,calls,calls_per_frame,min_ms,avg_ms,p50_ms,p99_ms,max_ms\n";
+}
+
+
 void pushInt(const char* key, int value)
 {
 	ThreadContext* ctx = g_instance.getThreadContext();
@@ -318,6 +1526,23 @@ void pushInt(const char* key, int value)
 
 
 
+u32 createCounter(const char* key_literal)
+{
+	MT::CriticalSectionLock lock(g_instance.mutex);
+	g_instance.counters.push(key_literal);
+	return g_instance.counters.size() - 1;
+}
+
+
+void pushCounter(u32 counter, float value)
+{
+	CounterRecord r;
+	r.counter = counter;
+	r.value = value;
+	write(g_instance.global_context, EventType::COUNTER, r);
+}
+
+
 void pushString(const char* value)
 {
 	ThreadContext* ctx = g_instance.getThreadContext();
@@ -394,11 +1619,12 @@ void beforeFiberSwitch()
 }
 
 
-void pushJobInfo(u32 signal_on_finish, u32 precondition)
+void pushJobInfo(u32 signal_on_finish, u32 precondition, u8 priority)
 {
 	JobRecord r;
 	r.signal_on_finish = signal_on_finish;
 	r.precondition = precondition;
+	r.priority = priority;
 	ThreadContext* ctx = g_instance.getThreadContext();
 	write(*ctx, EventType::JOB_INFO, r);
 }
@@ -415,6 +1641,7 @@ FiberSwitchData beginFiberWait(u32 job_system_signal)
 	ThreadContext* ctx = g_instance.getThreadContext();
 	res.count = ctx->open_blocks.size();
 	res.id = r.id;
+	r.blocks_count = res.count;
 	memcpy(res.blocks, ctx->open_blocks.begin(), minimum(res.count, lengthOf(res.blocks)) * sizeof(const char*));
 	write(*ctx, EventType::BEGIN_FIBER_WAIT, r);
 	return res;
@@ -427,6 +1654,7 @@ void endFiberWait(u32 job_system_signal, const FiberSwitchData& switch_data)
 	FiberWaitRecord r;
 	r.id = switch_data.id;
 	r.job_system_signal = job_system_signal;
+	r.blocks_count = switch_data.count;
 
 	write(*ctx, EventType::END_FIBER_WAIT, r);
 	const int count = switch_data.count;
@@ -471,6 +1699,7 @@ void frame()
 	}
 	g_instance.last_frame_time = n;
 	write(g_instance.global_context, EventType::FRAME, 0);
+	if (g_instance.block_stats) updateBlockStats(*g_instance.block_stats, n);
 }
 
 
@@ -519,6 +1748,18 @@ const char* GlobalState::getThreadName(int idx) const
 }
 
 
+int GlobalState::countersCount() const
+{
+	return g_instance.counters.size();
+}
+
+
+const char* GlobalState::getCounterName(int idx) const
+{
+	return g_instance.counters[idx];
+}
+
+
 ThreadState::ThreadState(GlobalState& reader, int thread_idx)
 	: reader(reader)
 	, thread_idx(thread_idx)
@@ -526,11 +1767,14 @@ ThreadState::ThreadState(GlobalState& reader, int thread_idx)
 	++reader.local_readers_count;
 	ThreadContext& ctx = thread_idx >= 0 ? *g_instance.contexts[thread_idx] : g_instance.global_context;
 
-	ctx.mutex.enter();
-	buffer = ctx.buffer.begin();
-	buffer_size = ctx.buffer.size();
-	begin = ctx.begin;
-	end = ctx.end;
+	// the snapshot is guarded by the global mutex, held by `reader`
+	refreshSnapshot(ctx);
+	buffer = ctx.snapshot.begin();
+	buffer_size = ctx.snapshot.size();
+	begin = ctx.snapshot_begin;
+	end = ctx.snapshot_end;
+
+	MT::CriticalSectionLock lock(ctx.mutex);
 	thread_id = ctx.thread_id;
 	name = ctx.name;
 	open = ctx.open;
@@ -542,10 +1786,10 @@ ThreadState::ThreadState(GlobalState& reader, int thread_idx)
 ThreadState::~ThreadState()
 {
 	ThreadContext& ctx = thread_idx >= 0 ? *g_instance.contexts[thread_idx] : g_instance.global_context;
+	MT::CriticalSectionLock lock(ctx.mutex);
 	ctx.open = open;
 	ctx.rows = rows;
 	ctx.show_in_profiler = show;
-	ctx.mutex.exit();
 	--reader.local_readers_count;
 }
 
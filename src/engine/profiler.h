@@ -22,9 +22,12 @@ LUMIX_ENGINE_API void beginBlock(const char* name_literal);
 LUMIX_ENGINE_API void blockColor(u8 r, u8 g, u8 b);
 LUMIX_ENGINE_API void endBlock();
 LUMIX_ENGINE_API void frame();
-LUMIX_ENGINE_API void pushJobInfo(u32 signal_on_finish, u32 precondition);
+LUMIX_ENGINE_API void pushJobInfo(u32 signal_on_finish, u32 precondition, u8 priority);
 LUMIX_ENGINE_API void pushString(const char* value);
 LUMIX_ENGINE_API void pushInt(const char* key_literal, int value);
+// counters are global values sampled over time, e.g. pool sizes or memory usage
+LUMIX_ENGINE_API u32 createCounter(const char* key_literal);
+LUMIX_ENGINE_API void pushCounter(u32 counter, float value);
 
 LUMIX_ENGINE_API void beginGPUBlock(const char* name, u64 timestamp, i64 profiler_link);
 LUMIX_ENGINE_API void endGPUBlock(u64 timestamp);
@@ -55,12 +58,22 @@ struct Scope
 LUMIX_ENGINE_API bool contextSwitchesEnabled();
 LUMIX_ENGINE_API u64 frequency();
 
+// windows reasons are KWAIT_REASON values, negative reasons are platform independent
+enum : i8 {
+	CONTEXT_SWITCH_WAIT = -1,
+	CONTEXT_SWITCH_PREEMPTED = -2,
+	// the thread continues on a different cpu, old_thread_id == new_thread_id
+	CONTEXT_SWITCH_MIGRATION = -3
+};
+
+
 struct ContextSwitchRecord
 {
 	u32 old_thread_id;
 	u32 new_thread_id;
 	u64 timestamp;
 	i8 reason;
+	u8 cpu;
 };
 
 
@@ -71,10 +84,18 @@ struct IntRecord
 };
 
 
+struct CounterRecord
+{
+	u32 counter;
+	float value;
+};
+
+
 struct JobRecord
 {
 	u32 signal_on_finish;
 	u32 precondition;
+	u8 priority; // JobSystem::Priority
 };
 
 
@@ -82,6 +103,8 @@ struct FiberWaitRecord
 {
 	i32 id;
 	u32 job_system_signal;
+	// blocks closed before the wait and reopened after it
+	u32 blocks_count;
 };
 
 
@@ -108,7 +131,8 @@ enum class EventType : u8
 	BEGIN_GPU_BLOCK,
 	END_GPU_BLOCK,
 	GPU_FRAME,
-	LINK
+	LINK,
+	COUNTER
 };
 
 #pragma pack(1)
@@ -121,12 +145,99 @@ struct EventHeader
 #pragma pack()
 
 
+// capture API
+// a capture file is CaptureHeader followed by chunks, each one is CaptureChunkHeader and `size` bytes of data
+
+struct CaptureHeader
+{
+	enum : u32 {
+		MAGIC = 0x4350584c, // 'LXPC'
+		VERSION = 2
+	};
+
+	u32 magic;
+	u32 version;
+	u64 frequency;
+};
+
+
+enum class CaptureChunkType : u8
+{
+	THREAD,		// CaptureThread
+	STRING,		// u64 pointer as it is stored in events, followed by the zero terminated string it points to
+	COUNTER,	// u32 counter index, followed by the zero terminated counter name
+	EVENTS,		// i32 thread index (-1 for global events), followed by events with the same layout as in ThreadState::buffer
+	LOST		// CaptureLost
+};
+
+
+#pragma pack(1)
+struct CaptureChunkHeader
+{
+	CaptureChunkType type;
+	u32 size;
+};
+#pragma pack()
+
+
+struct CaptureThread
+{
+	i32 thread_idx;
+	u32 thread_id;
+	char name[64];
+};
+
+
+// the capture did not keep up and `size` bytes of events were overwritten before they were written
+struct CaptureLost
+{
+	i32 thread_idx;
+	u32 size;
+};
+
+
+// block statistics API
+// aggregated from the recorded events in frame(), over a rolling window of the last `window_seconds`
+
+struct BlockStats
+{
+	const char* name;
+	u32 calls;
+	float calls_per_frame;
+	// milliseconds, percentiles are approximate
+	float min;
+	float avg;
+	float max;
+	float p50;
+	float p99;
+};
+
+
+// 0 disables the statistics
+LUMIX_ENGINE_API void enableBlockStats(float window_seconds);
+LUMIX_ENGINE_API bool getBlockStats(const char* name, BlockStats& stats);
+// returns the number of blocks, only up to stats.length() are filled
+LUMIX_ENGINE_API u32 getAllBlockStats(Span<BlockStats> stats);
+// statistics of all blocks are written every `period_seconds` to the file or to the log if `path` is null, 0 disables it
+LUMIX_ENGINE_API void dumpBlockStats(float period_seconds, const char* path);
+
+
+// events are written to the file continuously until stopCapture, call both from the main thread
+LUMIX_ENGINE_API bool startCapture(const char* path);
+LUMIX_ENGINE_API void stopCapture();
+LUMIX_ENGINE_API bool isCapturing();
+// converts a capture file to json, which can be opened in chrome://tracing or ui.perfetto.dev
+LUMIX_ENGINE_API bool exportChromeTrace(const char* capture_path, const char* json_path);
+
+
 struct LUMIX_ENGINE_API GlobalState {
 	GlobalState();
 	~GlobalState();
 	
 	int threadsCount() const;
 	const char* getThreadName(int idx) const;
+	int countersCount() const;
+	const char* getCounterName(int idx) const;
 
 	int local_readers_count = 0;
 };
@@ -3,6 +3,7 @@
 #include "engine/log.h"
 #include "engine/lumix.h"
 #include "engine/path.h"
+#include "engine/profiler.h"
 #include "engine/resource_manager.h"
 
 
@@ -28,6 +29,10 @@ Resource::Resource(const Path& path, ResourceManager& resource_manager, IAllocat
 	, m_cb(allocator)
 	, m_resource_manager(resource_manager)
 	, m_async_op(FileSystem::AsyncHandle::invalid())
+	, m_decoded(false)
+	, m_lru_prev(nullptr)
+	, m_lru_next(nullptr)
+	, m_release_time(0)
 {
 }
 
@@ -72,7 +77,7 @@ void Resource::checkState()
 }
 
 
-void Resource::fileLoaded(u64 size, const u8* mem, bool success)
+void Resource::fileLoaded(const ContentView& content, bool success)
 {
 	m_async_op = FileSystem::AsyncHandle::invalid();
 	if (m_desired_state != State::READY) return;
@@ -91,9 +96,16 @@ void Resource::fileLoaded(u64 size, const u8* mem, bool success)
 		return;
 	}
 
-	if (!load(size, mem)) {
+	if (isDecodeSupported()) {
+		PROFILE_BLOCK("finalize resource");
+		Profiler::pushString(getPath().c_str());
+		if (!m_decoded || !finalize()) ++m_failed_dep_count;
+		m_decoded = false;
+	}
+	else if (!loadView(content)) {
 		++m_failed_dep_count;
 	}
+	m_resource_manager.onLoaded(m_size);
 
 	ASSERT(m_empty_dep_count > 0);
 	--m_empty_dep_count;
@@ -102,8 +114,17 @@ void Resource::fileLoaded(u64 size, const u8* mem, bool success)
 }
 
 
+u32 Resource::addRef()
+{
+	// used again before it was evicted
+	if (m_ref_count == 0) m_resource_manager.getOwner().unlinkUnreferenced(*this);
+	return ++m_ref_count;
+}
+
+
 void Resource::doUnload()
 {
+	m_resource_manager.getOwner().unlinkUnreferenced(*this);
 	if (m_async_op.isValid())
 	{
 		FileSystem& fs = m_resource_manager.getOwner().getFileSystem();
@@ -111,10 +132,12 @@ void Resource::doUnload()
 		m_async_op = FileSystem::AsyncHandle::invalid();
 	}
 
+	m_decoded = false;
 	m_desired_state = State::EMPTY;
 	unload();
 	ASSERT(m_empty_dep_count <= 1);
 
+	m_resource_manager.onUnloaded(m_size);
 	m_size = 0;
 	m_empty_dep_count = 1;
 	m_failed_dep_count = 0;
@@ -134,7 +157,7 @@ void Resource::onCreated(State state)
 }
 
 
-void Resource::doLoad()
+void Resource::doLoad(FileSystem::Priority priority)
 {
 	if (m_desired_state == State::READY) return;
 	m_desired_state = State::READY;
@@ -142,13 +165,27 @@ void Resource::doLoad()
 	if (m_async_op.isValid()) return;
 
 	FileSystem& fs = m_resource_manager.getOwner().getFileSystem();
-	FileSystem::ContentCallback cb;
+	FileSystem::ContentViewCallback cb;
 	cb.bind<Resource, &Resource::fileLoaded>(this);
 
 	const u32 hash = m_path.getHash();
 	const StaticString<MAX_PATH_LENGTH> res_path(".lumix/assets/", hash, ".res");
 
-	m_async_op = fs.getContent(Path(res_path), cb);
+	if (isDecodeSupported()) {
+		FileSystem::DecodeCallback decode_cb;
+		decode_cb.bind<Resource, &Resource::decodeContent>(this);
+		m_async_op = fs.getContentDecoded(Path(res_path), decode_cb, cb, priority);
+		return;
+	}
+	m_async_op = fs.getContentView(Path(res_path), cb, priority);
+}
+
+
+void Resource::decodeContent(const ContentView& content)
+{
+	PROFILE_BLOCK("decode resource");
+	Profiler::pushString(getPath().c_str());
+	m_decoded = decode(content);
 }
 
 
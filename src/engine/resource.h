@@ -72,6 +72,15 @@ protected:
 	virtual void onBeforeEmpty() {}
 	virtual void unload() = 0;
 	virtual bool load(u64 size, const u8* mem) = 0;
+	// resources which keep pointers into the file override this and keep a copy of the content instead of copying the data
+	virtual bool loadView(const ContentView& content) { return load(content.size(), content.data()); }
+	// resources which return true are loaded by decode and finalize instead of load
+	// decode is called on a job worker, it must not touch anything other resources or the main thread can
+	// finalize is called on the main thread only if decode succeeded, e.g. to create gpu objects
+	// unload must release whatever decode made, finalize is not called if the resource is unloaded in between
+	virtual bool isDecodeSupported() const { return false; }
+	virtual bool decode(const ContentView& content) { return false; }
+	virtual bool finalize() { return true; }
 
 	void onCreated(State state);
 	void doUnload();
@@ -89,10 +98,11 @@ protected:
 	void checkState();
 
 private:
-	void doLoad();
-	void fileLoaded(u64 size, const u8* mem, bool success);
+	void doLoad(FileSystem::Priority priority);
+	void fileLoaded(const ContentView& content, bool success);
+	void decodeContent(const ContentView& content);
 	void onStateChanged(State old_state, State new_state, Resource&);
-	u32 addRef() { return ++m_ref_count; }
+	u32 addRef();
 	u32 remRef() { return --m_ref_count; }
 
 	Resource(const Resource&);
@@ -105,6 +115,12 @@ private:
 	u16 m_failed_dep_count;
 	State m_current_state;
 	FileSystem::AsyncHandle m_async_op;
+	// written by decodeContent on a job worker, read once the file system dispatches the request
+	bool m_decoded;
+	// in the list of unreferenced resources kept warm, see ResourceManagerHub::setBudget
+	Resource* m_lru_prev;
+	Resource* m_lru_next;
+	u64 m_release_time;
 }; // class Resource
 
 
@@ -1,5 +1,7 @@
 #include "engine/log.h"
 #include "engine/lumix.h"
+#include "engine/os.h"
+#include "engine/profiler.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
 
@@ -60,7 +62,7 @@ Resource* ResourceManager::load(const Path& path)
 			resource->addRef(); // for return value
 			return resource;
 		}
-		resource->doLoad();
+		resource->doLoad(m_load_priority);
 	}
 
 	resource->addRef();
@@ -74,7 +76,8 @@ void ResourceManager::removeUnreferenced()
 	Array<Resource*> to_remove(m_allocator);
 	for (auto* i : m_resources)
 	{
-		if (i->getRefCount() == 0) to_remove.push(i);
+		// resources kept warm are removed once they are evicted
+		if (i->getRefCount() == 0 && !m_owner->isKeptWarm(*i)) to_remove.push(i);
 	}
 
 	for (auto* i : to_remove)
@@ -93,7 +96,7 @@ void ResourceManager::load(Resource& resource)
 			resource.addRef(); // for hook
 			return;
 		}
-		resource.doLoad();
+		resource.doLoad(m_load_priority);
 	}
 
 	resource.addRef();
@@ -111,7 +114,7 @@ void ResourceManager::unload(Resource& resource)
 	ASSERT(new_ref_count >= 0);
 	if(new_ref_count == 0 && m_is_unload_enabled)
 	{
-		resource.doUnload();
+		m_owner->onUnreferenced(resource);
 	}
 }
 
@@ -131,7 +134,12 @@ void ResourceManager::reload(Resource& resource)
 		resource.addRef(); // for return value
 	}
 	else {
-		resource.doLoad();
+		// the old content is gone, someone is most likely waiting for the new one
+		resource.doLoad(FileSystem::Priority::HIGH);
+		// otherwise it would stay loaded until it is used and released again
+		if (resource.getRefCount() == 0 && m_is_unload_enabled && m_owner->getBudget() > 0) {
+			m_owner->onUnreferenced(resource);
+		}
 	}
 }
 
@@ -144,7 +152,7 @@ void ResourceManager::enableUnload(bool enable)
 	{
 		if (resource->getRefCount() == 0)
 		{
-			resource->doUnload();
+			m_owner->onUnreferenced(*resource);
 		}
 	}
 }
@@ -154,8 +162,25 @@ ResourceManager::ResourceManager(IAllocator& allocator)
 	, m_allocator(allocator)
 	, m_owner(nullptr)
 	, m_is_unload_enabled(true)
+	, m_loaded_size(0)
+	, m_evicted_count(0)
+	, m_evicted_size(0)
+	, m_load_priority(FileSystem::Priority::NORMAL)
 { }
 
+void ResourceManager::onLoaded(u64 size)
+{
+	m_loaded_size += size;
+	m_owner->m_loaded_size += size;
+}
+
+void ResourceManager::onUnloaded(u64 size)
+{
+	ASSERT(m_loaded_size >= size);
+	m_loaded_size -= size;
+	m_owner->m_loaded_size -= size;
+}
+
 ResourceManager::~ResourceManager()
 {
 	ASSERT(m_resources.empty());
@@ -166,10 +191,23 @@ ResourceManagerHub::ResourceManagerHub(IAllocator& allocator)
 	, m_allocator(allocator)
 	, m_load_hook(nullptr)
 	, m_file_system(nullptr)
+	, m_budget(0)
+	, m_keep_warm_time(2)
+	, m_loaded_size(0)
+	, m_lru_head(nullptr)
+	, m_lru_tail(nullptr)
+	, m_evicted_count(0)
+	, m_evicted_size(0)
 {
+	m_loaded_size_counter = Profiler::createCounter("Resources loaded (MB)");
+	m_evicted_count_counter = Profiler::createCounter("Resources evicted");
+	m_evicted_size_counter = Profiler::createCounter("Resources evicted (MB)");
 }
 
-ResourceManagerHub::~ResourceManagerHub() = default;
+ResourceManagerHub::~ResourceManagerHub()
+{
+	ASSERT(!m_lru_head);
+}
 
 
 void ResourceManagerHub::init(FileSystem& fs)
@@ -199,7 +237,7 @@ void ResourceManagerHub::LoadHook::continueLoad(Resource& resource)
 	ASSERT(resource.isEmpty());
 	resource.remRef(); // release from hook
 	resource.m_desired_state = Resource::State::EMPTY;
-	resource.doLoad();
+	resource.doLoad(resource.getResourceManager().getLoadPriority());
 }
 
 void ResourceManagerHub::setLoadHook(LoadHook* hook)
@@ -239,6 +277,82 @@ void ResourceManagerHub::enableUnload(bool enable)
 	}
 }
 
+void ResourceManagerHub::onUnreferenced(Resource& resource)
+{
+	if (m_budget == 0 || resource.m_desired_state == Resource::State::EMPTY) {
+		resource.doUnload();
+		return;
+	}
+
+	unlinkUnreferenced(resource);
+	resource.m_release_time = OS::Timer::getRawTimestamp();
+	resource.m_lru_prev = m_lru_tail;
+	resource.m_lru_next = nullptr;
+	if (m_lru_tail) m_lru_tail->m_lru_next = &resource;
+	else m_lru_head = &resource;
+	m_lru_tail = &resource;
+}
+
+bool ResourceManagerHub::isKeptWarm(const Resource& resource) const
+{
+	return resource.m_lru_prev || m_lru_head == &resource;
+}
+
+void ResourceManagerHub::unlinkUnreferenced(Resource& resource)
+{
+	if (!isKeptWarm(resource)) return;
+
+	if (resource.m_lru_prev) resource.m_lru_prev->m_lru_next = resource.m_lru_next;
+	else m_lru_head = resource.m_lru_next;
+	if (resource.m_lru_next) resource.m_lru_next->m_lru_prev = resource.m_lru_prev;
+	else m_lru_tail = resource.m_lru_prev;
+	resource.m_lru_prev = nullptr;
+	resource.m_lru_next = nullptr;
+}
+
+void ResourceManagerHub::setBudget(u64 bytes)
+{
+	m_budget = bytes;
+	// nothing is kept warm without a budget
+	if (m_budget == 0) unloadKeptWarm();
+}
+
+void ResourceManagerHub::unloadKeptWarm()
+{
+	// unloading a resource can release its dependencies, which are then kept warm
+	while (m_lru_head) m_lru_head->doUnload();
+}
+
+void ResourceManagerHub::update()
+{
+	PROFILE_FUNCTION();
+	const u64 now = OS::Timer::getRawTimestamp();
+	const u64 keep_warm_ticks = u64(m_keep_warm_time * OS::Timer::getFrequency());
+	Resource* resource = m_lru_head;
+	while (resource && m_loaded_size > m_budget) {
+		// the rest was released even later
+		if (now - resource->m_release_time < keep_warm_ticks) break;
+
+		Resource* next = resource->m_lru_next;
+		ResourceManager& manager = resource->getResourceManager();
+		if (manager.m_is_unload_enabled) {
+			PROFILE_BLOCK("evict resource");
+			Profiler::pushString(resource->getPath().c_str());
+			const u64 size = resource->size();
+			++manager.m_evicted_count;
+			manager.m_evicted_size += size;
+			++m_evicted_count;
+			m_evicted_size += size;
+			resource->doUnload();
+		}
+		resource = next;
+	}
+
+	Profiler::pushCounter(m_loaded_size_counter, m_loaded_size / (1024.f * 1024.f));
+	Profiler::pushCounter(m_evicted_count_counter, (float)m_evicted_count);
+	Profiler::pushCounter(m_evicted_size_counter, m_evicted_size / (1024.f * 1024.f));
+}
+
 void ResourceManagerHub::reload(const Path& path)
 {
 	for (auto* manager : m_resource_managers)
@@ -1,6 +1,7 @@
 #pragma once
 
 
+#include "engine/file_system.h"
 #include "engine/hash_map.h"
 
 
@@ -8,7 +9,6 @@ namespace Lumix
 {
 
 
-class FileSystem;
 class Path;
 class Resource;
 struct ResourceType;
@@ -37,6 +37,13 @@ public:
 	void reload(const Path& path);
 	void reload(Resource& resource);
 	ResourceTable& getResourceTable() { return m_resources; }
+	// sum of sizes of loaded resources of this type, including unreferenced resources kept warm
+	u64 getLoadedSize() const { return m_loaded_size; }
+	u32 getEvictedCount() const { return m_evicted_count; }
+	u64 getEvictedSize() const { return m_evicted_size; }
+	// file reads of this type's resources are queued with this priority, reloads always with HIGH
+	void setLoadPriority(FileSystem::Priority priority) { m_load_priority = priority; }
+	FileSystem::Priority getLoadPriority() const { return m_load_priority; }
 
 	explicit ResourceManager(IAllocator& allocator);
 	virtual ~ResourceManager();
@@ -48,16 +55,26 @@ protected:
 	virtual void destroyResource(Resource& resource) = 0;
 	Resource* get(const Path& path);
 
+private:
+	void onLoaded(u64 size);
+	void onUnloaded(u64 size);
+
 protected:
 	IAllocator& m_allocator;
 	ResourceTable m_resources;
 	ResourceManagerHub* m_owner;
 	bool m_is_unload_enabled;
+	u64 m_loaded_size;
+	u32 m_evicted_count;
+	u64 m_evicted_size;
+	FileSystem::Priority m_load_priority;
 };
 
 
 class LUMIX_ENGINE_API ResourceManagerHub
 {
+	friend class Resource;
+	friend class ResourceManager;
 	typedef HashMap<u32, ResourceManager*> ResourceManagerTable;
 
 public:
@@ -94,15 +111,43 @@ public:
 	void reload(const Path& path);
 	void removeUnreferenced();
 	void enableUnload(bool enable);
+	// evicts unreferenced resources over the budget
+	void update();
+
+	// unreferenced resources are kept loaded while all loaded resources fit in the budget
+	// if they do not, the least recently released are unloaded first, but not sooner than keep warm time after release
+	// 0 disables the budget, unreferenced resources are then unloaded right away
+	void setBudget(u64 bytes);
+	u64 getBudget() const { return m_budget; }
+	void setKeepWarmTime(float seconds) { m_keep_warm_time = seconds; }
+	float getKeepWarmTime() const { return m_keep_warm_time; }
+	u64 getLoadedSize() const { return m_loaded_size; }
+	// must be called before any manager is destroyed, warm resources can reference resources of other managers
+	void unloadKeptWarm();
 
 	FileSystem& getFileSystem() { return *m_file_system; }
 
 private:
 	Resource* load(ResourceManager& manager, const Path& path);
+	void onUnreferenced(Resource& resource);
+	bool isKeptWarm(const Resource& resource) const;
+	void unlinkUnreferenced(Resource& resource);
+
 	IAllocator& m_allocator;
 	ResourceManagerTable m_resource_managers;
 	FileSystem* m_file_system;
 	LoadHook* m_load_hook;
+	u64 m_budget;
+	float m_keep_warm_time;
+	u64 m_loaded_size;
+	// unreferenced loaded resources, the least recently released first
+	Resource* m_lru_head;
+	Resource* m_lru_tail;
+	u32 m_evicted_count;
+	u64 m_evicted_size;
+	u32 m_loaded_size_counter;
+	u32 m_evicted_count_counter;
+	u32 m_evicted_size_counter;
 };
 
 
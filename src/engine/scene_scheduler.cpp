@@ -0,0 +1,225 @@
+#include "scene_scheduler.h"
+#include "engine/job_system.h"
+#include "engine/os.h"
+#include "engine/profiler.h"
+#include "engine/string.h"
+#include "engine/universe/universe.h"
+
+
+namespace Lumix
+{
+
+
+static bool contains(const char* const (&names)[IScene::UpdateDependencies::MAX_SCENES], const char* name)
+{
+	for (const char* n : names) {
+		if (n && equalStrings(n, name)) return true;
+	}
+	return false;
+}
+
+
+static bool touches(const IScene::UpdateDependencies& deps, const char* name)
+{
+	return contains(deps.reads, name) || contains(deps.writes, name);
+}
+
+
+SceneScheduler::SceneScheduler(IAllocator& allocator)
+	: m_nodes(allocator)
+	, m_edges(allocator)
+	, m_stats(allocator)
+{
+	m_critical_path_counter = Profiler::createCounter("Scenes critical path ms");
+	m_wall_counter = Profiler::createCounter("Scenes update ms");
+}
+
+
+bool SceneScheduler::conflicts(const Node& a, const Node& b)
+{
+	if (a.deps.exclusive || b.deps.exclusive) return true;
+	if (a.deps.writes_transforms && (b.deps.reads_transforms || b.deps.writes_transforms)) return true;
+	if (b.deps.writes_transforms && a.deps.reads_transforms) return true;
+	// scripts can touch any scene from their callbacks
+	if (contains(a.deps.writes, "lua_script") || contains(b.deps.writes, "lua_script")) return true;
+	// a scene always writes its own data
+	if (touches(a.deps, b.name) || touches(b.deps, a.name)) return true;
+	for (const char* name : a.deps.writes) {
+		if (name && touches(b.deps, name)) return true;
+	}
+	for (const char* name : b.deps.writes) {
+		if (name && contains(a.deps.reads, name)) return true;
+	}
+	return false;
+}
+
+
+// edges go from earlier to later scenes, so they are sorted by from
+void SceneScheduler::buildGraph(Universe& universe)
+{
+	const Array<IScene*>& scenes = universe.getScenes();
+	m_nodes.clear();
+	m_edges.clear();
+	u32 segment = 0;
+	for (IScene* scene : scenes) {
+		Node& node = m_nodes.emplace();
+		node.scheduler = this;
+		node.scene = scene;
+		node.name = scene->getPlugin().getName();
+		node.deps = {};
+		scene->getUpdateDependencies(node.deps);
+		node.index = m_nodes.size() - 1;
+		// exclusive scenes wait for everything before them, so they split the graph into independent segments
+		if (node.deps.exclusive) ++segment;
+		node.segment = segment;
+		if (node.deps.exclusive) ++segment;
+	}
+
+	for (u32 i = 0, c = m_nodes.size(); i < c; ++i) {
+		for (u32 j = i + 1; j < c; ++j) {
+			if (conflicts(m_nodes[i], m_nodes[j])) m_edges.push({i, j});
+		}
+	}
+}
+
+
+void SceneScheduler::execute(Node& node)
+{
+	Profiler::beginBlock(node.name);
+	node.start = OS::Timer::getRawTimestamp();
+	if (m_late_update) {
+		node.scene->lateUpdate(m_time_delta, m_paused);
+	}
+	else {
+		node.scene->update(m_time_delta, m_paused);
+	}
+	node.end = OS::Timer::getRawTimestamp();
+	Profiler::endBlock();
+}
+
+
+void SceneScheduler::runJob(void* data)
+{
+	Node& node = *(Node*)data;
+	SceneScheduler& scheduler = *node.scheduler;
+	scheduler.execute(node);
+	for (const Edge& edge : scheduler.m_edges) {
+		if (edge.from != node.index) continue;
+		const Node& to = scheduler.m_nodes[edge.to];
+		if (to.segment == node.segment) JobSystem::decSignal(to.precondition);
+	}
+}
+
+
+void SceneScheduler::launchSegment(u32 begin, u32 end)
+{
+	if (begin == end) return;
+	if (end - begin == 1) {
+		execute(m_nodes[begin]);
+		return;
+	}
+
+	// all preconditions must be set before the first job can finish
+	for (u32 i = begin; i < end; ++i) {
+		m_nodes[i].precondition = JobSystem::INVALID_HANDLE;
+	}
+	for (const Edge& edge : m_edges) {
+		if (edge.from < begin || edge.to >= end) continue;
+		JobSystem::incSignal(&m_nodes[edge.to].precondition);
+	}
+	for (u32 i = begin; i < end; ++i) {
+		JobSystem::runEx(&m_nodes[i], &runJob, &m_done, m_nodes[i].precondition, JobSystem::ANY_WORKER, JobSystem::Priority::HIGH);
+	}
+}
+
+
+void SceneScheduler::runPhase(bool late_update)
+{
+	m_late_update = late_update;
+	m_done = JobSystem::INVALID_HANDLE;
+	u32 segment_begin = 0;
+	for (u32 i = 0, c = m_nodes.size(); i < c; ++i) {
+		if (!m_nodes[i].deps.exclusive) continue;
+
+		launchSegment(segment_begin, i);
+		JobSystem::wait(m_done);
+		execute(m_nodes[i]);
+		segment_begin = i + 1;
+	}
+	launchSegment(segment_begin, m_nodes.size());
+	JobSystem::wait(m_done);
+}
+
+
+// the longest chain of dependent updates, waiting for workers is not included
+float SceneScheduler::computeCriticalPath()
+{
+	const double to_ms = 1000.0 / OS::Timer::getFrequency();
+	for (Node& node : m_nodes) {
+		node.path_ms = 0;
+		node.critical_pred = -1;
+		node.critical = false;
+	}
+
+	// edges only go forward, so all predecessors of a node are done when we get to it
+	i32 last = -1;
+	for (u32 i = 0, c = m_nodes.size(); i < c; ++i) {
+		Node& node = m_nodes[i];
+		node.path_ms += float((node.end - node.start) * to_ms);
+		if (last < 0 || node.path_ms > m_nodes[last].path_ms) last = i;
+		for (const Edge& edge : m_edges) {
+			if (edge.from != i) continue;
+			Node& to = m_nodes[edge.to];
+			if (node.path_ms > to.path_ms) {
+				to.path_ms = node.path_ms;
+				to.critical_pred = i;
+			}
+		}
+	}
+
+	if (last < 0) return 0;
+	const float path_ms = m_nodes[last].path_ms;
+	for (i32 i = last; i >= 0; i = m_nodes[i].critical_pred) {
+		m_nodes[i].critical = true;
+	}
+	return path_ms;
+}
+
+
+void SceneScheduler::update(Universe& universe, float time_delta, bool paused)
+{
+	PROFILE_FUNCTION();
+	buildGraph(universe);
+	m_time_delta = time_delta;
+	m_paused = paused;
+	m_stats.clear();
+	m_serial_ms = 0;
+	m_critical_path_ms = 0;
+	m_update_start = OS::Timer::getRawTimestamp();
+
+	const double to_ms = 1000.0 / OS::Timer::getFrequency();
+	for (int phase = 0; phase < 2; ++phase) {
+		const bool late_update = phase == 1;
+		{
+			PROFILE_BLOCK(late_update ? "late update scenes" : "update scenes");
+			runPhase(late_update);
+		}
+		m_critical_path_ms += computeCriticalPath();
+		for (const Node& node : m_nodes) {
+			Stats& stats = m_stats.emplace();
+			stats.name = node.name;
+			stats.late_update = late_update;
+			stats.exclusive = node.deps.exclusive;
+			stats.critical = node.critical;
+			stats.start_ms = float((node.start - m_update_start) * to_ms);
+			stats.duration_ms = float((node.end - node.start) * to_ms);
+			m_serial_ms += stats.duration_ms;
+		}
+	}
+	m_wall_ms = float((OS::Timer::getRawTimestamp() - m_update_start) * to_ms);
+	Profiler::pushCounter(m_critical_path_counter, m_critical_path_ms);
+	Profiler::pushCounter(m_wall_counter, m_wall_ms);
+}
+
+
+} // namespace Lumix
@@ -0,0 +1,93 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/iplugin.h"
+
+
+namespace Lumix
+{
+
+
+class Universe;
+
+
+// updates scenes as a task graph built from IScene::getUpdateDependencies
+// scenes which do not conflict run concurrently on workers, conflicting scenes keep their order in the universe
+class LUMIX_ENGINE_API SceneScheduler
+{
+public:
+	struct Stats
+	{
+		// plugin name
+		const char* name;
+		bool late_update;
+		bool exclusive;
+		// on the longest chain of dependent updates
+		bool critical;
+		// relative to the beginning of the update
+		float start_ms;
+		float duration_ms;
+	};
+
+	explicit SceneScheduler(IAllocator& allocator);
+
+	// calls update and then lateUpdate of all scenes
+	void update(Universe& universe, float time_delta, bool paused);
+
+	// everything below is from the last update
+	const Array<Stats>& getStats() const { return m_stats; }
+	// the shortest possible time of the update with unlimited workers
+	float getCriticalPathMs() const { return m_critical_path_ms; }
+	// the time of the update if all scenes ran in sequence
+	float getSerialMs() const { return m_serial_ms; }
+	float getWallMs() const { return m_wall_ms; }
+
+private:
+	struct Node
+	{
+		SceneScheduler* scheduler;
+		IScene* scene;
+		const char* name;
+		IScene::UpdateDependencies deps;
+		u32 index;
+		u32 segment;
+		u32 precondition;
+		u64 start;
+		u64 end;
+		float path_ms;
+		i32 critical_pred;
+		bool critical;
+	};
+
+	struct Edge
+	{
+		u32 from;
+		u32 to;
+	};
+
+	static void runJob(void* data);
+	static bool conflicts(const Node& a, const Node& b);
+	void buildGraph(Universe& universe);
+	void runPhase(bool late_update);
+	void launchSegment(u32 begin, u32 end);
+	void execute(Node& node);
+	float computeCriticalPath();
+
+	Array<Node> m_nodes;
+	Array<Edge> m_edges;
+	Array<Stats> m_stats;
+	u32 m_done;
+	u64 m_update_start;
+	float m_time_delta;
+	bool m_paused;
+	bool m_late_update;
+	float m_critical_path_ms = 0;
+	float m_serial_ms = 0;
+	float m_wall_ms = 0;
+	u32 m_critical_path_counter;
+	u32 m_wall_counter;
+};
+
+
+} // namespace Lumix
@@ -0,0 +1,52 @@
+#include "engine/simd.h"
+#ifdef _WIN32
+	#include <intrin.h>
+#elif defined __x86_64__ || defined __i386__
+	#include <cpuid.h>
+#endif
+
+
+namespace Lumix
+{
+
+
+static bool detectAVX2()
+{
+	#ifdef _WIN32
+		int regs[4];
+		__cpuid(regs, 0);
+		if (regs[0] < 7) return false;
+		__cpuid(regs, 1);
+		const bool os_xsave = (regs[2] & (1 << 27)) != 0;
+		const bool avx = (regs[2] & (1 << 28)) != 0;
+		if (!os_xsave || !avx) return false;
+		// OS must save ymm registers on context switch
+		if ((_xgetbv(0) & 6) != 6) return false;
+		__cpuidex(regs, 7, 0);
+		return (regs[1] & (1 << 5)) != 0;
+	#elif defined __x86_64__ || defined __i386__
+		unsigned int eax, ebx, ecx, edx;
+		if (__get_cpuid_max(0, nullptr) < 7) return false;
+		__cpuid(1, eax, ebx, ecx, edx);
+		const bool os_xsave = (ecx & (1 << 27)) != 0;
+		const bool avx = (ecx & (1 << 28)) != 0;
+		if (!os_xsave || !avx) return false;
+		u32 xcr0_lo, xcr0_hi;
+		__asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+		if ((xcr0_lo & 6) != 6) return false;
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		return (ebx & (1 << 5)) != 0;
+	#else
+		return false;
+	#endif
+}
+
+
+bool f8IsSupported()
+{
+	static const bool supported = detectAVX2();
+	return supported;
+}
+
+
+} // namespace Lumix
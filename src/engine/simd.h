@@ -4,17 +4,29 @@
 #include "engine/lumix.h"
 
 
-#ifdef _WIN32
-	#include <xmmintrin.h>
+#if defined _WIN32 || defined __SSE2__
+	#define LUMIX_SSE
+	#include <emmintrin.h>
+	#include <immintrin.h>
+	#ifdef __SSE4_1__
+		#include <smmintrin.h>
+	#endif
 #else
 	#include <math.h>
 #endif
 
+#if defined LUMIX_SSE && !defined _MSC_VER
+	// gcc and clang refuse to compile AVX intrinsics unless the function is built for AVX
+	#define LUMIX_AVX2_TARGET __attribute__((target("avx2")))
+#else
+	#define LUMIX_AVX2_TARGET
+#endif
+
 namespace Lumix
 {
 
 
-#ifdef _WIN32
+#ifdef LUMIX_SSE
 	typedef __m128 float4;
 
 
@@ -101,6 +113,139 @@ namespace Lumix
 		return _mm_max_ps(a, b);
 	}
 
+
+	LUMIX_FORCE_INLINE float4 f4Floor(float4 a)
+	{
+		#ifdef __SSE4_1__
+			return _mm_floor_ps(a);
+		#else
+			const float4 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+			return _mm_sub_ps(t, _mm_and_ps(_mm_cmplt_ps(a, t), _mm_set_ps1(1.f)));
+		#endif
+	}
+
+
+	// a, b, c, d are rows of a 4x4 matrix, after the call they are its columns
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		_MM_TRANSPOSE4_PS(a, b, c, d);
+	}
+
+
+	typedef __m128d double2;
+
+
+	LUMIX_FORCE_INLINE double2 d2Set(double x, double y)
+	{
+		return _mm_set_pd(y, x);
+	}
+
+
+	LUMIX_FORCE_INLINE double2 d2Splat(double value)
+	{
+		return _mm_set1_pd(value);
+	}
+
+
+	LUMIX_FORCE_INLINE void d2Store(double* x, double* y, double2 src)
+	{
+		_mm_storel_pd(x, src);
+		_mm_storeh_pd(y, src);
+	}
+
+
+	LUMIX_FORCE_INLINE double2 d2Add(double2 a, double2 b)
+	{
+		return _mm_add_pd(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE double2 d2Sub(double2 a, double2 b)
+	{
+		return _mm_sub_pd(a, b);
+	}
+
+
+	LUMIX_FORCE_INLINE double2 d2Mul(double2 a, double2 b)
+	{
+		return _mm_mul_pd(a, b);
+	}
+
+
+	typedef __m256 float8;
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8LoadUnaligned(const void* src)
+	{
+		return _mm256_loadu_ps((const float*)src);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8Load(const void* src)
+	{
+		return _mm256_load_ps((const float*)src);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8Splat(float value)
+	{
+		return _mm256_set1_ps(value);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE void f8Store(void* dest, float8 src)
+	{
+		_mm256_store_ps((float*)dest, src);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE int f8MoveMask(float8 a)
+	{
+		return _mm256_movemask_ps(a);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8Add(float8 a, float8 b)
+	{
+		return _mm256_add_ps(a, b);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8Sub(float8 a, float8 b)
+	{
+		return _mm256_sub_ps(a, b);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8Mul(float8 a, float8 b)
+	{
+		return _mm256_mul_ps(a, b);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8Div(float8 a, float8 b)
+	{
+		return _mm256_div_ps(a, b);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8Sqrt(float8 a)
+	{
+		return _mm256_sqrt_ps(a);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8Min(float8 a, float8 b)
+	{
+		return _mm256_min_ps(a, b);
+	}
+
+
+	LUMIX_AVX2_TARGET LUMIX_FORCE_INLINE float8 f8Max(float8 a, float8 b)
+	{
+		return _mm256_max_ps(a, b);
+	}
+
 #else 
 	struct float4
 	{
@@ -239,8 +384,155 @@ namespace Lumix
 		};
 	}
 
+
+	LUMIX_FORCE_INLINE float4 f4Floor(float4 a)
+	{
+		return{
+			(float)floor(a.x),
+			(float)floor(a.y),
+			(float)floor(a.z),
+			(float)floor(a.w)
+		};
+	}
+
+
+	LUMIX_FORCE_INLINE void f4Transpose(float4& a, float4& b, float4& c, float4& d)
+	{
+		const float4 ta = a, tb = b, tc = c, td = d;
+		a = {ta.x, tb.x, tc.x, td.x};
+		b = {ta.y, tb.y, tc.y, td.y};
+		c = {ta.z, tb.z, tc.z, td.z};
+		d = {ta.w, tb.w, tc.w, td.w};
+	}
+
+
+	struct double2
+	{
+		double x, y;
+	};
+
+
+	LUMIX_FORCE_INLINE double2 d2Set(double x, double y)
+	{
+		return {x, y};
+	}
+
+
+	LUMIX_FORCE_INLINE double2 d2Splat(double value)
+	{
+		return {value, value};
+	}
+
+
+	LUMIX_FORCE_INLINE void d2Store(double* x, double* y, double2 src)
+	{
+		*x = src.x;
+		*y = src.y;
+	}
+
+
+	LUMIX_FORCE_INLINE double2 d2Add(double2 a, double2 b)
+	{
+		return {a.x + b.x, a.y + b.y};
+	}
+
+
+	LUMIX_FORCE_INLINE double2 d2Sub(double2 a, double2 b)
+	{
+		return {a.x - b.x, a.y - b.y};
+	}
+
+
+	LUMIX_FORCE_INLINE double2 d2Mul(double2 a, double2 b)
+	{
+		return {a.x * b.x, a.y * b.y};
+	}
+
+
+	// emulated with two float4, f8IsSupported() returns false so hot paths can keep using float4
+	struct float8
+	{
+		float4 lo, hi;
+	};
+
+
+	LUMIX_FORCE_INLINE float8 f8LoadUnaligned(const void* src)
+	{
+		return { f4LoadUnaligned(src), f4LoadUnaligned((const float*)src + 4) };
+	}
+
+
+	LUMIX_FORCE_INLINE float8 f8Load(const void* src)
+	{
+		return { f4Load(src), f4Load((const float*)src + 4) };
+	}
+
+
+	LUMIX_FORCE_INLINE float8 f8Splat(float value)
+	{
+		return { f4Splat(value), f4Splat(value) };
+	}
+
+
+	LUMIX_FORCE_INLINE void f8Store(void* dest, float8 src)
+	{
+		f4Store(dest, src.lo);
+		f4Store((float*)dest + 4, src.hi);
+	}
+
+
+	LUMIX_FORCE_INLINE int f8MoveMask(float8 a)
+	{
+		return f4MoveMask(a.lo) | (f4MoveMask(a.hi) << 4);
+	}
+
+
+	LUMIX_FORCE_INLINE float8 f8Add(float8 a, float8 b)
+	{
+		return { f4Add(a.lo, b.lo), f4Add(a.hi, b.hi) };
+	}
+
+
+	LUMIX_FORCE_INLINE float8 f8Sub(float8 a, float8 b)
+	{
+		return { f4Sub(a.lo, b.lo), f4Sub(a.hi, b.hi) };
+	}
+
+
+	LUMIX_FORCE_INLINE float8 f8Mul(float8 a, float8 b)
+	{
+		return { f4Mul(a.lo, b.lo), f4Mul(a.hi, b.hi) };
+	}
+
+
+	LUMIX_FORCE_INLINE float8 f8Div(float8 a, float8 b)
+	{
+		return { f4Div(a.lo, b.lo), f4Div(a.hi, b.hi) };
+	}
+
+
+	LUMIX_FORCE_INLINE float8 f8Sqrt(float8 a)
+	{
+		return { f4Sqrt(a.lo), f4Sqrt(a.hi) };
+	}
+
+
+	LUMIX_FORCE_INLINE float8 f8Min(float8 a, float8 b)
+	{
+		return { f4Min(a.lo, b.lo), f4Min(a.hi, b.hi) };
+	}
+
+
+	LUMIX_FORCE_INLINE float8 f8Max(float8 a, float8 b)
+	{
+		return { f4Max(a.lo, b.lo), f4Max(a.hi, b.hi) };
+	}
+
 #endif
 
 
+// float8 functions may be called only from LUMIX_AVX2_TARGET functions and only if this returns true
+LUMIX_ENGINE_API bool f8IsSupported();
+
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
@@ -0,0 +1,137 @@
+#pragma once
+
+
+#include "engine/array.h"
+
+
+namespace Lumix
+{
+
+
+// per-entity components stored densely, lookup by entity is O(1) and iteration touches only existing components
+// entity -> dense index table is paged, so entities without the component do not cost more than a page slot
+// erase moves the last component into the hole, so pointers and indices are not stable
+template <typename T> class SparseSet
+{
+public:
+	explicit SparseSet(IAllocator& allocator)
+		: m_allocator(allocator)
+		, m_pages(allocator)
+		, m_entities(allocator)
+		, m_values(allocator)
+	{}
+
+
+	~SparseSet()
+	{
+		for (i32* page : m_pages) m_allocator.deallocate(page);
+	}
+
+
+	T* begin() const { return m_values.begin(); }
+	T* end() const { return m_values.end(); }
+	int size() const { return m_values.size(); }
+	bool empty() const { return m_values.empty(); }
+
+
+	void reserve(int capacity)
+	{
+		m_entities.reserve(capacity);
+		m_values.reserve(capacity);
+	}
+
+
+	// index into the dense arrays or -1
+	LUMIX_FORCE_INLINE int find(EntityRef entity) const
+	{
+		const u32 page_idx = u32(entity.index) >> PAGE_BITS;
+		if (page_idx >= (u32)m_pages.size()) return -1;
+		const i32* page = m_pages[page_idx];
+		return page ? page[entity.index & PAGE_MASK] : -1;
+	}
+
+
+	bool has(EntityRef entity) const { return find(entity) >= 0; }
+
+
+	LUMIX_FORCE_INLINE T& operator[](EntityRef entity)
+	{
+		const int idx = find(entity);
+		ASSERT(idx >= 0);
+		return m_values[idx];
+	}
+
+
+	LUMIX_FORCE_INLINE const T& operator[](EntityRef entity) const
+	{
+		const int idx = find(entity);
+		ASSERT(idx >= 0);
+		return m_values[idx];
+	}
+
+
+	T& at(int index) { return m_values[index]; }
+	const T& at(int index) const { return m_values[index]; }
+	EntityRef getEntity(int index) const { return m_entities[index]; }
+
+
+	template <typename... Params> T& emplace(EntityRef entity, Params&&... params)
+	{
+		ASSERT(!has(entity));
+		getSlot(entity) = m_values.size();
+		m_entities.push(entity);
+		return m_values.emplace(static_cast<Params&&>(params)...);
+	}
+
+
+	T& insert(EntityRef entity, const T& value) { return emplace(entity, value); }
+
+
+	void erase(EntityRef entity)
+	{
+		const int idx = find(entity);
+		if (idx < 0) return;
+
+		const int last = m_values.size() - 1;
+		if (idx != last) {
+			const EntityRef moved = m_entities[last];
+			m_pages[moved.index >> PAGE_BITS][moved.index & PAGE_MASK] = idx;
+		}
+		m_pages[entity.index >> PAGE_BITS][entity.index & PAGE_MASK] = -1;
+		m_entities.swapAndPop(idx);
+		m_values.swapAndPop(idx);
+	}
+
+
+	void clear()
+	{
+		for (EntityRef e : m_entities) {
+			m_pages[e.index >> PAGE_BITS][e.index & PAGE_MASK] = -1;
+		}
+		m_entities.clear();
+		m_values.clear();
+	}
+
+private:
+	enum { PAGE_BITS = 12, PAGE_SIZE = 1 << PAGE_BITS, PAGE_MASK = PAGE_SIZE - 1 };
+
+	i32& getSlot(EntityRef entity)
+	{
+		const int page_idx = entity.index >> PAGE_BITS;
+		while (page_idx >= m_pages.size()) m_pages.push(nullptr);
+		i32*& page = m_pages[page_idx];
+		if (!page) {
+			page = (i32*)m_allocator.allocate(sizeof(i32) * PAGE_SIZE);
+			for (int i = 0; i < PAGE_SIZE; ++i) page[i] = -1;
+		}
+		return page[entity.index & PAGE_MASK];
+	}
+
+	IAllocator& m_allocator;
+	Array<i32*> m_pages;
+	Array<EntityRef> m_entities;
+	Array<T> m_values;
+};
+
+
+} // namespace Lumix
@@ -0,0 +1,480 @@
+#include "tag_allocator.h"
+#include "engine/debug.h"
+#include "engine/hash_map.h"
+#include "engine/log.h"
+#include "engine/math.h"
+#include "engine/mt/atomic.h"
+#include "engine/mt/thread.h"
+#include "engine/profiler.h"
+#include "engine/string.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+namespace Lumix
+{
+
+
+// a thread flushes its counters of a tag once they grow over one of these
+static const i64 FLUSH_BYTES = 64 * 1024;
+static const i64 FLUSH_ALLOCATIONS = 64;
+static const u32 MAX_ALIGN = 32 * 1024;
+
+
+// placed right in front of every allocation
+struct TagAllocationHeader
+{
+	Debug::StackNode* stack;
+	u64 size : 48;
+	// distance from the beginning of the source block
+	u64 offset : 16;
+};
+
+
+struct TagSlot
+{
+	char name[64];
+	i32 parent;
+	// changes every time the slot is reused, so threads do not flush stale counters into a new tag
+	volatile i32 generation;
+	bool used;
+	volatile i64 live_bytes;
+	volatile i64 peak_bytes;
+	volatile i64 allocations;
+	i64 last_frame_allocations;
+	u32 frame_allocations;
+	// profiler counters are created once per slot, a reused slot renames them
+	bool has_counters;
+	bool rename_counters;
+	u32 bytes_counter;
+	u32 allocations_counter;
+	char bytes_counter_name[128];
+	char allocations_counter_name[128];
+	HashMap<Debug::StackNode*, TagAllocator::StackStats>* stacks;
+};
+
+
+// zero initialized, so tags can be created from static constructors of other translation units
+struct TagRegistry
+{
+	volatile i32 lock;
+	volatile i32 stacks_lock;
+	bool track_stacks;
+	// never destroyed, so recorded stacks stay valid
+	Debug::StackTree* stack_tree;
+	TagSlot slots[TagAllocator::MAX_TAGS];
+};
+
+
+struct ThreadTagCounter
+{
+	i64 bytes;
+	i64 allocations;
+	i32 generation;
+};
+
+
+struct ThreadTagCounters
+{
+	~ThreadTagCounters();
+
+	ThreadTagCounter tags[TagAllocator::MAX_TAGS];
+	// static destructors can still allocate after the thread's counters are gone
+	bool destroyed;
+};
+
+
+static TagRegistry g_tags;
+static thread_local ThreadTagCounters g_thread_tag_counters;
+// stack maps are not accounted in any tag
+static DefaultAllocator g_stacks_allocator;
+
+
+static void lock(volatile i32* value)
+{
+	for (u32 i = 0; !MT::compareAndExchange(value, 1, 0); ++i) {
+		if (i > 64) MT::yield();
+	}
+}
+
+
+static void unlock(volatile i32* value)
+{
+	MT::memoryBarrier();
+	*value = 0;
+}
+
+
+static i64 atomicAdd64(volatile i64* value, i64 delta)
+{
+	for (;;) {
+		const i64 v = *value;
+		if (MT::compareAndExchange64(value, v + delta, v)) return v + delta;
+	}
+}
+
+
+static void flush(u32 id, i64 bytes, i64 allocations)
+{
+	// parents include their children
+	for (i32 i = (i32)id; i >= 0; i = g_tags.slots[i].parent) {
+		TagSlot& slot = g_tags.slots[i];
+		const i64 live = atomicAdd64(&slot.live_bytes, bytes);
+		if (allocations) atomicAdd64(&slot.allocations, allocations);
+		for (;;) {
+			const i64 peak = slot.peak_bytes;
+			if (live <= peak || MT::compareAndExchange64(&slot.peak_bytes, live, peak)) break;
+		}
+	}
+}
+
+
+ThreadTagCounters::~ThreadTagCounters()
+{
+	for (u32 i = 0; i < TagAllocator::MAX_TAGS; ++i) {
+		const ThreadTagCounter& counter = tags[i];
+		if (counter.generation != g_tags.slots[i].generation) continue;
+		if (counter.bytes != 0 || counter.allocations != 0) flush(i, counter.bytes, counter.allocations);
+	}
+	destroyed = true;
+}
+
+
+static void account(u32 id, i64 bytes, i64 allocations)
+{
+	ThreadTagCounters& counters = g_thread_tag_counters;
+	if (counters.destroyed) {
+		flush(id, bytes, allocations);
+		return;
+	}
+
+	ThreadTagCounter& counter = counters.tags[id];
+	const i32 generation = g_tags.slots[id].generation;
+	if (counter.generation != generation) {
+		counter = {};
+		counter.generation = generation;
+	}
+	counter.bytes += bytes;
+	counter.allocations += allocations;
+	if (counter.bytes >= FLUSH_BYTES || counter.bytes <= -FLUSH_BYTES || counter.allocations >= FLUSH_ALLOCATIONS) {
+		flush(id, counter.bytes, counter.allocations);
+		counter.bytes = 0;
+		counter.allocations = 0;
+	}
+}
+
+
+static Debug::StackNode* recordStack(u32 id, u64 size)
+{
+	if (!g_tags.track_stacks) return nullptr;
+
+	lock(&g_tags.stacks_lock);
+	// the tracking could have been disabled meanwhile
+	Debug::StackNode* stack = g_tags.stack_tree ? g_tags.stack_tree->record() : nullptr;
+	if (stack) {
+		TagSlot& slot = g_tags.slots[id];
+		if (!slot.stacks) slot.stacks = LUMIX_NEW(g_stacks_allocator, HashMap<Debug::StackNode*, TagAllocator::StackStats>)(g_stacks_allocator);
+		auto iter = slot.stacks->find(stack);
+		if (iter.isValid()) {
+			iter.value().bytes += size;
+			++iter.value().count;
+		}
+		else {
+			TagAllocator::StackStats stats;
+			stats.stack = stack;
+			stats.bytes = size;
+			stats.count = 1;
+			slot.stacks->insert(stack, stats);
+		}
+	}
+	unlock(&g_tags.stacks_lock);
+	return stack;
+}
+
+
+static void releaseStack(u32 id, Debug::StackNode* stack, u64 size)
+{
+	lock(&g_tags.stacks_lock);
+	TagSlot& slot = g_tags.slots[id];
+	if (slot.stacks) {
+		auto iter = slot.stacks->find(stack);
+		if (iter.isValid()) {
+			iter.value().bytes -= size;
+			--iter.value().count;
+			if (iter.value().count == 0) slot.stacks->erase(iter);
+		}
+	}
+	unlock(&g_tags.stacks_lock);
+}
+
+
+// the block keeps its stack, only its size changes
+static void resizeStack(u32 id, Debug::StackNode* stack, u64 old_size, u64 size)
+{
+	lock(&g_tags.stacks_lock);
+	TagSlot& slot = g_tags.slots[id];
+	if (slot.stacks) {
+		auto iter = slot.stacks->find(stack);
+		if (iter.isValid()) iter.value().bytes += size - old_size;
+	}
+	unlock(&g_tags.stacks_lock);
+}
+
+
+static LUMIX_FORCE_INLINE u32 getHeaderOffset(size_t align)
+{
+	ASSERT(align <= MAX_ALIGN);
+	return (u32)maximum(align, sizeof(TagAllocationHeader));
+}
+
+
+static LUMIX_FORCE_INLINE TagAllocationHeader& getHeader(void* ptr)
+{
+	return ((TagAllocationHeader*)ptr)[-1];
+}
+
+
+TagAllocator::TagAllocator(IAllocator& source, const char* name)
+	: m_source(source)
+{
+	init(name, -1);
+}
+
+
+// the child shares the parent's source, it only forwards its counters to the parent
+TagAllocator::TagAllocator(TagAllocator& parent, const char* name)
+	: m_source(parent.m_source)
+{
+	init(name, (i32)parent.m_id);
+}
+
+
+void TagAllocator::init(const char* name, i32 parent)
+{
+	lock(&g_tags.lock);
+	u32 id = 0;
+	while (id < MAX_TAGS && g_tags.slots[id].used) ++id;
+	LUMIX_FATAL(id < MAX_TAGS);
+
+	TagSlot& slot = g_tags.slots[id];
+	copyString(slot.name, name);
+	slot.parent = parent;
+	slot.used = true;
+	slot.live_bytes = 0;
+	slot.peak_bytes = 0;
+	slot.allocations = 0;
+	slot.last_frame_allocations = 0;
+	slot.frame_allocations = 0;
+	slot.rename_counters = true;
+	MT::atomicIncrement(&slot.generation);
+	m_id = id;
+	unlock(&g_tags.lock);
+}
+
+
+TagAllocator::~TagAllocator()
+{
+	lock(&g_tags.stacks_lock);
+	TagSlot& slot = g_tags.slots[m_id];
+	if (slot.stacks) slot.stacks->clear();
+	unlock(&g_tags.stacks_lock);
+
+	lock(&g_tags.lock);
+	MT::atomicIncrement(&slot.generation);
+	slot.used = false;
+	unlock(&g_tags.lock);
+}
+
+
+void* TagAllocator::allocate_aligned(size_t size, size_t align)
+{
+	const u32 offset = getHeaderOffset(align);
+	u8* mem = (u8*)m_source.allocate_aligned(size + offset, align);
+	if (!mem) return nullptr;
+
+	u8* ptr = mem + offset;
+	TagAllocationHeader& header = getHeader(ptr);
+	header.size = size;
+	header.offset = offset;
+	header.stack = recordStack(m_id, size);
+	account(m_id, (i64)size, 1);
+	return ptr;
+}
+
+
+void TagAllocator::deallocate_aligned(void* ptr)
+{
+	if (!ptr) return;
+
+	TagAllocationHeader& header = getHeader(ptr);
+	const u64 size = header.size;
+	if (header.stack) releaseStack(m_id, header.stack, size);
+	account(m_id, -(i64)size, 0);
+	m_source.deallocate_aligned((u8*)ptr - header.offset);
+}
+
+
+void* TagAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
+{
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0) {
+		deallocate_aligned(ptr);
+		return nullptr;
+	}
+
+	const u32 offset = getHeaderOffset(align);
+	TagAllocationHeader& old_header = getHeader(ptr);
+	ASSERT(old_header.offset == offset);
+	const u64 old_size = old_header.size;
+	Debug::StackNode* stack = old_header.stack;
+
+	u8* mem = (u8*)m_source.reallocate_aligned((u8*)ptr - offset, size + offset, align);
+	if (!mem) return nullptr;
+
+	// the block keeps the callstack of its first allocation
+	u8* new_ptr = mem + offset;
+	getHeader(new_ptr).size = size;
+	if (stack) resizeStack(m_id, stack, old_size, size);
+	account(m_id, (i64)size - (i64)old_size, 0);
+	return new_ptr;
+}
+
+
+void* TagAllocator::allocate(size_t size)
+{
+	return allocate_aligned(size, 16);
+}
+
+
+void TagAllocator::deallocate(void* ptr)
+{
+	deallocate_aligned(ptr);
+}
+
+
+void* TagAllocator::reallocate(void* ptr, size_t size)
+{
+	return reallocate_aligned(ptr, size, 16);
+}
+
+
+static void getPath(i32 id, Span<char> path)
+{
+	const TagSlot& slot = g_tags.slots[id];
+	if (slot.parent >= 0) {
+		getPath(slot.parent, path);
+		catString(path, "/");
+		catString(path, slot.name);
+	}
+	else {
+		copyString(path, slot.name);
+	}
+}
+
+
+void TagAllocator::frame()
+{
+	lock(&g_tags.lock);
+	for (u32 i = 0; i < MAX_TAGS; ++i) {
+		TagSlot& slot = g_tags.slots[i];
+		if (!slot.used) continue;
+
+		const i64 allocations = slot.allocations;
+		slot.frame_allocations = u32(allocations - slot.last_frame_allocations);
+		slot.last_frame_allocations = allocations;
+
+		if (slot.rename_counters) {
+			slot.rename_counters = false;
+			char path[96];
+			getPath(i, Span(path));
+			copyString(slot.bytes_counter_name, path);
+			catString(slot.bytes_counter_name, " MB");
+			copyString(slot.allocations_counter_name, path);
+			catString(slot.allocations_counter_name, " allocations");
+			if (!slot.has_counters) {
+				slot.bytes_counter = Profiler::createCounter(slot.bytes_counter_name);
+				slot.allocations_counter = Profiler::createCounter(slot.allocations_counter_name);
+				slot.has_counters = true;
+			}
+		}
+		Profiler::pushCounter(slot.bytes_counter, float(maximum(slot.live_bytes, (i64)0) / (1024.0 * 1024.0)));
+		Profiler::pushCounter(slot.allocations_counter, (float)slot.frame_allocations);
+	}
+	unlock(&g_tags.lock);
+}
+
+
+u32 TagAllocator::getStats(Span<Stats> stats)
+{
+	// maps slots to indices in stats
+	i32 indices[MAX_TAGS];
+	u32 count = 0;
+	lock(&g_tags.lock);
+	for (u32 i = 0; i < MAX_TAGS; ++i) {
+		indices[i] = -1;
+		const TagSlot& slot = g_tags.slots[i];
+		if (!slot.used) continue;
+
+		if (count < stats.length()) {
+			Stats& s = stats[count];
+			indices[i] = count;
+			s.name = slot.name;
+			s.id = i;
+			s.parent = slot.parent;
+			s.live_bytes = (u64)maximum(slot.live_bytes, (i64)0);
+			s.peak_bytes = (u64)maximum(slot.peak_bytes, (i64)0);
+			s.total_allocations = (u64)slot.allocations;
+			s.frame_allocations = slot.frame_allocations;
+		}
+		++count;
+	}
+	unlock(&g_tags.lock);
+
+	for (u32 i = 0, c = minimum(count, stats.length()); i < c; ++i) {
+		if (stats[i].parent >= 0) stats[i].parent = indices[stats[i].parent];
+	}
+	return count;
+}
+
+
+void TagAllocator::enableStackTracking(bool enable)
+{
+	lock(&g_tags.stacks_lock);
+	g_tags.track_stacks = enable;
+	if (enable && !g_tags.stack_tree) g_tags.stack_tree = LUMIX_NEW(g_stacks_allocator, Debug::StackTree)();
+	unlock(&g_tags.stacks_lock);
+}
+
+
+bool TagAllocator::isStackTrackingEnabled()
+{
+	return g_tags.track_stacks;
+}
+
+
+u32 TagAllocator::getStackStats(u32 id, Span<StackStats> stats)
+{
+	if (id >= MAX_TAGS || stats.length() == 0) return 0;
+
+	u32 count = 0;
+	lock(&g_tags.stacks_lock);
+	const TagSlot& slot = g_tags.slots[id];
+	if (slot.stacks) {
+		// keeps the biggest ones sorted by bytes
+		for (const StackStats& s : *slot.stacks) {
+			if (count == stats.length() && stats[count - 1].bytes >= s.bytes) continue;
+			u32 pos = minimum(count, stats.length() - 1);
+			while (pos > 0 && stats[pos - 1].bytes < s.bytes) {
+				stats[pos] = stats[pos - 1];
+				--pos;
+			}
+			stats[pos] = s;
+			if (count < stats.length()) ++count;
+		}
+	}
+	unlock(&g_tags.stacks_lock);
+	return count;
+}
+
+
+} // namespace Lumix
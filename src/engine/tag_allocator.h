@@ -0,0 +1,77 @@
+#pragma once
+
+
+#include "engine/allocator.h"
+
+
+namespace Lumix
+{
+
+
+namespace Debug
+{
+	class StackNode;
+}
+
+
+// proxy allocator which accounts the memory of a subsystem under a name
+// tags can be nested, memory of a child tag is included in all its parents
+// each thread counts into its own counters, which are flushed to the tag in batches, so the stats can lag a bit behind
+class LUMIX_ENGINE_API TagAllocator final : public IAllocator
+{
+public:
+	enum { MAX_TAGS = 256 };
+
+	struct Stats
+	{
+		// valid while the tag exists
+		const char* name;
+		u32 id;
+		// index of the parent in the array filled by getStats, -1 for root tags
+		i32 parent;
+		u64 live_bytes;
+		u64 peak_bytes;
+		u64 total_allocations;
+		// allocations in the last frame, see frame()
+		u32 frame_allocations;
+	};
+
+	struct StackStats
+	{
+		Debug::StackNode* stack;
+		u64 bytes;
+		u32 count;
+	};
+
+	TagAllocator(IAllocator& source, const char* name);
+	TagAllocator(TagAllocator& parent, const char* name);
+	~TagAllocator();
+
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t size) override;
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+	IAllocator& getSourceAllocator() { return m_source; }
+	u32 getID() const { return m_id; }
+
+	// called once per frame, computes allocations per frame and pushes them with live bytes as profiler counters
+	static void frame();
+	// returns the number of tags, fills at most stats.length() of them
+	static u32 getStats(Span<Stats> stats);
+	// allocations made while enabled remember their callstack, this is slow
+	static void enableStackTracking(bool enable);
+	static bool isStackTrackingEnabled();
+	// the biggest live callstacks of the tag, returns the number of filled stats
+	static u32 getStackStats(u32 id, Span<StackStats> stats);
+
+private:
+	void init(const char* name, i32 parent);
+
+	IAllocator& m_source;
+	u32 m_id;
+};
+
+
+} // namespace Lumix
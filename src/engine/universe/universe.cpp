@@ -1,11 +1,14 @@
 #include "universe.h"
 #include "engine/crc32.h"
 #include "engine/iplugin.h"
+#include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/math.h"
 #include "engine/prefab.h"
+#include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/serializer.h"
+#include "engine/simd.h"
 #include "engine/universe/component.h"
 
 
@@ -14,13 +17,17 @@ namespace Lumix
 
 
 static const int RESERVED_ENTITIES_COUNT = 5000;
+// smaller updates are not worth the jobs
+static const u32 MIN_PARALLEL_TRANSFORMS = 1024;
+static const u32 TRANSFORM_ROOTS_GRAIN = 16;
 
 
 Universe::~Universe() = default;
 
 
-Universe::Universe(IAllocator& allocator)
+Universe::Universe(IAllocator& allocator, IAllocator& frame_allocator)
 	: m_allocator(allocator)
+	, m_frame_allocator(frame_allocator)
 	, m_names(m_allocator)
 	, m_entities(m_allocator)
 	, m_component_added(m_allocator)
@@ -28,13 +35,23 @@ Universe::Universe(IAllocator& allocator)
 	, m_entity_created(m_allocator)
 	, m_entity_destroyed(m_allocator)
 	, m_entity_moved(m_allocator)
+	, m_entities_moved(m_allocator)
 	, m_first_free_slot(-1)
 	, m_scenes(m_allocator)
 	, m_hierarchy(m_allocator)
-	, m_transforms(m_allocator)
+	, m_positions(m_allocator)
+	, m_rotations(m_allocator)
+	, m_scales(m_allocator)
+	, m_dirty_transforms(m_allocator)
+	, m_changed_transforms(m_allocator)
+	, m_notified_transforms(m_allocator)
+	, m_transform_queue(m_allocator)
+	, m_transform_roots(m_allocator)
 {
 	m_entities.reserve(RESERVED_ENTITIES_COUNT);
-	m_transforms.reserve(RESERVED_ENTITIES_COUNT);
+	m_positions.reserve(RESERVED_ENTITIES_COUNT);
+	m_rotations.reserve(RESERVED_ENTITIES_COUNT);
+	m_scales.reserve(RESERVED_ENTITIES_COUNT);
 }
 
 
@@ -77,20 +94,27 @@ void Universe::removeScene(IScene* scene)
 
 const DVec3& Universe::getPosition(EntityRef entity) const
 {
-	return m_transforms[entity.index].pos;
+	return m_positions[entity.index];
 }
 
 
 const Quat& Universe::getRotation(EntityRef entity) const
 {
-	return m_transforms[entity.index].rot;
+	return m_rotations[entity.index];
 }
 
 
 void Universe::transformEntity(EntityRef entity, bool update_local)
 {
+	if (m_deferred_transforms) {
+		ASSERT(update_local);
+		deferTransform(entity);
+		return;
+	}
+
 	const int hierarchy_idx = m_entities[entity.index].hierarchy;
 	entityTransformed().invoke(entity);
+	markTransformChanged(entity);
 	if (hierarchy_idx >= 0) {
 		Hierarchy& h = m_hierarchy[hierarchy_idx];
 		const Transform my_transform = getTransform(entity);
@@ -103,9 +127,7 @@ void Universe::transformEntity(EntityRef entity, bool update_local)
 		while (child.isValid())
 		{
 			const Hierarchy& child_h = m_hierarchy[m_entities[child.index].hierarchy];
-			const Transform abs_tr = my_transform * child_h.local_transform;
-			Transform& child_data = m_transforms[child.index];
-			child_data = abs_tr;
+			storeTransform(child.index, my_transform * child_h.local_transform);
 			transformEntity((EntityRef)child, false);
 
 			child = child_h.next_sibling;
@@ -114,16 +136,344 @@ void Universe::transformEntity(EntityRef entity, bool update_local)
 }
 
 
+// appends the root and all its descendants, parents are always before their children
+void Universe::collectSubtree(EntityRef root, Array<EntityRef>& out) const
+{
+	const int begin = out.size();
+	out.push(root);
+	for (int i = begin; i < out.size(); ++i) {
+		const int hierarchy_idx = m_entities[out[i].index].hierarchy;
+		if (hierarchy_idx < 0) continue;
+
+		EntityPtr child = m_hierarchy[hierarchy_idx].first_child;
+		while (child.isValid()) {
+			out.push((EntityRef)child);
+			child = m_hierarchy[m_entities[child.index].hierarchy].next_sibling;
+		}
+	}
+}
+
+
+// subtree comes from collectSubtree, the root's transform is already up to date
+// children of a parent are composed with it in batches, parents are final before we get to their children
+void Universe::propagateTransforms(const EntityRef* subtree, u32 count)
+{
+	enum { BATCH_SIZE = 64 };
+	Transform locals[BATCH_SIZE];
+	Transform globals[BATCH_SIZE];
+	EntityRef children[BATCH_SIZE];
+
+	for (u32 i = 0; i < count; ++i) {
+		const int hierarchy_idx = m_entities[subtree[i].index].hierarchy;
+		if (hierarchy_idx < 0) continue;
+
+		EntityPtr child = m_hierarchy[hierarchy_idx].first_child;
+		if (!child.isValid()) continue;
+
+		const Transform parent = getTransform(subtree[i]);
+		while (child.isValid()) {
+			u32 batch_count = 0;
+			while (child.isValid() && batch_count < BATCH_SIZE) {
+				const Hierarchy& h = m_hierarchy[m_entities[child.index].hierarchy];
+				children[batch_count] = (EntityRef)child;
+				locals[batch_count] = h.local_transform;
+				++batch_count;
+				child = h.next_sibling;
+			}
+
+			composeTransforms(parent, Span<const Transform>(locals, batch_count), globals);
+			for (u32 j = 0; j < batch_count; ++j) {
+				storeTransform(children[j].index, globals[j]);
+			}
+		}
+	}
+}
+
+
+void Universe::storeTransform(int index, const Transform& transform)
+{
+	m_positions[index] = transform.pos;
+	m_rotations[index] = transform.rot;
+	m_scales[index] = transform.scale;
+}
+
+
+void Universe::getPositions(Span<const EntityRef> entities, DVec3* out) const
+{
+	const DVec3* LUMIX_RESTRICT positions = m_positions.begin();
+	for (u32 i = 0, c = entities.length(); i < c; ++i) {
+		out[i] = positions[entities[i].index];
+	}
+}
+
+
+// the same math as Quat::rotate and Transform::transform(Vec3), four points at once
+void Universe::transformPoints(EntityRef entity, Span<const Vec3> points, DVec3* out) const
+{
+	const Quat& rot = m_rotations[entity.index];
+	const DVec3& pos = m_positions[entity.index];
+	const float scale = m_scales[entity.index];
+	const u32 count = points.length();
+	const Vec3* LUMIX_RESTRICT src = points.begin();
+
+	const float4 qx = f4Splat(rot.x);
+	const float4 qy = f4Splat(rot.y);
+	const float4 qz = f4Splat(rot.z);
+	const float4 w2 = f4Splat(2 * rot.w);
+	const float4 two = f4Splat(2);
+	const float4 s = f4Splat(scale);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		alignas(16) float tmp[3][4];
+		for (u32 j = 0; j < 4; ++j) {
+			tmp[0][j] = src[i + j].x;
+			tmp[1][j] = src[i + j].y;
+			tmp[2][j] = src[i + j].z;
+		}
+		const float4 vx = f4Load(tmp[0]);
+		const float4 vy = f4Load(tmp[1]);
+		const float4 vz = f4Load(tmp[2]);
+
+		// uv = q x v, uuv = q x uv
+		const float4 uvx = f4Sub(f4Mul(qy, vz), f4Mul(qz, vy));
+		const float4 uvy = f4Sub(f4Mul(qz, vx), f4Mul(qx, vz));
+		const float4 uvz = f4Sub(f4Mul(qx, vy), f4Mul(qy, vx));
+		const float4 uuvx = f4Sub(f4Mul(qy, uvz), f4Mul(qz, uvy));
+		const float4 uuvy = f4Sub(f4Mul(qz, uvx), f4Mul(qx, uvz));
+		const float4 uuvz = f4Sub(f4Mul(qx, uvy), f4Mul(qy, uvx));
+
+		const float4 rx = f4Add(f4Add(vx, f4Mul(uvx, w2)), f4Mul(uuvx, two));
+		const float4 ry = f4Add(f4Add(vy, f4Mul(uvy, w2)), f4Mul(uuvy, two));
+		const float4 rz = f4Add(f4Add(vz, f4Mul(uvz, w2)), f4Mul(uuvz, two));
+		f4Store(tmp[0], f4Mul(rx, s));
+		f4Store(tmp[1], f4Mul(ry, s));
+		f4Store(tmp[2], f4Mul(rz, s));
+		for (u32 j = 0; j < 4; ++j) {
+			out[i + j] = pos + Vec3(tmp[0][j], tmp[1][j], tmp[2][j]);
+		}
+	}
+	for (; i < count; ++i) {
+		out[i] = pos + rot.rotate(src[i]) * scale;
+	}
+}
+
+
+// the same math as Transform::operator*, rotations four at once in floats, positions two at once in doubles
+void Universe::composeTransforms(const Transform& parent, Span<const Transform> locals, Transform* out)
+{
+	const u32 count = locals.length();
+	const Transform* LUMIX_RESTRICT src = locals.begin();
+
+	const float4 px = f4Splat(parent.rot.x);
+	const float4 py = f4Splat(parent.rot.y);
+	const float4 pz = f4Splat(parent.rot.z);
+	const float4 pw = f4Splat(parent.rot.w);
+	const float4 ps = f4Splat(parent.scale);
+
+	const double2 dqx = d2Splat(parent.rot.x);
+	const double2 dqy = d2Splat(parent.rot.y);
+	const double2 dqz = d2Splat(parent.rot.z);
+	const double2 dw2 = d2Splat(2.0 * parent.rot.w);
+	const double2 dtwo = d2Splat(2.0);
+	const double2 dscale = d2Splat(parent.scale);
+	const double2 ppx = d2Splat(parent.pos.x);
+	const double2 ppy = d2Splat(parent.pos.y);
+	const double2 ppz = d2Splat(parent.pos.z);
+
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		float4 rx = f4LoadUnaligned(&src[i + 0].rot);
+		float4 ry = f4LoadUnaligned(&src[i + 1].rot);
+		float4 rz = f4LoadUnaligned(&src[i + 2].rot);
+		float4 rw = f4LoadUnaligned(&src[i + 3].rot);
+		f4Transpose(rx, ry, rz, rw);
+
+		alignas(16) float tmp[5][4];
+		f4Store(tmp[0], f4Sub(f4Add(f4Add(f4Mul(pw, rx), f4Mul(rw, px)), f4Mul(py, rz)), f4Mul(ry, pz)));
+		f4Store(tmp[1], f4Sub(f4Add(f4Add(f4Mul(pw, ry), f4Mul(rw, py)), f4Mul(pz, rx)), f4Mul(rz, px)));
+		f4Store(tmp[2], f4Sub(f4Add(f4Add(f4Mul(pw, rz), f4Mul(rw, pz)), f4Mul(px, ry)), f4Mul(rx, py)));
+		f4Store(tmp[3], f4Sub(f4Sub(f4Sub(f4Mul(pw, rw), f4Mul(px, rx)), f4Mul(py, ry)), f4Mul(pz, rz)));
+		for (u32 j = 0; j < 4; ++j) tmp[4][j] = src[i + j].scale;
+		f4Store(tmp[4], f4Mul(ps, f4Load(tmp[4])));
+
+		for (u32 j = 0; j < 4; j += 2) {
+			const Transform& a = src[i + j];
+			const Transform& b = src[i + j + 1];
+			const double2 vx = d2Mul(d2Set(a.pos.x, b.pos.x), dscale);
+			const double2 vy = d2Mul(d2Set(a.pos.y, b.pos.y), dscale);
+			const double2 vz = d2Mul(d2Set(a.pos.z, b.pos.z), dscale);
+
+			const double2 uvx = d2Sub(d2Mul(dqy, vz), d2Mul(dqz, vy));
+			const double2 uvy = d2Sub(d2Mul(dqz, vx), d2Mul(dqx, vz));
+			const double2 uvz = d2Sub(d2Mul(dqx, vy), d2Mul(dqy, vx));
+			const double2 uuvx = d2Sub(d2Mul(dqy, uvz), d2Mul(dqz, uvy));
+			const double2 uuvy = d2Sub(d2Mul(dqz, uvx), d2Mul(dqx, uvz));
+			const double2 uuvz = d2Sub(d2Mul(dqx, uvy), d2Mul(dqy, uvx));
+
+			Transform& out_a = out[i + j];
+			Transform& out_b = out[i + j + 1];
+			d2Store(&out_a.pos.x, &out_b.pos.x, d2Add(d2Add(d2Add(vx, d2Mul(uvx, dw2)), d2Mul(uuvx, dtwo)), ppx));
+			d2Store(&out_a.pos.y, &out_b.pos.y, d2Add(d2Add(d2Add(vy, d2Mul(uvy, dw2)), d2Mul(uuvy, dtwo)), ppy));
+			d2Store(&out_a.pos.z, &out_b.pos.z, d2Add(d2Add(d2Add(vz, d2Mul(uvz, dw2)), d2Mul(uuvz, dtwo)), ppz));
+		}
+
+		for (u32 j = 0; j < 4; ++j) {
+			out[i + j].rot = Quat(tmp[0][j], tmp[1][j], tmp[2][j], tmp[3][j]);
+			out[i + j].scale = tmp[4][j];
+		}
+	}
+	for (; i < count; ++i) {
+		out[i] = parent * src[i];
+	}
+}
+
+
+void Universe::markTransformChanged(EntityRef entity)
+{
+	EntityData& data = m_entities[entity.index];
+	data.transform_dirty = false;
+	if (data.transform_changed) return;
+
+	data.transform_changed = true;
+	m_changed_transforms.push(entity);
+}
+
+
+// makes the global transform of the entity up to date, by propagating its topmost dirty ancestor or itself
+void Universe::flushTransform(EntityRef entity)
+{
+	if (!m_deferred_transforms) return;
+
+	EntityPtr root = INVALID_ENTITY;
+	for (EntityPtr e = entity; e.isValid(); e = getParent((EntityRef)e)) {
+		if (m_entities[e.index].transform_dirty) root = e;
+	}
+	if (!root.isValid()) return;
+
+	Array<EntityRef> subtree(m_allocator);
+	collectSubtree((EntityRef)root, subtree);
+	propagateTransforms(subtree.begin(), subtree.size());
+	for (EntityRef e : subtree) {
+		markTransformChanged(e);
+	}
+}
+
+
+void Universe::deferTransform(EntityRef entity)
+{
+	const int hierarchy_idx = m_entities[entity.index].hierarchy;
+	if (hierarchy_idx >= 0) {
+		Hierarchy& h = m_hierarchy[hierarchy_idx];
+		if (h.parent.isValid()) {
+			// parent can be stale, flushing it would overwrite our new transform
+			const Transform my_transform = getTransform(entity);
+			flushTransform((EntityRef)h.parent);
+			storeTransform(entity.index, my_transform);
+			h.local_transform = getTransform((EntityRef)h.parent).inverted() * my_transform;
+		}
+	}
+
+	EntityData& data = m_entities[entity.index];
+	if (!data.transform_dirty) {
+		data.transform_dirty = true;
+		m_dirty_transforms.push(entity);
+	}
+}
+
+
+void Universe::setDeferredTransforms(bool enable)
+{
+	if (!enable && m_deferred_transforms) updateTransforms();
+	m_deferred_transforms = enable;
+}
+
+
+void Universe::updateTransforms()
+{
+	PROFILE_FUNCTION();
+	if (!m_dirty_transforms.empty()) propagateDirtyTransforms();
+	publishTransformChanges();
+}
+
+
+void Universe::propagateDirtyTransforms()
+{
+	// roots are dirty entities without dirty ancestors, so their subtrees do not overlap
+	m_transform_queue.clear();
+	m_transform_roots.clear();
+	for (EntityRef entity : m_dirty_transforms) {
+		const EntityData& data = m_entities[entity.index];
+		if (!data.valid || !data.transform_dirty) continue;
+
+		bool is_root = true;
+		for (EntityPtr e = getParent(entity); e.isValid() && is_root; e = getParent((EntityRef)e)) {
+			is_root = !m_entities[e.index].transform_dirty;
+		}
+		if (!is_root) continue;
+
+		m_transform_roots.push(m_transform_queue.size());
+		collectSubtree(entity, m_transform_queue);
+	}
+	m_dirty_transforms.clear();
+
+	const u32 roots_count = m_transform_roots.size();
+	auto propagate = [&](const JobSystem::Range& range){
+		for (u32 i = range.begin; i < range.end; ++i) {
+			const u32 begin = m_transform_roots[i];
+			const u32 end = i + 1 < roots_count ? m_transform_roots[i + 1] : m_transform_queue.size();
+			propagateTransforms(&m_transform_queue[begin], end - begin);
+		}
+	};
+	if ((u32)m_transform_queue.size() < MIN_PARALLEL_TRANSFORMS) {
+		propagate(JobSystem::Range{0, roots_count});
+	}
+	else {
+		PROFILE_BLOCK("propagate");
+		JobSystem::parallelFor(0, roots_count, TRANSFORM_ROOTS_GRAIN, propagate);
+	}
+
+	for (EntityRef entity : m_transform_queue) {
+		markTransformChanged(entity);
+	}
+}
+
+
+void Universe::publishTransformChanges()
+{
+	// listeners can move entities, those are notified in the next update
+	m_notified_transforms.clear();
+	m_notified_transforms.swap(m_changed_transforms);
+	int count = 0;
+	for (EntityRef entity : m_notified_transforms) {
+		EntityData& data = m_entities[entity.index];
+		data.transform_changed = false;
+		if (data.valid) {
+			m_notified_transforms[count] = entity;
+			++count;
+		}
+	}
+	m_notified_transforms.resize(count);
+	if (count == 0) return;
+
+	if (m_deferred_transforms) {
+		for (EntityRef entity : m_notified_transforms) {
+			m_entity_moved.invoke(entity);
+		}
+	}
+	m_entities_moved.invoke(Span<const EntityRef>(m_notified_transforms.begin(), count));
+}
+
+
 void Universe::setRotation(EntityRef entity, const Quat& rot)
 {
-	m_transforms[entity.index].rot = rot;
+	m_rotations[entity.index] = rot;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setRotation(EntityRef entity, float x, float y, float z, float w)
 {
-	m_transforms[entity.index].rot.set(x, y, z, w);
+	m_rotations[entity.index].set(x, y, z, w);
 	transformEntity(entity, true);
 }
 
@@ -136,11 +486,13 @@ bool Universe::hasEntity(EntityRef entity) const
 
 void Universe::setTransformKeepChildren(EntityRef entity, const Transform& transform)
 {
-	Transform& tmp = m_transforms[entity.index];
-	tmp = transform;
+	// parent's and children's global transforms must be up to date before we compute the local transforms
+	flushTransform(entity);
+	storeTransform(entity.index, transform);
 	
 	int hierarchy_idx = m_entities[entity.index].hierarchy;
-	entityTransformed().invoke(entity);
+	if (!m_deferred_transforms) entityTransformed().invoke(entity);
+	markTransformChanged(entity);
 	if (hierarchy_idx >= 0)
 	{
 		Hierarchy& h = m_hierarchy[hierarchy_idx];
@@ -165,43 +517,39 @@ void Universe::setTransformKeepChildren(EntityRef entity, const Transform& trans
 
 void Universe::setTransform(EntityRef entity, const Transform& transform)
 {
-	Transform& tmp = m_transforms[entity.index];
-	tmp = transform;
+	storeTransform(entity.index, transform);
 	transformEntity(entity, true);
 }
 
 
 void Universe::setTransform(EntityRef entity, const RigidTransform& transform)
 {
-	auto& tmp = m_transforms[entity.index];
-	tmp.pos = transform.pos;
-	tmp.rot = transform.rot;
+	m_positions[entity.index] = transform.pos;
+	m_rotations[entity.index] = transform.rot;
 	transformEntity(entity, true);
 }
 
 
 void Universe::setTransform(EntityRef entity, const DVec3& pos, const Quat& rot, float scale)
 {
-	auto& tmp = m_transforms[entity.index];
-	tmp.pos = pos;
-	tmp.rot = rot;
-	tmp.scale = scale;
+	m_positions[entity.index] = pos;
+	m_rotations[entity.index] = rot;
+	m_scales[entity.index] = scale;
 	transformEntity(entity, true);
 }
 
 
-const Transform& Universe::getTransform(EntityRef entity) const
+Transform Universe::getTransform(EntityRef entity) const
 {
-	return m_transforms[entity.index];
+	return {m_positions[entity.index], m_rotations[entity.index], m_scales[entity.index]};
 }
 
 
 Matrix Universe::getRelativeMatrix(EntityRef entity, const DVec3& base_pos) const
 {
-	const Transform& transform = m_transforms[entity.index];
-	Matrix mtx = transform.rot.toMatrix();
-	mtx.setTranslation((transform.pos - base_pos).toFloat());
-	mtx.multiply3x3(transform.scale);
+	Matrix mtx = m_rotations[entity.index].toMatrix();
+	mtx.setTranslation((m_positions[entity.index] - base_pos).toFloat());
+	mtx.multiply3x3(m_scales[entity.index]);
 	return mtx;
 }
 
@@ -214,7 +562,7 @@ void Universe::setPosition(EntityRef entity, double x, double y, double z)
 
 void Universe::setPosition(EntityRef entity, const DVec3& pos)
 {
-	m_transforms[entity.index].pos = pos;
+	m_positions[entity.index] = pos;
 	transformEntity(entity, true);
 }
 
@@ -281,13 +629,16 @@ void Universe::emplaceEntity(EntityRef entity)
 	while (m_entities.size() <= entity.index)
 	{
 		EntityData& data = m_entities.emplace();
-		Transform& tr = m_transforms.emplace();
+		m_positions.emplace(0, 0, 0);
+		m_rotations.emplace(0, 0, 0, 1);
+		m_scales.push(-1);
 		data.valid = false;
 		data.prev = -1;
 		data.name = -1;
 		data.hierarchy = -1;
+		data.transform_dirty = false;
+		data.transform_changed = false;
 		data.next = m_first_free_slot;
-		tr.scale = -1;
 		if (m_first_free_slot >= 0)
 		{
 			m_entities[m_first_free_slot].prev = m_entities.size() - 1;
@@ -307,10 +658,7 @@ void Universe::emplaceEntity(EntityRef entity)
 		m_entities[m_entities[entity.index].next].prev= m_entities[entity.index].prev;
 	}
 	EntityData& data = m_entities[entity.index];
-	Transform& tr = m_transforms[entity.index];
-	tr.pos = DVec3(0, 0, 0);
-	tr.rot.set(0, 0, 0, 1);
-	tr.scale = 1;
+	storeTransform(entity.index, {DVec3(0, 0, 0), Quat::IDENTITY, 1});
 	data.name = -1;
 	data.hierarchy = -1;
 	data.components = 0;
@@ -355,11 +703,9 @@ EntityRef Universe::createEntity(const DVec3& position, const Quat& rotation)
 {
 	EntityData* data;
 	EntityRef entity;
-	Transform* tr;
 	if (m_first_free_slot >= 0)
 	{
 		data = &m_entities[m_first_free_slot];
-		tr = &m_transforms[m_first_free_slot];
 		entity.index = m_first_free_slot;
 		if (data->next >= 0) m_entities[data->next].prev = -1;
 		m_first_free_slot = data->next;
@@ -368,11 +714,14 @@ EntityRef Universe::createEntity(const DVec3& position, const Quat& rotation)
 	{
 		entity.index = m_entities.size();
 		data = &m_entities.emplace();
-		tr = &m_transforms.emplace();
+		m_positions.emplace();
+		m_rotations.emplace();
+		m_scales.emplace();
+		// reused slots keep their flags, they can still be in the pending transform arrays
+		data->transform_dirty = false;
+		data->transform_changed = false;
 	}
-	tr->pos = position;
-	tr->rot = rotation;
-	tr->scale = 1;
+	storeTransform(entity.index, {position, rotation, 1});
 	data->name = -1;
 	data->hierarchy = -1;
 	data->components = 0;
@@ -495,6 +844,9 @@ void Universe::setParent(EntityPtr new_parent, EntityRef child)
 		return;
 	}
 
+	flushTransform(child);
+	if (new_parent.isValid()) flushTransform((EntityRef)new_parent);
+
 	auto collectGarbage = [this](EntityRef entity) {
 		Hierarchy& h = m_hierarchy[m_entities[entity.index].hierarchy];
 		if (h.parent.isValid()) return;
@@ -575,6 +927,18 @@ void Universe::updateGlobalTransform(EntityRef entity)
 {
 	const Hierarchy& h = m_hierarchy[m_entities[entity.index].hierarchy];
 	ASSERT(h.parent.isValid());
+	if (m_deferred_transforms) {
+		// local transform is the source of truth here, children are propagated in updateTransforms
+		flushTransform((EntityRef)h.parent);
+		storeTransform(entity.index, getTransform((EntityRef)h.parent) * h.local_transform);
+		EntityData& data = m_entities[entity.index];
+		if (!data.transform_dirty) {
+			data.transform_dirty = true;
+			m_dirty_transforms.push(entity);
+		}
+		return;
+	}
+
 	Transform parent_tr = getTransform((EntityRef)h.parent);
 	
 	Transform new_tr = parent_tr * h.local_transform;
@@ -674,10 +1038,19 @@ void Universe::deserializeComponent(IDeserializer& serializer, EntityRef entity,
 
 void Universe::serialize(IOutputStream& serializer)
 {
+	for (EntityRef entity : m_dirty_transforms) {
+		if (m_entities[entity.index].valid) flushTransform(entity);
+	}
 	serializer.write((i32)m_entities.size());
 	if (!m_entities.empty()) {
 		serializer.write(&m_entities[0], m_entities.byte_size());
-		serializer.write(&m_transforms[0], m_transforms.byte_size());
+		// the format stores whole transforms
+		Array<Transform> transforms(m_allocator);
+		transforms.resize(m_entities.size());
+		for (int i = 0, c = m_entities.size(); i < c; ++i) {
+			transforms[i] = getTransform({i});
+		}
+		serializer.write(&transforms[0], transforms.byte_size());
 	}
 	serializer.write((i32)m_names.size());
 	for (const EntityName& name : m_names) {
@@ -696,12 +1069,25 @@ void Universe::deserialize(IInputStream& serializer)
 	i32 count;
 	serializer.read(count);
 	m_entities.resize(count);
-	m_transforms.resize(count);
+	m_positions.resize(count);
+	m_rotations.resize(count);
+	m_scales.resize(count);
 
 	if (count > 0) {
 		serializer.read(&m_entities[0], m_entities.byte_size());
-		serializer.read(&m_transforms[0], m_transforms.byte_size());
+		Array<Transform> transforms(m_allocator);
+		transforms.resize(count);
+		serializer.read(&transforms[0], transforms.byte_size());
+		for (int i = 0; i < count; ++i) {
+			storeTransform(i, transforms[i]);
+		}
+	}
+	for (EntityData& data : m_entities) {
+		data.transform_dirty = false;
+		data.transform_changed = false;
 	}
+	m_dirty_transforms.clear();
+	m_changed_transforms.clear();
 
 	serializer.read(count);
 	for (int i = 0; i < count; ++i)
@@ -745,7 +1131,7 @@ EntityPtr Universe::instantiatePrefab(const PrefabResource& prefab,
 	float scale)
 {
 	InputMemoryStream blob(prefab.data.begin(), prefab.data.byte_size());
-	Array<EntityRef> entities(m_allocator);
+	Array<EntityRef> entities(m_frame_allocator);
 	PrefabEntityGUIDMap entity_map(entities);
 	TextDeserializer deserializer(blob, entity_map);
 	u32 version;
@@ -802,14 +1188,14 @@ EntityPtr Universe::instantiatePrefab(const PrefabResource& prefab,
 
 void Universe::setScale(EntityRef entity, float scale)
 {
-	m_transforms[entity.index].scale = scale;
+	m_scales[entity.index] = scale;
 	transformEntity(entity, true);
 }
 
 
 float Universe::getScale(EntityRef entity) const
 {
-	return m_transforms[entity.index].scale;
+	return m_scales[entity.index];
 }
 
 
@@ -59,14 +59,21 @@ public:
 			};
 		};
 		bool valid;
+		// deferred mode, descendants' transforms are not propagated yet
+		bool transform_dirty;
+		// in the list of moved entities waiting for updateTransforms
+		bool transform_changed;
 	};
 
 public:
-	explicit Universe(IAllocator& allocator);
+	Universe(IAllocator& allocator, IAllocator& frame_allocator);
 	~Universe();
 
 	IAllocator& getAllocator() { return m_allocator; }
-	const Transform* getTransforms() const { return m_transforms.begin(); }
+	// transforms are stored as separate arrays indexed by entity, so loops touching only some parts stay dense
+	const DVec3* getPositions() const { return m_positions.begin(); }
+	const Quat* getRotations() const { return m_rotations.begin(); }
+	const float* getScales() const { return m_scales.begin(); }
 	void emplaceEntity(EntityRef entity);
 	EntityRef createEntity(const DVec3& position, const Quat& rotation);
 	EntityRef cloneEntity(EntityRef entity);
@@ -115,12 +122,19 @@ public:
 	void setTransform(EntityRef entity, const Transform& transform);
 	void setTransformKeepChildren(EntityRef entity, const Transform& transform);
 	void setTransform(EntityRef entity, const DVec3& pos, const Quat& rot, float scale);
-	const Transform& getTransform(EntityRef entity) const;
+	Transform getTransform(EntityRef entity) const;
 	void setRotation(EntityRef entity, float x, float y, float z, float w);
 	void setRotation(EntityRef entity, const Quat& rot);
 	void setPosition(EntityRef entity, double x, double y, double z);
 	void setPosition(EntityRef entity, const DVec3& pos);
 	void setScale(EntityRef entity, float scale);
+	// in deferred mode, transforms of descendants are propagated and listeners notified only in updateTransforms
+	// global transforms of descendants of moved entities are stale until then
+	void setDeferredTransforms(bool enable);
+	bool areTransformsDeferred() const { return m_deferred_transforms; }
+	// propagates moved entities' transforms to their descendants and passes all entities moved since the last call
+	// to entitiesTransformed, called at the end of a frame and before rendering
+	void updateTransforms();
 	EntityPtr instantiatePrefab(const PrefabResource& prefab,
 		const DVec3& pos,
 		const Quat& rot,
@@ -128,6 +142,12 @@ public:
 	float getScale(EntityRef entity) const;
 	const DVec3& getPosition(EntityRef entity) const;
 	const Quat& getRotation(EntityRef entity) const;
+	// out must have room for entities.length() items
+	void getPositions(Span<const EntityRef> entities, DVec3* out) const;
+	// out[i] is points[i] transformed from the entity's space to world space
+	void transformPoints(EntityRef entity, Span<const Vec3> points, DVec3* out) const;
+	// out[i] = parent * locals[i]
+	static void composeTransforms(const Transform& parent, Span<const Transform> locals, Transform* out);
 	const char* getName() const { return m_name; }
 	void setName(const char* name) 
 	{ 
@@ -135,6 +155,8 @@ public:
 	}
 
 	DelegateList<void(EntityRef)>& entityTransformed() { return m_entity_moved; }
+	// all entities transformed since the last updateTransforms at once, each entity is there only once
+	DelegateList<void(Span<const EntityRef>)>& entitiesTransformed() { return m_entities_moved; }
 	DelegateList<void(EntityRef)>& entityCreated() { return m_entity_created; }
 	DelegateList<void(EntityRef)>& entityDestroyed() { return m_entity_destroyed; }
 	DelegateList<void(const ComponentUID&)>& componentDestroyed() { return m_component_destroyed; }
@@ -153,6 +175,14 @@ public:
 
 private:
 	void transformEntity(EntityRef entity, bool update_local);
+	void deferTransform(EntityRef entity);
+	void flushTransform(EntityRef entity);
+	void collectSubtree(EntityRef root, Array<EntityRef>& out) const;
+	void propagateTransforms(const EntityRef* subtree, u32 count);
+	void markTransformChanged(EntityRef entity);
+	void storeTransform(int index, const Transform& transform);
+	void propagateDirtyTransforms();
+	void publishTransformChanges();
 	void updateGlobalTransform(EntityRef entity);
 
 	struct Hierarchy
@@ -173,19 +203,30 @@ private:
 
 private:
 	IAllocator& m_allocator;
+	IAllocator& m_frame_allocator;
 	ComponentTypeEntry m_component_type_map[ComponentType::MAX_TYPES_COUNT];
 	Array<IScene*> m_scenes;
-	Array<Transform> m_transforms;
+	Array<DVec3> m_positions;
+	Array<Quat> m_rotations;
+	Array<float> m_scales;
 	Array<EntityData> m_entities;
 	Array<Hierarchy> m_hierarchy;
 	Array<EntityName> m_names;
 	DelegateList<void(EntityRef)> m_entity_moved;
+	DelegateList<void(Span<const EntityRef>)> m_entities_moved;
 	DelegateList<void(EntityRef)> m_entity_created;
 	DelegateList<void(EntityRef)> m_entity_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_destroyed;
 	DelegateList<void(const ComponentUID&)> m_component_added;
 	int m_first_free_slot;
 	StaticString<64> m_name;
+	bool m_deferred_transforms = false;
+	Array<EntityRef> m_dirty_transforms;
+	Array<EntityRef> m_changed_transforms;
+	Array<EntityRef> m_notified_transforms;
+	// subtrees of dirty roots in breadth-first order
+	Array<EntityRef> m_transform_queue;
+	Array<u32> m_transform_roots;
 };
 
 
@@ -676,6 +676,32 @@ void* memReserve(size_t size) {
 	return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_READWRITE);
 }
 
+// large pages need SeLockMemoryPrivilege, which the user must have been granted
+static bool enableLockMemoryPrivilege() {
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return false;
+
+	TOKEN_PRIVILEGES tp = {};
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool res = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+		&& AdjustTokenPrivileges(token, FALSE, &tp, 0, nullptr, nullptr)
+		&& GetLastError() == ERROR_SUCCESS;
+	CloseHandle(token);
+	return res;
+}
+
+u32 getMemLargePageSize() {
+	static const u32 size = enableLockMemoryPrivilege() ? (u32)GetLargePageMinimum() : 0;
+	return size;
+}
+
+void* memReserveLargePages(size_t size) {
+	const u32 large_page_size = getMemLargePageSize();
+	if (large_page_size == 0 || size % large_page_size != 0) return nullptr;
+	return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+}
+
 void memCommit(void* ptr, size_t size) {
 	VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE);
 }
@@ -997,6 +1023,38 @@ u64 getLastModified(const char* path)
 }
 
 
+const void* mapFile(const char* path, Ref<u64> size)
+{
+	const WCharStr<MAX_PATH_LENGTH> wpath(path);
+	HANDLE file = CreateFile(wpath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	// the view keeps the mapping and the file alive, so both handles can be closed right away
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (!mapping) return nullptr;
+
+	const void* mem = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!mem) return nullptr;
+
+	size = file_size.QuadPart;
+	return mem;
+}
+
+
+void unmapFile(const void* mem, u64 size)
+{
+	UnmapViewOfFile(mem);
+}
+
+
 bool makePath(const char* path)
 {
 	char tmp[MAX_PATH];
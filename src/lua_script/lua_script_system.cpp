@@ -18,6 +18,7 @@
 #include "engine/serializer.h"
 #include "engine/stream.h"
 #include "engine/string.h"
+#include "engine/tag_allocator.h"
 #include "engine/universe/universe.h"
 #include "gui/gui_scene.h"
 #include "lua_script/lua_script.h"
@@ -71,6 +72,7 @@ namespace Lumix
 		LuaScriptManager& getScriptManager() { return m_script_manager; }
 
 		Engine& m_engine;
+		TagAllocator m_tag_allocator;
 		Debug::Allocator m_allocator;
 		LuaScriptManager m_script_manager;
 	};
@@ -1923,7 +1925,8 @@ namespace Lumix
 
 	LuaScriptSystemImpl::LuaScriptSystemImpl(Engine& engine)
 		: m_engine(engine)
-		, m_allocator(engine.getAllocator())
+		, m_tag_allocator(engine.getAllocator(), "Lua")
+		, m_allocator(m_tag_allocator)
 		, m_script_manager(m_allocator)
 	{
 		m_script_manager.create(LuaScript::TYPE, engine.getResourceManager());
@@ -135,19 +135,24 @@ struct NavigationSceneImpl final : public NavigationScene
 		if (!iter.isValid()) return;
 		if (m_moving_agent == entity) return;
 		if (iter.value().agent < 0) return;
-		const Agent& agent = iter.value();
-		RecastZone& zone = m_zones[(EntityRef)agent.zone];
+		Agent& agent = iter.value();
+		teleportIfMoved(agent, m_zones[(EntityRef)agent.zone]);
+	}
 
-		const DVec3 pos = m_universe.getPosition(iter.key());
+
+	// agents moved by the crowd itself end up at npos, so only foreign moves pass this
+	void teleportIfMoved(Agent& agent, RecastZone& zone)
+	{
+		const Transform zone_tr = m_universe.getTransform(zone.entity);
+		const Vec3 pos = zone_tr.inverted().transform(m_universe.getPosition(agent.entity)).toFloat();
 		const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
 		if ((pos - *(Vec3*)dt_agent->npos).squaredLength() > 0.1f) {
-			const Transform old_zone_tr = m_universe.getTransform(zone.entity);
-			const DVec3 target_pos = old_zone_tr.transform(*(Vec3*)dt_agent->targetPos);
+			const DVec3 target_pos = zone_tr.transform(*(Vec3*)dt_agent->targetPos);
 			float speed = dt_agent->params.maxSpeed;
 			zone.crowd->removeAgent(agent.agent);
-			addCrowdAgent(iter.value(), zone);
+			addCrowdAgent(agent, zone);
 			if (!agent.is_finished) {
-				navigate({entity.index}, target_pos, speed, agent.stop_distance);
+				navigate({agent.entity.index}, target_pos, speed, agent.stop_distance);
 			}
 		}
 	}
@@ -385,11 +390,16 @@ struct NavigationSceneImpl final : public NavigationScene
 
 		static const u32 ANIMATION_HASH = crc32("animation");
 		auto* anim_scene = (AnimationScene*)m_universe.getScene(ANIMATION_HASH);
+		const bool is_deferred = m_universe.areTransformsDeferred();
 
 		for (Agent& agent : m_agents) {
 			if (agent.agent < 0) continue;
 			if (agent.zone != zone.entity) continue;
 
+			// with deferred transforms, onEntityMoved is called only after the crowd already overwrote the foreign move
+			if (is_deferred && (agent.flags & Agent::USE_ROOT_MOTION) == 0) teleportIfMoved(agent, zone);
+			if (agent.agent < 0) continue;
+
 			const dtCrowdAgent* dt_agent = zone.crowd->getAgent(agent.agent);
 			//if (dt_agent->paused) continue;
 
@@ -1589,6 +1599,16 @@ struct NavigationSceneImpl final : public NavigationScene
 	}
 
 	IPlugin& getPlugin() const override { return m_system; }
+
+	void getUpdateDependencies(UpdateDependencies& deps) const override
+	{
+		deps.exclusive = false;
+		deps.writes_transforms = true;
+		// root motion
+		deps.reads[0] = "animation";
+		// onUpdate and path finished callbacks
+		deps.writes[0] = "lua_script";
+	}
 	Universe& getUniverse() override { return m_universe; }
 
 	IAllocator& m_allocator;
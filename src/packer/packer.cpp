@@ -0,0 +1,144 @@
+#include "engine/allocator.h"
+#include "engine/array.h"
+#include "engine/os.h"
+#include "engine/pack.h"
+#include "engine/stream.h"
+#include "engine/string.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+using namespace Lumix;
+
+
+struct Packer
+{
+	Packer(IAllocator& allocator, u32 block_size)
+		: allocator(allocator)
+		, writer(allocator, block_size)
+		, content(allocator)
+	{}
+
+	bool addFile(const char* root, const char* path)
+	{
+		const StaticString<MAX_PATH_LENGTH> full_path(root, "/", path);
+		OS::InputFile file;
+		if (!file.open(full_path)) {
+			fprintf(stderr, "Could not open %s\n", full_path.data);
+			return false;
+		}
+		content.resize((int)file.size());
+		const bool read = file.read(content.begin(), content.byte_size());
+		file.close();
+		if (!read) {
+			fprintf(stderr, "Could not read %s\n", full_path.data);
+			return false;
+		}
+		if (!writer.add(path, content.begin(), content.byte_size())) {
+			fprintf(stderr, "Could not add %s, another file has the same path hash\n", path);
+			return false;
+		}
+		return true;
+	}
+
+	// path is relative to root, empty for root itself
+	bool addDir(const char* root, const char* path)
+	{
+		const StaticString<MAX_PATH_LENGTH> full_path(root, "/", path);
+		OS::FileIterator* iter = OS::createFileIterator(full_path, allocator);
+		OS::FileInfo info;
+		bool success = true;
+		while (success && OS::getNextFile(iter, &info)) {
+			if (equalStrings(info.filename, ".") || equalStrings(info.filename, "..")) continue;
+
+			StaticString<MAX_PATH_LENGTH> child;
+			if (path[0]) child << path << "/";
+			child << info.filename;
+			success = info.is_directory ? addDir(root, child) : addFile(root, child);
+		}
+		OS::destroyFileIterator(iter);
+		return success;
+	}
+
+	IAllocator& allocator;
+	PackWriter writer;
+	Array<u8> content;
+};
+
+
+// the written pack is opened and all its blocks are checked
+static bool verify(IAllocator& allocator, const char* path)
+{
+	OS::InputFile file;
+	if (!file.open(path)) return false;
+
+	Array<u8> data(allocator);
+	data.resize((int)file.size());
+	const bool read = file.read(data.begin(), data.byte_size());
+	file.close();
+	if (!read) return false;
+
+	PackFile pack(allocator);
+	return pack.open(data.begin(), data.byte_size()) && pack.verify();
+}
+
+
+// packs all files in source_dir, the output can be embedded in the executable as the bundle
+// packer [-block_size N] [-no_verify] source_dir output_file
+int main(int argc, char* argv[])
+{
+	const char* source_dir = nullptr;
+	const char* output_path = nullptr;
+	u32 block_size = PackHeader::DEFAULT_BLOCK_SIZE;
+	bool verify_output = true;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-block_size") == 0 && i + 1 < argc) {
+			++i;
+			block_size = (u32)atoi(argv[i]);
+		}
+		else if (strcmp(argv[i], "-no_verify") == 0) {
+			verify_output = false;
+		}
+		else if (!source_dir) {
+			source_dir = argv[i];
+		}
+		else {
+			output_path = argv[i];
+		}
+	}
+	if (!source_dir || !output_path || block_size == 0) {
+		fprintf(stderr, "Usage: packer [-block_size N] [-no_verify] source_dir output_file\n");
+		return -1;
+	}
+
+	DefaultAllocator allocator;
+	Packer packer(allocator, block_size);
+	if (!packer.addDir(source_dir, "")) return -1;
+
+	OS::OutputFile file;
+	if (!file.open(output_path)) {
+		fprintf(stderr, "Could not create %s\n", output_path);
+		return -1;
+	}
+	const bool written = packer.writer.write(file);
+	file.close();
+	if (!written || file.isError()) {
+		fprintf(stderr, "Could not write %s\n", output_path);
+		return -1;
+	}
+
+	if (verify_output && !verify(allocator, output_path)) {
+		fprintf(stderr, "%s is corrupted\n", output_path);
+		return -1;
+	}
+
+	const u64 uncompressed_size = packer.writer.getUncompressedSize();
+	const u64 data_size = packer.writer.getDataSize();
+	printf("%u files, %llu bytes packed to %llu bytes (%.1f%%)\n"
+		, packer.writer.getEntriesCount()
+		, (unsigned long long)uncompressed_size
+		, (unsigned long long)data_size
+		, uncompressed_size > 0 ? 100.0 * data_size / uncompressed_size : 100.0);
+	return 0;
+}
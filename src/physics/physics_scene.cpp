@@ -179,6 +179,11 @@ static PxTransform toPhysx(const RigidTransform& v)
 {
 	return {toPhysx(v.pos.toFloat()), toPhysx(v.rot)};
 }
+// poses read back from the universe can differ in the last bits, e.g. after propagation from a parent
+static bool isSamePose(const PxTransform& a, const PxTransform& b)
+{
+	return (a.p - b.p).magnitudeSquared() < 1e-8f && PxAbs(a.q.dot(b.q)) > 1 - 1e-6f;
+}
 
 
 struct Joint
@@ -330,6 +335,13 @@ struct PhysicsSceneImpl final : public PhysicsScene
 		void rescale();
 		void setResource(PhysicsGeometry* resource);
 		void setPhysxActor(PxRigidActor* actor);
+		// anything but the simulation changed the velocity or replaced the actor
+		void invalidateSimulatedVelocity()
+		{
+			#ifdef LUMIX_DEBUG
+				is_simulated_velocity_valid = false;
+			#endif
+		}
 
 		EntityRef entity;
 		float scale;
@@ -339,6 +351,11 @@ struct PhysicsSceneImpl final : public PhysicsScene
 		PhysicsSceneImpl& scene;
 		DynamicType dynamic_type;
 		bool is_trigger;
+		#ifdef LUMIX_DEBUG
+			// velocity after the last simulation, invalid once something else moves the actor
+			PxVec3 simulated_velocity;
+			bool is_simulated_velocity_valid = false;
+		#endif
 
 	private:
 		void onStateChanged(Resource::State old_state, Resource::State new_state, Resource&);
@@ -587,6 +604,13 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	IPlugin& getPlugin() const override { return *m_system; }
 
 
+	void getUpdateDependencies(UpdateDependencies& deps) const override
+	{
+		// fetchResults blocks until the PhysX tasks queued on workers finish, so it must not occupy a worker itself
+		deps.exclusive = true;
+	}
+
+
 	int getControllerLayer(EntityRef entity) override { return m_controllers[entity].m_layer; }
 
 
@@ -1555,6 +1579,10 @@ struct PhysicsSceneImpl final : public PhysicsScene
 			m_update_in_progress = actor;
 			PxTransform trans = actor->physx_actor->getGlobalPose();
 			m_universe.setTransform(actor->entity, fromPhysx(trans));
+			#ifdef LUMIX_DEBUG
+				actor->simulated_velocity = ((PxRigidBody*)actor->physx_actor)->getLinearVelocity();
+				actor->is_simulated_velocity_valid = true;
+			#endif
 		}
 		m_update_in_progress = nullptr;
 
@@ -2183,6 +2211,9 @@ struct PhysicsSceneImpl final : public PhysicsScene
 		if (!m_is_game_running || paused) return;
 
 		time_delta = minimum(1 / 20.0f, time_delta);
+		#ifdef LUMIX_DEBUG
+			checkSimulatedVelocities();
+		#endif
 		updateVehicles(time_delta);
 		simulateScene(time_delta);
 		fetchResults();
@@ -2194,6 +2225,21 @@ struct PhysicsSceneImpl final : public PhysicsScene
 	}
 
 
+	#ifdef LUMIX_DEBUG
+		// a frame after the simulation, e.g. after deferred transforms are published, actors nobody else moved
+		// must still have their simulated velocity, i.e. our own moves must not come back to physx
+		void checkSimulatedVelocities()
+		{
+			for (RigidActor* actor : m_dynamic_actors) {
+				if (!actor->physx_actor || !actor->is_simulated_velocity_valid) continue;
+				const PxVec3 velocity = ((PxRigidBody*)actor->physx_actor)->getLinearVelocity();
+				ASSERT(velocity == actor->simulated_velocity);
+				actor->is_simulated_velocity_valid = false;
+			}
+		}
+	#endif
+
+
 	DelegateList<void(const ContactData&)>& onContact() override { return m_contact_callbacks; }
 
 
@@ -2595,6 +2641,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 		PxRigidBody* rigid_body = actor->physx_actor->is<PxRigidBody>();
 		if (!rigid_body) return;
 
+		actor->invalidateSimulatedVelocity();
 		PxRigidBodyExt::addForceAtPos(*rigid_body, toPhysx(force), toPhysx(pos));
 	}
 
@@ -2751,17 +2798,23 @@ struct PhysicsSceneImpl final : public PhysicsScene
 			if (iter.isValid())
 			{
 				RigidActor* actor = iter.value();
-				if (actor->physx_actor && m_update_in_progress != actor)
+				Transform trans = m_universe.getTransform(entity);
+				const PxTransform pose = toPhysx(trans.getRigidPart());
+				// in deferred mode we are notified about our own moves from updateDynamicActors only after the update,
+				// pushing them back would teleport the actor and break its contacts
+				const bool is_own_move = m_update_in_progress == actor
+					|| (actor->physx_actor && actor->scale == trans.scale && isSamePose(pose, actor->physx_actor->getGlobalPose()));
+				if (actor->physx_actor && !is_own_move)
 				{
-					Transform trans = m_universe.getTransform(entity);
+					actor->invalidateSimulatedVelocity();
 					if (actor->dynamic_type == DynamicType::KINEMATIC)
 					{
 						auto* rigid_dynamic = (PxRigidDynamic*)actor->physx_actor;
-						rigid_dynamic->setKinematicTarget(toPhysx(trans.getRigidPart()));
+						rigid_dynamic->setKinematicTarget(pose);
 					}
 					else
 					{
-						actor->physx_actor->setGlobalPose(toPhysx(trans.getRigidPart()), false);
+						actor->physx_actor->setGlobalPose(pose, false);
 					}
 					if (actor->resource && actor->scale != trans.scale)
 					{
@@ -4891,6 +4944,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 		auto* physx_actor = static_cast<PxRigidDynamic*>(actor->physx_actor);
 		if (!physx_actor) return;
+		actor->invalidateSimulatedVelocity();
 		physx_actor->putToSleep();
 	}
 
@@ -4909,6 +4963,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 		auto* physx_actor = static_cast<PxRigidDynamic*>(actor->physx_actor);
 		if (!physx_actor) return;
+		actor->invalidateSimulatedVelocity();
 		physx_actor->addForce(toPhysx(force));
 	}
 
@@ -4927,6 +4982,7 @@ struct PhysicsSceneImpl final : public PhysicsScene
 
 		auto* physx_actor = static_cast<PxRigidDynamic*>(actor->physx_actor);
 		if (!physx_actor) return;
+		actor->invalidateSimulatedVelocity();
 		physx_actor->addForce(toPhysx(impulse), PxForceMode::eIMPULSE);
 	}
 
@@ -5128,6 +5184,7 @@ void PhysicsSceneImpl::RigidActor::rescale()
 
 void PhysicsSceneImpl::RigidActor::setPhysxActor(PxRigidActor* actor)
 {
+	invalidateSimulatedVelocity();
 	if (physx_actor)
 	{
 		scene.m_scene->removeActor(*physx_actor);
@@ -7,6 +7,7 @@
 #include "engine/engine.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
+#include "engine/tag_allocator.h"
 #include "engine/universe/universe.h"
 #include "physics/physics_geometry.h"
 #include "physics/physics_scene.h"
@@ -209,9 +210,9 @@ namespace Lumix
 	struct PhysicsSystemImpl final : public PhysicsSystem
 	{
 		explicit PhysicsSystemImpl(Engine& engine)
-			: m_allocator(engine.getAllocator())
+			: m_allocator(engine.getAllocator(), "Physics")
 			, m_engine(engine)
-			, m_manager(*this, engine.getAllocator())
+			, m_manager(*this, m_allocator)
 		{
 			registerProperties(engine.getAllocator());
 			m_manager.create(PhysicsGeometry::TYPE, engine.getResourceManager());
@@ -281,6 +282,7 @@ namespace Lumix
 			return false;
 		}
 
+		TagAllocator m_allocator;
 		physx::PxPhysics* m_physics;
 		physx::PxFoundation* m_foundation;
 		physx::PxControllerManager* m_controller_manager;
@@ -289,7 +291,6 @@ namespace Lumix
 		physx::PxCooking* m_cooking;
 		PhysicsGeometryManager m_manager;
 		Engine& m_engine;
-		IAllocator& m_allocator;
 	};
 
 
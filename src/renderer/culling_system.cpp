@@ -93,7 +93,7 @@ struct CullingSystemImpl final : public CullingSystem
 			return &cell.spheres[count];
 		}
 
-		void* mem = m_page_allocator.allocate(true);
+		void* mem = m_page_allocator.allocate();
 		CellPage* new_cell = new (Lumix::NewPlaceholder(), mem) CellPage;
 		new_cell->header.origin = cell.header.origin;
 		new_cell->header.indices = cell.header.indices;
@@ -128,7 +128,7 @@ struct CullingSystemImpl final : public CullingSystem
 
 		auto iter = m_cell_map.find(i);
 		if (!iter.isValid()) {
-			void* mem = m_page_allocator.allocate(true);
+			void* mem = m_page_allocator.allocate();
 			CellPage* new_cell = new (Lumix::NewPlaceholder(), mem) CellPage;
 			new_cell->header.origin = i.pos * double(m_cell_size);
 			new_cell->header.indices = i;
@@ -161,7 +161,7 @@ struct CullingSystemImpl final : public CullingSystem
 			if (cell.header.next) cell.header.next->header.prev = cell.header.prev;
 			m_cells.swapAndPopItem(&cell);
 			cell.~CellPage();
-			m_page_allocator.deallocate(&cell, true);
+			m_page_allocator.deallocate(&cell);
 		}
 		else {
 			const int idx = int(sphere - cell.spheres);
@@ -203,6 +203,35 @@ struct CullingSystemImpl final : public CullingSystem
 	}
 
 
+	void setPositions(Span<const EntityRef> entities, const DVec3* positions) override
+	{
+		PROFILE_FUNCTION();
+		const u32 count = entities.length();
+		const u32 entity_to_cell_size = m_entity_to_cell.size();
+		for (u32 i = 0; i < count; ++i) {
+			const EntityRef entity = entities[i];
+			if (entity.index >= entity_to_cell_size) continue;
+
+			Sphere* sphere = m_entity_to_cell[entity.index];
+			if (!sphere) continue;
+
+			const DVec3& pos = positions[i];
+			CellPage& cell = getCell(*sphere);
+			const IVec3 new_indices(pos * (1 / m_cell_size));
+			if (new_indices == cell.header.indices.pos) {
+				sphere->position = (pos - cell.header.origin).toFloat();
+				continue;
+			}
+
+			// moving between cells can swap spheres around, so m_entity_to_cell is read again for the next entity
+			const float radius = sphere->radius;
+			const u8 type = cell.header.indices.type;
+			remove(entity);
+			add(entity, type, pos, radius);
+		}
+	}
+
+
 	float getRadius(EntityRef entity) override
 	{
 		return m_entity_to_cell[entity.index]->radius;
@@ -237,7 +266,7 @@ struct CullingSystemImpl final : public CullingSystem
 				CellPage* tmp = iter;
 				iter = tmp->header.next;
 				tmp->~CellPage();
-				m_page_allocator.deallocate(tmp, true);
+				m_page_allocator.deallocate(tmp);
 			}
 		}
 	   
@@ -302,6 +331,51 @@ struct CullingSystemImpl final : public CullingSystem
 	}
 
 
+	// all 8 frustum planes are tested at once
+	LUMIX_AVX2_TARGET void doCullingAVX2(const CellPage& cell
+		, const Frustum& frustum
+		, CullResult* LUMIX_RESTRICT results
+		, PagedList<CullResult>& list)
+	{
+		PROFILE_FUNCTION();
+		const Sphere* LUMIX_RESTRICT start = cell.spheres;
+		const Sphere* LUMIX_RESTRICT end = cell.spheres + cell.header.count;
+		const EntityPtr* LUMIX_RESTRICT sphere_to_entity_map = cell.entities;
+
+		Profiler::pushInt("objects", cell.header.count);
+		const float8 px = f8LoadUnaligned(frustum.xs);
+		const float8 py = f8LoadUnaligned(frustum.ys);
+		const float8 pz = f8LoadUnaligned(frustum.zs);
+		const float8 pd = f8LoadUnaligned(frustum.ds);
+		int cursor = results->header.count;
+	
+		int i = 0;
+		for (const Sphere *sphere = start; sphere < end; ++sphere, ++i) {
+			const float8 cx = f8Splat(sphere->position.x);
+			const float8 cy = f8Splat(sphere->position.y);
+			const float8 cz = f8Splat(sphere->position.z);
+			const float8 r = f8Splat(-sphere->radius);
+
+			float8 t = f8Mul(cx, px);
+			t = f8Add(t, f8Mul(cy, py));
+			t = f8Add(t, f8Mul(cz, pz));
+			t = f8Add(t, pd);
+			t = f8Sub(t, r);
+			if (f8MoveMask(t)) continue;
+
+			if(cursor == lengthOf(results->entities)) {
+				results->header.count = cursor;
+				results = list.push();
+				cursor = 0;
+			}
+
+			results->entities[cursor] = (EntityRef)sphere_to_entity_map[i];
+			++cursor;
+		}
+		results->header.count = cursor;
+	}
+
+
 	CullResult* cull(const ShiftedFrustum& frustum, u8 type) override
 	{
 		PROFILE_FUNCTION();
@@ -312,6 +386,7 @@ struct CullingSystemImpl final : public CullingSystem
 		JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
 		volatile i32 cell_idx = 0;
 		PagedList<CullResult> list(m_page_allocator);
+		const bool use_avx2 = f8IsSupported();
 
 		JobSystem::runOnWorkers([&](){
 			PROFILE_BLOCK("cull_job");
@@ -342,10 +417,16 @@ struct CullingSystemImpl final : public CullingSystem
 					}
 				}
 				else if (frustum.intersectsAABB(cell.header.origin - v3_cell_size, v3_2_cell_size)) {
-					doCulling(cell, frustum.getRelative(cell.header.origin), result, list);
+					const Frustum rel_frustum = frustum.getRelative(cell.header.origin);
+					if (use_avx2) {
+						doCullingAVX2(cell, rel_frustum, result, list);
+					}
+					else {
+						doCulling(cell, rel_frustum, result, list);
+					}
 				}
 			}
-		});
+		}, JobSystem::Priority::HIGH);
 
 		return list.detach();
 	}
@@ -373,7 +454,7 @@ void CullResult::free(PageAllocator& allocator)
 	while(i) {
 		CullResult* tmp = i;
 		i = i->header.next;
-		allocator.deallocate(tmp, true);
+		allocator.deallocate(tmp);
 	}
 }
 
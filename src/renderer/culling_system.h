@@ -54,6 +54,8 @@ namespace Lumix
 		virtual void remove(EntityRef entity) = 0;
 
 		virtual void setPosition(EntityRef entity, const DVec3& pos) = 0;
+		// positions[i] belongs to entities[i], entities which are not added are skipped
+		virtual void setPositions(Span<const EntityRef> entities, const DVec3* positions) = 0;
 		virtual void setRadius(EntityRef entity, float radius) = 0;
 
 		virtual float getRadius(EntityRef entity) = 0;
@@ -1282,7 +1282,7 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			job->m_out_path = fs.getBasePath();
 			job->m_out_path << out_path;
 			JobSystem::SignalHandle signal = JobSystem::INVALID_HANDLE;
-			JobSystem::runEx(job, &TextureTileJob::execute, &signal, m_tile_signal, JobSystem::getWorkersCount() - 1);
+			JobSystem::runEx(job, &TextureTileJob::execute, &signal, m_tile_signal, JobSystem::ANY_WORKER, JobSystem::Priority::BACKGROUND);
 			m_tile_signal = signal;
 			return true;
 		}
@@ -1861,9 +1861,9 @@ struct EnvironmentProbePlugin final : public PropertyGrid::IPlugin
 		m_probe_guid = scene->getEnvironmentProbeGUID(entity);
 		m_reload_probe = entity;
 
-		JobSystem::run(this, [](void* ptr) {
+		JobSystem::runEx(this, [](void* ptr) {
 			((EnvironmentProbePlugin*)ptr)->processData();
-		}, &m_signal);
+		}, &m_signal, JobSystem::INVALID_HANDLE, JobSystem::ANY_WORKER, JobSystem::Priority::BACKGROUND);
 	}
 
 
@@ -580,7 +580,7 @@ static float4* getStream(const ParticleEmitter& emitter
 }
 
 
-void ParticleEmitter::update(float dt)
+void ParticleEmitter::update(float dt, IAllocator& frame_allocator)
 {
 	if (!m_resource || !m_resource->isReady()) return;
 
@@ -600,8 +600,7 @@ void ParticleEmitter::update(float dt)
 	m_constants[0].value = dt;
 	const OutputMemoryStream& bytecode = m_resource->getBytecode();
 	InputMemoryStream blob(bytecode.getData(), bytecode.getPos());
-	// TODO
-	Array<float4> reg_mem(m_allocator);
+	Array<float4> reg_mem(frame_allocator);
 	reg_mem.resize(m_resource->getRegistersCount() * ((m_particles_count + 3) >> 2));
 	m_instances_count = m_particles_count;
 
@@ -752,7 +751,7 @@ int ParticleEmitter::getInstanceDataSizeBytes() const
 }
 
 
-void ParticleEmitter::fillInstanceData(const DVec3& cam_pos, float* data)
+void ParticleEmitter::fillInstanceData(const DVec3& cam_pos, float* data, IAllocator& frame_allocator)
 {
 	PROFILE_FUNCTION();
 	const OutputMemoryStream& bytecode = m_resource->getBytecode();
@@ -762,8 +761,7 @@ void ParticleEmitter::fillInstanceData(const DVec3& cam_pos, float* data)
 	m_constants[1].value = (float)cam_pos.x;
 	m_constants[2].value = (float)cam_pos.y;
 	m_constants[3].value = (float)cam_pos.z;
-	// TODO
-	Array<float4> reg_mem(m_allocator);
+	Array<float4> reg_mem(frame_allocator);
 	reg_mem.resize(m_resource->getRegistersCount() * ((m_particles_count + 3) >> 2));
 
 	auto sim = [&](u32 offset, u32 count){
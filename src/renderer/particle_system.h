@@ -60,9 +60,9 @@ public:
 
 	void serialize(IOutputStream& blob);
 	void deserialize(IInputStream& blob, ResourceManagerHub& manager);
-	void update(float dt);
+	void update(float dt, IAllocator& frame_allocator);
 	void emit(const float* args);
-	void fillInstanceData(const DVec3& cam_pos, float* data);
+	void fillInstanceData(const DVec3& cam_pos, float* data, IAllocator& frame_allocator);
 	int getInstanceDataSizeBytes() const;
 	ParticleEmitterResource* getResource() const { return m_resource; }
 	void setResource(ParticleEmitterResource* res);
@@ -3,6 +3,7 @@
 #include "engine/crc32.h"
 #include "engine/engine.h"
 #include "engine/file_system.h"
+#include "engine/frame_allocator.h"
 #include "engine/geometry.h"
 #include "engine/job_system.h"
 #include "engine/log.h"
@@ -15,6 +16,7 @@
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/resource_manager.h"
+#include "engine/sparse_set.h"
 #include "engine/universe/universe.h"
 #include "culling_system.h"
 #include "font.h"
@@ -1133,7 +1135,7 @@ struct PipelineImpl final : Pipeline
 					str.write(size);
 					str.write(emitter->getInstancesCount());
 					float* instance_data = (float*)str.skip(size);
-					emitter->fillInstanceData(m_camera_params.pos, instance_data);
+					emitter->fillInstanceData(m_camera_params.pos, instance_data, m_pipeline->m_renderer.getEngine().getFrameAllocator());
 				}
 				m_size = (u32)str.getPos();
 			}
@@ -1512,7 +1514,7 @@ struct PipelineImpl final : Pipeline
 		}
 
 		for(int i = 0; i < cmd->m_bucket_count; ++i) {
-			CmdPage* page = new (NewPlaceholder(), page_allocator.allocate(true)) CmdPage;
+			CmdPage* page = new (NewPlaceholder(), page_allocator.allocate()) CmdPage;
 			cmd->m_command_sets[i] = page;
 			LuaWrapper::push(L, page);
 		}
@@ -1963,7 +1965,7 @@ struct PipelineImpl final : Pipeline
 						}
 					}
 					CmdPage* next = page->header.next;
-					m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(page, true);
+					m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(page);
 					page = next;
 				}
 				#undef READ
@@ -2197,7 +2199,7 @@ struct PipelineImpl final : Pipeline
 						}
 					}
 					CmdPage* next = page->header.next;
-					m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(page, true);
+					m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(page);
 					page = next;
 				}
 				#undef READ
@@ -2474,8 +2476,9 @@ struct PipelineImpl final : Pipeline
 				RADIXSORT_BIT_MASK = RADIXSORT_HISTOGRAM_SIZE - 1
 			};
 
-			Array<u64> tmp_keys(m_allocator); // TODO more suitable allocator
-			Array<u64> tmp_values(m_allocator);
+			IAllocator& frame_allocator = m_pipeline->m_renderer.getEngine().getFrameAllocator();
+			Array<u64> tmp_keys(frame_allocator);
+			Array<u64> tmp_values(frame_allocator);
 			tmp_keys.resize(size);
 			tmp_values.resize(size);
 
@@ -2563,14 +2566,14 @@ struct PipelineImpl final : Pipeline
 				
 				const u64* LUMIX_RESTRICT renderables = ctx->renderables;
 				const u64* LUMIX_RESTRICT sort_keys = ctx->sort_keys;
-				CmdPage* cmd_page = new (NewPlaceholder(), ctx->cmd->m_page_allocator.allocate(true)) CmdPage;
+				CmdPage* cmd_page = new (NewPlaceholder(), ctx->cmd->m_page_allocator.allocate()) CmdPage;
 				ctx->first_page = ctx->last_page = cmd_page;
 				cmd_page->header.bucket = sort_keys[0] >> 56;
 				u8* out = cmd_page->data;
 
 				auto new_page = [&](u8 bucket){
 					cmd_page->header.size = int(out - cmd_page->data);
-					CmdPage* new_page = new (NewPlaceholder(), ctx->cmd->m_page_allocator.allocate(true)) CmdPage;
+					CmdPage* new_page = new (NewPlaceholder(), ctx->cmd->m_page_allocator.allocate()) CmdPage;
 					cmd_page->header.next = new_page;
 					cmd_page = new_page;
 					new_page->header.bucket = bucket;
@@ -2580,8 +2583,10 @@ struct PipelineImpl final : Pipeline
 
 				RenderScene* scene = ctx->cmd->m_pipeline->m_scene;
 				const ShiftedFrustum frustum = ctx->cmd->m_camera_params.frustum;
-				const ModelInstance* LUMIX_RESTRICT model_instances = scene->getModelInstances();
-				const Transform* LUMIX_RESTRICT entity_data = universe.getTransforms(); 
+				const SparseSet<ModelInstance>& model_instances = scene->getModelInstances();
+				const DVec3* LUMIX_RESTRICT entity_positions = universe.getPositions();
+				const Quat* LUMIX_RESTRICT entity_rotations = universe.getRotations();
+				const float* LUMIX_RESTRICT entity_scales = universe.getScales();
 				const DVec3 camera_pos = ctx->camera_pos;
 				for (int i = 0, c = ctx->count; i < c; ++i) {
 					const EntityRef e = {int(renderables[i] & 0xFFffFFff)};
@@ -2595,7 +2600,7 @@ struct PipelineImpl final : Pipeline
 						case RenderableTypes::MESH_GROUP:
 						case RenderableTypes::MESH: {
 							const u32 mesh_idx = renderables[i] >> 40;
-							const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e.index];
+							const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e];
 							int start_i = i;
 							const bool sort_depth = ctx->cmd->m_bucket_map[bucket] > 0xff;
 							const u64 instance_key_mask = sort_depth ? 0xff00'0000'00ff'ffff : 0xffff'ffff'0000'0000;
@@ -2609,14 +2614,13 @@ struct PipelineImpl final : Pipeline
 							if (instance_data) {
 								for (int j = start_i; j < start_i + count; ++j) {
 									const EntityRef e = { int(renderables[j] & 0xFFffFFff) };
-									const Transform& tr = entity_data[e.index];
-									const Vec3 lpos = (tr.pos - camera_pos).toFloat();
-									memcpy(instance_data, &tr.rot, sizeof(tr.rot));
-									instance_data += sizeof(tr.rot);
+									const Vec3 lpos = (entity_positions[e.index] - camera_pos).toFloat();
+									memcpy(instance_data, &entity_rotations[e.index], sizeof(Quat));
+									instance_data += sizeof(Quat);
 									memcpy(instance_data, &lpos, sizeof(lpos));
 									instance_data += sizeof(lpos);
-									memcpy(instance_data, &tr.scale, sizeof(tr.scale));
-									instance_data += sizeof(tr.scale);
+									memcpy(instance_data, &entity_scales[e.index], sizeof(float));
+									instance_data += sizeof(float);
 								}
 								if ((cmd_page->data + sizeof(cmd_page->data) - out) < 30) {
 									new_page(bucket);
@@ -2635,9 +2639,8 @@ struct PipelineImpl final : Pipeline
 						}
 						case RenderableTypes::SKINNED: {
 							const u32 mesh_idx = renderables[i] >> 40;
-							const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e.index];
-							const Transform& tr = entity_data[e.index];
-							const Vec3 rel_pos = (tr.pos - camera_pos).toFloat();
+							const ModelInstance* LUMIX_RESTRICT mi = &model_instances[e];
+							const Vec3 rel_pos = (entity_positions[e.index] - camera_pos).toFloat();
 
 							if (u32(cmd_page->data + sizeof(cmd_page->data) - out) < (u32)mi->pose->count * sizeof(Matrix) + 53) {
 								new_page(bucket);
@@ -2647,8 +2650,8 @@ struct PipelineImpl final : Pipeline
 							WRITE(mi->meshes[mesh_idx].render_data);
 							WRITE_FN(mi->meshes[mesh_idx].material->getRenderData());
 							WRITE(rel_pos);
-							WRITE(tr.rot);
-							WRITE(tr.scale);
+							WRITE(entity_rotations[e.index]);
+							WRITE(entity_scales[e.index]);
 							WRITE(mi->pose->count);
 
 							const Quat* rotations = mi->pose->rotations;
@@ -2687,12 +2690,11 @@ struct PipelineImpl final : Pipeline
 								u8* mem = slice.ptr;
 								for(int j = start_i; j < i; ++j) {
 									const EntityRef e = {int(renderables[j] & 0x00ffFFff)};
-									const Transform& tr = entity_data[e.index];
-									const Vec3 lpos = (tr.pos - camera_pos).toFloat();
+									const Vec3 lpos = (entity_positions[e.index] - camera_pos).toFloat();
 									memcpy(mem, &lpos, sizeof(lpos));
 									mem += sizeof(lpos);
-									memcpy(mem, &tr.rot, sizeof(tr.rot));
-									mem += sizeof(tr.rot);
+									memcpy(mem, &entity_rotations[e.index], sizeof(Quat));
+									mem += sizeof(Quat);
 									const Vec3 half_extents = scene->getDecalHalfExtents(e);
 									memcpy(mem, &half_extents, sizeof(half_extents));
 									mem += sizeof(half_extents);
@@ -2727,18 +2729,18 @@ struct PipelineImpl final : Pipeline
 
 								for (int j = start_i; j < i; ++j) {
 									const EntityRef e = {int(renderables[j] & 0x00ffFFff)};
-									const Transform& tr = entity_data[e.index];
-									const Vec3 lpos = (tr.pos - camera_pos).toFloat();
+									const Quat& rot = entity_rotations[e.index];
+									const Vec3 lpos = (entity_positions[e.index] - camera_pos).toFloat();
 									const PointLight& pl = scene->getPointLight(e);
-									const bool intersecting = frustum.intersectNearPlane(tr.pos, pl.range * SQRT3);
+									const bool intersecting = frustum.intersectNearPlane(entity_positions[e.index], pl.range * SQRT3);
 							
 									LightData* iter = intersecting ? end : beg;
 									iter->pos = lpos;
-									iter->rot = tr.rot;
+									iter->rot = rot;
 									iter->range = pl.range;
 									iter->attenuation = pl.attenuation_param;
 									iter->color = pl.color * pl.intensity;
-									iter->dir = tr.rot * Vec3(0, 0, 1);
+									iter->dir = rot * Vec3(0, 0, 1);
 									iter->fov = pl.fov;
 									intersecting ? --end : ++beg;
 								}
@@ -2765,8 +2767,7 @@ struct PipelineImpl final : Pipeline
 							// TODO 0 const in following:
 							const Terrain::GrassPatch& p = t->m_grass_quads[0][quad_idx]->m_patches[patch_idx];
 							const Mesh& mesh = p.m_type->m_grass_model->getMesh(0);
-							const Transform& tr = entity_data[e.index];
-							const Vec3 lpos = (tr.pos - camera_pos).toFloat();
+							const Vec3 lpos = (entity_positions[e.index] - camera_pos).toFloat();
 							if (p.instance_data.empty()) break;
 							const Renderer::TransientSlice slice = renderer.allocTransient(p.instance_data.byte_size());
 							
@@ -2775,7 +2776,7 @@ struct PipelineImpl final : Pipeline
 									new_page(bucket);
 								}
 								WRITE(type);
-								WRITE(tr.rot);
+								WRITE(entity_rotations[e.index]);
 								WRITE(lpos);
 								WRITE(mesh.render_data);
 								WRITE_FN(mesh.material->getRenderData());
@@ -2823,10 +2824,10 @@ struct PipelineImpl final : Pipeline
 				int total = 0;
 				const auto* bucket_map = m_bucket_map;
 				RenderScene* scene = m_pipeline->m_scene;
-				const ModelInstance* LUMIX_RESTRICT model_instances = scene->getModelInstances();
+				const SparseSet<ModelInstance>& model_instances = scene->getModelInstances();
 				const MeshSortData* LUMIX_RESTRICT mesh_data = scene->getMeshSortData();
 				MTBucketArray<u64>::Bucket result = sort_keys.begin();
-				const Transform* LUMIX_RESTRICT entity_data = scene->getUniverse().getTransforms();
+				const DVec3* LUMIX_RESTRICT entity_positions = scene->getUniverse().getPositions();
 				const DVec3 camera_pos = m_camera_params.pos;
 				const u64 type_mask = (u64)type << 32;
 				
@@ -2889,14 +2890,14 @@ struct PipelineImpl final : Pipeline
 						case RenderableTypes::MESH: {
 							for (int i = 0, c = page->header.count; i < c; ++i) {
 								const EntityRef e = renderables[i];
-								const MeshSortData& mesh = mesh_data[e.index];
+								const MeshSortData& mesh = mesh_data[model_instances.find(e)];
 								const u32 bucket = bucket_map[mesh.layer];
 								const u64 subrenderable = e.index | type_mask;
 								if (bucket < 0xff) {
 									const u64 key = ((u64)mesh.sort_key << 32) | ((u64)bucket << 56);
 									result.push(key, subrenderable);
 								} else if (bucket < 0xffFF) {
-									const DVec3 pos = entity_data[e.index].pos;
+									const DVec3 pos = entity_positions[e.index];
 									const DVec3 rel_pos = pos - camera_pos;
 									const float squared_length = float(rel_pos.x * rel_pos.x + rel_pos.y * rel_pos.y + rel_pos.z * rel_pos.z);
 									const u32 depth_bits = floatFlip(*(u32*)&squared_length);
@@ -2910,8 +2911,8 @@ struct PipelineImpl final : Pipeline
 						case RenderableTypes::MESH_GROUP: {
 							for (int i = 0, c = page->header.count; i < c; ++i) {
 								const EntityRef e = renderables[i];
-								const DVec3 pos = entity_data[e.index].pos;
-								const ModelInstance& mi = model_instances[e.index];
+								const DVec3 pos = entity_positions[e.index];
+								const ModelInstance& mi = model_instances[e];
 								const float squared_length = float((pos - camera_pos).squaredLength());
 								const LODMeshIndices lod = mi.model->getLODMeshIndices(squared_length);
 								for (int mesh_idx = lod.from; mesh_idx <= lod.to; ++mesh_idx) {
@@ -2924,7 +2925,7 @@ struct PipelineImpl final : Pipeline
 										const u64 key = ((u64)mi.meshes[mesh_idx].sort_key << 32) | ((u64)bucket << 56);
 										result.push(key, subrenderable);
 									} else if (bucket < 0xffFF) {
-										const DVec3 pos = entity_data[e.index].pos;
+										const DVec3 pos = entity_positions[e.index];
 										const DVec3 rel_pos = pos - camera_pos;
 										const float squared_length = float(rel_pos.x * rel_pos.x + rel_pos.y * rel_pos.y + rel_pos.z * rel_pos.z);
 										const u32 depth_bits = floatFlip(*(u32*)&squared_length);
@@ -2996,7 +2997,7 @@ struct PipelineImpl final : Pipeline
 				ctx.count = count;
 				ctx.cmd = this;
 				ctx.camera_pos = m_camera_params.pos;
-				JobSystem::run(&ctx, &CreateCommands::execute, &counter);
+				JobSystem::runEx(&ctx, &CreateCommands::execute, &counter, JobSystem::INVALID_HANDLE, JobSystem::ANY_WORKER, JobSystem::Priority::HIGH);
 				offset += count;
 			}
 			JobSystem::wait(counter);
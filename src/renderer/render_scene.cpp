@@ -5,6 +5,7 @@
 #include "engine/crc32.h"
 #include "engine/engine.h"
 #include "engine/file_system.h"
+#include "engine/frame_allocator.h"
 #include "engine/geometry.h"
 #include "engine/job_system.h"
 #include "engine/log.h"
@@ -17,6 +18,7 @@
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/serializer.h"
+#include "engine/sparse_set.h"
 #include "engine/stream.h"
 #include "engine/universe/universe.h"
 #include "lua_script/lua_script_system.h"
@@ -161,6 +163,7 @@ public:
 	~RenderSceneImpl()
 	{
 		m_universe.entityTransformed().unbind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
+		m_universe.entitiesTransformed().unbind<RenderSceneImpl, &RenderSceneImpl::onEntitiesMoved>(this);
 		m_universe.entityDestroyed().unbind<RenderSceneImpl, &RenderSceneImpl::onEntityDestroyed>(this);
 		CullingSystem::destroy(*m_culling_system);
 	}
@@ -241,7 +244,7 @@ public:
 
 		for (auto& i : m_model_instances)
 		{
-			if (i.entity != INVALID_ENTITY && i.model)
+			if (i.model)
 			{
 				i.model->getResourceManager().unload(*i.model);
 				LUMIX_DELETE(m_allocator, i.pose);
@@ -249,6 +252,7 @@ public:
 			}
 		}
 		m_model_instances.clear();
+		m_mesh_sort_data.clear();
 		for(auto iter = m_model_entity_map.begin(), end = m_model_entity_map.end(); iter != end; ++iter) {
 			Model* model = iter.key();
 			model->getObserverCb().unbind<RenderSceneImpl, &RenderSceneImpl::modelStateChanged>(this);
@@ -549,9 +553,9 @@ public:
 	{
 		BoneAttachment& ba = m_bone_attachments[entity];
 		ba.parent_entity = parent;
-		if (parent.isValid() && parent.index < m_model_instances.size())
+		if (parent.isValid() && m_model_instances.has((EntityRef)parent))
 		{
-			ModelInstance& mi = m_model_instances[parent.index];
+			ModelInstance& mi = m_model_instances[(EntityRef)parent];
 			mi.flags.set(ModelInstance::IS_BONE_ATTACHMENT_PARENT);
 		}
 		updateRelativeMatrix(ba);
@@ -580,7 +584,7 @@ public:
 		{
 			for (auto* emitter : m_particle_emitters)
 			{
-				emitter->update(dt);
+				emitter->update(dt, m_engine.getFrameAllocator());
 			}
 		}
 	}
@@ -588,8 +592,7 @@ public:
 
 	void serializeModelInstance(ISerializer& serialize, EntityRef entity)
 	{
-		ModelInstance& r = m_model_instances[entity.index];
-		ASSERT(r.entity != INVALID_ENTITY);
+		ModelInstance& r = m_model_instances[entity];
 
 		serialize.write("source", r.model ? r.model->getPath().c_str() : "");
 		serialize.write("flags", u8(r.flags.base));
@@ -598,16 +601,8 @@ public:
 
 	void deserializeModelInstance(IDeserializer& serializer, EntityRef entity, int scene_version)
 	{
-		while (entity.index >= m_model_instances.size())
-		{
-			auto& r = m_model_instances.emplace();
-			r.entity = INVALID_ENTITY;
-			r.pose = nullptr;
-			r.model = nullptr;
-			r.meshes = nullptr;
-			r.mesh_count = 0;
-		}
-		auto& r = m_model_instances[entity.index];
+		auto& r = m_model_instances.emplace(entity);
+		m_mesh_sort_data.emplace();
 		r.entity = entity;
 		r.model = nullptr;
 		r.pose = nullptr;
@@ -937,9 +932,9 @@ public:
 		serializer.read(Ref(bone_attachment.relative_transform));
 		m_universe.onComponentCreated(bone_attachment.entity, BONE_ATTACHMENT_TYPE, this);
 		EntityPtr parent_entity = bone_attachment.parent_entity;
-		if (parent_entity.isValid() && parent_entity.index < m_model_instances.size())
+		if (parent_entity.isValid() && m_model_instances.has((EntityRef)parent_entity))
 		{
-			ModelInstance& mi = m_model_instances[parent_entity.index];
+			ModelInstance& mi = m_model_instances[(EntityRef)parent_entity];
 			mi.flags.set(ModelInstance::IS_BONE_ATTACHMENT_PARENT);
 		}
 	}
@@ -1105,11 +1100,7 @@ public:
 		{
 			serializer.write(r.entity);
 			serializer.write(u8(r.flags.base));
-			if(r.entity != INVALID_ENTITY)
-			{
-				serializer.write(r.model ? r.model->getPath().getHash() : 0);
-			}
-			
+			serializer.write(r.model ? r.model->getPath().getHash() : 0);
 		}
 	}
 
@@ -1339,30 +1330,33 @@ public:
 		m_mesh_sort_data.reserve(size);
 		for (int i = 0; i < size; ++i)
 		{
-			auto& r = m_model_instances.emplace();
-			serializer.read(r.entity);
-			serializer.read(r.flags);
-			ASSERT(r.entity.index == i || !r.entity.isValid());
+			EntityPtr entity;
+			FlagSet<ModelInstance::Flags, u8> flags;
+			serializer.read(entity);
+			serializer.read(flags);
+			// older versions stored a slot for each entity
+			if (!entity.isValid()) continue;
+
+			const EntityRef e = (EntityRef)entity;
+			auto& r = m_model_instances.emplace(e);
+			m_mesh_sort_data.emplace();
+			r.entity = e;
+			r.flags = flags;
 			r.model = nullptr;
 			r.pose = nullptr;
 			r.meshes = nullptr;
 			r.mesh_count = 0;
 
-			if(r.entity.isValid())
-			{
-				const EntityRef e = (EntityRef)r.entity;
-
-				u32 path;
-				serializer.read(path);
-
-				if (path != 0)
-				{
-					auto* model = m_engine.getResourceManager().load<Model>(Path(path));
-					setModel(e, model);
-				}
+			u32 path;
+			serializer.read(path);
 
-				m_universe.onComponentCreated(e, MODEL_INSTANCE_TYPE, this);
+			if (path != 0)
+			{
+				auto* model = m_engine.getResourceManager().load<Model>(Path(path));
+				setModel(e, model);
 			}
+
+			m_universe.onComponentCreated(e, MODEL_INSTANCE_TYPE, this);
 		}
 	}
 
@@ -1423,9 +1417,9 @@ public:
 	{
 		const BoneAttachment& bone_attachment = m_bone_attachments[entity];
 		const EntityPtr parent_entity = bone_attachment.parent_entity;
-		if (parent_entity.isValid() && parent_entity.index < m_model_instances.size())
+		if (parent_entity.isValid() && m_model_instances.has((EntityRef)parent_entity))
 		{
-			ModelInstance& mi = m_model_instances[bone_attachment.parent_entity.index];
+			ModelInstance& mi = m_model_instances[(EntityRef)parent_entity];
 			mi.flags.unset(ModelInstance::IS_BONE_ATTACHMENT_PARENT);
 		}
 		m_bone_attachments.erase(entity);
@@ -1447,10 +1441,11 @@ public:
 	void destroyModelInstance(EntityRef entity)
 	{
 		setModel(entity, nullptr);
-		auto& model_instance = m_model_instances[entity.index];
+		auto& model_instance = m_model_instances[entity];
 		LUMIX_DELETE(m_allocator, model_instance.pose);
-		model_instance.pose = nullptr;
-		model_instance.entity = INVALID_ENTITY;
+		// mesh sort data is parallel to the dense model instances
+		m_mesh_sort_data.swapAndPop(m_model_instances.find(entity));
+		m_model_instances.erase(entity);
 		m_universe.onComponentDestroyed(entity, MODEL_INSTANCE_TYPE, this);
 	}
 
@@ -1570,7 +1565,7 @@ public:
 		auto iter = m_point_lights.begin();
 		auto end = m_point_lights.end();
 		while (iter != end && light_count < max_lights) {
-			const PointLight& light = iter.value();
+			const PointLight& light = *iter;
 			++iter;
 
 			if (!light.cast_shadows) continue;
@@ -1593,7 +1588,7 @@ public:
 		}
 
 		while(iter != end) {
-			const PointLight& light = iter.value();
+			const PointLight& light = *iter;
 			++iter;
 
 			if (!light.cast_shadows) continue;
@@ -1647,21 +1642,21 @@ public:
 	}
 
 
-	const ModelInstance* getModelInstances() const override
+	const SparseSet<ModelInstance>& getModelInstances() const override
 	{
-		return m_model_instances.empty() ? nullptr : &m_model_instances[0];
+		return m_model_instances;
 	}
 
 
 	ModelInstance* getModelInstance(EntityRef entity) override
 	{
-		return &m_model_instances[entity.index];
+		return &m_model_instances[entity];
 	}
 
 
 	Vec3 getPoseBonePosition(EntityRef model_instance, int bone_index)
 	{
-		Pose* pose = m_model_instances[model_instance.index].pose;
+		Pose* pose = m_model_instances[model_instance].pose;
 		return pose->positions[bone_index];
 	}
 
@@ -1679,6 +1674,32 @@ public:
 	}
 
 
+	// in deferred mode culling is updated in bulk in onEntitiesMoved, bone attachments must react immediately
+	// universes without deferred transforms are not necessarily flushed, so those update culling in onEntityMoved
+	void onEntitiesMoved(Span<const EntityRef> entities)
+	{
+		PROFILE_FUNCTION();
+		if (!m_universe.areTransformsDeferred()) return;
+
+		const u64 decal_mask = (u64)1 << DECAL_TYPE.index;
+		m_moved_culled.clear();
+		m_moved_positions.clear();
+		for (EntityRef entity : entities) {
+			const u64 cmp_mask = m_universe.getComponentsMask(entity);
+			if ((cmp_mask & m_culled_cmps_mask) == 0) continue;
+
+			if (cmp_mask & decal_mask) updateDecalInfo(m_decals[entity]);
+			m_moved_culled.push(entity);
+		}
+		if (m_moved_culled.empty()) return;
+
+		const Span<const EntityRef> moved(m_moved_culled.begin(), m_moved_culled.size());
+		m_moved_positions.resize(m_moved_culled.size());
+		m_universe.getPositions(moved, m_moved_positions.begin());
+		m_culling_system->setPositions(moved, m_moved_positions.begin());
+	}
+
+
 	void onEntityMoved(EntityRef entity)
 	{
 		const u64 cmp_mask = m_universe.getComponentsMask(entity);
@@ -1686,23 +1707,13 @@ public:
 			return;
 		}
 
-		if (m_culling_system->isAdded(entity)) {
-			if (m_universe.hasComponent(entity, MODEL_INSTANCE_TYPE)) {
-				const DVec3 position = m_universe.getPosition(entity);
-				m_culling_system->setPosition(entity, position);
-			}
-			else if (m_universe.hasComponent(entity, DECAL_TYPE)) {
-				auto iter = m_decals.find(entity);
-				updateDecalInfo(iter.value());
-				const DVec3 position = m_universe.getPosition(entity);
-				m_culling_system->setPosition(entity, position);
-			}
-			else if (m_universe.hasComponent(entity, POINT_LIGHT_TYPE)) {
-				const DVec3 pos = m_universe.getPosition(entity);
-				m_culling_system->setPosition(entity, pos);
-			}
+		if (!m_universe.areTransformsDeferred() && m_culling_system->isAdded(entity)) {
+			if (cmp_mask & ((u64)1 << DECAL_TYPE.index)) updateDecalInfo(m_decals[entity]);
+			m_culling_system->setPosition(entity, m_universe.getPosition(entity));
 		}
 
+		if (m_bone_attachments.size() == 0) return;
+
 		bool was_updating = m_is_updating_attachments;
 		m_is_updating_attachments = true;
 		for (auto& attachment : m_bone_attachments)
@@ -1845,8 +1856,7 @@ public:
 
 	Material* getDecalMaterial(EntityRef entity) const override
 	{
-		auto iter = m_decals.find(entity);
-		return iter.value().material;
+		return m_decals[entity].material;
 	}
 
 	Path getDecalMaterialPath(EntityRef entity) override
@@ -1888,12 +1898,12 @@ public:
 	float getTerrainYScale(EntityRef entity) override { return m_terrains[entity]->getYScale(); }
 
 
-	Pose* lockPose(EntityRef entity) override { return m_model_instances[entity.index].pose; }
+	Pose* lockPose(EntityRef entity) override { return m_model_instances[entity].pose; }
 	void unlockPose(EntityRef entity, bool changed) override
 	{
 		if (!changed) return;
-		if (entity.index < m_model_instances.size()
-			&& (m_model_instances[entity.index].flags.isSet(ModelInstance::IS_BONE_ATTACHMENT_PARENT)) == 0)
+		if (m_model_instances.has(entity)
+			&& (m_model_instances[entity].flags.isSet(ModelInstance::IS_BONE_ATTACHMENT_PARENT)) == 0)
 		{
 			return;
 		}
@@ -1909,19 +1919,19 @@ public:
 	}
 
 
-	Model* getModelInstanceModel(EntityRef entity) override { return m_model_instances[entity.index].model; }
+	Model* getModelInstanceModel(EntityRef entity) override { return m_model_instances[entity].model; }
 
 
 	bool isModelInstanceEnabled(EntityRef entity) override
 	{
-		ModelInstance& model_instance = m_model_instances[entity.index];
+		ModelInstance& model_instance = m_model_instances[entity];
 		return model_instance.flags.isSet(ModelInstance::ENABLED);
 	}
 
 
 	void enableModelInstance(EntityRef entity, bool enable) override
 	{
-		ModelInstance& model_instance = m_model_instances[entity.index];
+		ModelInstance& model_instance = m_model_instances[entity];
 		model_instance.flags.set(ModelInstance::ENABLED, enable);
 		if (enable)
 		{
@@ -1943,13 +1953,14 @@ public:
 
 	Path getModelInstancePath(EntityRef entity) override
 	{
-		return m_model_instances[entity.index].model ? m_model_instances[entity.index].model->getPath() : Path("");
+		const ModelInstance& r = m_model_instances[entity];
+		return r.model ? r.model->getPath() : Path("");
 	}
 
 
 	void setModelInstancePath(EntityRef entity, const Path& path) override
 	{
-		ModelInstance& r = m_model_instances[entity.index];
+		ModelInstance& r = m_model_instances[entity];
 
 		if (path.isValid()) {
 			Model* model = m_engine.getResourceManager().load<Model>(path);
@@ -2171,17 +2182,14 @@ public:
 
 	EntityPtr getFirstModelInstance() override
 	{
-		return getNextModelInstance(INVALID_ENTITY);
+		return m_model_instances.empty() ? INVALID_ENTITY : (EntityPtr)m_model_instances.getEntity(0);
 	}
 
 
 	EntityPtr getNextModelInstance(EntityPtr entity) override
 	{
-		for(int i = entity.index + 1; i < m_model_instances.size(); ++i)
-		{
-			if (m_model_instances[i].entity != INVALID_ENTITY) return {i};
-		}
-		return INVALID_ENTITY;
+		const int idx = entity.isValid() ? m_model_instances.find((EntityRef)entity) + 1 : 0;
+		return idx < m_model_instances.size() ? (EntityPtr)m_model_instances.getEntity(idx) : INVALID_ENTITY;
 	}
 
 
@@ -2206,14 +2214,14 @@ public:
 		if(type == RenderableTypes::GRASS) {
 			if (m_is_grass_enabled && !m_terrains.empty()) {
 				PageAllocator& page_allocator = m_engine.getPageAllocator();
-				CullResult* result = (CullResult*)page_allocator.allocate(true);
+				CullResult* result = (CullResult*)page_allocator.allocate();
 				CullResult* iter = result; 
 				result->header.count = 0;
 				result->header.next = nullptr;
 				for (auto* terrain : m_terrains) {
 					terrain->updateGrass(0, frustum.origin);
 					if(iter->header.count == lengthOf(iter->entities)) {
-						iter->header.next = (CullResult*)page_allocator.allocate(true);
+						iter->header.next = (CullResult*)page_allocator.allocate();
 						iter->header.next->header.next = nullptr;
 						iter->header.next->header.count = 0;
 						iter = iter->header.next;
@@ -2787,9 +2795,8 @@ public:
 		hit.dir = dir;
 		double cur_dist = DBL_MAX;
 		const Universe& universe = getUniverse();
-		for (int i = 0; i < m_model_instances.size(); ++i) {
-			auto& r = m_model_instances[i];
-			if (ignored_model_instance.index == i || !r.model) continue;
+		for (const ModelInstance& r : m_model_instances) {
+			if (r.entity == ignored_model_instance || !r.model) continue;
 			if (!r.flags.isSet(ModelInstance::ENABLED)) continue;
 
 			const EntityRef entity = (EntityRef)r.entity;
@@ -3008,7 +3015,7 @@ public:
 
 	void modelUnloaded(Model*, EntityRef entity)
 	{
-		auto& r = m_model_instances[entity.index];
+		auto& r = m_model_instances[entity];
 		r.meshes = nullptr;
 		r.mesh_count = 0;
 		LUMIX_DELETE(m_allocator, r.pose);
@@ -3022,7 +3029,7 @@ public:
 	{
 		auto& rm = m_engine.getResourceManager();
 
-		auto& r = m_model_instances[entity.index];
+		auto& r = m_model_instances[entity];
 
 		float bounding_radius = r.model->getBoundingRadius();
 		float scale = m_universe.getScale(entity);
@@ -3047,21 +3054,19 @@ public:
 			updateBoneAttachment(m_bone_attachments[entity]);
 		}
 
-		while (m_mesh_sort_data.size() < m_model_instances.size()) {
-			m_mesh_sort_data.emplace();
-		}
-		m_mesh_sort_data[entity.index].layer = r.meshes[0].layer;
-		m_mesh_sort_data[entity.index].sort_key = r.meshes[0].sort_key;
+		MeshSortData& sort_data = m_mesh_sort_data[m_model_instances.find(entity)];
+		sort_data.layer = r.meshes[0].layer;
+		sort_data.sort_key = r.meshes[0].sort_key;
 	}
 
 
 	void modelUnloaded(Model* model)
 	{
-		for (int i = 0, c = m_model_instances.size(); i < c; ++i)
+		for (const ModelInstance& r : m_model_instances)
 		{
-			if (m_model_instances[i].entity != INVALID_ENTITY && m_model_instances[i].model == model)
+			if (r.model == model)
 			{
-				modelUnloaded(model, {i});
+				modelUnloaded(model, (EntityRef)r.entity);
 			}
 		}
 	}
@@ -3073,7 +3078,7 @@ public:
 		EntityPtr e = map_iter.value();
 		while(e.isValid()) {
 			modelLoaded(model, (EntityRef)e);
-			e = m_model_instances[e.index].next_model;
+			e = m_model_instances[(EntityRef)e].next_model;
 		}
 	}
 
@@ -3097,7 +3102,7 @@ public:
 	
 	void addToModelEntityMap(Model* model, EntityRef entity)
 	{
-		ModelInstance& r = m_model_instances[entity.index];
+		ModelInstance& r = m_model_instances[entity];
 		r.prev_model = INVALID_ENTITY;
 		auto map_iter = m_model_entity_map.find(model);
 		if(map_iter.isValid()) {
@@ -3114,12 +3119,12 @@ public:
 
 	void removeFromModelEntityMap(Model* model, EntityRef entity)
 	{
-		ModelInstance& r = m_model_instances[entity.index];
+		ModelInstance& r = m_model_instances[entity];
 		if(r.prev_model.isValid()) {
-			m_model_instances[r.prev_model.index].next_model = r.next_model;
+			m_model_instances[(EntityRef)r.prev_model].next_model = r.next_model;
 		}
 		if(r.next_model.isValid()) {
-			m_model_instances[r.next_model.index].prev_model = r.prev_model;
+			m_model_instances[(EntityRef)r.next_model].prev_model = r.prev_model;
 		}
 		auto map_iter = m_model_entity_map.find(model);
 		if(map_iter.value() == entity) {
@@ -3157,8 +3162,7 @@ public:
 
 	void setModel(EntityRef entity, Model* model)
 	{
-		auto& model_instance = m_model_instances[entity.index];
-		ASSERT(model_instance.entity.isValid());
+		auto& model_instance = m_model_instances[entity];
 		Model* old_model = model_instance.model;
 		bool no_change = model == old_model && old_model;
 		if (no_change)
@@ -3287,14 +3291,8 @@ public:
 
 	void createModelInstance(EntityRef entity)
 	{
-		while(entity.index >= m_model_instances.size())
-		{
-			auto& r = m_model_instances.emplace();
-			r.entity = INVALID_ENTITY;
-			r.model = nullptr;
-			r.pose = nullptr;
-		}
-		auto& r = m_model_instances[entity.index];
+		auto& r = m_model_instances.emplace(entity);
+		m_mesh_sort_data.emplace();
 		r.entity = entity;
 		r.model = nullptr;
 		r.meshes = nullptr;
@@ -3337,12 +3335,17 @@ private:
 	Engine& m_engine;
 	CullingSystem* m_culling_system;
 	u64 m_render_cmps_mask;
+	// components with a sphere in the culling system
+	u64 m_culled_cmps_mask;
+	Array<EntityRef> m_moved_culled;
+	Array<DVec3> m_moved_positions;
 
 	EntityPtr m_active_global_light_entity;
-	HashMap<EntityRef, PointLight> m_point_lights;
+	SparseSet<PointLight> m_point_lights;
 
-	HashMap<EntityRef, Decal> m_decals;
-	Array<ModelInstance> m_model_instances;
+	SparseSet<Decal> m_decals;
+	SparseSet<ModelInstance> m_model_instances;
+	// parallel to m_model_instances
 	Array<MeshSortData> m_mesh_sort_data;
 	HashMap<EntityRef, Environment> m_environments;
 	HashMap<EntityRef, Camera> m_cameras;
@@ -3429,15 +3432,19 @@ RenderSceneImpl::RenderSceneImpl(Renderer& renderer,
 	, m_is_updating_attachments(false)
 	, m_material_decal_map(m_allocator)
 	, m_mesh_sort_data(m_allocator)
+	, m_moved_culled(m_allocator)
+	, m_moved_positions(m_allocator)
 {
 
 	m_universe.entityTransformed().bind<RenderSceneImpl, &RenderSceneImpl::onEntityMoved>(this);
+	m_universe.entitiesTransformed().bind<RenderSceneImpl, &RenderSceneImpl::onEntitiesMoved>(this);
 	m_universe.entityDestroyed().bind<RenderSceneImpl, &RenderSceneImpl::onEntityDestroyed>(this);
 	m_culling_system = CullingSystem::create(m_allocator, engine.getPageAllocator());
 	m_model_instances.reserve(5000);
 	m_mesh_sort_data.reserve(5000);
 
 	m_render_cmps_mask = 0;
+	m_culled_cmps_mask = ((u64)1 << MODEL_INSTANCE_TYPE.index) | ((u64)1 << DECAL_TYPE.index) | ((u64)1 << POINT_LIGHT_TYPE.index);
 	for (auto& i : COMPONENT_INFOS)
 	{
 		m_render_cmps_mask |= (u64)1 << i.type.index;
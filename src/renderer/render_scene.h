@@ -34,6 +34,7 @@ class Texture;
 class Universe;
 template <typename T> class Array;
 template <typename T, typename T2> class AssociativeArray;
+template <typename T> class SparseSet;
 
 
 struct Camera
@@ -270,7 +271,7 @@ public:
 	virtual bool isModelInstanceEnabled(EntityRef entity) = 0;
 	virtual ModelInstance* getModelInstance(EntityRef entity) = 0;
 	virtual const MeshSortData* getMeshSortData() const = 0;
-	virtual const ModelInstance* getModelInstances() const = 0;
+	virtual const SparseSet<ModelInstance>& getModelInstances() const = 0;
 	virtual Path getModelInstancePath(EntityRef entity) = 0;
 	virtual void setModelInstancePath(EntityRef entity, const Path& path) = 0;
 	virtual CullResult* getRenderables(const ShiftedFrustum& frustum, RenderableTypes type) const = 0;
@@ -15,6 +15,7 @@
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
 #include "engine/string.h"
+#include "engine/tag_allocator.h"
 #include "engine/universe/component.h"
 #include "engine/universe/universe.h"
 #include "renderer/font.h"
@@ -390,10 +391,12 @@ struct RendererImpl final : public Renderer
 {
 	explicit RendererImpl(Engine& engine)
 		: m_engine(engine)
-		, m_allocator(engine.getAllocator())
-		, m_texture_manager(*this, m_allocator)
+		, m_allocator(engine.getAllocator(), "Renderer")
+		, m_model_allocator(m_allocator, "Models")
+		, m_texture_allocator(m_allocator, "Textures")
+		, m_texture_manager(*this, m_texture_allocator)
 		, m_pipeline_manager(*this, m_allocator)
-		, m_model_manager(*this, m_allocator)
+		, m_model_manager(*this, m_model_allocator)
 		, m_particle_emitter_manager(*this, m_allocator)
 		, m_material_manager(*this, m_allocator)
 		, m_shader_manager(*this, m_allocator)
@@ -495,6 +498,9 @@ struct RendererImpl final : public Renderer
 		m_material_manager.create(Material::TYPE, manager);
 		m_particle_emitter_manager.create(ParticleEmitterResource::TYPE, manager);
 		m_shader_manager.create(Shader::TYPE, manager);
+		// pipelines and shaders are small and nothing can be drawn without them
+		m_pipeline_manager.setLoadPriority(FileSystem::Priority::HIGH);
+		m_shader_manager.setLoadPriority(FileSystem::Priority::HIGH);
 		m_font_manager = LUMIX_NEW(m_allocator, FontManager)(*this, m_allocator);
 		m_font_manager->create(FontResource::TYPE, manager);
 
@@ -1045,7 +1051,9 @@ struct RendererImpl final : public Renderer
 	}
 
 	Engine& m_engine;
-	IAllocator& m_allocator;
+	TagAllocator m_allocator;
+	TagAllocator m_model_allocator;
+	TagAllocator m_texture_allocator;
 	Array<StaticString<32>> m_shader_defines;
 	MT::CriticalSection m_shader_defines_mutex;
 	Array<StaticString<32>> m_layers;
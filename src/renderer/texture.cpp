@@ -376,14 +376,15 @@ static void flipVertical(u32* image, int width, int height)
 }
 
 
-bool Texture::loadTGA(IInputStream& file)
+bool Texture::decodeTGA(IInputStream& file)
 {
 	PROFILE_FUNCTION();
 	TGAHeader header;
 	file.read(&header, sizeof(header));
 
-	bytes_per_pixel = header.bitsPerPixel / 8;
-	int image_size = header.width * header.height * 4;
+	const int image_size = header.width * header.height * 4;
+	m_decoded.width = header.width;
+	m_decoded.height = header.height;
 	if (header.dataType != 2 && header.dataType != 10)
 	{
 		int w, h, cmp;
@@ -392,49 +393,25 @@ bool Texture::loadTGA(IInputStream& file)
 			logError("Renderer") << "Unsupported texture format " << getPath().c_str();
 			return false;
 		}
-		Renderer::MemRef mem;
-		if (!data_reference) mem = renderer.allocate(image_size);
-		u8* image_dest = data_reference ? &data[0] : (u8*)mem.data;
-		copyMemory(image_dest, stb_data, image_size);
+		m_decoded.image = renderer.allocate(image_size);
+		copyMemory(m_decoded.image.data, stb_data, image_size);
 		stbi_image_free(stb_data);
 
-		//if ((header.imageDescriptor & 32) == 0) flipVertical((u32*)image_dest, header.width, header.height);
-
-		is_cubemap = false;
-		width = header.width;
-		height = header.height;
-		bytes_per_pixel = 4;
-		mips = 1;
-		if (data_reference) mem = renderer.copy(image_dest, image_size);
-		const bool is_srgb = flags & (u32)ffr::TextureFlags::SRGB;
-		handle = renderer.createTexture(header.width
-			, header.height
-			, 1
-			, is_srgb ? ffr::TextureFormat::SRGBA : ffr::TextureFormat::RGBA8
-			, getFFRFlags() & ~(u32)ffr::TextureFlags::SRGB
-			, mem
-			, getPath().c_str());
-		depth = 1;
-		layers = 1;
-		return handle.isValid();
+		//if ((header.imageDescriptor & 32) == 0) flipVertical((u32*)m_decoded.image.data, header.width, header.height);
+
+		return true;
 	}
 
+	const int bytes_per_pixel = header.bitsPerPixel / 8;
 	if (bytes_per_pixel < 3)
 	{
 		logError("Renderer") << "Unsupported color mode " << getPath().c_str();
 		return false;
 	}
 
-	width = header.width;
-	height = header.height;
-	int pixel_count = width * height;
-	is_cubemap = false;
-	if (data_reference) data.resize(image_size);
-
-	Renderer::MemRef mem;
-	if (!data_reference) mem = renderer.allocate(image_size);
-
-	u8* image_dest = data_reference ? &data[0] : (u8*)mem.data;
+	int pixel_count = header.width * header.height;
+	m_decoded.image = renderer.allocate(image_size);
+	u8* image_dest = (u8*)m_decoded.image.data;
 
 	bool is_rle = header.dataType == 10;
 	if (is_rle)
@@ -518,20 +495,37 @@ bool Texture::loadTGA(IInputStream& file)
 		}
 	}
 	if ((header.imageDescriptor & 32) == 0) flipVertical((u32*)image_dest, header.width, header.height);
+	return true;
+}
+
 
+bool Texture::createTGATexture()
+{
+	PROFILE_FUNCTION();
+	is_cubemap = false;
+	width = m_decoded.width;
+	height = m_decoded.height;
 	bytes_per_pixel = 4;
 	mips = 1;
-	if (data_reference) mem = renderer.copy(image_dest, image_size);
+	depth = 1;
+	layers = 1;
+
+	// the renderer frees the image once it is uploaded
+	const Renderer::MemRef mem = m_decoded.image;
+	m_decoded.image = Renderer::MemRef();
+	if (data_reference) {
+		data.resize(mem.size);
+		copyMemory(&data[0], mem.data, mem.size);
+	}
+
 	const bool is_srgb = flags & (u32)ffr::TextureFlags::SRGB;
-	handle = renderer.createTexture(header.width
-		, header.height
+	handle = renderer.createTexture(width
+		, height
 		, 1
 		, is_srgb ? ffr::TextureFormat::SRGBA : ffr::TextureFormat::RGBA8
 		, getFFRFlags() & ~(u32)ffr::TextureFlags::SRGB
 		, mem
 		, getPath().c_str());
-	depth = 1;
-	layers = 1;
 	return handle.isValid();
 }
 
@@ -598,29 +592,57 @@ u32 Texture::getFFRFlags() const
 
 
 bool Texture::load(u64 size, const u8* mem)
+{
+	// the view does not own mem, so nothing can keep it
+	return decode(ContentView(nullptr, mem, size)) && finalize();
+}
+
+
+bool Texture::decode(const ContentView& content)
 {
 	PROFILE_FUNCTION();
-	char ext[4] = {};
-	InputMemoryStream file(mem, size);
-	if (!file.read(ext, 3)) return false;
-	if (!file.read(&flags, sizeof(flags))) return false;
+	InputMemoryStream file(content.data(), content.size());
+	if (!file.read(m_decoded.ext, 3)) return false;
+	if (!file.read(&m_decoded.flags, sizeof(m_decoded.flags))) return false;
 
-	bool loaded = false;
-	if (equalIStrings(ext, "dds")) {
-		loaded = loadDDS(*this, file);
+	// dds and raw are passed to the renderer almost as they are, so they are loaded in finalize
+	if (equalIStrings(m_decoded.ext, "dds") || equalIStrings(m_decoded.ext, "raw")) {
+		m_decoded.content = content;
+		return true;
 	}
-	else if (equalIStrings(ext, "raw")) {
-		loaded = loadRaw(*this, file, allocator);
+
+	if (!decodeTGA(file)) {
+		logWarning("Renderer") << "Error loading texture " << getPath();
+		return false;
+	}
+	m_decoded.size = content.size();
+	return true;
+}
+
+
+bool Texture::finalize()
+{
+	PROFILE_FUNCTION();
+	flags = m_decoded.flags;
+
+	bool loaded = false;
+	u64 size = m_decoded.size;
+	if (equalIStrings(m_decoded.ext, "dds") || equalIStrings(m_decoded.ext, "raw")) {
+		InputMemoryStream file(m_decoded.content.data(), m_decoded.content.size());
+		file.skip(3 + sizeof(flags));
+		loaded = equalIStrings(m_decoded.ext, "dds") ? loadDDS(*this, file) : loadRaw(*this, file, allocator);
+		size = file.size();
+		m_decoded.content.reset();
 	}
 	else {
-		loaded = loadTGA(file);
+		loaded = createTGATexture();
 	}
 	if (!loaded) {
 		logWarning("Renderer") << "Error loading texture " << getPath();
 		return false;
 	}
 
-	m_size = file.size() - 3;
+	m_size = size - 3;
 	return true;
 }
 
@@ -632,6 +654,12 @@ void Texture::unload()
 		handle = ffr::INVALID_TEXTURE;
 	}
 	data.clear();
+	// unloaded after decode, but before finalize
+	if (m_decoded.image.data) {
+		renderer.free(m_decoded.image);
+		m_decoded.image = Renderer::MemRef();
+	}
+	m_decoded.content.reset();
 }
 
 
@@ -3,6 +3,7 @@
 
 #include "engine/resource.h"
 #include "ffr/ffr.h"
+#include "renderer/renderer.h"
 
 
 namespace Lumix
@@ -90,10 +91,32 @@ public:
 	Array<u8> data;
 	Renderer& renderer;
 
+private:
+	// filled by decode on a job worker, used by finalize on the main thread
+	struct Decoded
+	{
+		char ext[4] = {};
+		u32 flags = 0;
+		u64 size = 0;
+		// dds and raw, loaded in finalize
+		ContentView content;
+		// tga decoded to rgba8, only passed to the renderer in finalize
+		Renderer::MemRef image;
+		int width = 0;
+		int height = 0;
+	};
+
 private:
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
-	bool loadTGA(IInputStream& file);
+	bool isDecodeSupported() const override { return true; }
+	bool decode(const ContentView& content) override;
+	bool finalize() override;
+	bool decodeTGA(IInputStream& file);
+	bool createTGATexture();
+
+private:
+	Decoded m_decoded;
 };
 
 